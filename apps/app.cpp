@@ -6,11 +6,32 @@
  * Public License (SSPL, version 3). Both licenses are provided with this software distribution.
  */
 
+#include <el3dec/arrow.hpp>
+#include <el3dec/capture.hpp>
 #include <el3dec/lib.hpp>
+#include <el3dec/output.hpp>
+#include <el3dec/prefilter.hpp>
 #include <el3dec/telemetry.hpp>
+#include <el3dec/trackfilter.hpp>
+#include <el3dec/utils.hpp>
+#include <getopt.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
 #include <iostream>
 #include <fstream>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
 #define MAX_PAYLOAD_BYTES 256
@@ -55,17 +76,886 @@ void readSamples(std::string fileName, std::vector<std::string>& vec, unsigned i
     file.close();
 }
 
+/* input handed to a batch worker at a time */
+#define BATCH_CHUNK_BYTES   (1024 * 1024)
+
+/* streaming read size, also the longest line kept across reads */
+#define STREAM_BLOCK_BYTES  (64 * 1024)
+
+/* streaming output is written once this much is pending, or the latency bound expires */
+#define STREAM_FLUSH_BYTES  (64 * 1024)
+
+/* the length byte does not count the magic, itself and the checksum */
+#define ELERON_FRAME_OVERHEAD   3
+
+enum InputFormat {
+    INPUT_HEX,          /* one hex encoded frame per line */
+    INPUT_BINARY        /* raw frames back to back, delimited by their own header */
+};
+
+struct DecodeOptions {
+    unsigned jobs;
+    InputFormat input;
+    El3OutputFormat format;     /* Arrow is the file format in batch mode and the stream format streaming */
+    int outfd;
+    unsigned latencyMs;
+    bool trackFilter;
+    El3TrackFilterConfig filterConfig;
+    El3CaptureIoConfig captureIo;
+};
+
+// RapidJSON output stream appending to a string, so workers serialize straight into their chunk
+struct StringOutput {
+    typedef char Ch;
+
+    std::string *out;
+
+    void Put(char c) { out->push_back(c); }
+    void Flush() {}
+};
+
+static bool decodeFrame(const unsigned char *frame, size_t len, El3TelemetryRecord &rec)
+{
+    if (EL3_SCREEN_VERDICT(el3DecodableScreen().screen(frame, len)) == SCREEN_REJECT)
+        return false;
+
+    try {
+        El3Telemetry telemetry(frame, len, FAULT_TOLERANT);
+        rec = telemetry.Record();
+        return true;
+    } catch (const std::exception &) {
+        return false;
+    }
+}
+
+static void appendRecord(const El3TelemetryRecord &rec, El3OutputFormat format, std::string &out,
+    rapidjson::Writer<StringOutput> &writer)
+{
+    if (format == OUTPUT_BINARY)
+    {
+        out.append((const char *) &rec, sizeof(rec));
+        return;
+    }
+
+    StringOutput stream = { &out };
+
+    writer.Reset(stream);
+    el3WriteJson(rec, writer);
+    out.push_back('\n');
+}
+
+static bool writeAll(int fd, const std::string &buf)
+{
+    const char *p = buf.data();
+    size_t len = buf.size();
+
+    while (len)
+    {
+        ssize_t n = write(fd, p, len);
+
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            std::cerr << "write failed: " << strerror(errno) << "\n";
+            return false;
+        }
+
+        p += n;
+        len -= n;
+    }
+
+    return true;
+}
+
+struct BatchChunk {
+    const char *begin;              /* hex text: a run of whole lines */
+    const char *end;
+    uint32_t firstBlock;            /* capture archive: a run of blocks */
+    uint32_t lastBlock;
+
+    std::vector<El3TelemetryRecord> records;    /* when the track filter has to run in order, or for Arrow */
+    std::vector<int64_t> recvNs;                /* of the records, capture archives only */
+    std::string out;
+    uint64_t frames;
+    uint64_t errors;
+    std::string failure;            /* the chunk could not be read */
+    bool done;
+};
+
+class BatchDecoder
+{
+    const DecodeOptions &opts_;
+    const El3CaptureReader *capture_;
+    std::string path_;
+    std::vector<BatchChunk> chunks_;
+
+    std::mutex mutex_;
+    std::condition_variable ready_;     /* a chunk was decoded */
+    std::condition_variable drained_;   /* a chunk was written out */
+    size_t next_;
+    size_t written_;
+    size_t window_;
+
+public:
+    BatchDecoder(const DecodeOptions &opts, const El3CaptureReader *capture, const char *path)
+        : opts_(opts), capture_(capture), path_(path), next_(0), written_(0), window_(opts.jobs * 4)
+    {
+    }
+
+    // Line aligned chunks of a mapped hex text recording
+    void
+    splitText(const char *data, size_t len)
+    {
+        const char *p = data, *end = data + len;
+
+        while (p < end)
+        {
+            const char *stop = p + std::min<size_t>(BATCH_CHUNK_BYTES, end - p);
+
+            if (stop < end)
+            {
+                const char *nl = (const char *) memchr(stop, '\n', end - stop);
+                stop = nl ? nl + 1 : end;
+            }
+
+            chunks_.push_back(BatchChunk{ p, stop, 0, 0, {}, {}, {}, 0, 0, {}, false });
+            p = stop;
+        }
+    }
+
+    // Runs of whole blocks of a capture archive
+    void
+    splitCapture()
+    {
+        uint32_t first = 0;
+        size_t bytes = 0;
+
+        for (uint32_t b = 0; b < capture_->blocks(); b++)
+        {
+            bytes += capture_->block(b).bytes;
+
+            if (bytes >= BATCH_CHUNK_BYTES || b + 1 == capture_->blocks())
+            {
+                chunks_.push_back(BatchChunk{ NULL, NULL, first, b + 1, {}, {}, {}, 0, 0, {}, false });
+                first = b + 1;
+                bytes = 0;
+            }
+        }
+    }
+
+    bool
+    run(uint64_t *frames, uint64_t *errors)
+    {
+        std::vector<std::thread> workers;
+        unsigned jobs = std::max<unsigned>(1, std::min<size_t>(opts_.jobs, chunks_.size()));
+        bool ok = true;
+
+        for (unsigned i = 0; i < jobs; i++)
+            workers.emplace_back(&BatchDecoder::work, this);
+
+        ok = drain(frames, errors);
+
+        if (!ok)
+        {
+            // let the workers run out of chunks
+            std::lock_guard<std::mutex> guard(mutex_);
+            next_ = chunks_.size();
+            written_ = chunks_.size();
+            drained_.notify_all();
+        }
+
+        for (auto &t : workers)
+            t.join();
+
+        return ok;
+    }
+
+private:
+    void
+    decoded(BatchChunk &chunk, const El3TelemetryRecord &rec, int64_t recvNs,
+        rapidjson::Writer<StringOutput> &writer)
+    {
+        chunk.frames++;
+
+        // the track filter needs the fixes in input order, which only the writer side has, and
+        // Arrow batches cut across chunks
+        if (opts_.trackFilter || opts_.format == OUTPUT_ARROW)
+        {
+            chunk.records.push_back(rec);
+            if (capture_)
+                chunk.recvNs.push_back(recvNs);
+        }
+        else
+            appendRecord(rec, opts_.format, chunk.out, writer);
+    }
+
+    void
+    decodeChunk(BatchChunk &chunk, rapidjson::Writer<StringOutput> &writer)
+    {
+        unsigned char frame[MAX_PAYLOAD_BYTES];
+        El3TelemetryRecord rec;
+
+        if (capture_)
+        {
+            // read through the configured backend rather than the reader's mapping, io_uring
+            // keeps the chunk's blocks in flight while the first ones decode
+            std::vector<uint32_t> blocks;
+            El3CaptureRecord crec;
+
+            for (uint32_t b = chunk.firstBlock; b < chunk.lastBlock; b++)
+                blocks.push_back(b);
+
+            try {
+                El3CaptureBlockStream stream(*capture_, path_, blocks, opts_.captureIo);
+
+                while (stream.next(crec))
+                {
+                    if (decodeFrame(crec.data, crec.length, rec))
+                        decoded(chunk, rec, crec.recvNs, writer);
+                    else
+                        chunk.errors++;
+                }
+            } catch (const std::exception &e) {
+                chunk.failure = e.what();
+            }
+            return;
+        }
+
+        const char *p = chunk.begin;
+
+        while (p < chunk.end)
+        {
+            const char *nl = (const char *) memchr(p, '\n', chunk.end - p);
+            const char *eol = nl ? nl : chunk.end;
+            size_t hexlen = eol - p;
+
+            if (hexlen && p[hexlen - 1] == '\r')
+                hexlen--;
+
+            if (hexlen)
+            {
+                size_t len = hex_to_bytes(p, hexlen, frame, sizeof(frame));
+
+                if (len && decodeFrame(frame, len, rec))
+                    decoded(chunk, rec, 0, writer);
+                else
+                    chunk.errors++;
+            }
+
+            p = eol + 1;
+        }
+    }
+
+    void
+    work()
+    {
+        // one writer per worker, its level stack is reused across records
+        rapidjson::Writer<StringOutput> writer;
+
+        for (;;)
+        {
+            size_t n;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+
+                // bound the decoded output waiting to be written
+                drained_.wait(lock, [this] { return next_ >= chunks_.size() || next_ < written_ + window_; });
+
+                if (next_ >= chunks_.size())
+                    return;
+
+                n = next_++;
+            }
+
+            BatchChunk &chunk = chunks_[n];
+            chunk.out.reserve(opts_.format == OUTPUT_BINARY ? BATCH_CHUNK_BYTES : BATCH_CHUNK_BYTES * 3);
+            decodeChunk(chunk, writer);
+
+            std::lock_guard<std::mutex> guard(mutex_);
+            chunk.done = true;
+            ready_.notify_all();
+        }
+    }
+
+    // Writes the chunks out in input order as they complete
+    bool
+    drain(uint64_t *frames, uint64_t *errors)
+    {
+        El3TrackFilter filter(opts_.filterConfig);
+        El3ArrowWriter arrow(ARROW_FILE, capture_ != NULL);
+        rapidjson::Writer<StringOutput> writer;
+        std::string filtered;
+
+        if (opts_.format == OUTPUT_ARROW)
+        {
+            arrow.begin(filtered);
+            if (!writeAll(opts_.outfd, filtered))
+                return false;
+        }
+
+        for (size_t i = 0; i < chunks_.size(); i++)
+        {
+            BatchChunk &chunk = chunks_[i];
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                ready_.wait(lock, [&chunk] { return chunk.done; });
+            }
+
+            if (opts_.trackFilter || opts_.format == OUTPUT_ARROW)
+            {
+                filtered.clear();
+
+                for (size_t r = 0; r < chunk.records.size(); r++)
+                {
+                    El3TelemetryRecord &rec = chunk.records[r];
+
+                    if (opts_.trackFilter && filter.suppressed(filter.check(rec)))
+                        continue;
+
+                    if (opts_.format != OUTPUT_ARROW)
+                        appendRecord(rec, opts_.format, filtered, writer);
+                    else
+                    {
+                        arrow.add(rec, capture_ ? chunk.recvNs[r] : 0);
+                        if (arrow.pending() == EL3_ARROW_BATCH_ROWS)
+                            arrow.batch(filtered);
+                    }
+                }
+
+                chunk.out.swap(filtered);
+            }
+
+            *frames += chunk.frames;
+            *errors += chunk.errors;
+
+            if (!chunk.failure.empty())
+            {
+                std::cerr << chunk.failure << "\n";
+                return false;
+            }
+
+            if (!writeAll(opts_.outfd, chunk.out))
+                return false;
+
+            // release the output, the window only bounds memory if written chunks let go of it
+            std::string().swap(chunk.out);
+            std::vector<El3TelemetryRecord>().swap(chunk.records);
+            std::vector<int64_t>().swap(chunk.recvNs);
+
+            std::lock_guard<std::mutex> guard(mutex_);
+            written_ = i + 1;
+            drained_.notify_all();
+        }
+
+        // the footer, even with no chunks at all: empty input is still a valid (empty) file
+        if (opts_.format == OUTPUT_ARROW)
+        {
+            filtered.clear();
+            arrow.end(filtered);
+            if (!writeAll(opts_.outfd, filtered))
+                return false;
+        }
+
+        return true;
+    }
+};
+
+static int runBatch(const char *path, const DecodeOptions &opts)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+
+    if (fd < 0 || fstat(fd, &st) < 0)
+    {
+        std::cerr << "cannot open " << path << ": " << strerror(errno) << "\n";
+        return EXIT_FAILURE;
+    }
+
+    // an empty file has nothing to map, but still gets its (empty) output
+    void *map = st.st_size ? mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+    close(fd);
+
+    if (map == MAP_FAILED)
+    {
+        std::cerr << "cannot map " << path << ": " << strerror(errno) << "\n";
+        return EXIT_FAILURE;
+    }
+
+    if (map)
+        madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+    std::unique_ptr<El3CaptureReader> capture;
+    bool archive = (size_t) st.st_size >= strlen(EL3_CAPTURE_MAGIC) &&
+        !memcmp(map, EL3_CAPTURE_MAGIC, strlen(EL3_CAPTURE_MAGIC));
+
+    if (archive)
+    {
+        try {
+            capture.reset(new El3CaptureReader(path));
+        } catch (const std::exception &e) {
+            std::cerr << e.what() << "\n";
+            munmap(map, st.st_size);
+            return EXIT_FAILURE;
+        }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    uint64_t frames = 0, errors = 0;
+    BatchDecoder decoder(opts, capture.get(), path);
+
+    if (capture)
+        decoder.splitCapture();
+    else
+        decoder.splitText((const char *) map, st.st_size);
+
+    bool ok = decoder.run(&frames, &errors);
+
+    if (map)
+        munmap(map, st.st_size);
+
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cerr << frames << " frames decoded, " << errors << " undecodable, in " << secs << " s ("
+        << (uint64_t) (secs > 0 ? frames / secs : 0) << " frames/s, " << opts.jobs << " jobs)\n";
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Decodes a pipe or FIFO as it is fed, in constant memory
+class StreamDecoder
+{
+    const DecodeOptions &opts_;
+    El3TrackFilter filter_;
+    rapidjson::Writer<StringOutput> writer_;
+
+    char in_[STREAM_BLOCK_BYTES];
+    size_t have_;
+    bool discarding_;               /* skipping the rest of an overlong line */
+
+    std::string out_;
+    std::unique_ptr<El3ArrowWriter> arrow_;
+    std::chrono::steady_clock::time_point pendingSince_;
+
+public:
+    uint64_t frames;
+    uint64_t errors;
+
+    explicit
+    StreamDecoder(const DecodeOptions &opts)
+        : opts_(opts), filter_(opts.filterConfig), have_(0), discarding_(false), frames(0), errors(0)
+    {
+        out_.reserve(STREAM_FLUSH_BYTES + STREAM_BLOCK_BYTES);
+
+        if (opts_.format == OUTPUT_ARROW)
+        {
+            arrow_.reset(new El3ArrowWriter(ARROW_STREAM, false));
+            arrow_->begin(out_);
+        }
+    }
+
+    bool
+    run(int fd)
+    {
+        struct pollfd pfd = { fd, POLLIN, 0 };
+
+        for (;;)
+        {
+            int timeout = -1;
+
+            if (pending())
+            {
+                auto due = pendingSince_ + std::chrono::milliseconds(opts_.latencyMs);
+                auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    due - std::chrono::steady_clock::now()).count();
+
+                timeout = std::max<long>(0, left);
+            }
+
+            int ready = poll(&pfd, 1, timeout);
+
+            if (ready < 0 && errno != EINTR)
+            {
+                std::cerr << "poll failed: " << strerror(errno) << "\n";
+                return false;
+            }
+
+            if (ready <= 0)
+            {
+                // quiet input: the latency bound is up
+                if (!flush())
+                    return false;
+                continue;
+            }
+
+            ssize_t n = read(fd, in_ + have_, sizeof(in_) - have_);
+
+            if (n < 0)
+            {
+                if (errno == EINTR || errno == EAGAIN)
+                    continue;
+
+                std::cerr << "read failed: " << strerror(errno) << "\n";
+                return false;
+            }
+
+            if (n == 0)
+                break;
+
+            have_ += n;
+            consume(false);
+
+            if (out_.size() >= STREAM_FLUSH_BYTES || (arrow_ && arrow_->pending() >= EL3_ARROW_BATCH_ROWS) ||
+                (pending() && std::chrono::steady_clock::now() - pendingSince_ >=
+                    std::chrono::milliseconds(opts_.latencyMs)))
+            {
+                if (!flush())
+                    return false;
+            }
+        }
+
+        consume(true);
+
+        if (arrow_)
+            arrow_->end(out_);
+
+        return flush();
+    }
+
+private:
+    bool
+    pending() const
+    {
+        return !out_.empty() || (arrow_ && arrow_->pending());
+    }
+
+    bool
+    flush()
+    {
+        // the rows waiting for Arrow go out as a (possibly short) batch
+        if (arrow_)
+            arrow_->batch(out_);
+
+        bool ok = writeAll(opts_.outfd, out_);
+
+        out_.clear();
+        return ok;
+    }
+
+    void
+    decoded(El3TelemetryRecord &rec)
+    {
+        frames++;
+
+        if (opts_.trackFilter && filter_.suppressed(filter_.check(rec)))
+            return;
+
+        if (!pending())
+            pendingSince_ = std::chrono::steady_clock::now();
+
+        if (arrow_)
+            arrow_->add(rec);
+        else
+            appendRecord(rec, opts_.format, out_, writer_);
+    }
+
+    // Decodes every complete line, keeping the partial one for the next read
+    size_t
+    consumeLines(bool eof)
+    {
+        unsigned char bytes[MAX_PAYLOAD_BYTES];
+        size_t pos = 0;
+
+        while (pos < have_)
+        {
+            char *nl = (char *) memchr(in_ + pos, '\n', have_ - pos);
+
+            if (!nl && !eof)
+                break;
+
+            char *line = in_ + pos;
+            size_t hexlen = (nl ? nl : in_ + have_) - line;
+
+            pos += hexlen + (nl ? 1 : 0);
+
+            if (discarding_)
+            {
+                discarding_ = false;
+                continue;
+            }
+
+            if (hexlen && line[hexlen - 1] == '\r')
+                hexlen--;
+
+            if (!hexlen)
+                continue;
+
+            size_t len = hex_to_bytes(line, hexlen, bytes, sizeof(bytes));
+            El3TelemetryRecord rec;
+
+            if (len && decodeFrame(bytes, len, rec))
+                decoded(rec);
+            else
+                errors++;
+        }
+
+        // a full buffer without a newline is garbage, drop it and resync on the next line
+        if (pos == 0 && have_ == sizeof(in_))
+        {
+            errors++;
+            discarding_ = true;
+            return have_;
+        }
+
+        return pos;
+    }
+
+    // Splits raw frames on their magic byte and length, resyncing on anything undecodable
+    size_t
+    consumeFrames(bool eof)
+    {
+        const unsigned char *buf = (const unsigned char *) in_;
+        size_t pos = 0;
+
+        while (pos < have_)
+        {
+            if (buf[pos] != ENICS_ELERON_PACKET_MAGICBYTE)
+            {
+                const void *magic = memchr(buf + pos, ENICS_ELERON_PACKET_MAGICBYTE, have_ - pos);
+
+                errors++;
+                pos = magic ? (const unsigned char *) magic - buf : have_;
+                continue;
+            }
+
+            if (have_ - pos < 2)
+                break;
+
+            size_t len = buf[pos + 1] + ELERON_FRAME_OVERHEAD;
+
+            if (have_ - pos < len)
+                break;
+
+            El3TelemetryRecord rec;
+
+            if (decodeFrame(buf + pos, len, rec))
+            {
+                decoded(rec);
+                pos += len;
+            }
+            else
+            {
+                // a false magic byte, try from the next one
+                errors++;
+                pos++;
+            }
+        }
+
+        if (eof && pos < have_)
+        {
+            errors++;
+            pos = have_;
+        }
+
+        return pos;
+    }
+
+    void
+    consume(bool eof)
+    {
+        size_t used = opts_.input == INPUT_HEX ? consumeLines(eof) : consumeFrames(eof);
+
+        memmove(in_, in_ + used, have_ - used);
+        have_ -= used;
+    }
+};
+
+static int runStream(const char *path, const DecodeOptions &opts)
+{
+    int fd = STDIN_FILENO;
+
+    if (strcmp(path, "-"))
+    {
+        fd = open(path, O_RDONLY | O_CLOEXEC);
+
+        if (fd < 0)
+        {
+            std::cerr << "cannot open " << path << ": " << strerror(errno) << "\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    StreamDecoder decoder(opts);
+    bool ok = decoder.run(fd);
+
+    if (fd != STDIN_FILENO)
+        close(fd);
+
+    std::cerr << decoder.frames << " frames decoded, " << decoder.errors << " undecodable\n";
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static bool isStream(const char *path)
+{
+    struct stat st;
+
+    if (!strcmp(path, "-"))
+        return true;
+
+    return stat(path, &st) == 0 && (S_ISFIFO(st.st_mode) || S_ISCHR(st.st_mode) || S_ISSOCK(st.st_mode));
+}
+
+static void usage()
+{
+    std::cerr << "Usage: el3dec_app [options] path\n"
+        "  -t, --track-filter        flag position fixes inconsistent with the UAV track\n"
+        "  -s, --suppress-glitches   track filter, and drop physically impossible fixes\n"
+        "  -b, --batch               decode the whole file (hex text or capture archive) on a\n"
+        "                            thread pool, output in input order\n"
+        "  -j, --jobs N              batch worker threads (default: one per core)\n"
+        "  -f, --format FORMAT       output: ndjson (default), binary records or arrow (Arrow IPC\n"
+        "                            file, a stream when streaming)\n"
+        "  -o, --output PATH         batch/stream output file (default: stdout)\n"
+        "  -I, --capture-io MODE     capture archive reads: auto (default), buffered, uring or\n"
+        "                            direct (io_uring and O_DIRECT)\n"
+        "Streaming (path '-' for stdin, or a FIFO):\n"
+        "  -l, --latency MS          longest a decoded frame waits to be written (default 100)\n"
+        "  -i, --input FORMAT        hex lines (default) or binary frames\n"
+        "  -f applies to streaming output as well.\n";
+}
+
 int main(int argc, char **argv)
 {
     std::vector<std::string> vecHexLines;
+    El3TrackFilterConfig filterConfig;
+    DecodeOptions decodeOpts;
+    const char *output = NULL;
+    bool trackFilter = false;
+    bool batch = false;
+    int opt;
+
+    decodeOpts.jobs = std::max(1u, std::thread::hardware_concurrency());
+    decodeOpts.format = OUTPUT_NDJSON;
+    decodeOpts.outfd = STDOUT_FILENO;
+    decodeOpts.input = INPUT_HEX;
+    decodeOpts.latencyMs = 100;
+
+    static const struct option longopts[] = {
+        { "track-filter",       no_argument,        NULL,   't' },
+        { "suppress-glitches",  no_argument,        NULL,   's' },
+        { "batch",              no_argument,        NULL,   'b' },
+        { "jobs",               required_argument,  NULL,   'j' },
+        { "format",             required_argument,  NULL,   'f' },
+        { "output",             required_argument,  NULL,   'o' },
+        { "latency",            required_argument,  NULL,   'l' },
+        { "input",              required_argument,  NULL,   'i' },
+        { "capture-io",         required_argument,  NULL,   'I' },
+        { "help",               no_argument,        NULL,   'h' },
+        { NULL,                 0,                  NULL,   0 }
+    };
+
+    while ((opt = getopt_long(argc, argv, "tsbj:f:o:l:i:I:h", longopts, NULL)) != -1)
+    {
+        switch (opt)
+        {
+            case 's':
+                filterConfig.suppress = true;
+                /* fall through */
+            case 't':
+                trackFilter = true;
+                break;
+            case 'b':
+                batch = true;
+                break;
+            case 'j':
+                decodeOpts.jobs = std::max(1, atoi(optarg));
+                break;
+            case 'f':
+                if (!strcmp(optarg, "ndjson"))
+                    decodeOpts.format = OUTPUT_NDJSON;
+                else if (!strcmp(optarg, "binary"))
+                    decodeOpts.format = OUTPUT_BINARY;
+                else if (!strcmp(optarg, "arrow"))
+                    decodeOpts.format = OUTPUT_ARROW;
+                else
+                {
+                    std::cerr << "Unknown output format: " << optarg << "\n";
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'o':
+                output = optarg;
+                break;
+            case 'l':
+                decodeOpts.latencyMs = strtoul(optarg, NULL, 0);
+                break;
+            case 'i':
+                if (!strcmp(optarg, "hex"))
+                    decodeOpts.input = INPUT_HEX;
+                else if (!strcmp(optarg, "binary"))
+                    decodeOpts.input = INPUT_BINARY;
+                else
+                {
+                    std::cerr << "Unknown input format: " << optarg << "\n";
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'I':
+                if (!el3ParseCaptureIo(optarg, decodeOpts.captureIo))
+                {
+                    std::cerr << "Unknown capture I/O mode: " << optarg << "\n";
+                    return EXIT_FAILURE;
+                }
+                break;
+            default:
+                usage();
+                return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    if (argc - optind != 1)
+    {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    bool stream = isStream(argv[optind]);
 
-    if (argc != 2)
+    if (stream && batch)
     {
-        std::cerr << "Usage: el3dec_app [path]\n";
+        std::cerr << "--batch needs a regular file\n";
         return EXIT_FAILURE;
     }
 
-    readSamples(argv[1], vecHexLines, 0);
+    if (batch || stream)
+    {
+        decodeOpts.trackFilter = trackFilter;
+        decodeOpts.filterConfig = filterConfig;
+
+        if (output)
+        {
+            decodeOpts.outfd = open(output, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+            if (decodeOpts.outfd < 0)
+            {
+                std::cerr << "cannot create " << output << ": " << strerror(errno) << "\n";
+                return EXIT_FAILURE;
+            }
+        }
+
+        int ret = stream ? runStream(argv[optind], decodeOpts) : runBatch(argv[optind], decodeOpts);
+
+        if (output && close(decodeOpts.outfd) < 0)
+            ret = EXIT_FAILURE;
+
+        return ret;
+    }
+
+    El3TrackFilter filter(filterConfig);
+
+    readSamples(argv[optind], vecHexLines, 0);
 
     for (auto &s: vecHexLines)
     {
@@ -75,6 +965,13 @@ int main(int argc, char **argv)
 
         El3Telemetry *telemetry = el3Decode(bindata.data(), bindata.size(), FAULT_TOLERANT);
 
+        if (trackFilter && filter.suppressed(filter.check(*telemetry)))
+        {
+            std::cout << "Suppressed (track glitch)" << std::endl;
+            delete telemetry;
+            continue;
+        }
+
         std::cout << "Decoded telemetry:" << std::endl;
         std::string jsonStr = telemetry->toJson(true);
         std::cout << jsonStr << "\n";
@@ -0,0 +1,184 @@
+/*
+ * Copyright (c) 2022 Subreption LLC. All rights reserved.
+ * Author: 12dc8242df1be0d6f4b73d68166552197936a27074c004c8af95b27194ec584d
+ *
+ * Dual-licensed under the Subreption Ukraine Defense License (SUDL, version 1) and the  Server Side
+ * Public License (SSPL, version 3). Both licenses are provided with this software distribution.
+ */
+
+#include <el3dec/capture.hpp>
+#include <el3dec/utils.hpp>
+#include <getopt.h>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+static void usage()
+{
+    std::cerr << "Usage: el3dec_capconv [options] input output\n"
+        "Converts hex text recordings (one frame per line) into capture archives.\n"
+        "  -s, --sensor ID        sensor ID stored with every frame (default 0)\n"
+        "  -t, --start SECONDS    receive time of the first frame, epoch seconds (default now)\n"
+        "  -i, --interval MS      receive time spacing between frames (default 500)\n"
+        "  -b, --block-size BYTES archive block size (default 65536)\n"
+        "  -d, --dump             the other way around: capture archive to hex text\n"
+        "                         (output '-' for stdout)\n";
+}
+
+static int textToCapture(const char *input, const char *output, uint32_t sensorId, int64_t startNs,
+    int64_t intervalNs, uint32_t blockSize)
+{
+    std::ifstream file(input);
+
+    if (!file)
+    {
+        std::cerr << "cannot open " << input << "\n";
+        return EXIT_FAILURE;
+    }
+
+    El3CaptureWriter writer(output, blockSize);
+    unsigned char frame[EL3_CAPTURE_MAX_FRAME];
+    std::string line;
+    uint64_t lineno = 0, skipped = 0;
+    int64_t recvNs = startNs;
+
+    while (std::getline(file, line))
+    {
+        lineno++;
+
+        /* tolerate CRLF recordings */
+        if (!line.empty() && line[line.size() - 1] == '\r')
+            line.erase(line.size() - 1);
+
+        if (line.empty())
+            continue;
+
+        size_t len = hex_to_bytes(line.data(), line.size(), frame, sizeof(frame));
+
+        if (!len)
+        {
+            std::cerr << input << ":" << lineno << ": not a hex frame, skipped\n";
+            skipped++;
+            continue;
+        }
+
+        writer.append(recvNs, sensorId, frame, len);
+        recvNs += intervalNs;
+    }
+
+    writer.close();
+
+    std::cerr << writer.records() << " frames in " << writer.blocks() << " blocks";
+    if (skipped)
+        std::cerr << ", " << skipped << " lines skipped";
+    std::cerr << "\n";
+
+    return EXIT_SUCCESS;
+}
+
+static int captureToText(const char *input, const char *output)
+{
+    static const char tab[] = "0123456789abcdef";
+
+    El3CaptureReader reader(input);
+    FILE *out = std::string(output) == "-" ? stdout : fopen(output, "w");
+
+    if (!out)
+    {
+        std::cerr << "cannot create " << output << "\n";
+        return EXIT_FAILURE;
+    }
+
+    std::string line;
+
+    for (uint32_t b = 0; b < reader.blocks(); b++)
+    {
+        El3CaptureCursor cursor;
+        El3CaptureRecord rec;
+
+        reader.begin(b, cursor);
+        while (reader.next(cursor, rec))
+        {
+            line.resize(rec.length * 2 + 1);
+
+            for (size_t i = 0; i < rec.length; i++)
+            {
+                line[i * 2] = tab[rec.data[i] >> 4];
+                line[i * 2 + 1] = tab[rec.data[i] & 0x0f];
+            }
+
+            line[rec.length * 2] = '\n';
+            fwrite(line.data(), 1, line.size(), out);
+        }
+    }
+
+    if (out != stdout)
+        fclose(out);
+
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t sensorId = 0;
+    uint32_t blockSize = EL3_CAPTURE_DEFAULT_BLOCK;
+    int64_t startNs = time(NULL) * 1000000000LL;
+    int64_t intervalNs = 500 * 1000000LL;
+    bool dump = false;
+    int opt;
+
+    static const struct option longopts[] = {
+        { "sensor",     required_argument,  NULL,   's' },
+        { "start",      required_argument,  NULL,   't' },
+        { "interval",   required_argument,  NULL,   'i' },
+        { "block-size", required_argument,  NULL,   'b' },
+        { "dump",       no_argument,        NULL,   'd' },
+        { "help",       no_argument,        NULL,   'h' },
+        { NULL,         0,                  NULL,   0 }
+    };
+
+    while ((opt = getopt_long(argc, argv, "s:t:i:b:dh", longopts, NULL)) != -1)
+    {
+        switch (opt)
+        {
+            case 's':
+                sensorId = strtoul(optarg, NULL, 0);
+                break;
+            case 't':
+                startNs = strtoll(optarg, NULL, 0) * 1000000000LL;
+                break;
+            case 'i':
+                intervalNs = strtoll(optarg, NULL, 0) * 1000000LL;
+                break;
+            case 'b':
+                blockSize = strtoul(optarg, NULL, 0);
+                break;
+            case 'd':
+                dump = true;
+                break;
+            default:
+                usage();
+                return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    if (argc - optind != 2)
+    {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    try {
+        if (dump)
+            return captureToText(argv[optind], argv[optind + 1]);
+
+        return textToCapture(argv[optind], argv[optind + 1], sensorId, startNs, intervalNs, blockSize);
+    } catch (const std::exception &e) {
+        std::cerr << "el3dec_capconv: " << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,429 @@
+/*
+ * Copyright (c) 2022 Subreption LLC. All rights reserved.
+ * Author: 12dc8242df1be0d6f4b73d68166552197936a27074c004c8af95b27194ec584d
+ *
+ * Dual-licensed under the Subreption Ukraine Defense License (SUDL, version 1) and the  Server Side
+ * Public License (SSPL, version 3). Both licenses are provided with this software distribution.
+ */
+
+#include <el3dec/capture.hpp>
+#include <el3dec/encoder.hpp>
+#include <getopt.h>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+static const double deg2rad = M_PI / 180.0;
+static const double earth_radius_m = 6371000.0;
+
+static void usage()
+{
+    std::cerr << "Usage: el3dec_gencorpus [options] output\n"
+        "Writes a synthetic, reproducible corpus of Eleron 3 telemetry from many concurrent UAVs.\n"
+        "  -s, --seed N           random seed (default 1)\n"
+        "  -u, --uavs N           concurrent UAVs (default 1000)\n"
+        "  -U, --uav-base ID      first UAV ID (default 1000)\n"
+        "  -n, --frames N         frames to write, before damage (default 100000)\n"
+        "  -i, --interval MS      telemetry period of each UAV (default 500)\n"
+        "  -t, --start SECONDS    time of the first frame, epoch seconds (default now)\n"
+        "  -c, --corrupt RATE     fraction of frames with flipped bytes (default 0)\n"
+        "  -x, --truncate RATE    fraction of frames cut short (default 0)\n"
+        "  -d, --duplicate RATE   fraction of frames sent twice (default 0)\n"
+        "  -f, --format FMT       hex (one frame per line, '-' for stdout) or capture (default hex)\n"
+        "  -S, --sensor ID        sensor ID of the capture records (default 0)\n"
+        "  -b, --block-size BYTES capture block size (default 65536)\n";
+}
+
+/*
+ * splitmix64: the standard library distributions are not specified bit for bit, a corpus must come
+ * out the same from a given seed whatever it was built with.
+ */
+class Random
+{
+  public:
+    Random(uint64_t seed): m_state(seed) {}
+
+    uint64_t next()
+    {
+        uint64_t z = (m_state += 0x9e3779b97f4a7c15ULL);
+
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+
+        return z ^ (z >> 31);
+    }
+
+    /* [0, 1) */
+    double uniform() { return (next() >> 11) * (1.0 / 9007199254740992.0); }
+    double uniform(double lo, double hi) { return lo + (hi - lo) * uniform(); }
+    uint64_t below(uint64_t n) { return next() % n; }
+    bool chance(double p) { return p > 0 && uniform() < p; }
+
+  private:
+    uint64_t m_state;
+};
+
+/* a UAV flying a smooth random path: the turn rate and climb rate wander, the rest follows */
+struct SimUav {
+    El3TelemetryRecord rec;
+    double latitude;
+    double longitude;
+    double altitude;
+    double course;          /* degrees from north */
+    double speed;           /* km/h */
+    double turnRate;        /* degrees/s */
+    double climbRate;       /* m/s */
+    double flightTime;      /* s */
+    double endurance;       /* s */
+};
+
+struct CorpusConfig {
+    uint64_t seed;
+    uint32_t uavs;
+    uint32_t uavBase;
+    uint64_t frames;
+    uint32_t intervalMs;
+    int64_t startNs;
+    double corruptRate;
+    double truncateRate;
+    double duplicateRate;
+    bool capture;
+    uint32_t sensorId;
+    uint32_t blockSize;
+};
+
+static void launch(SimUav &uav, Random &rng, uint16_t uavNo)
+{
+    memset(&uav.rec, 0, sizeof(uav.rec));
+
+    uav.rec.engineType = 1;
+    uav.rec.uavType = 1;
+    uav.rec.uavNo = uavNo;
+    uav.rec.videoTxChannel = rng.below(15);
+    uav.rec.videoTxFreq = 1205 + uav.rec.videoTxChannel * 3;
+
+    /* spread over the theatre, already some way into their flights */
+    uav.latitude = rng.uniform(46.0, 51.5);
+    uav.longitude = rng.uniform(23.0, 40.0);
+    uav.altitude = rng.uniform(200.0, 3000.0);
+    uav.course = rng.uniform(0.0, 360.0);
+    uav.speed = rng.uniform(60.0, 150.0);
+    uav.turnRate = 0;
+    uav.climbRate = 0;
+    uav.flightTime = rng.uniform(0.0, 3600.0);
+    uav.endurance = uav.flightTime + rng.uniform(1800.0, 7200.0);
+
+    uav.rec.camera.angle = rng.uniform(0.0, 90.0);
+    uav.rec.camera.azimuth = rng.uniform(-180.0, 180.0);
+    uav.rec.camera.position = rng.uniform(-90.0, 90.0);
+}
+
+static void fly(SimUav &uav, Random &rng, double dt)
+{
+    /* mean-reverting turn and climb rates give arcs and long straights rather than jitter */
+    uav.turnRate += -0.2 * uav.turnRate * dt + rng.uniform(-1.0, 1.0) * dt;
+    uav.turnRate = fmax(-6.0, fmin(6.0, uav.turnRate));
+    uav.climbRate += -0.2 * uav.climbRate * dt + rng.uniform(-0.5, 0.5) * dt;
+    uav.climbRate = fmax(-5.0, fmin(5.0, uav.climbRate));
+    uav.speed = fmax(50.0, fmin(180.0, uav.speed + rng.uniform(-1.0, 1.0) * dt));
+
+    uav.course = fmod(uav.course + uav.turnRate * dt + 360.0, 360.0);
+
+    double travel = uav.speed / 3.6 * dt;
+
+    uav.latitude += travel * cos(uav.course * deg2rad) / earth_radius_m / deg2rad;
+    uav.longitude += travel * sin(uav.course * deg2rad) /
+        (earth_radius_m * cos(uav.latitude * deg2rad)) / deg2rad;
+
+    uav.altitude += uav.climbRate * dt;
+    if (uav.altitude < 100.0 || uav.altitude > 4000.0)
+    {
+        uav.climbRate = -uav.climbRate;
+        uav.altitude = fmax(100.0, fmin(4000.0, uav.altitude));
+    }
+
+    uav.flightTime += dt;
+
+    uav.rec.camera.azimuth += rng.uniform(-2.0, 2.0);
+    if (uav.rec.camera.azimuth > 180.0)
+        uav.rec.camera.azimuth -= 360.0;
+    else if (uav.rec.camera.azimuth < -180.0)
+        uav.rec.camera.azimuth += 360.0;
+}
+
+static void stamp(SimUav &uav, int64_t nowNs)
+{
+    time_t secs = nowNs / 1000000000LL;
+    struct tm utc;
+
+    gmtime_r(&secs, &utc);
+
+    uav.rec.stampHours = utc.tm_hour;
+    uav.rec.stampMinutes = utc.tm_min;
+    uav.rec.stampSeconds = utc.tm_sec;
+    uav.rec.flightTime = (uint16_t) uav.flightTime;
+    uav.rec.remainingMinutes = uav.endurance > uav.flightTime ?
+        (uint16_t) ((uav.endurance - uav.flightTime) / 60) : 0;
+
+    uav.rec.gpsData.latitude = uav.latitude;
+    uav.rec.gpsData.longitude = uav.longitude;
+    uav.rec.gpsData.altitude = (uint16_t) uav.altitude;
+    uav.rec.groundSpeed = uav.speed;
+    uav.rec.careen = uav.course;
+    uav.rec.pitch = atan2(uav.climbRate, uav.speed / 3.6) / deg2rad;
+}
+
+/* where frames go, hex text or a capture archive */
+class CorpusOutput
+{
+  public:
+    CorpusOutput(const std::string &path, const CorpusConfig &config):
+        m_file(NULL), m_sensorId(config.sensorId)
+    {
+        if (config.capture)
+        {
+            m_capture.reset(new El3CaptureWriter(path, config.blockSize));
+            return;
+        }
+
+        m_file = path == "-" ? stdout : fopen(path.c_str(), "w");
+        if (!m_file)
+            throw std::runtime_error("cannot create " + path);
+    }
+
+    ~CorpusOutput()
+    {
+        close();
+    }
+
+    void write(int64_t recvNs, const unsigned char *frame, size_t len)
+    {
+        static const char tab[] = "0123456789abcdef";
+
+        if (m_capture)
+        {
+            m_capture->append(recvNs, m_sensorId, frame, len);
+            return;
+        }
+
+        m_line.resize(len * 2 + 1);
+
+        for (size_t i = 0; i < len; i++)
+        {
+            m_line[i * 2] = tab[frame[i] >> 4];
+            m_line[i * 2 + 1] = tab[frame[i] & 0x0f];
+        }
+
+        m_line[len * 2] = '\n';
+
+        if (fwrite(m_line.data(), 1, m_line.size(), m_file) != m_line.size())
+            throw std::runtime_error("write failed");
+    }
+
+    void close()
+    {
+        if (m_capture)
+            m_capture->close();
+
+        if (m_file && m_file != stdout)
+            fclose(m_file);
+
+        m_file = NULL;
+    }
+
+  private:
+    std::unique_ptr<El3CaptureWriter> m_capture;
+    FILE *m_file;
+    uint32_t m_sensorId;
+    std::string m_line;
+};
+
+static int generate(const std::string &path, const CorpusConfig &config)
+{
+    Random rng(config.seed);
+    std::vector<SimUav> uavs(config.uavs);
+    CorpusOutput output(path, config);
+    unsigned char frame[EL3_TELEMETRY_FRAME_LEN];
+    uint64_t written = 0, corrupted = 0, truncated = 0, duplicated = 0;
+    double dt = config.intervalMs / 1000.0;
+    int64_t intervalNs = config.intervalMs * 1000000LL;
+
+    for (uint32_t i = 0; i < config.uavs; i++)
+        launch(uavs[i], rng, config.uavBase + i);
+
+    for (uint64_t n = 0; n < config.frames; n++)
+    {
+        uint64_t tick = n / config.uavs;
+        uint32_t i = n % config.uavs;
+        SimUav &uav = uavs[i];
+
+        /* the UAVs report in turn, spread evenly over the period */
+        int64_t recvNs = config.startNs + tick * intervalNs + intervalNs * i / config.uavs;
+
+        if (tick)
+            fly(uav, rng, dt);
+
+        stamp(uav, recvNs);
+
+        size_t len = el3EncodeTelemetry(uav.rec, frame, sizeof(frame));
+
+        if (rng.chance(config.corruptRate))
+        {
+            int flips = 1 + rng.below(3);
+
+            while (flips--)
+                frame[rng.below(len)] ^= 1 << rng.below(8);
+
+            corrupted++;
+        }
+
+        if (rng.chance(config.truncateRate))
+        {
+            len = 1 + rng.below(len - 1);
+            truncated++;
+        }
+
+        output.write(recvNs, frame, len);
+        written++;
+
+        if (rng.chance(config.duplicateRate))
+        {
+            output.write(recvNs, frame, len);
+            written++;
+            duplicated++;
+        }
+    }
+
+    output.close();
+
+    std::cerr << written << " frames from " << config.uavs << " UAVs (" << corrupted << " corrupted, "
+        << truncated << " truncated, " << duplicated << " duplicated)\n";
+
+    return EXIT_SUCCESS;
+}
+
+static bool parseRate(const char *arg, double *rate)
+{
+    char *end;
+
+    *rate = strtod(arg, &end);
+
+    return *end == '\0' && *rate >= 0.0 && *rate <= 1.0;
+}
+
+int main(int argc, char **argv)
+{
+    CorpusConfig config;
+    int opt;
+
+    config.seed = 1;
+    config.uavs = 1000;
+    config.uavBase = 1000;
+    config.frames = 100000;
+    config.intervalMs = 500;
+    config.startNs = time(NULL) * 1000000000LL;
+    config.corruptRate = 0;
+    config.truncateRate = 0;
+    config.duplicateRate = 0;
+    config.capture = false;
+    config.sensorId = 0;
+    config.blockSize = EL3_CAPTURE_DEFAULT_BLOCK;
+
+    static const struct option longopts[] = {
+        { "seed",       required_argument,  NULL,   's' },
+        { "uavs",       required_argument,  NULL,   'u' },
+        { "uav-base",   required_argument,  NULL,   'U' },
+        { "frames",     required_argument,  NULL,   'n' },
+        { "interval",   required_argument,  NULL,   'i' },
+        { "start",      required_argument,  NULL,   't' },
+        { "corrupt",    required_argument,  NULL,   'c' },
+        { "truncate",   required_argument,  NULL,   'x' },
+        { "duplicate",  required_argument,  NULL,   'd' },
+        { "format",     required_argument,  NULL,   'f' },
+        { "sensor",     required_argument,  NULL,   'S' },
+        { "block-size", required_argument,  NULL,   'b' },
+        { "help",       no_argument,        NULL,   'h' },
+        { NULL,         0,                  NULL,   0 }
+    };
+
+    while ((opt = getopt_long(argc, argv, "s:u:U:n:i:t:c:x:d:f:S:b:h", longopts, NULL)) != -1)
+    {
+        bool ok = true;
+
+        switch (opt)
+        {
+            case 's':
+                config.seed = strtoull(optarg, NULL, 0);
+                break;
+            case 'u':
+                config.uavs = strtoul(optarg, NULL, 0);
+                break;
+            case 'U':
+                config.uavBase = strtoul(optarg, NULL, 0);
+                break;
+            case 'n':
+                config.frames = strtoull(optarg, NULL, 0);
+                break;
+            case 'i':
+                config.intervalMs = strtoul(optarg, NULL, 0);
+                break;
+            case 't':
+                config.startNs = strtoll(optarg, NULL, 0) * 1000000000LL;
+                break;
+            case 'c':
+                ok = parseRate(optarg, &config.corruptRate);
+                break;
+            case 'x':
+                ok = parseRate(optarg, &config.truncateRate);
+                break;
+            case 'd':
+                ok = parseRate(optarg, &config.duplicateRate);
+                break;
+            case 'f':
+                ok = !strcmp(optarg, "hex") || !strcmp(optarg, "capture");
+                config.capture = !strcmp(optarg, "capture");
+                break;
+            case 'S':
+                config.sensorId = strtoul(optarg, NULL, 0);
+                break;
+            case 'b':
+                config.blockSize = strtoul(optarg, NULL, 0);
+                break;
+            default:
+                usage();
+                return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+
+        if (!ok)
+        {
+            std::cerr << "el3dec_gencorpus: bad value for -" << (char) opt << ": " << optarg << "\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (argc - optind != 1)
+    {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    if (!config.uavs || config.uavBase + config.uavs > 0x10000 || !config.intervalMs)
+    {
+        std::cerr << "el3dec_gencorpus: UAV IDs must fit 16 bits and the interval must be set\n";
+        return EXIT_FAILURE;
+    }
+
+    try {
+        return generate(argv[optind], config);
+    } catch (const std::exception &e) {
+        std::cerr << "el3dec_gencorpus: " << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+}
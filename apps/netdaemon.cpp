@@ -7,10 +7,19 @@
  */
 
 #include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
 #include <boost/beast/websocket.hpp>
+#include <boost/asio/co_spawn.hpp>
 #include <boost/asio/dispatch.hpp>
+#include <boost/asio/redirect_error.hpp>
 #include <boost/asio/strand.hpp>
+#include <boost/asio/thread_pool.hpp>
+#include <boost/asio/use_awaitable.hpp>
 #include <boost/asio/signal_set.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/ip/udp.hpp>
+#include <boost/asio/connect.hpp>
+#include <boost/asio/write.hpp>
 #include <boost/log/core.hpp>
 #include <boost/log/trivial.hpp>
 #include <boost/log/expressions.hpp>
@@ -20,17 +29,45 @@
 #include <boost/log/utility/setup/common_attributes.hpp>
 #include <boost/log/sources/severity_logger.hpp>
 #include <boost/log/sources/record_ostream.hpp>
-#include <boost/algorithm/hex.hpp>
 #include <boost/format.hpp>
 #include <boost/program_options.hpp>
+#include <el3dec/aggregate.hpp>
+#include <el3dec/capture.hpp>
+#include <el3dec/fusion.hpp>
 #include <el3dec/lib.hpp>
+#include <el3dec/output.hpp>
+#include <el3dec/prefilter.hpp>
+#include <el3dec/query.hpp>
+#include <el3dec/relay.hpp>
+#include <el3dec/shmring.hpp>
+#include <el3dec/snapshot.hpp>
+#include <el3dec/trace.hpp>
 #include <el3dec/telemetry.hpp>
+#include <el3dec/trackfilter.hpp>
+#include <el3dec/trackstore.hpp>
+#include <el3dec/utils.hpp>
+#include <netinet/in.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
 #include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
 #include <functional>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
 #include <thread>
 #include <vector>
 
@@ -44,9 +81,44 @@ namespace http = beast::http;           // from <boost/beast/http.hpp>
 namespace websocket = beast::websocket; // from <boost/beast/websocket.hpp>
 namespace net = boost::asio;            // from <boost/asio.hpp>
 using tcp = boost::asio::ip::tcp;       // from <boost/asio/ip/tcp.hpp>
+using udp = boost::asio::ip::udp;       // from <boost/asio/ip/udp.hpp>
 using namespace logging::trivial;
 src::severity_logger< severity_level > lg;
 
+// Optional track consistency filter, shared by every session
+static std::unique_ptr<El3TrackFilter> track_filter;
+static std::mutex track_filter_mutex;
+
+// Every UAV heard from and its recent fixes, saved in snapshots for warm restarts
+static El3TrackStore track_store;
+static std::mutex track_store_mutex;
+
+// Relay mode: edges forward decoded records upstream, the aggregator fuses what its edges send
+static std::unique_ptr<El3RelayOutbox> relay_outbox;
+static std::mutex relay_outbox_mutex;
+static std::unique_ptr<El3Fusion> relay_fusion;
+static El3RelayPeers relay_peers;
+static std::mutex relay_mutex;
+
+// Output sinks (files, TCP, AMQP) every decoded record is pushed to, set up before serving
+static std::vector<std::unique_ptr<El3OutputSink>> outputs;
+
+// Optional rollups by UAV and sensor over tumbling or sliding windows, with a coverage heatmap
+static std::unique_ptr<El3Aggregator> aggregator;
+static std::mutex aggregator_mutex;
+
+// Optional capture archive of every frame received, shared by every session
+static std::unique_ptr<El3CaptureWriter> capture;
+static std::mutex capture_mutex;
+static std::atomic<bool> capturing;
+static uint32_t capture_sensor_id;
+static std::string capture_path;
+
+// Track queries search these archives (and the .el3cap files of these directories), the capture file
+// and the track store; the archives are read ahead a few blocks at a time, whatever the query returns
+static std::vector<std::string> query_archives;
+static El3CaptureIoConfig query_io;
+
 //------------------------------------------------------------------------------
 
 // Report a failure
@@ -76,143 +148,1619 @@ void log_incoming_telemetry(El3Telemetry *el3tele)
             % el3tele->CameraPosition();
 }
 
-class session : public std::enable_shared_from_this<session>
+// A raw frame screened and decoded: telemetry is NULL, with the reason in error, when it was not
+struct decoded_frame
+{
+    std::unique_ptr<El3Telemetry> telemetry;
+    std::string error;
+    bool suppressed = false;
+};
+
+// Count the frames, and keep the fixes of those decoded and not suppressed; each lock is taken once
+static void store_frames(const decoded_frame *frames, size_t n, int64_t now)
+{
+    static thread_local std::vector<El3TelemetryRecord> kept;
+    std::unique_lock<std::mutex> guard(track_store_mutex);
+    El3TrackStoreCounters &counters = track_store.counters();
+
+    kept.clear();
+
+    for (size_t i = 0; i < n; i++)
+    {
+        counters.frames++;
+
+        if (!frames[i].telemetry)
+        {
+            counters.rejected++;
+            continue;
+        }
+
+        counters.decoded++;
+
+        if (frames[i].suppressed)
+        {
+            counters.suppressed++;
+            continue;
+        }
+
+        kept.push_back(frames[i].telemetry->Record());
+        track_store.update(kept.back(), now);
+    }
+
+    if (kept.empty())
+        return;
+
+    if (relay_outbox)
+    {
+        std::lock_guard<std::mutex> relay_guard(relay_outbox_mutex);
+
+        for (const El3TelemetryRecord &rec : kept)
+            relay_outbox->push(rec, now);
+    }
+
+    guard.unlock();
+
+    if (aggregator)
+    {
+        std::lock_guard<std::mutex> stats_guard(aggregator_mutex);
+
+        for (const El3TelemetryRecord &rec : kept)
+        {
+            aggregator->receive(capture_sensor_id, now);
+            aggregator->add(rec, now);
+        }
+    }
+
+    // A sink blocking on a full queue only holds up these frames
+    for (auto &output : outputs)
+        for (const El3TelemetryRecord &rec : kept)
+            output->push(rec, now);
+}
+
+static uint64_t steady_ms()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Latest fix of every UAV in the track store, with the frame counters
+static std::string tracks_json()
+{
+    rapidjson::StringBuffer strbuf;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(strbuf);
+    std::lock_guard<std::mutex> guard(track_store_mutex);
+    const El3TrackStoreCounters &counters = track_store.counters();
+
+    writer.StartObject();
+    writer.Key("tracks");
+    writer.StartArray();
+    for (size_t i = 0; i < track_store.size(); i++)
+        el3WriteJson(track_store.entries()[i].latest(), writer);
+    writer.EndArray();
+
+    writer.Key("counters");
+    writer.StartObject();
+    writer.Key("frames");       writer.Uint64(counters.frames);
+    writer.Key("decoded");      writer.Uint64(counters.decoded);
+    writer.Key("rejected");     writer.Uint64(counters.rejected);
+    writer.Key("suppressed");   writer.Uint64(counters.suppressed);
+    writer.EndObject();
+    writer.EndObject();
+
+    return std::string(strbuf.GetString(), strbuf.GetSize());
+}
+
+// The window ending now, as far as it went
+static std::string stats_json()
+{
+    if (!aggregator)
+        return "{\"error\":\"statistics disabled\"}";
+
+    int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    El3WindowSummary summary;
+    {
+        std::lock_guard<std::mutex> guard(aggregator_mutex);
+        aggregator->query(now, summary);
+    }
+
+    rapidjson::StringBuffer strbuf;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(strbuf);
+    el3WriteJson(summary, writer);
+
+    return std::string(strbuf.GetString(), strbuf.GetSize());
+}
+
+// Fixes per query chunk (a websocket message, an HTTP chunk), about 100 KB of JSON
+#define QUERY_CHUNK_FIXES       256
+
+// Queries open and read archives a chunk at a time on a pool of their own, so a slow disk does not hold
+// up the I/O threads; more than this at once are turned away
+#define MAX_RUNNING_QUERIES     4
+#define QUERY_THREADS           2
+
+static std::unique_ptr<net::thread_pool> query_pool;
+
+static std::atomic<unsigned> running_queries;
+
+class query_slot
 {
-    websocket::stream<beast::tcp_stream> ws_;
-    beast::flat_buffer buffer_;
+    bool held_;
 
 public:
-    // Take ownership of the socket
-    explicit
-    session(tcp::socket&& socket)
-        : ws_(std::move(socket))
+    query_slot() : held_(++running_queries <= MAX_RUNNING_QUERIES)
     {
+        if (!held_)
+            running_queries--;
     }
 
-    // Get on the correct executor
-    void
-    run()
+    ~query_slot()
     {
-        // We need to be executing within a strand to perform async operations
-        // on the I/O objects in this session. Although not strictly necessary
-        // for single-threaded contexts, this example code is written to be
-        // thread-safe by default.
-        net::dispatch(ws_.get_executor(),
-            beast::bind_front_handler(
-                &session::on_run,
-                shared_from_this()));
+        if (held_)
+            running_queries--;
     }
 
-    // Start the asynchronous operation
-    void
-    on_run()
+    bool held() const { return held_; }
+};
+
+static std::string error_json(const std::string &message)
+{
+    rapidjson::StringBuffer strbuf;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(strbuf);
+
+    writer.StartObject();
+    writer.Key("error");
+    writer.String(message.c_str());
+    writer.EndObject();
+
+    return std::string(strbuf.GetString(), strbuf.GetSize());
+}
+
+// Run f on the query pool, the calling coroutine resuming with its result where it was
+template <typename Function>
+static auto on_query_pool(Function f) -> net::awaitable<decltype(f())>
+{
+    co_return co_await net::co_spawn(query_pool->get_executor(),
+        [&f]() -> net::awaitable<decltype(f())> { co_return f(); }, net::use_awaitable);
+}
+
+// A query of one UAV between two times, planned over every archive and the track store; NULL with the
+// reason in error if the arguments do not make one. Reads archive indexes, so it runs on the query pool
+static std::unique_ptr<El3TrackQueryCursor> start_query(std::string_view uav, std::string_view from,
+    std::string_view to, std::string &error)
+{
+    El3TrackQuery query;
+    std::string uav_text(uav);
+    char *end;
+    unsigned long uav_no = strtoul(uav_text.c_str(), &end, 10);
+
+    if (uav_text.empty() || *end || uav_no > 0xffff)
     {
-        // Set suggested timeout settings for the websocket
-        ws_.set_option(
-            websocket::stream_base::timeout::suggested(
-                beast::role_type::server));
+        error = error_json("the UAV ID is a number up to 65535");
+        return NULL;
+    }
 
-        // Set a decorator to change the Server of the handshake
-        ws_.set_option(websocket::stream_base::decorator(
-            [](websocket::response_type& res)
-            {
-                res.set(http::field::server, "el3dec_websocket_netdaemon");
-            }));
-        // Accept the websocket handshake
-        ws_.async_accept(
-            beast::bind_front_handler(
-                &session::on_accept,
-                shared_from_this()));
+    query.uavNo = uav_no;
+
+    if (!el3ParseTime(std::string(from), query.fromNs) || !el3ParseTime(std::string(to), query.toNs))
+    {
+        error = error_json("times are ISO 8601 UTC (2022-09-13T14:00:00Z) or seconds since the epoch");
+        return NULL;
     }
 
-    void
-    on_accept(beast::error_code ec)
+    if (query.fromNs > query.toNs)
     {
-        if (ec)
-            return fail(ec, "accept");
+        error = error_json("the query ends before it starts");
+        return NULL;
+    }
 
-        // Read a message
-        do_read();
+    std::unique_ptr<El3TrackQueryCursor> cursor(new El3TrackQueryCursor(query, query_io));
+    std::vector<std::string> paths;
+
+    for (auto &archive : query_archives)
+    {
+        std::error_code ec;
+
+        if (!std::filesystem::is_directory(archive, ec))
+        {
+            paths.push_back(archive);
+            continue;
+        }
+
+        size_t first = paths.size();
+
+        for (auto &file : std::filesystem::directory_iterator(archive, ec))
+            if (file.path().extension() == ".el3cap")
+                paths.push_back(file.path().string());
+
+        std::sort(paths.begin() + first, paths.end());
     }
 
-    void
-    do_read()
+    // What the capture file holds so far, and a copy of what it does not yet, the block being filled
+    // included; the capture is not flushed for queries
+    std::vector<unsigned char> tail;
+    uint64_t written = 0;
+    bool live = false;
+
+    if (capturing)
     {
-        ws_.async_read(
-            buffer_,
-            beast::bind_front_handler(
-                &session::on_read,
-                shared_from_this()));
+        std::lock_guard<std::mutex> guard(capture_mutex);
+
+        if (capture)
+        {
+            written = capture->unwritten(tail);
+            live = true;
+        }
     }
 
-    void
-    on_read(
-        beast::error_code ec,
-        std::size_t bytes_transferred)
+    if (!capture_path.empty())
+    {
+        paths.erase(std::remove(paths.begin(), paths.end(), capture_path), paths.end());
+        paths.push_back(capture_path);
+    }
+
+    for (auto &path : paths)
+    {
+        try {
+            if (live && path == capture_path)
+                cursor->addCapture(path, written, tail);
+            else
+                cursor->addArchive(path);
+        } catch (const std::exception &e) {
+            BOOST_LOG_SEV(lg, warning) << "Query skips " << path << ": " << e.what();
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(track_store_mutex);
+        cursor->addLive(track_store, capture_sensor_id);
+    }
+
+    return cursor;
+}
+
+// The next chunk of a query as JSON lines, the last one closed by a line with the totals; false once
+// that one is out
+static bool query_chunk(El3TrackQueryCursor &cursor, std::vector<El3QueryFix> &fixes, std::string &out)
+{
+    rapidjson::StringBuffer strbuf;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(strbuf);
+    bool more;
+
+    try {
+        more = cursor.next(fixes, QUERY_CHUNK_FIXES);
+    } catch (const std::exception &e) {
+        BOOST_LOG_SEV(lg, error) << "Query failed: " << e.what();
+        out = error_json(e.what()) + "\n";
+        return false;
+    }
+
+    for (auto &fix : fixes)
+    {
+        writer.Reset(strbuf);
+        el3WriteJson(fix, writer);
+        strbuf.Put('\n');
+    }
+
+    if (!more)
+    {
+        const El3QueryStats &stats = cursor.stats();
+
+        writer.Reset(strbuf);
+        writer.StartObject();
+        writer.Key("done");     writer.Bool(true);
+        writer.Key("stats");    el3WriteJson(stats, writer);
+        writer.EndObject();
+        strbuf.Put('\n');
+
+        BOOST_LOG_SEV(lg, info) << boost::format("Query of UAV %u: %u fixes, %u of %u blocks read, %u frames decoded")
+            % cursor.query().uavNo % stats.fixes % stats.blocksRead % stats.blocks % stats.framesDecoded;
+    }
+
+    out.assign(strbuf.GetString(), strbuf.GetSize());
+    return more;
+}
+
+static int64_t now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// Archive one raw frame; capture_mutex is held
+static void capture_frame(const unsigned char *bytes, size_t len, int64_t now)
+{
+    try {
+        if (capture)
+            capture->append(now, capture_sensor_id, bytes, len);
+    } catch (const std::exception &e) {
+        BOOST_LOG_SEV(lg, error) << "Capture disabled: " << e.what();
+        capturing = false;
+        capture.reset();
+    }
+}
+
+// Screen and decode one raw frame, before the track filter
+static void decode_frame(const unsigned char *bytes, size_t len, decoded_frame &frame)
+{
+    uint8_t screened = el3DecodableScreen().screen(bytes, len);
+
+    el3TraceMark(TRACE_SCREEN);
+
+    if (EL3_SCREEN_VERDICT(screened) == SCREEN_REJECT)
+    {
+        frame.error = std::string("invalid packet (") + el3ScreenReasonName(EL3_SCREEN_REASON(screened)) + ")";
+        return;
+    }
+
+    try {
+        frame.telemetry.reset(el3Decode(bytes, len, FAULT_TOLERANT));
+    } catch (const std::exception &e) {
+        // even fault tolerant decoding gives up on frames without a usable header
+        frame.error = e.what();
+    }
+}
+
+// Run the decoded frames through the track filter, under one lock
+static void filter_frames(decoded_frame *frames, size_t n)
+{
+    if (!track_filter)
+        return;
+
+    std::lock_guard<std::mutex> guard(track_filter_mutex);
+
+    for (size_t i = 0; i < n; i++)
+        if (frames[i].telemetry)
+            frames[i].suppressed = track_filter->suppressed(track_filter->check(*frames[i].telemetry));
+}
+
+// Suppressed glitches are not handed out to anyone, the sender included
+static std::string frame_reply(const decoded_frame &frame)
+{
+    if (!frame.telemetry)
+        return error_json(frame.error);
+
+    return frame.suppressed ? error_json("fix suppressed (track glitch)") : frame.telemetry->toJson(false);
+}
+
+// Decode, filter, log and record one raw frame, returning the JSON reply for the sender (if any)
+static std::string handle_frame(const unsigned char *bytes, size_t len, bool reply = true)
+{
+    int64_t now = now_ns();
+
+    if (capturing)
+    {
+        std::lock_guard<std::mutex> guard(capture_mutex);
+
+        capture_frame(bytes, len, now);
+        el3TraceMark(TRACE_CAPTURE);
+    }
+
+    decoded_frame frame;
+
+    decode_frame(bytes, len, frame);
+
+    if (frame.telemetry && track_filter)
+    {
+        filter_frames(&frame, 1);
+        el3TraceMark(TRACE_TRACK);
+    }
+
+    store_frames(&frame, 1, now);
+
+    if (!frame.telemetry)
+        BOOST_LOG_SEV(lg, debug) << "Undecodable frame: " << frame.error;
+    else if (!frame.suppressed)
+    {
+        log_incoming_telemetry(frame.telemetry.get());
+        el3TraceMark(TRACE_LOG);
+    }
+
+    return reply ? frame_reply(frame) : std::string();
+}
+
+// Frames from a demodulator on this host, decoded in place in the shared memory ring
+static void shm_ring_loop(El3ShmRingReader *ring, std::atomic<bool> *running)
+{
+    El3CaptureRecord rec;
+    uint64_t dropped = ring->dropped();
+    uint64_t corrupt = 0;
+
+    while (*running)
+    {
+        while (ring->next(rec))
+        {
+            el3TraceBegin();
+            handle_frame(rec.data, rec.length, false);
+        }
+
+        if (ring->dropped() != dropped)
+        {
+            BOOST_LOG_SEV(lg, warning) << boost::format("Shared memory ring full, %u frames dropped")
+                % (ring->dropped() - dropped);
+            dropped = ring->dropped();
+        }
+
+        if (ring->corrupt() != corrupt)
+        {
+            BOOST_LOG_SEV(lg, error) << boost::format("Shared memory ring corrupt, skipped %u times")
+                % (ring->corrupt() - corrupt);
+            corrupt = ring->corrupt();
+        }
+
+        // bounded, so a stop request is noticed without the producer's help
+        ring->wait(100);
+    }
+}
+
+// Datagrams taken per recvmmsg call in busy-poll mode
+#define BUSY_POLL_BATCH     32
+
+// Microseconds the kernel may spin on the device queue for a busy-poll socket (SO_BUSY_POLL)
+#define BUSY_POLL_USEC      50
+
+// Empty polls between yields, so a core shared by mistake is not starved
+#define BUSY_POLL_SPINS     4096
+
+// CPUs as in 2,3 or 4-7
+static bool parse_cpu_list(const std::string &list, std::vector<int> &cpus)
+{
+    const char *p = list.c_str();
+
+    for (;;)
     {
-        boost::ignore_unused(bytes_transferred);
+        char *end;
+        long first = strtol(p, &end, 10), last = first;
+
+        if (end == p)
+            return false;
+
+        if (*end == '-')
+        {
+            p = end + 1;
+            last = strtol(p, &end, 10);
+            if (end == p)
+                return false;
+        }
+
+        if (first < 0 || last < first || last >= CPU_SETSIZE)
+            return false;
+
+        for (long cpu = first; cpu <= last; cpu++)
+            cpus.push_back(cpu);
+
+        if (*end == '\0')
+            return true;
+        if (*end != ',')
+            return false;
+
+        p = end + 1;
+    }
+}
+
+// One socket per busy-poll thread, the kernel spreads senders over them by flow (SO_REUSEPORT)
+static int open_busy_poll_socket(const udp::endpoint &endpoint)
+{
+    int fd = socket(endpoint.protocol().family(), SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    int one = 1, rcvbuf = 4 * 1024 * 1024;
+
+    if (fd < 0)
+        return -1;
+
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+#ifdef SO_BUSY_POLL
+    // Raising it past net.core.busy_read takes CAP_NET_ADMIN, polling still works without
+    int usec = BUSY_POLL_USEC;
+
+    if (setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &usec, sizeof(usec)) < 0)
+        BOOST_LOG_SEV(lg, warning) << "SO_BUSY_POLL not set: " << strerror(errno);
+#endif
+#ifdef SO_PREFER_BUSY_POLL
+    setsockopt(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &one, sizeof(one));
+#endif
+
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) < 0 ||
+        bind(fd, endpoint.data(), endpoint.size()) < 0)
+    {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+
+    return fd;
+}
+
+// Low-latency ingest: a thread pinned to its CPU spins on its socket, decoding, publishing and
+// answering each burst as it comes, without ever sleeping in epoll or logging fixes
+static void busy_poll_loop(int fd, int cpu, std::atomic<bool> *running)
+{
+    struct mmsghdr msgs[BUSY_POLL_BATCH];
+    struct iovec iov[BUSY_POLL_BATCH];
+    struct sockaddr_storage senders[BUSY_POLL_BATCH];
+    static thread_local unsigned char frames[BUSY_POLL_BATCH][EL3_MAX_FRAME_BYTES];
+    static thread_local decoded_frame decoded[BUSY_POLL_BATCH];
+    El3TraceToken traces[BUSY_POLL_BATCH];
+    cpu_set_t set;
+    unsigned idle = 0;
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+        BOOST_LOG_SEV(lg, warning) << "Cannot pin the busy-poll thread to CPU " << cpu;
+
+    memset(msgs, 0, sizeof(msgs));
+    for (int i = 0; i < BUSY_POLL_BATCH; i++)
+    {
+        iov[i].iov_base = frames[i];
+        iov[i].iov_len = EL3_MAX_FRAME_BYTES;
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_name = &senders[i];
+    }
+
+    while (*running)
+    {
+        for (int i = 0; i < BUSY_POLL_BATCH; i++)
+            msgs[i].msg_hdr.msg_namelen = sizeof(senders[i]);
+
+        int n = recvmmsg(fd, msgs, BUSY_POLL_BATCH, MSG_DONTWAIT, NULL);
+
+        if (n <= 0)
+        {
+            if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                BOOST_LOG_SEV(lg, error) << "Busy-poll receive: " << strerror(errno);
+
+            if (++idle == BUSY_POLL_SPINS)
+            {
+                idle = 0;
+                sched_yield();
+            }
+            continue;
+        }
+
+        idle = 0;
+
+        // The burst is handled as a whole: one capture lock, one filter and track store update,
+        // and no per-frame log lines, which would stall the spinning thread on the log sink
+        int64_t now = now_ns();
+
+        if (capturing)
+        {
+            std::lock_guard<std::mutex> guard(capture_mutex);
+
+            for (int i = 0; i < n && capture; i++)
+                capture_frame(frames[i], msgs[i].msg_len, now);
+        }
+
+        for (int i = 0; i < n; i++)
+        {
+            decoded[i] = decoded_frame();
+            el3TraceBegin();
+            decode_frame(frames[i], msgs[i].msg_len, decoded[i]);
+            traces[i] = el3TraceDetach();
+        }
+
+        filter_frames(decoded, n);
+        store_frames(decoded, n, now);
+
+        for (int i = 0; i < n; i++)
+        {
+            std::string reply = frame_reply(decoded[i]);
+
+            if (sendto(fd, reply.data(), reply.size(), MSG_DONTWAIT,
+                    (struct sockaddr *) &senders[i], msgs[i].msg_hdr.msg_namelen) < 0)
+                BOOST_LOG_SEV(lg, warning) << "Busy-poll send: " << strerror(errno);
+
+            el3TraceFinish(traces[i], TRACE_WRITE);
+        }
+    }
+}
+
+// Answer one websocket message: a query, or a hex encoded frame to decode
+static void handle_message(std::string_view instr, std::string &reply)
+{
+    BOOST_LOG_SEV(lg, debug) <<  boost::format("Recvd %u hex encoded bytes...") % instr.size();
+
+    if (instr == "tracks")
+    {
+        // Consoles (re)connecting get the current picture without waiting for every UAV
+        reply = tracks_json();
+    }
+    else if (instr == "stats")
+    {
+        reply = stats_json();
+    }
+    else if (instr.size() > EL3_MAX_FRAME_BYTES * 2)
+    {
+        reply = "{\"error\":\"frame too long\"}";
+    }
+    else
+    {
+        unsigned char bytes[EL3_MAX_FRAME_BYTES];
+
+        el3TraceMark(TRACE_READ);
+        size_t len = hex_to_bytes(instr.data(), instr.size(), bytes, sizeof(bytes));
+        el3TraceMark(TRACE_UNHEX);
+
+        reply = len ? handle_frame(bytes, len) : "{\"error\":\"invalid hex encoding\"}";
+    }
+}
+
+// Spare message buffers, more than this are freed once returned
+#define MAX_SPARE_BUFFERS       64
+
+// Buffers grown past this (a tracks reply for many UAVs) are shrunk before going back
+#define MAX_SPARE_BUFFER_BYTES  (64 * 1024)
+
+struct message_buffers
+{
+    beast::flat_buffer in;
+    std::string out;
+};
+
+// Websocket sessions borrow their buffers while they handle a message, idle ones hold none
+static std::vector<std::unique_ptr<message_buffers>> spare_buffers;
+static std::mutex spare_buffers_mutex;
+
+class lent_buffers
+{
+    std::unique_ptr<message_buffers> buffers_;
+
+public:
+    lent_buffers()
+    {
+        std::lock_guard<std::mutex> guard(spare_buffers_mutex);
+
+        if (spare_buffers.empty())
+        {
+            buffers_.reset(new message_buffers());
+        }
+        else
+        {
+            buffers_ = std::move(spare_buffers.back());
+            spare_buffers.pop_back();
+        }
+    }
+
+    ~lent_buffers()
+    {
+        buffers_->in.clear();
+        buffers_->out.clear();
+
+        if (buffers_->in.capacity() > MAX_SPARE_BUFFER_BYTES)
+            buffers_->in.shrink_to_fit();
+        if (buffers_->out.capacity() > MAX_SPARE_BUFFER_BYTES)
+            buffers_->out.shrink_to_fit();
+
+        std::lock_guard<std::mutex> guard(spare_buffers_mutex);
+        if (spare_buffers.size() < MAX_SPARE_BUFFERS)
+            spare_buffers.push_back(std::move(buffers_));
+    }
+
+    message_buffers *operator->() { return buffers_.get(); }
+};
+
+// The websocket layer keeps its own timeouts, a plain socket underneath saves the timers of a tcp_stream
+using websocket_stream = websocket::stream<tcp::socket>;
+
+// Longest a new connection may take to send its request, the websocket timeouts only start after
+#define HANDSHAKE_TIMEOUT       std::chrono::seconds(30)
+
+static std::string url_decode(std::string_view text)
+{
+    std::string out;
+
+    for (size_t i = 0; i < text.size(); i++)
+    {
+        unsigned char byte;
+
+        if (text[i] == '%' && i + 2 < text.size() && hex_to_bytes(text.data() + i + 1, 2, &byte, 1))
+        {
+            out.push_back((char) byte);
+            i += 2;
+        }
+        else
+        {
+            out.push_back(text[i] == '+' ? ' ' : text[i]);
+        }
+    }
+
+    return out;
+}
+
+// Stream a query as websocket messages of QUERY_CHUNK_FIXES fixes, each written before the next is
+// read; false once the connection is done
+static net::awaitable<bool> serve_query(websocket_stream &ws, std::string_view args, std::string &out)
+{
+    beast::error_code ec;
+    std::vector<std::string_view> words;
+    query_slot slot;
+
+    for (size_t pos = 0; pos < args.size(); )
+    {
+        size_t end = std::min(args.find(' ', pos), args.size());
+
+        if (end > pos)
+            words.push_back(args.substr(pos, end - pos));
+        pos = end + 1;
+    }
+
+    std::unique_ptr<El3TrackQueryCursor> cursor;
+    std::vector<El3QueryFix> fixes;
+    bool more = false;
+
+    if (words.size() != 3)
+        out = error_json("usage: query <uav> <from> <to>");
+    else if (!slot.held())
+        out = error_json("too many queries running");
+    else
+        cursor = co_await on_query_pool([&] { return start_query(words[0], words[1], words[2], out); });
+
+    if (cursor)
+        more = co_await on_query_pool([&] { return query_chunk(*cursor, fixes, out); });
+
+    ws.text(true);
+
+    for (;;)
+    {
+        co_await ws.async_write(net::buffer(out), net::redirect_error(net::use_awaitable, ec));
+        if (ec)
+        {
+            fail(ec, "write");
+            co_return false;
+        }
+
+        if (!more)
+            break;
+
+        more = co_await on_query_pool([&] { return query_chunk(*cursor, fixes, out); });
+    }
+
+    co_return true;
+}
+
+static net::awaitable<void> http_reply(tcp::socket &socket, unsigned version, http::status status,
+    const std::string &body)
+{
+    beast::error_code ec;
+    http::response<http::string_body> res{status, version};
+
+    res.set(http::field::server, "el3dec_websocket_netdaemon");
+    res.set(http::field::content_type, "application/json");
+    res.keep_alive(false);
+    res.body() = body;
+    res.prepare_payload();
+
+    co_await http::async_write(socket, res, net::redirect_error(net::use_awaitable, ec));
+    if (ec)
+        fail(ec, "http write");
+}
+
+// A track query over plain HTTP, GET /query?uav=&from=&to=, answered with JSON lines in chunks
+static net::awaitable<void> serve_http(tcp::socket &socket, const http::request<http::empty_body> &req)
+{
+    beast::error_code ec;
+    std::string_view target(req.target().data(), req.target().size());
+    size_t mark = target.find('?');
+
+    if (target.substr(0, mark) != "/query")
+    {
+        co_await http_reply(socket, req.version(), http::status::not_found, error_json("not found"));
+        co_return;
+    }
+
+    if (req.method() != http::verb::get)
+    {
+        co_await http_reply(socket, req.version(), http::status::method_not_allowed,
+            error_json("queries are GET requests"));
+        co_return;
+    }
+
+    std::string uav, from, to;
+    std::string_view params = mark == std::string_view::npos ? std::string_view() : target.substr(mark + 1);
+
+    for (size_t pos = 0; pos < params.size(); )
+    {
+        size_t end = std::min(params.find('&', pos), params.size());
+        std::string_view param = params.substr(pos, end - pos);
+        size_t eq = param.find('=');
+
+        if (eq != std::string_view::npos)
+        {
+            std::string_view name = param.substr(0, eq);
+            std::string value = url_decode(param.substr(eq + 1));
+
+            if (name == "uav")
+                uav = value;
+            else if (name == "from")
+                from = value;
+            else if (name == "to")
+                to = value;
+        }
+
+        pos = end + 1;
+    }
+
+    query_slot slot;
+    std::string out;
+
+    if (!slot.held())
+    {
+        co_await http_reply(socket, req.version(), http::status::service_unavailable,
+            error_json("too many queries running"));
+        co_return;
+    }
+
+    std::unique_ptr<El3TrackQueryCursor> cursor =
+        co_await on_query_pool([&] { return start_query(uav, from, to, out); });
+
+    if (!cursor)
+    {
+        co_await http_reply(socket, req.version(), http::status::bad_request, out);
+        co_return;
+    }
+
+    http::response<http::empty_body> res{http::status::ok, req.version()};
+
+    res.set(http::field::server, "el3dec_websocket_netdaemon");
+    res.set(http::field::content_type, "application/x-ndjson");
+    res.keep_alive(false);
+    res.chunked(true);
+
+    http::response_serializer<http::empty_body> sr{res};
+
+    co_await http::async_write_header(socket, sr, net::redirect_error(net::use_awaitable, ec));
+
+    std::vector<El3QueryFix> fixes;
+    bool more = true;
+
+    while (!ec && more)
+    {
+        more = co_await on_query_pool([&] { return query_chunk(*cursor, fixes, out); });
+        co_await net::async_write(socket, http::make_chunk(net::buffer(out)),
+            net::redirect_error(net::use_awaitable, ec));
+    }
+
+    if (!ec)
+        co_await net::async_write(socket, http::make_chunk_last(), net::redirect_error(net::use_awaitable, ec));
+    if (ec)
+    {
+        fail(ec, "http write");
+        co_return;
+    }
+
+    socket.shutdown(tcp::socket::shutdown_send, ec);
+}
+
+// The handshake, false if it failed or the connection was a plain HTTP request, answered here
+static net::awaitable<bool> accept_session(websocket_stream &ws)
+{
+    beast::error_code ec;
+
+    // Set suggested timeout settings for the websocket
+    ws.set_option(websocket::stream_base::timeout::suggested(beast::role_type::server));
+
+    // Set a decorator to change the Server of the handshake
+    ws.set_option(websocket::stream_base::decorator(
+        [](websocket::response_type& res)
+        {
+            res.set(http::field::server, "el3dec_websocket_netdaemon");
+        }));
+
+    beast::flat_buffer buffer;
+    http::request_parser<http::empty_body> parser;
+    net::steady_timer timeout(ws.get_executor());
+
+    // The timer runs on the connection's strand; done tells it the read finished, even once this
+    // frame and the socket are gone
+    auto done = std::make_shared<bool>(false);
+
+    parser.header_limit(8 * 1024);
+    timeout.expires_after(HANDSHAKE_TIMEOUT);
+    timeout.async_wait([&ws, done](beast::error_code ec)
+        {
+            if (!ec && !*done)
+                ws.next_layer().cancel();
+        });
+
+    co_await http::async_read(ws.next_layer(), buffer, parser, net::redirect_error(net::use_awaitable, ec));
+    *done = true;
+    timeout.cancel();
+
+    if (ec)
+    {
+        fail(ec, "request");
+        co_return false;
+    }
+
+    if (!websocket::is_upgrade(parser.get()))
+    {
+        co_await serve_http(ws.next_layer(), parser.get());
+        co_return false;
+    }
+
+    co_await ws.async_accept(parser.get(), net::redirect_error(net::use_awaitable, ec));
+    if (ec)
+        fail(ec, "accept");
+
+    co_return !ec;
+}
+
+// The rest of a message once it started, and the reply; false once the connection is done
+static net::awaitable<bool> serve_message(websocket_stream &ws)
+{
+    beast::error_code ec;
+    lent_buffers buffers;
+
+    if (!ws.is_message_done())
+    {
+        co_await ws.async_read(buffers->in, net::redirect_error(net::use_awaitable, ec));
+        if (ec == websocket::error::closed)
+            co_return false;
+        if (ec)
+        {
+            fail(ec, "read");
+            co_return false;
+        }
+    }
+
+    auto data = buffers->in.data();
+    std::string_view instr(static_cast<const char*>(data.data()), data.size());
+
+    if (instr.substr(0, 6) == "query ")
+        co_return co_await serve_query(ws, instr.substr(6), buffers->out);
+
+    el3TraceBegin();
+
+    handle_message(instr, buffers->out);
+
+    // The thread that finishes the write may not be this one
+    El3TraceToken trace = el3TraceDetach();
+
+    ws.text(ws.got_text());
+    co_await ws.async_write(net::buffer(buffers->out), net::redirect_error(net::use_awaitable, ec));
+    if (ec)
+    {
+        fail(ec, "write");
+        co_return false;
+    }
+
+    el3TraceFinish(trace, TRACE_WRITE);
+    co_return true;
+}
+
+// One websocket connection. Idle, it costs its socket, the websocket state and the frames of this
+// coroutine and the read it waits on, about 5 KB; the handshake and messages run in frames of their
+// own, which asio recycles per thread.
+static net::awaitable<void> session(tcp::socket socket)
+{
+    websocket_stream ws(std::move(socket));
+    beast::error_code ec;
+
+    if (!co_await accept_session(ws))
+        co_return;
+
+    // Beast's UTF-8 check of text frames trips over a null pointer, even with nothing to check
+    char none;
+
+    do
+    {
+        // An empty read waits for the next message without a buffer, it returns once the first
+        // frame is in; pings, close frames and the idle timeout are handled meanwhile
+        co_await ws.async_read_some(net::mutable_buffer(&none, 0),
+            net::redirect_error(net::use_awaitable, ec));
+        if (ec == websocket::error::closed)
+            co_return;
+        if (ec)
+        {
+            fail(ec, "read");
+            co_return;
+        }
+    }
+    while (co_await serve_message(ws));
+}
+
+//------------------------------------------------------------------------------
+
+// Accepts incoming connections and launches the sessions
+class listener : public std::enable_shared_from_this<listener>
+{
+    net::io_context& ioc_;
+    tcp::acceptor acceptor_;
+
+public:
+    listener(
+        net::io_context& ioc,
+        tcp::endpoint endpoint)
+        : ioc_(ioc)
+        , acceptor_(ioc)
+    {
+        beast::error_code ec;
+
+        // Open the acceptor
+        acceptor_.open(endpoint.protocol(), ec);
+        if(ec)
+        {
+            fail(ec, "open");
+            return;
+        }
+
+        // Allow address reuse
+        acceptor_.set_option(net::socket_base::reuse_address(true), ec);
+        if(ec)
+        {
+            fail(ec, "set_option");
+            return;
+        }
+
+        // Bind to the server address
+        acceptor_.bind(endpoint, ec);
+        if(ec)
+        {
+            fail(ec, "bind");
+            return;
+        }
+
+        // Start listening for connections
+        acceptor_.listen(
+            net::socket_base::max_listen_connections, ec);
+        if(ec)
+        {
+            fail(ec, "listen");
+            return;
+        }
+    }
+
+    // Start accepting incoming connections
+    void
+    run()
+    {
+        do_accept();
+    }
+
+private:
+    void
+    do_accept()
+    {
+        // The new connection gets its own strand
+        acceptor_.async_accept(
+            net::make_strand(ioc_),
+            beast::bind_front_handler(
+                &listener::on_accept,
+                shared_from_this()));
+    }
+
+    void
+    on_accept(beast::error_code ec, tcp::socket socket)
+    {
+        if(ec)
+        {
+            fail(ec, "accept");
+        }
+        else
+        {
+            BOOST_LOG_SEV(lg, info) << "Connection from " << socket.remote_endpoint().address().to_string();
+
+            // The session runs on the connection's strand
+            auto executor = socket.get_executor();
+            net::co_spawn(executor, session(std::move(socket)),
+                [](std::exception_ptr e)
+                {
+                    try {
+                        if (e)
+                            std::rethrow_exception(e);
+                    } catch (const std::exception &ex) {
+                        BOOST_LOG_SEV(lg, error) << "Session failed: " << ex.what();
+                    }
+                });
+        }
+
+        // Accept another connection
+        do_accept();
+    }
+};
+
+//------------------------------------------------------------------------------
+
+// Takes raw frames, one per datagram, and answers each with its JSON
+class udp_listener : public std::enable_shared_from_this<udp_listener>
+{
+    udp::socket socket_;
+    udp::endpoint sender_;
+    unsigned char buffer_[EL3_MAX_FRAME_BYTES];
+
+public:
+    udp_listener(
+        net::io_context& ioc,
+        udp::endpoint endpoint)
+        : socket_(net::make_strand(ioc))
+    {
+        beast::error_code ec;
+
+        socket_.open(endpoint.protocol(), ec);
+        if(ec)
+        {
+            fail(ec, "udp open");
+            return;
+        }
+
+        // Bursts from the replay tool and busy sensors outrun the default buffer
+        socket_.set_option(net::socket_base::receive_buffer_size(4 * 1024 * 1024), ec);
+
+        socket_.bind(endpoint, ec);
+        if(ec)
+        {
+            fail(ec, "udp bind");
+            return;
+        }
+    }
+
+    void
+    run()
+    {
+        if (socket_.is_open())
+            do_receive();
+    }
+
+private:
+    void
+    do_receive()
+    {
+        socket_.async_receive_from(
+            net::buffer(buffer_),
+            sender_,
+            beast::bind_front_handler(
+                &udp_listener::on_receive,
+                shared_from_this()));
+    }
+
+    void
+    on_receive(beast::error_code ec, std::size_t bytes_transferred)
+    {
+        if (ec == net::error::operation_aborted)
+            return;
+
+        if (ec)
+        {
+            fail(ec, "udp receive");
+            return do_receive();
+        }
+
+        el3TraceBegin();
+
+        // Datagrams are handled one at a time on the strand, so replies go out in arrival order
+        auto reply = std::make_shared<std::string>(handle_frame(buffer_, bytes_transferred));
+        El3TraceToken trace = el3TraceDetach();
+
+        socket_.async_send_to(
+            net::buffer(*reply),
+            sender_,
+            [reply, trace](beast::error_code ec, std::size_t)
+            {
+                if (ec)
+                    fail(ec, "udp send");
+
+                el3TraceFinish(trace, TRACE_WRITE);
+            });
+
+        do_receive();
+    }
+};
+
+//------------------------------------------------------------------------------
+
+// Edge side of a relay link: forwards the outbox to the aggregator, reconnecting and resuming
+// whenever the link drops
+class relay_client : public std::enable_shared_from_this<relay_client>
+{
+    net::strand<net::io_context::executor_type> strand_;
+    tcp::resolver resolver_;
+    tcp::socket socket_;
+    net::steady_timer flush_timer_;
+    net::steady_timer retry_timer_;
+    std::string host_;
+    std::string port_;
+    El3RelayReader reader_;
+    unsigned char in_[4096];
+    std::string out_;
+    bool connected_ = false;
+    bool welcomed_ = false;
+    bool writing_ = false;
+
+public:
+    relay_client(net::io_context& ioc, std::string host, std::string port)
+        : strand_(net::make_strand(ioc))
+        , resolver_(strand_)
+        , socket_(strand_)
+        , flush_timer_(strand_)
+        , retry_timer_(strand_)
+        , host_(std::move(host))
+        , port_(std::move(port))
+    {
+    }
+
+    void
+    run()
+    {
+        net::dispatch(strand_, [self = shared_from_this()] {
+            self->do_connect();
+            self->do_flush_timer();
+        });
+    }
+
+    void
+    stop()
+    {
+        net::dispatch(strand_, [self = shared_from_this()] {
+            self->flush_timer_.cancel();
+            self->retry_timer_.cancel();
+            self->connected_ = false;
+            beast::error_code ec;
+            self->socket_.close(ec);
+        });
+    }
+
+private:
+    void
+    do_connect()
+    {
+        resolver_.async_resolve(host_, port_,
+            [self = shared_from_this()](beast::error_code ec, tcp::resolver::results_type results)
+            {
+                if (ec)
+                    return self->retry(ec, "relay resolve");
+
+                net::async_connect(self->socket_, results,
+                    [self](beast::error_code ec, const tcp::endpoint&)
+                    {
+                        if (ec)
+                            return self->retry(ec, "relay connect");
+
+                        self->on_connect();
+                    });
+            });
+    }
+
+    void
+    on_connect()
+    {
+        BOOST_LOG_SEV(lg, info) << "Relay link to " << host_ << ":" << port_ << " up";
+
+        socket_.set_option(tcp::no_delay(true));
+        connected_ = true;
+        welcomed_ = false;
+        reader_ = El3RelayReader();
+
+        out_.clear();
+        {
+            std::lock_guard<std::mutex> guard(relay_outbox_mutex);
+            relay_outbox->hello(out_);
+        }
+
+        do_write();
+        do_read();
+    }
+
+    void
+    do_read()
+    {
+        socket_.async_read_some(net::buffer(in_),
+            [self = shared_from_this()](beast::error_code ec, std::size_t n)
+            {
+                if (ec)
+                    return self->drop(ec, "relay read");
+
+                try {
+                    El3RelayMessageView msg;
+
+                    self->reader_.feed(self->in_, n);
+                    while (self->reader_.next(msg))
+                        self->on_message(msg);
+                } catch (const std::exception &e) {
+                    BOOST_LOG_SEV(lg, error) << "Relay link: " << e.what();
+                    return self->drop(net::error::invalid_argument, "relay protocol");
+                }
+
+                self->do_read();
+            });
+    }
+
+    void
+    on_message(const El3RelayMessageView &msg)
+    {
+        std::lock_guard<std::mutex> guard(relay_outbox_mutex);
+
+        if (msg.type == RELAY_WELCOME)
+        {
+            El3RelayWelcome welcome;
+            memcpy(&welcome, msg.body, sizeof(welcome));
+
+            relay_outbox->resume(welcome.lastSeq);
+            welcomed_ = true;
+        }
+        else if (msg.type == RELAY_ACK)
+        {
+            El3RelayAck ack;
+            memcpy(&ack, msg.body, sizeof(ack));
+
+            relay_outbox->ack(ack.seq);
+        }
+    }
+
+    // Batches everything not sent yet into one write
+    void
+    flush()
+    {
+        if (!connected_ || !welcomed_ || writing_)
+            return;
+
+        out_.clear();
+        {
+            std::lock_guard<std::mutex> guard(relay_outbox_mutex);
+            for (int i = 0; i < 8 && relay_outbox->batch(out_); i++)
+                ;
+        }
+
+        if (!out_.empty())
+            do_write();
+    }
+
+    void
+    do_write()
+    {
+        writing_ = true;
+
+        net::async_write(socket_, net::buffer(out_),
+            [self = shared_from_this()](beast::error_code ec, std::size_t)
+            {
+                self->writing_ = false;
+
+                if (ec)
+                    return self->drop(ec, "relay write");
+
+                self->flush();
+            });
+    }
+
+    // Records are sent as they arrive while the link keeps up, and in batches once it does not
+    void
+    do_flush_timer()
+    {
+        flush_timer_.expires_after(std::chrono::milliseconds(10));
+        flush_timer_.async_wait(
+            [self = shared_from_this()](beast::error_code ec)
+            {
+                if (ec)
+                    return;
+
+                self->flush();
+                self->do_flush_timer();
+            });
+    }
+
+    void
+    drop(beast::error_code ec, char const* what)
+    {
+        // the other pending operation fails too, one reconnect is enough
+        if (!connected_)
+            return;
+
+        connected_ = false;
+        welcomed_ = false;
+
+        beast::error_code ignored;
+        socket_.close(ignored);
+
+        retry(ec, what);
+    }
+
+    void
+    retry(beast::error_code ec, char const* what)
+    {
+        if (ec == net::error::operation_aborted)
+            return;
+
+        BOOST_LOG_SEV(lg, warning) << what << ": " << ec.message() << ", retrying";
+
+        retry_timer_.expires_after(std::chrono::seconds(1));
+        retry_timer_.async_wait(
+            [self = shared_from_this()](beast::error_code ec)
+            {
+                if (!ec)
+                    self->do_connect();
+            });
+    }
+};
+
+// Aggregator side of one relay link
+class relay_session : public std::enable_shared_from_this<relay_session>
+{
+    tcp::socket socket_;
+    El3RelayReader reader_;
+    unsigned char in_[16384];
+    std::string out_;
+    std::string queued_;
+    uint32_t sensor_ = 0;
+    uint64_t session_ = 0;
+    bool greeted_ = false;
+    bool writing_ = false;
+
+public:
+    explicit
+    relay_session(tcp::socket&& socket)
+        : socket_(std::move(socket))
+    {
+    }
+
+    ~relay_session()
+    {
+        if (greeted_)
+        {
+            std::lock_guard<std::mutex> guard(relay_mutex);
+            relay_peers.closed(sensor_, session_);
+        }
+    }
+
+    void
+    run()
+    {
+        socket_.set_option(tcp::no_delay(true));
+        do_read();
+    }
+
+private:
+    void
+    do_read()
+    {
+        socket_.async_read_some(net::buffer(in_),
+            beast::bind_front_handler(
+                &relay_session::on_read,
+                shared_from_this()));
+    }
+
+    void
+    on_read(beast::error_code ec, std::size_t n)
+    {
+        if (ec)
+        {
+            if (ec != net::error::eof && ec != net::error::operation_aborted)
+                fail(ec, "relay read");
+            if (greeted_)
+                BOOST_LOG_SEV(lg, info) << "Relay link from sensor " << sensor_ << " closed";
+            return;
+        }
+
+        uint64_t acked = 0;
+
+        try {
+            El3RelayMessageView msg;
+
+            reader_.feed(in_, n);
+            while (reader_.next(msg))
+                acked = std::max(acked, on_message(msg));
+        } catch (const std::exception &e) {
+            if (greeted_)
+                BOOST_LOG_SEV(lg, error) << "Relay link from sensor " << sensor_ << ": " << e.what();
+            else
+                BOOST_LOG_SEV(lg, error) << "Relay link refused: " << e.what();
+            return;
+        }
+
+        // One ack covers every batch of this read
+        if (acked)
+        {
+            El3RelayAck ack = { acked };
+            el3RelayMessage(queued_, RELAY_ACK, &ack, sizeof(ack));
+        }
+
+        do_write();
+        do_read();
+    }
+
+    // Returns the sequence number to acknowledge, if any
+    uint64_t
+    on_message(const El3RelayMessageView &msg)
+    {
+        if (msg.type == RELAY_HELLO && !greeted_)
+        {
+            El3RelayHello hello;
+            memcpy(&hello, msg.body, sizeof(hello));
+
+            if (memcmp(hello.magic, EL3_RELAY_MAGIC, sizeof(hello.magic)) ||
+                hello.version != EL3_RELAY_VERSION)
+                throw std::runtime_error("not an el3dec relay peer");
+
+            El3RelayWelcome welcome;
+            bool welcomed;
+            {
+                std::lock_guard<std::mutex> guard(relay_mutex);
+                welcomed = relay_peers.hello(hello, welcome.lastSeq);
+            }
 
-        if (ec == websocket::error::closed)
-            return;
+            // Two edges left with the same ID would mix up their acks and be fused as one sensor
+            if (!welcomed)
+                throw std::runtime_error("sensor " + std::to_string(hello.sensorId) +
+                    " is already connected with another session");
 
-        if (ec)
-            return fail(ec, "read");
+            sensor_ = hello.sensorId;
+            session_ = hello.session;
+            greeted_ = true;
+            el3RelayMessage(queued_, RELAY_WELCOME, &welcome, sizeof(welcome));
 
-        std::string instr(boost::asio::buffer_cast<const char*>(buffer_.data()), buffer_.size());
+            BOOST_LOG_SEV(lg, info) << boost::format("Relay link from sensor %u, resuming after %u")
+                % sensor_ % welcome.lastSeq;
+            return 0;
+        }
 
-        unsigned char bytes[256];
+        if (msg.type != RELAY_BATCH || !greeted_)
+            throw std::runtime_error("unexpected relay message");
 
-        if (buffer_.size() < sizeof(bytes))
-        {
-            memset(bytes, 0, sizeof(bytes));
+        El3RelayBatchHeader hdr;
+        memcpy(&hdr, msg.body, sizeof(hdr));
 
-            std::string hexdata = boost::algorithm::unhex(instr); 
-            std::copy(hexdata.begin(), hexdata.end(), bytes);
+        const unsigned char *records = msg.body + sizeof(hdr);
+        uint64_t now = steady_ms();
+        int64_t now_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        std::lock_guard<std::mutex> guard(relay_mutex);
 
-            BOOST_LOG_SEV(lg, debug) <<  boost::format("Recvd %u hex encoded bytes...") % buffer_.size();
+        // Only the last ones are new, the rest was resent after a reconnect
+        uint32_t fresh = relay_peers.receive(sensor_, hdr.firstSeq, hdr.count);
 
-            El3Telemetry *telemetry = el3Decode(bytes, buffer_.size(), FAULT_TOLERANT);
-            log_incoming_telemetry(telemetry);
+        for (uint32_t i = hdr.count - fresh; i < hdr.count; i++)
+        {
+            El3RelayRecord wire;
+            El3TelemetryRecord rec;
 
-            ws_.text(ws_.got_text());
-            ws_.async_write(
-            boost::asio::buffer(telemetry->toJson(false)),
-            beast::bind_front_handler(
-                &session::on_write,
-                shared_from_this()));
+            memcpy(&wire, records + i * sizeof(wire), sizeof(wire));
+            el3RelayUnpack(wire, rec);
+            relay_fusion->ingest(sensor_, rec, now);
+        }
 
-            delete telemetry;
+        // Reception counts by sensor come from the reports, UAV rollups from what they fuse into
+        if (aggregator)
+        {
+            std::lock_guard<std::mutex> stats_guard(aggregator_mutex);
+            for (uint32_t i = hdr.count - fresh; i < hdr.count; i++)
+                aggregator->receive(sensor_, now_ns);
         }
+
+        return relay_peers.lastSeq(sensor_);
     }
 
     void
-    on_write(
-        beast::error_code ec,
-        std::size_t bytes_transferred)
+    do_write()
     {
-        boost::ignore_unused(bytes_transferred);
+        if (writing_ || queued_.empty())
+            return;
 
-        if (ec)
-            return fail(ec, "write");
+        out_.swap(queued_);
+        queued_.clear();
+        writing_ = true;
 
-        // Clear the buffer
-        buffer_.consume(buffer_.size());
+        net::async_write(socket_, net::buffer(out_),
+            [self = shared_from_this()](beast::error_code ec, std::size_t)
+            {
+                self->writing_ = false;
 
-        // Do another read
-        do_read();
+                if (ec)
+                    return fail(ec, "relay write");
+
+                self->do_write();
+            });
     }
 };
 
-//------------------------------------------------------------------------------
-
-// Accepts incoming connections and launches the sessions
-class listener : public std::enable_shared_from_this<listener>
+// Accepts relay links from edge daemons
+class relay_listener : public std::enable_shared_from_this<relay_listener>
 {
     net::io_context& ioc_;
     tcp::acceptor acceptor_;
 
 public:
-    listener(
+    relay_listener(
         net::io_context& ioc,
         tcp::endpoint endpoint)
         : ioc_(ioc)
@@ -220,56 +1768,33 @@ public:
     {
         beast::error_code ec;
 
-        // Open the acceptor
         acceptor_.open(endpoint.protocol(), ec);
+        if(!ec)
+            acceptor_.set_option(net::socket_base::reuse_address(true), ec);
+        if(!ec)
+            acceptor_.bind(endpoint, ec);
+        if(!ec)
+            acceptor_.listen(net::socket_base::max_listen_connections, ec);
         if(ec)
-        {
-            fail(ec, "open");
-            return;
-        }
-
-        // Allow address reuse
-        acceptor_.set_option(net::socket_base::reuse_address(true), ec);
-        if(ec)
-        {
-            fail(ec, "set_option");
-            return;
-        }
-
-        // Bind to the server address
-        acceptor_.bind(endpoint, ec);
-        if(ec)
-        {
-            fail(ec, "bind");
-            return;
-        }
-
-        // Start listening for connections
-        acceptor_.listen(
-            net::socket_base::max_listen_connections, ec);
-        if(ec)
-        {
-            fail(ec, "listen");
-            return;
-        }
+            fail(ec, "relay listen");
     }
 
-    // Start accepting incoming connections
     void
     run()
     {
-        do_accept();
+        if (acceptor_.is_open())
+            do_accept();
     }
 
 private:
     void
     do_accept()
     {
-        // The new connection gets its own strand
+        // Every link gets its own strand
         acceptor_.async_accept(
             net::make_strand(ioc_),
             beast::bind_front_handler(
-                &listener::on_accept,
+                &relay_listener::on_accept,
                 shared_from_this()));
     }
 
@@ -277,21 +1802,45 @@ private:
     on_accept(beast::error_code ec, tcp::socket socket)
     {
         if(ec)
-        {
-            fail(ec, "accept");
-        }
+            fail(ec, "relay accept");
         else
-        {
-            BOOST_LOG_SEV(lg, info) << "Connection from " << socket.remote_endpoint().address().to_string();
-            // Create the session and run it
-            std::make_shared<session>(std::move(socket))->run();
-        }
+            std::make_shared<relay_session>(std::move(socket))->run();
 
-        // Accept another connection
         do_accept();
     }
 };
 
+// Fused records of the aggregator go to its track store, and further upstream when relaying too
+static void relay_fused(const std::vector<El3FusedRecord> &fused)
+{
+    int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+
+    {
+        std::lock_guard<std::mutex> guard(track_store_mutex);
+        for (auto &f : fused)
+            track_store.update(f.record, now);
+    }
+
+    if (aggregator)
+    {
+        std::lock_guard<std::mutex> guard(aggregator_mutex);
+        for (auto &f : fused)
+            aggregator->add(f.record, now);
+    }
+
+    if (relay_outbox)
+    {
+        std::lock_guard<std::mutex> guard(relay_outbox_mutex);
+        for (auto &f : fused)
+            relay_outbox->push(f.record, now);
+    }
+
+    for (auto &output : outputs)
+        for (auto &f : fused)
+            output->push(f.record, now);
+}
+
 //------------------------------------------------------------------------------
 
 static void init_logging(void)
@@ -323,11 +1872,32 @@ int main(int argc, char* argv[])
     server_opts.add_options()
         ("address", po::value<std::string>(), "address (to listen for connections)")
         ("port", po::value<int>(), "port")
+        ("udp-port", po::value<int>(), "also take raw frames over UDP on this port")
+        ("busy-poll", po::value<std::string>(),
+            "take --udp-port frames on threads spinning on these CPUs (2,3 or 4-7), memory locked")
+        ("shm-ring", po::value<std::string>(), "also take raw frames from this shared memory ring")
+        ("relay-to", po::value<std::string>(), "forward decoded records to an aggregator (host:port)")
+        ("relay-port", po::value<int>(), "aggregate the records edge daemons relay to this port")
         ;
 
     po::options_description extra_opts("Backend options");
     extra_opts.add_options()
         ("num-threads", po::value<int>(), "the initial number of threads")
+        ("track-filter", po::value<std::string>(), "check fixes against their track: flag, or suppress glitches everywhere")
+        ("capture-file", po::value<std::string>(), "record every frame received to a capture archive")
+        ("capture-io", po::value<std::string>(), "capture writes: auto, buffered, uring or direct (O_DIRECT)")
+        ("sensor-id", po::value<unsigned>(), "sensor ID recorded with captured and relayed frames")
+        ("query-archive", po::value<std::vector<std::string>>()->composing(),
+            "capture archive, or directory of them, track queries search besides the capture file (repeatable)")
+        ("snapshot-file", po::value<std::string>(), "keep live state here across restarts")
+        ("snapshot-interval", po::value<unsigned>(), "seconds between snapshots (60), 0 for on exit only")
+        ("trace-sample", po::value<unsigned>(), "trace the stages of one frame in N, per thread")
+        ("trace-file", po::value<std::string>(), "Chrome trace JSON written on SIGUSR1 (el3dec_trace.json)")
+        ("output", po::value<std::vector<std::string>>()->composing(),
+            "also send decoded records to file:PATH, tcp:HOST:PORT or amqp:HOST:PORT (repeatable)")
+        ("stats-window", po::value<unsigned>(), "roll up UAVs, sensors and coverage over windows of N seconds")
+        ("stats-slide", po::value<unsigned>(), "seconds between windows, less than the window to slide (tumbling)")
+        ("stats-file", po::value<std::string>(), "append each closed window as a JSON line here, else log it")
         ;
 
     po::options_description all_opts("Allowed options");
@@ -348,9 +1918,177 @@ int main(int argc, char* argv[])
         return EXIT_SUCCESS;
     }
 
+    if (vm.count("track-filter"))
+    {
+        El3TrackFilterConfig filterConfig;
+        std::string policy = vm["track-filter"].as<std::string>();
+
+        if (policy != "flag" && policy != "suppress")
+        {
+            std::cerr << "Unknown track filter policy: " << policy << "\n";
+            return EXIT_FAILURE;
+        }
+
+        filterConfig.suppress = (policy == "suppress");
+        track_filter.reset(new El3TrackFilter(filterConfig));
+    }
+
+    if (vm.count("sensor-id"))
+        capture_sensor_id = vm["sensor-id"].as<unsigned>();
+
+    if (vm.count("capture-file"))
+    {
+        El3CaptureIoConfig io;
+
+        if (vm.count("capture-io") && !el3ParseCaptureIo(vm["capture-io"].as<std::string>(), io))
+        {
+            std::cerr << "Unknown capture I/O mode: " << vm["capture-io"].as<std::string>() << "\n";
+            return EXIT_FAILURE;
+        }
+
+        try {
+            capture_path = vm["capture-file"].as<std::string>();
+            capture.reset(new El3CaptureWriter(capture_path, EL3_CAPTURE_DEFAULT_BLOCK, io));
+            capturing = true;
+        } catch (const std::exception &e) {
+            std::cerr << e.what() << "\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (vm.count("query-archive"))
+        query_archives = vm["query-archive"].as<std::vector<std::string>>();
+
+    // Queries stream through a few buffers of their own, bypassing the page cache along with captures
+    if (vm.count("capture-io") && !el3ParseCaptureIo(vm["capture-io"].as<std::string>(), query_io))
+    {
+        std::cerr << "Unknown capture I/O mode: " << vm["capture-io"].as<std::string>() << "\n";
+        return EXIT_FAILURE;
+    }
+
+    query_io.depth = 4;
+    query_io.bufferSize = 256 * 1024;
+
+    if (vm.count("output"))
+    {
+        try {
+            for (auto &spec : vm["output"].as<std::vector<std::string>>())
+                outputs.push_back(el3OutputSink(spec));
+        } catch (const std::exception &e) {
+            std::cerr << e.what() << "\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (vm.count("stats-window"))
+    {
+        El3AggregateConfig statsConfig;
+
+        statsConfig.windowMs = vm["stats-window"].as<unsigned>() * 1000;
+        statsConfig.slideMs = vm.count("stats-slide") ? vm["stats-slide"].as<unsigned>() * 1000
+            : statsConfig.windowMs;
+
+        try {
+            aggregator.reset(new El3Aggregator(statsConfig));
+        } catch (const std::exception &e) {
+            std::cerr << e.what() << "\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::vector<int> busy_cpus;
+
+    if (vm.count("busy-poll"))
+    {
+        if (!vm.count("udp-port"))
+        {
+            std::cerr << "Busy polling takes frames from --udp-port\n";
+            return EXIT_FAILURE;
+        }
+
+        if (!parse_cpu_list(vm["busy-poll"].as<std::string>(), busy_cpus))
+        {
+            std::cerr << "Bad CPU list: " << vm["busy-poll"].as<std::string>() << "\n";
+            return EXIT_FAILURE;
+        }
+
+        // Everything else keeps off the ingest cores, the threads started from here on inherit this
+        cpu_set_t others;
+
+        if (sched_getaffinity(0, sizeof(others), &others) == 0)
+        {
+            for (int cpu : busy_cpus)
+                CPU_CLR(cpu, &others);
+
+            if (CPU_COUNT(&others))
+                sched_setaffinity(0, sizeof(others), &others);
+        }
+    }
+
+    std::ofstream stats_file;
+
+    if (aggregator && vm.count("stats-file"))
+    {
+        stats_file.open(vm["stats-file"].as<std::string>(), std::ios::app);
+
+        if (!stats_file)
+        {
+            std::cerr << "Cannot open " << vm["stats-file"].as<std::string>() << "\n";
+            return EXIT_FAILURE;
+        }
+    }
+
     init_logging();
     logging::add_common_attributes();
 
+    // No page faults on the ingest path. Locked memory counts against RLIMIT_MEMLOCK, which would then
+    // fail allocations later on, so without room for all of it memory stays unlocked
+    if (!busy_cpus.empty())
+    {
+        struct rlimit memlock;
+
+        if (geteuid() != 0 && (getrlimit(RLIMIT_MEMLOCK, &memlock) < 0 || memlock.rlim_cur != RLIM_INFINITY))
+            BOOST_LOG_SEV(lg, warning) << "Memory not locked for busy polling, it needs ulimit -l unlimited";
+        else if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0)
+            BOOST_LOG_SEV(lg, warning) << "Cannot lock memory for busy polling: " << strerror(errno);
+    }
+
+    for (auto &output : outputs)
+    {
+        output->start();
+        BOOST_LOG_SEV(lg, info) << "Output to " << output->name();
+    }
+
+    std::string snapshot_file = vm.count("snapshot-file") ? vm["snapshot-file"].as<std::string>() : "";
+    unsigned snapshot_interval = vm.count("snapshot-interval") ? vm["snapshot-interval"].as<unsigned>() : 60;
+
+    if (!snapshot_file.empty() && access(snapshot_file.c_str(), F_OK) == 0)
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        try {
+            El3SnapshotReader snapshot(snapshot_file);
+            snapshot.restore(track_store, track_filter.get());
+
+            BOOST_LOG_SEV(lg, info) << boost::format("Restored %u tracks from %s in %.1f ms")
+                % track_store.size() % snapshot_file
+                % (std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        } catch (const std::exception &e) {
+            // Starting empty beats not starting
+            BOOST_LOG_SEV(lg, warning) << "Snapshot ignored: " << e.what();
+        }
+    }
+
+    // Idle subscribers cost little besides their descriptor, take all the hard limit allows
+    struct rlimit nofile;
+
+    if (getrlimit(RLIMIT_NOFILE, &nofile) == 0 && nofile.rlim_cur < nofile.rlim_max)
+    {
+        nofile.rlim_cur = nofile.rlim_max;
+        if (setrlimit(RLIMIT_NOFILE, &nofile) < 0)
+            BOOST_LOG_SEV(lg, warning) << "Cannot raise the open file limit: " << strerror(errno);
+    }
+
     auto const address = net::ip::make_address(vm["address"].as<std::string>());
     auto const port = static_cast<unsigned short>(vm["port"].as<int>());
     auto const threads = std::max<int>(1, vm["num-threads"].as<int>());
@@ -358,14 +2096,273 @@ int main(int argc, char* argv[])
     // The io_context is required for all I/O
     net::io_context ioc{threads};
 
+    query_pool = std::make_unique<net::thread_pool>(QUERY_THREADS);
+
     // Create and launch a listening port
     std::make_shared<listener>(ioc, tcp::endpoint{address, port})->run();
 
+    std::atomic<bool> busy_running(true);
+    std::vector<std::thread> busy_threads;
+    std::vector<int> busy_fds;
+
+    if (vm.count("udp-port"))
+    {
+        auto const udp_port = static_cast<unsigned short>(vm["udp-port"].as<int>());
+
+        if (busy_cpus.empty())
+            std::make_shared<udp_listener>(ioc, udp::endpoint{address, udp_port})->run();
+
+        for (size_t i = 0; i < busy_cpus.size(); i++)
+        {
+            int fd = open_busy_poll_socket(udp::endpoint{address, udp_port});
+
+            if (fd < 0)
+            {
+                std::cerr << "Cannot open the busy-poll socket: " << strerror(errno) << "\n";
+                return EXIT_FAILURE;
+            }
+
+            busy_fds.push_back(fd);
+        }
+
+        for (size_t i = 0; i < busy_cpus.size(); i++)
+            busy_threads.emplace_back(busy_poll_loop, busy_fds[i], busy_cpus[i], &busy_running);
+
+        if (!busy_cpus.empty())
+            BOOST_LOG_SEV(lg, info) << boost::format("Busy polling UDP port %u on %u CPUs")
+                % udp_port % busy_cpus.size();
+    }
+
+    std::shared_ptr<relay_client> relay;
+    net::steady_timer fusion_timer(ioc);
+
+    if (vm.count("relay-to"))
+    {
+        std::string upstream = vm["relay-to"].as<std::string>();
+        size_t colon = upstream.rfind(':');
+
+        if (colon == std::string::npos)
+        {
+            std::cerr << "Relay target must be host:port\n";
+            return EXIT_FAILURE;
+        }
+
+        // The aggregator tells edges apart by their ID, the default would be shared
+        if (!vm.count("sensor-id"))
+        {
+            std::cerr << "Relaying needs a --sensor-id of its own\n";
+            return EXIT_FAILURE;
+        }
+
+        relay_outbox.reset(new El3RelayOutbox(capture_sensor_id));
+        relay = std::make_shared<relay_client>(ioc, upstream.substr(0, colon), upstream.substr(colon + 1));
+        relay->run();
+    }
+
+    // Fused records leave the aggregator once their window expired
+    std::function<void(beast::error_code const&)> poll_fusion =
+        [&](beast::error_code const& ec)
+        {
+            if (ec)
+                return;
+
+            std::vector<El3FusedRecord> fused;
+            {
+                std::lock_guard<std::mutex> guard(relay_mutex);
+                relay_fusion->poll(steady_ms(), fused);
+            }
+
+            if (!fused.empty())
+                relay_fused(fused);
+
+            fusion_timer.expires_after(std::chrono::milliseconds(50));
+            fusion_timer.async_wait(poll_fusion);
+        };
+
+    if (vm.count("relay-port"))
+    {
+        auto const relay_port = static_cast<unsigned short>(vm["relay-port"].as<int>());
+
+        relay_fusion.reset(new El3Fusion());
+        std::make_shared<relay_listener>(ioc, tcp::endpoint{address, relay_port})->run();
+
+        fusion_timer.expires_after(std::chrono::milliseconds(50));
+        fusion_timer.async_wait(poll_fusion);
+    }
+
+    std::unique_ptr<El3ShmRingReader> shm_ring;
+    std::atomic<bool> shm_running(true);
+    std::thread shm_thread;
+
+    if (vm.count("shm-ring"))
+    {
+        try {
+            shm_ring.reset(new El3ShmRingReader(vm["shm-ring"].as<std::string>()));
+        } catch (const std::exception &e) {
+            std::cerr << e.what() << "\n";
+            return EXIT_FAILURE;
+        }
+
+        shm_thread = std::thread(shm_ring_loop, shm_ring.get(), &shm_running);
+    }
+
+    std::string trace_file = vm.count("trace-file") ? vm["trace-file"].as<std::string>()
+        : "el3dec_trace.json";
+    net::signal_set trace_signal(ioc, SIGUSR1);
+
+    if (vm.count("trace-sample"))
+        el3TraceSampling(vm["trace-sample"].as<unsigned>());
+
+    // Dumps what the trace buffers hold, and keeps listening for the next request
+    std::function<void(beast::error_code const&, int)> dump_trace =
+        [&](beast::error_code const& ec, int)
+        {
+            if (ec)
+                return;
+
+            if (el3TraceDump(trace_file))
+                BOOST_LOG_SEV(lg, info) << "Trace written to " << trace_file;
+            else
+                BOOST_LOG_SEV(lg, error) << "Cannot write the trace to " << trace_file;
+
+            trace_signal.async_wait(dump_trace);
+        };
+
+    trace_signal.async_wait(dump_trace);
+
+    // Periodic snapshots come from a forked child, the fork is all ingest waits for
+    net::steady_timer snapshot_timer(ioc);
+    pid_t snapshot_child = -1;
+
+    std::function<void(beast::error_code const&)> take_snapshot =
+        [&](beast::error_code const& ec)
+        {
+            if (ec)
+                return;
+
+            if (snapshot_child > 0 && waitpid(snapshot_child, NULL, WNOHANG) == snapshot_child)
+                snapshot_child = -1;
+
+            // A snapshot still being written is not interrupted, the next tick tries again
+            if (snapshot_child < 0)
+            {
+                std::lock_guard<std::mutex> filter_guard(track_filter_mutex);
+                std::lock_guard<std::mutex> store_guard(track_store_mutex);
+
+                snapshot_child = el3ForkSnapshot(snapshot_file, track_store, track_filter.get());
+            }
+
+            if (snapshot_child < 0)
+                BOOST_LOG_SEV(lg, error) << "Cannot fork for a snapshot: " << strerror(errno);
+
+            snapshot_timer.expires_after(std::chrono::seconds(snapshot_interval));
+            snapshot_timer.async_wait(take_snapshot);
+        };
+
+    if (!snapshot_file.empty() && snapshot_interval)
+    {
+        snapshot_timer.expires_after(std::chrono::seconds(snapshot_interval));
+        snapshot_timer.async_wait(take_snapshot);
+    }
+
+    // Sinks fail quietly in their own threads, what they report is logged here
+    net::steady_timer output_timer(ioc);
+
+    std::function<void(beast::error_code const&)> check_outputs =
+        [&](beast::error_code const& ec)
+        {
+            if (ec)
+                return;
+
+            for (auto &output : outputs)
+            {
+                std::string error = output->lastError();
+
+                if (!error.empty())
+                    BOOST_LOG_SEV(lg, warning) << boost::format("Output to %s failing (%u records dropped): %s")
+                        % output->name() % output->counters().dropped % error;
+            }
+
+            output_timer.expires_after(std::chrono::seconds(10));
+            output_timer.async_wait(check_outputs);
+        };
+
+    if (!outputs.empty())
+    {
+        output_timer.expires_after(std::chrono::seconds(10));
+        output_timer.async_wait(check_outputs);
+    }
+
+    // Windows close as the clock passes their end, packets or not
+    net::steady_timer stats_timer(ioc);
+
+    auto emit_windows = [&](std::vector<El3WindowSummary> &windows)
+    {
+        for (auto &summary : windows)
+        {
+            if (stats_file.is_open())
+            {
+                rapidjson::StringBuffer strbuf;
+                rapidjson::Writer<rapidjson::StringBuffer> writer(strbuf);
+
+                el3WriteJson(summary, writer);
+                stats_file << strbuf.GetString() << "\n";
+                continue;
+            }
+
+            time_t start = summary.startNs / 1000000000;
+            struct tm tm;
+            char stamp[32];
+
+            gmtime_r(&start, &tm);
+            strftime(stamp, sizeof(stamp), "%H:%M:%S", &tm);
+
+            BOOST_LOG_SEV(lg, info) << boost::format("Window from %s UTC (%u s): %u packets, %u UAVs, %u sensors, %u cells")
+                % stamp % ((summary.endNs - summary.startNs) / 1000000000) % summary.packets
+                % summary.uavs.size() % summary.sensors.size() % summary.cells.size();
+        }
+
+        stats_file.flush();
+    };
+
+    std::function<void(beast::error_code const&)> close_windows =
+        [&](beast::error_code const& ec)
+        {
+            if (ec)
+                return;
+
+            int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+            std::vector<El3WindowSummary> windows;
+            {
+                std::lock_guard<std::mutex> guard(aggregator_mutex);
+                aggregator->advance(now, windows);
+            }
+
+            emit_windows(windows);
+
+            stats_timer.expires_after(std::chrono::seconds(1));
+            stats_timer.async_wait(close_windows);
+        };
+
+    if (aggregator)
+    {
+        stats_timer.expires_after(std::chrono::seconds(1));
+        stats_timer.async_wait(close_windows);
+    }
+
     net::signal_set signals(ioc, SIGINT, SIGTERM);
     signals.async_wait(
         [&](beast::error_code const&, int)
         {
             BOOST_LOG_SEV(lg, info) << "Exiting...";
+            trace_signal.cancel();
+            snapshot_timer.cancel();
+            fusion_timer.cancel();
+            output_timer.cancel();
+            stats_timer.cancel();
+            if (relay)
+                relay->stop();
             // Stop the `io_context`. This will cause `run()`
             // to return immediately, eventually destroying the
             // `io_context` and all of the sockets in it.
@@ -389,5 +2386,57 @@ int main(int argc, char* argv[])
     for(auto& t : v)
         t.join();
 
+    // Queries still running are dropped, the sessions they answer are gone
+    query_pool->stop();
+    query_pool->join();
+
+    shm_running = false;
+    if (shm_thread.joinable())
+        shm_thread.join();
+
+    busy_running = false;
+    for (auto &t : busy_threads)
+        t.join();
+    for (int fd : busy_fds)
+        close(fd);
+
+    // Writes the capture index
+    capture.reset();
+
+    if (relay_fusion)
+    {
+        std::vector<El3FusedRecord> fused;
+
+        relay_fusion->flush(fused);
+        relay_fused(fused);
+    }
+
+    // What the sinks still queue is written out, unless their destination stays gone
+    for (auto &output : outputs)
+    {
+        output->stop();
+
+        El3OutputCounters counters = output->counters();
+        BOOST_LOG_SEV(lg, info) << boost::format("Output to %s: %u records written, %u dropped")
+            % output->name() % counters.written % counters.dropped;
+
+        if (!output->lastError().empty())
+            BOOST_LOG_SEV(lg, warning) << "Output to " << output->name() << " failing: " << output->lastError();
+    }
+
+    // Ingest has stopped, the final snapshot is written in place
+    if (!snapshot_file.empty())
+    {
+        if (snapshot_child > 0)
+            waitpid(snapshot_child, NULL, 0);
+
+        if (el3WriteSnapshot(snapshot_file, track_store, track_filter.get()))
+            BOOST_LOG_SEV(lg, info) << boost::format("Snapshot of %u tracks written to %s")
+                % track_store.size() % snapshot_file;
+        else
+            BOOST_LOG_SEV(lg, error) << "Cannot write the snapshot to " << snapshot_file << ": "
+                << strerror(errno);
+    }
+
     return EXIT_SUCCESS;
 }
\ No newline at end of file
@@ -0,0 +1,970 @@
+/*
+ * Copyright (c) 2022 Subreption LLC. All rights reserved.
+ * Author: 12dc8242df1be0d6f4b73d68166552197936a27074c004c8af95b27194ec584d
+ *
+ * Dual-licensed under the Subreption Ukraine Defense License (SUDL, version 1) and the  Server Side
+ * Public License (SSPL, version 3). Both licenses are provided with this software distribution.
+ */
+
+#include <boost/beast/core.hpp>
+#include <boost/beast/websocket.hpp>
+#include <boost/asio/ip/udp.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/strand.hpp>
+#include <boost/program_options.hpp>
+#include <el3dec/capture.hpp>
+#include <el3dec/layout.hpp>
+#include <el3dec/telemetry.hpp>
+#include <el3dec/utils.hpp>
+#include "rapidjson/prettywriter.h"
+#include "rapidjson/stringbuffer.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace po = boost::program_options;
+namespace beast = boost::beast;
+namespace websocket = beast::websocket;
+namespace net = boost::asio;
+using tcp = net::ip::tcp;
+using udp = net::ip::udp;
+using steady = std::chrono::steady_clock;
+
+// How long outstanding replies are waited for once the run is over
+#define DRAIN_TIMEOUT_MS 2000
+
+// How long a reply is waited for before its frame counts as lost
+#define REPLY_TIMEOUT_MS 2000
+
+// Reply token of a frame the replay cannot decode itself; the daemon answers it with an error
+#define NO_TOKEN UINT32_MAX
+
+//------------------------------------------------------------------------------
+
+/*
+ * Log-linear latency histogram: exact below 64 ns, then 32 sub-buckets per power of two (about 3%
+ * resolution). Constant size no matter how long the run, and cheap to merge across connections.
+ */
+class LatencyHistogram
+{
+    static const unsigned SUB_BUCKETS = 32;
+
+    std::vector<uint64_t> counts_;
+    uint64_t samples_;
+    uint64_t sum_;
+    uint64_t min_;
+    uint64_t max_;
+
+    static size_t
+    index(uint64_t ns)
+    {
+        if (ns < 2 * SUB_BUCKETS)
+            return ns;
+
+        unsigned shift = 63 - __builtin_clzll(ns) - 5;
+
+        return 2 * SUB_BUCKETS + (shift - 1) * SUB_BUCKETS + ((ns >> shift) - SUB_BUCKETS);
+    }
+
+    static uint64_t
+    midpoint(size_t idx)
+    {
+        if (idx < 2 * SUB_BUCKETS)
+            return idx;
+
+        unsigned shift = (idx - 2 * SUB_BUCKETS) / SUB_BUCKETS + 1;
+        uint64_t top = (idx - 2 * SUB_BUCKETS) % SUB_BUCKETS + SUB_BUCKETS;
+
+        return (top << shift) + (1ULL << (shift - 1));
+    }
+
+public:
+    LatencyHistogram()
+        : counts_(2 * SUB_BUCKETS + 58 * SUB_BUCKETS), samples_(0), sum_(0), min_(UINT64_MAX), max_(0)
+    {
+    }
+
+    void
+    record(uint64_t ns)
+    {
+        counts_[index(ns)]++;
+        samples_++;
+        sum_ += ns;
+        min_ = std::min(min_, ns);
+        max_ = std::max(max_, ns);
+    }
+
+    void
+    merge(const LatencyHistogram &other)
+    {
+        for (size_t i = 0; i < counts_.size(); i++)
+            counts_[i] += other.counts_[i];
+
+        samples_ += other.samples_;
+        sum_ += other.sum_;
+        min_ = std::min(min_, other.min_);
+        max_ = std::max(max_, other.max_);
+    }
+
+    uint64_t samples() const { return samples_; }
+    uint64_t min() const { return samples_ ? min_ : 0; }
+    uint64_t max() const { return max_; }
+    double mean() const { return samples_ ? (double) sum_ / samples_ : 0; }
+
+    uint64_t
+    percentile(double p) const
+    {
+        uint64_t rank = (uint64_t) (p / 100.0 * samples_ + 0.5), seen = 0;
+
+        for (size_t i = 0; i < counts_.size(); i++)
+        {
+            seen += counts_[i];
+
+            if (seen && seen >= rank)
+                return std::min(std::max(midpoint(i), min()), max_);
+        }
+
+        return max_;
+    }
+};
+
+//------------------------------------------------------------------------------
+
+enum Transport {
+    TRANSPORT_WEBSOCKET,
+    TRANSPORT_UDP
+};
+
+struct ReplayConfig {
+    Transport transport;
+    net::ip::address address;
+    unsigned short port;
+    unsigned connections;
+    unsigned uavs;
+    unsigned uavBase;
+    double rate;                /* frames/s over all connections, 0 for as fast as possible */
+    unsigned pipeline;          /* replies awaited per connection when unpaced */
+    double duration;            /* seconds, 0 for no limit */
+    uint64_t count;             /* frames, 0 for no limit */
+};
+
+// Shared by every connection: the corpus, the frame budget and the stop flag
+struct ReplayState {
+    const ReplayConfig &config;
+    std::vector<std::vector<unsigned char>> corpus;
+    std::vector<uint32_t> flightTimes;      /* per corpus frame, NO_TOKEN if it does not decode */
+    std::atomic<uint64_t> budget;
+    std::atomic<bool> stopping;
+
+    explicit ReplayState(const ReplayConfig &cfg)
+        : config(cfg), budget(cfg.count ? cfg.count : UINT64_MAX), stopping(false)
+    {
+    }
+
+    bool
+    take()
+    {
+        if (stopping)
+            return false;
+
+        uint64_t left = budget.load();
+
+        do {
+            if (!left)
+                return false;
+        } while (!budget.compare_exchange_weak(left, left - 1));
+
+        return true;
+    }
+};
+
+/*
+ * Frames for the UAVs a connection plays, round robin. Every UAV walks the corpus from its own
+ * starting point under its own ID, so the stream interleaves flights at different stages the way a
+ * receiver covering several UAVs sees them.
+ */
+class FrameSource
+{
+    struct Uav {
+        uint16_t id;
+        size_t cursor;
+    };
+
+    const std::vector<std::vector<unsigned char>> &corpus_;
+    const std::vector<uint32_t> &flightTimes_;
+    std::vector<Uav> uavs_;
+    size_t next_;
+
+public:
+    FrameSource(const ReplayState &state, unsigned connection)
+        : corpus_(state.corpus), flightTimes_(state.flightTimes), next_(0)
+    {
+        const ReplayConfig &cfg = state.config;
+
+        for (unsigned k = connection; k < cfg.uavs; k += cfg.connections)
+            uavs_.push_back(Uav{ (uint16_t) (cfg.uavBase + k), k * corpus_.size() / cfg.uavs });
+
+        // more connections than UAVs: several receivers reporting the same UAV
+        if (uavs_.empty())
+        {
+            unsigned k = connection % cfg.uavs;
+            uavs_.push_back(Uav{ (uint16_t) (cfg.uavBase + k), k * corpus_.size() / cfg.uavs });
+        }
+    }
+
+    // Copy the next frame to out, with the token its reply will carry (see replyToken)
+    size_t
+    next(unsigned char *out, uint32_t &token)
+    {
+        Uav &uav = uavs_[next_++ % uavs_.size()];
+        size_t index = uav.cursor++ % corpus_.size();
+        const std::vector<unsigned char> &frame = corpus_[index];
+
+        token = flightTimes_[index] == NO_TOKEN ? NO_TOKEN : (uint32_t) uav.id << 16 | flightTimes_[index];
+
+        std::copy(frame.begin(), frame.end(), out);
+
+        if (frame.size() > 4)
+        {
+            out[3] = uav.id >> 8;
+            out[4] = uav.id & 0xff;
+        }
+
+        return frame.size();
+    }
+};
+
+// Integer value of a key in the daemon's compact JSON, false if it is missing
+static bool jsonInt(const char *data, size_t len, const char *key, long &value)
+{
+    size_t keylen = strlen(key);
+    const char *end = data + len;
+
+    for (const char *p = data; (p = (const char *) memmem(p, end - p, key, keylen)); p += keylen)
+    {
+        if (p + keylen < end && p[keylen] == ':')
+        {
+            // the reply is not terminated, copy the number out
+            char digits[16] = { 0 };
+            char *stop;
+
+            memcpy(digits, p + keylen + 1, std::min<size_t>(sizeof(digits) - 1, end - p - keylen - 1));
+            value = strtol(digits, &stop, 10);
+            return stop != digits;
+        }
+    }
+
+    return false;
+}
+
+// The UAV ID and flight time a decoded fix echoes back, NO_TOKEN for an error reply
+static uint32_t replyToken(const char *data, size_t len)
+{
+    long id, flightTime = 0;
+
+    if (!jsonInt(data, len, "\"uav_id\"", id))
+        return NO_TOKEN;
+
+    // zero flight times are left out
+    jsonInt(data, len, "\"flight_time\"", flightTime);
+
+    return (uint32_t) id << 16 | (uint16_t) flightTime;
+}
+
+//------------------------------------------------------------------------------
+
+/*
+ * One client connection. Paced runs send on a fixed schedule and time each reply from the moment
+ * its frame was due, not from when it went out, so a stalled daemon cannot hide its backlog
+ * (coordinated omission). Unpaced runs keep `pipeline` frames in flight. Replies are matched to
+ * the oldest frame in flight with the same UAV ID and flight time, error replies to the oldest the
+ * replay could not decode either, so a datagram lost or reordered on UDP does not shift the
+ * latency of every reply after it. Frames left unanswered for REPLY_TIMEOUT_MS count as lost.
+ */
+class Client
+{
+protected:
+    ReplayState &state_;
+    FrameSource source_;
+    net::steady_timer timer_;
+
+    struct Pending {
+        steady::time_point due;
+        uint32_t token;
+    };
+
+    std::deque<Pending> inflight_;
+    steady::time_point nextDue_;
+    steady::duration interval_;
+    std::atomic<bool> finished_;
+
+public:
+    LatencyHistogram latency;
+    uint64_t sent;
+    uint64_t received;
+    uint64_t errors;
+    uint64_t expired;
+    steady::time_point lastReply;
+
+    Client(ReplayState &state, unsigned connection, net::any_io_executor ex)
+        : state_(state), source_(state, connection), timer_(ex), finished_(false),
+          sent(0), received(0), errors(0), expired(0)
+    {
+        double perConnection = state.config.rate / state.config.connections;
+
+        interval_ = perConnection > 0 ?
+            std::chrono::duration_cast<steady::duration>(std::chrono::duration<double>(1.0 / perConnection)) :
+            steady::duration::zero();
+    }
+
+    virtual ~Client() {}
+
+    bool finished() const { return finished_; }
+
+protected:
+    virtual void send(const unsigned char *frame, size_t len) = 0;
+    virtual void shutdown() = 0;
+
+    bool paced() const { return interval_ != steady::duration::zero(); }
+
+    void
+    connected()
+    {
+        nextDue_ = steady::now();
+
+        if (paced())
+            tick();
+        else
+            for (unsigned i = 0; i < state_.config.pipeline; i++)
+                sendNext(steady::now());
+    }
+
+    bool
+    sendNext(steady::time_point due)
+    {
+        unsigned char frame[EL3_MAX_FRAME_BYTES];
+        uint32_t token;
+
+        if (!state_.take())
+            return false;
+
+        size_t len = source_.next(frame, token);
+
+        inflight_.push_back(Pending{ due, token });
+        sent++;
+        send(frame, len);
+
+        return true;
+    }
+
+    void
+    tick()
+    {
+        expire(steady::now());
+
+        if (!sendNext(nextDue_))
+            return maybeFinish();
+
+        nextDue_ += interval_;
+
+        timer_.expires_at(nextDue_);
+        timer_.async_wait([this](beast::error_code ec)
+            {
+                if (!ec)
+                    tick();
+            });
+    }
+
+    // Give up on frames unanswered for too long; frames are in flight in the order they were due
+    void
+    expire(steady::time_point now)
+    {
+        steady::time_point limit = now - std::chrono::milliseconds(REPLY_TIMEOUT_MS);
+
+        while (!inflight_.empty() && inflight_.front().due < limit)
+        {
+            inflight_.pop_front();
+            expired++;
+
+            if (!paced())
+                sendNext(now);
+        }
+    }
+
+    void
+    replied(const char *data, size_t len)
+    {
+        steady::time_point now = steady::now();
+        uint32_t token = replyToken(data, len);
+        auto match = std::find_if(inflight_.begin(), inflight_.end(),
+            [token](const Pending &p) { return p.token == token; });
+
+        // the daemon may reject a frame the replay decodes, an error reply then takes the oldest
+        if (match == inflight_.end() && token == NO_TOKEN && !inflight_.empty())
+            match = inflight_.begin();
+
+        // late, after its frame expired
+        if (match == inflight_.end())
+        {
+            errors++;
+            return;
+        }
+
+        latency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(now - match->due).count());
+        inflight_.erase(match);
+        received++;
+        lastReply = now;
+
+        if (!len || data[0] != '{' || token == NO_TOKEN)
+            errors++;
+
+        expire(now);
+
+        if (!paced())
+            sendNext(now);
+
+        maybeFinish();
+    }
+
+    void
+    failed(beast::error_code ec, const char *what)
+    {
+        if (!state_.stopping)
+            std::cerr << what << ": " << ec.message() << "\n";
+
+        errors++;
+        finish();
+    }
+
+    void
+    maybeFinish()
+    {
+        bool exhausted = state_.stopping || !state_.budget;
+
+        if (exhausted && inflight_.empty())
+            finish();
+    }
+
+    void
+    finish()
+    {
+        if (finished_)
+            return;
+
+        finished_ = true;
+        timer_.cancel();
+        shutdown();
+    }
+
+public:
+    // Give up on replies still outstanding once the drain period is over
+    void
+    abandon()
+    {
+        finish();
+    }
+};
+
+class WebsocketClient : public Client
+{
+    websocket::stream<beast::tcp_stream> ws_;
+    beast::flat_buffer buffer_;
+    std::deque<std::string> queue_;
+    std::string host_;
+
+public:
+    WebsocketClient(ReplayState &state, unsigned connection, net::io_context &ioc)
+        : WebsocketClient(state, connection, net::make_strand(ioc))
+    {
+    }
+
+    void
+    start()
+    {
+        net::dispatch(ws_.get_executor(), [this]
+            {
+                beast::get_lowest_layer(ws_).async_connect(
+                    tcp::endpoint{ state_.config.address, state_.config.port },
+                    [this](beast::error_code ec) { on_connect(ec); });
+            });
+    }
+
+    void
+    stop()
+    {
+        net::dispatch(ws_.get_executor(), [this] { maybeFinish(); });
+    }
+
+    void
+    abandonAll()
+    {
+        net::dispatch(ws_.get_executor(), [this] { abandon(); });
+    }
+
+private:
+    WebsocketClient(ReplayState &state, unsigned connection, net::strand<net::io_context::executor_type> ex)
+        : Client(state, connection, ex), ws_(ex)
+    {
+        host_ = state.config.address.to_string() + ":" + std::to_string(state.config.port);
+    }
+
+    void
+    on_connect(beast::error_code ec)
+    {
+        if (ec)
+            return failed(ec, "connect");
+
+        beast::get_lowest_layer(ws_).expires_never();
+        ws_.set_option(websocket::stream_base::timeout::suggested(beast::role_type::client));
+        ws_.async_handshake(host_, "/", [this](beast::error_code ec) { on_handshake(ec); });
+    }
+
+    void
+    on_handshake(beast::error_code ec)
+    {
+        if (ec)
+            return failed(ec, "handshake");
+
+        ws_.text(true);
+        do_read();
+        connected();
+    }
+
+    void
+    send(const unsigned char *frame, size_t len) override
+    {
+        static const char tab[] = "0123456789abcdef";
+        std::string hex(len * 2, 0);
+
+        for (size_t i = 0; i < len; i++)
+        {
+            hex[i * 2] = tab[frame[i] >> 4];
+            hex[i * 2 + 1] = tab[frame[i] & 0x0f];
+        }
+
+        queue_.push_back(std::move(hex));
+
+        // one write at a time on a websocket stream
+        if (queue_.size() == 1)
+            do_write();
+    }
+
+    void
+    do_write()
+    {
+        ws_.async_write(net::buffer(queue_.front()),
+            [this](beast::error_code ec, std::size_t)
+            {
+                if (ec)
+                    return failed(ec, "write");
+
+                queue_.pop_front();
+                if (!queue_.empty())
+                    do_write();
+            });
+    }
+
+    void
+    do_read()
+    {
+        ws_.async_read(buffer_,
+            [this](beast::error_code ec, std::size_t)
+            {
+                if (ec)
+                    return finished() ? void() : failed(ec, "read");
+
+                replied((const char *) buffer_.data().data(), buffer_.size());
+                buffer_.consume(buffer_.size());
+
+                if (!finished())
+                    do_read();
+            });
+    }
+
+    void
+    shutdown() override
+    {
+        if (!ws_.is_open())
+            return beast::get_lowest_layer(ws_).close();
+
+        // a proper close frame, so the daemon does not log every connection as a failed read
+        ws_.async_close(websocket::close_code::normal, [this](beast::error_code)
+            {
+                beast::get_lowest_layer(ws_).close();
+            });
+    }
+};
+
+class UdpClient : public Client
+{
+    udp::socket socket_;
+    char reply_[64 * 1024];
+
+public:
+    UdpClient(ReplayState &state, unsigned connection, net::io_context &ioc)
+        : UdpClient(state, connection, net::make_strand(ioc))
+    {
+    }
+
+    void
+    start()
+    {
+        net::dispatch(socket_.get_executor(), [this]
+            {
+                beast::error_code ec;
+
+                socket_.connect(udp::endpoint{ state_.config.address, state_.config.port }, ec);
+                if (ec)
+                    return failed(ec, "connect");
+
+                do_receive();
+                connected();
+            });
+    }
+
+    void
+    stop()
+    {
+        net::dispatch(socket_.get_executor(), [this] { maybeFinish(); });
+    }
+
+    void
+    abandonAll()
+    {
+        net::dispatch(socket_.get_executor(), [this] { abandon(); });
+    }
+
+private:
+    UdpClient(ReplayState &state, unsigned connection, net::strand<net::io_context::executor_type> ex)
+        : Client(state, connection, ex), socket_(ex)
+    {
+    }
+
+    void
+    send(const unsigned char *frame, size_t len) override
+    {
+        auto datagram = std::make_shared<std::vector<unsigned char>>(frame, frame + len);
+
+        socket_.async_send(net::buffer(*datagram),
+            [this, datagram](beast::error_code ec, std::size_t)
+            {
+                if (ec)
+                    failed(ec, "send");
+            });
+    }
+
+    void
+    do_receive()
+    {
+        socket_.async_receive(net::buffer(reply_),
+            [this](beast::error_code ec, std::size_t n)
+            {
+                if (ec)
+                    return finished() ? void() : failed(ec, "receive");
+
+                replied(reply_, n);
+
+                if (!finished())
+                    do_receive();
+            });
+    }
+
+    void
+    shutdown() override
+    {
+        beast::error_code ec;
+        socket_.close(ec);
+    }
+};
+
+//------------------------------------------------------------------------------
+
+// Flight time of every corpus frame, for matching replies
+static void corpusTokens(ReplayState &state)
+{
+    state.flightTimes.clear();
+
+    for (const std::vector<unsigned char> &frame : state.corpus)
+    {
+        try {
+            El3Telemetry telemetry(frame.data(), frame.size(), FAULT_TOLERANT);
+            state.flightTimes.push_back(telemetry.FlightTime());
+        } catch (const std::exception &) {
+            state.flightTimes.push_back(NO_TOKEN);
+        }
+    }
+}
+
+static size_t loadCorpus(const std::string &path, std::vector<std::vector<unsigned char>> &corpus)
+{
+    std::ifstream probe(path, std::ios::binary);
+    char magic[sizeof(EL3_CAPTURE_MAGIC) - 1] = { 0 };
+
+    probe.read(magic, sizeof(magic));
+
+    if (probe && !memcmp(magic, EL3_CAPTURE_MAGIC, sizeof(magic)))
+    {
+        El3CaptureReader reader(path);
+        std::vector<uint32_t> blocks(reader.blocks());
+        El3CaptureRecord rec;
+
+        for (uint32_t b = 0; b < reader.blocks(); b++)
+            blocks[b] = b;
+
+        /* streamed through io_uring where there is one, reading ahead of the copy */
+        El3CaptureBlockStream stream(reader, path, blocks);
+
+        while (stream.next(rec))
+        {
+            if (rec.length <= EL3_MAX_FRAME_BYTES)
+                corpus.emplace_back(rec.data, rec.data + rec.length);
+        }
+
+        return corpus.size();
+    }
+
+    std::ifstream file(path);
+    std::string line;
+    unsigned char frame[EL3_MAX_FRAME_BYTES];
+
+    while (std::getline(file, line))
+    {
+        if (!line.empty() && line[line.size() - 1] == '\r')
+            line.erase(line.size() - 1);
+
+        size_t len = hex_to_bytes(line.data(), line.size(), frame, sizeof(frame));
+
+        if (len)
+            corpus.emplace_back(frame, frame + len);
+    }
+
+    return corpus.size();
+}
+
+static void writeReport(const std::string &path, const ReplayConfig &cfg, const std::string &input,
+    uint64_t sent, uint64_t received, uint64_t errors, uint64_t expired, double elapsed,
+    const LatencyHistogram &lat)
+{
+    rapidjson::StringBuffer strbuf;
+    rapidjson::PrettyWriter<rapidjson::StringBuffer> w(strbuf);
+
+    w.StartObject();
+    w.Key("tool");              w.String("el3dec_replay");
+    w.Key("input");             w.String(input.c_str());
+    w.Key("target");            w.String((cfg.address.to_string() + ":" + std::to_string(cfg.port)).c_str());
+    w.Key("transport");         w.String(cfg.transport == TRANSPORT_UDP ? "udp" : "websocket");
+    w.Key("connections");       w.Uint(cfg.connections);
+    w.Key("uavs");              w.Uint(cfg.uavs);
+    w.Key("target_rate");       w.Double(cfg.rate);
+    w.Key("pipeline");          w.Uint(cfg.pipeline);
+    w.Key("sent");              w.Uint64(sent);
+    w.Key("received");          w.Uint64(received);
+    w.Key("lost");              w.Uint64(sent - received);
+    w.Key("timed_out");         w.Uint64(expired);
+    w.Key("errors");            w.Uint64(errors);
+    w.Key("elapsed_s");         w.Double(elapsed);
+    w.Key("throughput_fps");    w.Double(elapsed > 0 ? received / elapsed : 0);
+
+    w.Key("latency_us");
+    w.StartObject();
+    w.Key("min");               w.Double(lat.min() / 1e3);
+    w.Key("mean");              w.Double(lat.mean() / 1e3);
+    w.Key("p50");               w.Double(lat.percentile(50) / 1e3);
+    w.Key("p90");               w.Double(lat.percentile(90) / 1e3);
+    w.Key("p99");               w.Double(lat.percentile(99) / 1e3);
+    w.Key("p999");              w.Double(lat.percentile(99.9) / 1e3);
+    w.Key("max");               w.Double(lat.max() / 1e3);
+    w.EndObject();
+
+    w.EndObject();
+
+    if (path == "-")
+    {
+        std::cout << strbuf.GetString() << "\n";
+        return;
+    }
+
+    std::ofstream out(path);
+    out << strbuf.GetString() << "\n";
+}
+
+template <typename C>
+static int replay(ReplayConfig &cfg, ReplayState &state, unsigned threads, const std::string &input,
+    const std::string &report)
+{
+    net::io_context ioc{ (int) threads };
+    std::vector<std::unique_ptr<C>> clients;
+
+    for (unsigned i = 0; i < cfg.connections; i++)
+        clients.emplace_back(new C(state, i, ioc));
+
+    auto work = net::make_work_guard(ioc);
+    std::vector<std::thread> pool;
+
+    for (unsigned i = 0; i < threads; i++)
+        pool.emplace_back([&ioc] { ioc.run(); });
+
+    steady::time_point start = steady::now();
+
+    for (auto &c : clients)
+        c->start();
+
+    // Wait for the end of the run: duration, frame budget, or every connection gone
+    for (;;)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+        bool alive = std::any_of(clients.begin(), clients.end(), [](const std::unique_ptr<C> &c) { return !c->finished(); });
+        bool expired = cfg.duration > 0 &&
+            steady::now() - start >= std::chrono::duration<double>(cfg.duration);
+
+        if (!alive)
+            break;
+
+        if (expired || !state.budget)
+        {
+            state.stopping = true;
+
+            for (auto &c : clients)
+                c->stop();
+
+            steady::time_point drain = steady::now() + std::chrono::milliseconds(DRAIN_TIMEOUT_MS);
+
+            while (steady::now() < drain && std::any_of(clients.begin(), clients.end(),
+                [](const std::unique_ptr<C> &c) { return !c->finished(); }))
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+            for (auto &c : clients)
+                c->abandonAll();
+
+            break;
+        }
+    }
+
+    work.reset();
+    ioc.stop();
+
+    for (auto &t : pool)
+        t.join();
+
+    LatencyHistogram latency;
+    uint64_t sent = 0, received = 0, errors = 0, expired = 0;
+    steady::time_point end = start;
+
+    for (auto &c : clients)
+    {
+        latency.merge(c->latency);
+        sent += c->sent;
+        received += c->received;
+        errors += c->errors;
+        expired += c->expired;
+        end = std::max(end, c->lastReply);
+    }
+
+    double elapsed = std::chrono::duration<double>(end - start).count();
+
+    fprintf(stderr, "%llu sent, %llu received, %llu errors in %.3f s: %.0f frames/s\n"
+        "latency (us): min %.1f p50 %.1f p90 %.1f p99 %.1f p99.9 %.1f max %.1f\n",
+        (unsigned long long) sent, (unsigned long long) received, (unsigned long long) errors,
+        elapsed, elapsed > 0 ? received / elapsed : 0.0,
+        latency.min() / 1e3, latency.percentile(50) / 1e3, latency.percentile(90) / 1e3,
+        latency.percentile(99) / 1e3, latency.percentile(99.9) / 1e3, latency.max() / 1e3);
+
+    if (!report.empty())
+        writeReport(report, cfg, input, sent, received, errors, expired, elapsed, latency);
+
+    return received ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int main(int argc, char* argv[])
+{
+    ReplayConfig cfg;
+    std::string transport, input, report;
+    unsigned threads;
+
+    po::options_description opts("Allowed options");
+    opts.add_options()
+        ("help", "produce a help message")
+        ("input", po::value<std::string>(&input), "hex text recording or capture archive to replay")
+        ("address", po::value<std::string>()->default_value("127.0.0.1"), "daemon address")
+        ("port", po::value<unsigned short>(&cfg.port)->default_value(8081), "daemon port (websocket or UDP)")
+        ("transport", po::value<std::string>(&transport)->default_value("websocket"), "websocket or udp")
+        ("connections", po::value<unsigned>(&cfg.connections)->default_value(8), "concurrent connections")
+        ("uavs", po::value<unsigned>(&cfg.uavs)->default_value(16), "distinct UAVs interleaved in the stream")
+        ("uav-base", po::value<unsigned>(&cfg.uavBase)->default_value(1000), "ID of the first UAV")
+        ("rate", po::value<double>(&cfg.rate)->default_value(0), "frames/s over all connections, 0 for as fast as possible")
+        ("pipeline", po::value<unsigned>(&cfg.pipeline)->default_value(1), "frames in flight per connection when unpaced")
+        ("duration", po::value<double>(&cfg.duration)->default_value(10), "seconds to run, 0 for no limit")
+        ("count", po::value<uint64_t>(&cfg.count)->default_value(0), "frames to send, 0 for no limit")
+        ("threads", po::value<unsigned>(&threads)->default_value(1), "client I/O threads")
+        ("report", po::value<std::string>(&report), "write a JSON report to this file ('-' for stdout)")
+        ;
+
+    po::positional_options_description positional;
+    positional.add("input", 1);
+
+    po::variables_map vm;
+
+    try {
+        po::store(po::command_line_parser(argc, argv).options(opts).positional(positional).run(), vm);
+        po::notify(vm);
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+
+    if (vm.count("help") || input.empty())
+    {
+        std::cerr << "Usage: el3dec_replay [options] input\n" << opts;
+        return vm.count("help") ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (transport != "websocket" && transport != "udp")
+    {
+        std::cerr << "Unknown transport: " << transport << "\n";
+        return EXIT_FAILURE;
+    }
+
+    if (!cfg.duration && !cfg.count)
+    {
+        std::cerr << "Please limit the run with --duration or --count\n";
+        return EXIT_FAILURE;
+    }
+
+    cfg.transport = transport == "udp" ? TRANSPORT_UDP : TRANSPORT_WEBSOCKET;
+    cfg.address = net::ip::make_address(vm["address"].as<std::string>());
+    cfg.connections = std::max(1u, cfg.connections);
+    cfg.uavs = std::max(1u, cfg.uavs);
+    cfg.pipeline = std::max(1u, cfg.pipeline);
+    threads = std::max(1u, threads);
+
+    ReplayState state(cfg);
+
+    try {
+        if (!loadCorpus(input, state.corpus))
+        {
+            std::cerr << "No frames in " << input << "\n";
+            return EXIT_FAILURE;
+        }
+
+        corpusTokens(state);
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+
+    if (cfg.transport == TRANSPORT_UDP)
+        return replay<UdpClient>(cfg, state, threads, input, report);
+
+    return replay<WebsocketClient>(cfg, state, threads, input, report);
+}
@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2022 Subreption LLC. All rights reserved.
+ * Author: 12dc8242df1be0d6f4b73d68166552197936a27074c004c8af95b27194ec584d
+ *
+ * Dual-licensed under the Subreption Ukraine Defense License (SUDL, version 1) and the  Server Side
+ * Public License (SSPL, version 3). Both licenses are provided with this software distribution.
+ */
+
+#include "alloccount.hpp"
+#include <cstddef>
+
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t nmemb, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+}
+
+/* plain __thread: initial-exec TLS in the executable, touching it never allocates */
+static __thread uint64_t thread_allocs;
+static __thread uint64_t thread_bytes;
+
+extern "C" void *malloc(size_t size)
+{
+    thread_allocs++;
+    thread_bytes += size;
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t nmemb, size_t size)
+{
+    thread_allocs++;
+    thread_bytes += nmemb * size;
+    return __libc_calloc(nmemb, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size)
+{
+    thread_allocs++;
+    thread_bytes += size;
+    return __libc_realloc(ptr, size);
+}
+
+El3AllocScope::El3AllocScope():
+    m_allocs(thread_allocs), m_bytes(thread_bytes)
+{
+}
+
+uint64_t El3AllocScope::allocations() const
+{
+    return thread_allocs - m_allocs;
+}
+
+uint64_t El3AllocScope::bytes() const
+{
+    return thread_bytes - m_bytes;
+}
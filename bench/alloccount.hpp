@@ -0,0 +1,32 @@
+/*
+ * Copyright (c) 2022 Subreption LLC. All rights reserved.
+ * Author: 12dc8242df1be0d6f4b73d68166552197936a27074c004c8af95b27194ec584d
+ *
+ * Dual-licensed under the Subreption Ukraine Defense License (SUDL, version 1) and the  Server Side
+ * Public License (SSPL, version 3). Both licenses are provided with this software distribution.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+/*
+ * Heap allocation counting for the benchmarks. Linking alloccount.cpp into a program replaces
+ * malloc, calloc and realloc with counting wrappers around glibc's own allocator (operator new goes
+ * through malloc in libstdc++, so C++ allocations are counted as well). Counters are per thread, a
+ * scope only sees what its own thread allocated. Not compatible with sanitizers, which bring their
+ * own allocator.
+ */
+class El3AllocScope
+{
+  public:
+    El3AllocScope();
+
+    /* allocations and requested bytes since construction */
+    uint64_t allocations() const;
+    uint64_t bytes() const;
+
+  private:
+    uint64_t m_allocs;
+    uint64_t m_bytes;
+};
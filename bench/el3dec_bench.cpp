@@ -0,0 +1,640 @@
+/*
+ * Copyright (c) 2022 Subreption LLC. All rights reserved.
+ * Author: 12dc8242df1be0d6f4b73d68166552197936a27074c004c8af95b27194ec584d
+ *
+ * Dual-licensed under the Subreption Ukraine Defense License (SUDL, version 1) and the  Server Side
+ * Public License (SSPL, version 3). Both licenses are provided with this software distribution.
+ */
+
+#include <alloccount.hpp>
+#include <boost/format.hpp>
+#include <el3dec/lib.hpp>
+#include <el3dec/prefilter.hpp>
+#include <el3dec/trace.hpp>
+#include <el3dec/telemetry.hpp>
+#include <el3dec/utils.hpp>
+#include "rapidjson/document.h"
+#include "rapidjson/prettywriter.h"
+#include "rapidjson/stringbuffer.h"
+#include "rapidjson/writer.h"
+#include <getopt.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#define MAX_FRAME_BYTES     (255 + 3)
+
+/* timed samples per benchmark, the median is reported */
+#define BENCH_SAMPLES       7
+
+typedef std::vector<unsigned char> Frame;
+
+// Keep the optimizer from discarding a result
+template <typename T>
+static inline void keep(const T &value)
+{
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+//------------------------------------------------------------------------------
+
+// CPU cycles spent in user space by this thread, when the kernel and hardware allow it
+class CycleCounter
+{
+    int fd_;
+
+public:
+    CycleCounter()
+    {
+        struct perf_event_attr attr;
+
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CPU_CYCLES;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+
+        fd_ = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+
+    ~CycleCounter()
+    {
+        if (fd_ >= 0)
+            close(fd_);
+    }
+
+    bool available() const { return fd_ >= 0; }
+
+    void
+    start()
+    {
+        if (fd_ < 0)
+            return;
+
+        ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+    }
+
+    uint64_t
+    stop()
+    {
+        uint64_t cycles = 0;
+
+        if (fd_ < 0)
+            return 0;
+
+        ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+
+        if (read(fd_, &cycles, sizeof(cycles)) != sizeof(cycles))
+            return 0;
+
+        return cycles;
+    }
+};
+
+//------------------------------------------------------------------------------
+
+struct BenchResult {
+    std::string name;
+    uint64_t ops;
+    double nsPerOp;
+    double opsPerSec;
+    double allocsPerOp;
+    double bytesPerOp;
+    double cyclesPerOp;         /* negative when no hardware counter is available */
+};
+
+struct BenchOptions {
+    double minTime;             /* seconds spent timing each benchmark */
+    std::string filter;
+};
+
+/*
+ * A pass runs the operation over a whole corpus and returns how many operations it did. Passes are
+ * repeated until a sample has run minTime / BENCH_SAMPLES; the median sample is reported, which
+ * keeps a stray interrupt from skewing the figure. Allocations are counted over one warm pass.
+ */
+static bool bench(const BenchOptions &opts, CycleCounter &cycles, const std::string &name,
+    const std::function<size_t()> &pass, std::vector<BenchResult> &results)
+{
+    typedef std::chrono::steady_clock clock;
+
+    if (!opts.filter.empty() && name.find(opts.filter) == std::string::npos)
+        return false;
+
+    BenchResult r;
+    r.name = name;
+
+    /* warm up caches, branch predictors and any lazily grown buffers */
+    size_t perPass = pass();
+
+    if (!perPass)
+        return false;
+
+    {
+        El3AllocScope scope;
+        pass();
+        r.allocsPerOp = (double) scope.allocations() / perPass;
+        r.bytesPerOp = (double) scope.bytes() / perPass;
+    }
+
+    /* calibrate the passes per sample */
+    size_t passes = 1;
+    double sampleTime = opts.minTime / BENCH_SAMPLES;
+
+    for (;;)
+    {
+        auto t0 = clock::now();
+        for (size_t i = 0; i < passes; i++)
+            pass();
+        double elapsed = std::chrono::duration<double>(clock::now() - t0).count();
+
+        if (elapsed >= sampleTime / 4 || passes >= (1u << 30))
+        {
+            passes = std::max<size_t>(1, passes * sampleTime / std::max(elapsed, 1e-9));
+            break;
+        }
+
+        passes *= 4;
+    }
+
+    std::vector<double> samples;
+    uint64_t cycleTotal = 0;
+
+    for (int s = 0; s < BENCH_SAMPLES; s++)
+    {
+        cycles.start();
+        auto t0 = clock::now();
+
+        for (size_t i = 0; i < passes; i++)
+            pass();
+
+        double ns = std::chrono::duration<double, std::nano>(clock::now() - t0).count();
+        cycleTotal += cycles.stop();
+
+        samples.push_back(ns / (passes * perPass));
+    }
+
+    std::sort(samples.begin(), samples.end());
+
+    r.ops = (uint64_t) passes * perPass * BENCH_SAMPLES;
+    r.nsPerOp = samples[BENCH_SAMPLES / 2];
+    r.opsPerSec = 1e9 / r.nsPerOp;
+    r.cyclesPerOp = cycles.available() ? (double) cycleTotal / r.ops : -1;
+
+    results.push_back(r);
+
+    if (r.cyclesPerOp >= 0)
+        printf("%-28s %10.1f ns/op %12.0f op/s %8.2f allocs/op %9.1f B/op %9.1f cycles/op\n",
+            r.name.c_str(), r.nsPerOp, r.opsPerSec, r.allocsPerOp, r.bytesPerOp, r.cyclesPerOp);
+    else
+        printf("%-28s %10.1f ns/op %12.0f op/s %8.2f allocs/op %9.1f B/op %16s\n",
+            r.name.c_str(), r.nsPerOp, r.opsPerSec, r.allocsPerOp, r.bytesPerOp, "n/a cycles/op");
+
+    fflush(stdout);
+    return true;
+}
+
+//------------------------------------------------------------------------------
+
+static size_t loadFixtures(const std::string &path, std::vector<std::string> &hex, std::vector<Frame> &frames)
+{
+    std::ifstream file(path);
+    std::string line;
+    unsigned char buf[MAX_FRAME_BYTES];
+
+    while (std::getline(file, line))
+    {
+        if (!line.empty() && line[line.size() - 1] == '\r')
+            line.erase(line.size() - 1);
+
+        size_t len = hex_to_bytes(line.data(), line.size(), buf, sizeof(buf));
+
+        if (!len)
+            continue;
+
+        hex.push_back(line);
+        frames.emplace_back(buf, buf + len);
+    }
+
+    return frames.size();
+}
+
+/* fixture frames moved around: other UAVs, positions and altitudes, same layout */
+static void makeSynthetic(const std::vector<Frame> &fixtures, std::mt19937 &rng, size_t count,
+    std::vector<Frame> &out)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        Frame f = fixtures[rng() % fixtures.size()];
+
+        f[3] = rng();
+        f[4] = rng();
+
+        /* low bytes of the packed latitude and longitude, and the altitude */
+        for (size_t off : { 0x0b, 0x0c, 0x0f, 0x10, 0x20 })
+        {
+            if (off < f.size())
+                f[off] = rng();
+        }
+
+        out.push_back(f);
+    }
+}
+
+/* valid frames cut short anywhere past the header */
+static void makeTruncated(const std::vector<Frame> &fixtures, std::mt19937 &rng, size_t count,
+    std::vector<Frame> &out)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        const Frame &f = fixtures[rng() % fixtures.size()];
+        size_t len = 6 + rng() % (f.size() - 6);
+
+        out.emplace_back(f.begin(), f.begin() + len);
+    }
+}
+
+/* noise, half of it behind a magic byte so it gets past the first check */
+static void makeGarbage(std::mt19937 &rng, size_t count, std::vector<Frame> &out)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        Frame f(3 + rng() % 120);
+
+        for (auto &b : f)
+            b = rng();
+
+        if (i % 2)
+            f[0] = ENICS_ELERON_PACKET_MAGICBYTE;
+
+        out.push_back(f);
+    }
+}
+
+// The daemon's per packet log line, minus the sink
+static std::string formatLogLine(const El3Telemetry &t)
+{
+    return boost::str(boost::format(
+        "UAV ID:%d Type:%d Time:%s Lat:%f Lon:%f Alt:%u Speed:%g VideoFreq:%d Rem:%d "
+        "Camera: A:%g Z:%g P:%g"
+        ) % t.ID() % t.Type() % t.Timestamp() % t.Latitude() % t.Longitude() % t.Altitude()
+          % t.Groundspeed() % t.VideoFreq() % t.RemainingFlightMinutes() % t.CameraAngle()
+          % t.CameraAzimuth() % t.CameraPosition());
+}
+
+// Decodes that are expected to fail half the time still have to be paid for
+static size_t decodeAll(const std::vector<Frame> &frames)
+{
+    size_t ops = 0;
+
+    for (auto &f : frames)
+    {
+        try {
+            El3Telemetry t(f.data(), f.size(), FAULT_TOLERANT);
+            keep(t);
+        } catch (const std::exception &) {
+        }
+        ops++;
+    }
+
+    return ops;
+}
+
+//------------------------------------------------------------------------------
+
+static bool writeReport(const std::string &path, const std::vector<BenchResult> &results)
+{
+    rapidjson::StringBuffer strbuf;
+    rapidjson::PrettyWriter<rapidjson::StringBuffer> w(strbuf);
+
+    w.StartObject();
+    w.Key("el3dec_version");    w.Int(EL3DEC_VERSION);
+    w.Key("compiler");          w.String(__VERSION__);
+    w.Key("benchmarks");
+    w.StartArray();
+
+    for (auto &r : results)
+    {
+        w.StartObject();
+        w.Key("name");          w.String(r.name.c_str());
+        w.Key("ops");           w.Uint64(r.ops);
+        w.Key("ns_per_op");     w.Double(r.nsPerOp);
+        w.Key("ops_per_s");     w.Double(r.opsPerSec);
+        w.Key("allocs_per_op"); w.Double(r.allocsPerOp);
+        w.Key("bytes_per_op");  w.Double(r.bytesPerOp);
+        w.Key("cycles_per_op");
+        if (r.cyclesPerOp >= 0)
+            w.Double(r.cyclesPerOp);
+        else
+            w.Null();
+        w.EndObject();
+    }
+
+    w.EndArray();
+    w.EndObject();
+
+    std::ofstream out(path);
+    out << strbuf.GetString() << "\n";
+
+    return out.good();
+}
+
+/*
+ * Regressions against a stored report: more than threshold percent slower, or any extra allocation
+ * per operation. Benchmarks missing on either side are skipped.
+ */
+static int compareBaseline(const std::string &path, const std::vector<BenchResult> &results, double threshold)
+{
+    std::ifstream in(path);
+    std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    rapidjson::Document d;
+
+    d.Parse(text.c_str(), text.size());
+
+    if (!in || d.HasParseError() || !d.IsObject() || !d["benchmarks"].IsArray())
+    {
+        std::cerr << "cannot read baseline " << path << "\n";
+        return -1;
+    }
+
+    const rapidjson::Value &base = d["benchmarks"];
+    int regressions = 0;
+
+    printf("\nagainst %s (threshold %.1f%%):\n", path.c_str(), threshold);
+
+    for (auto &r : results)
+    {
+        for (rapidjson::SizeType i = 0; i < base.Size(); i++)
+        {
+            const rapidjson::Value &b = base[i];
+
+            if (!b["name"].IsString() || r.name != b["name"].GetString() || !b["ns_per_op"].IsNumber())
+                continue;
+
+            double baseNs = b["ns_per_op"].GetDouble();
+            double baseAllocs = b["allocs_per_op"].IsNumber() ? b["allocs_per_op"].GetDouble() : r.allocsPerOp;
+            double change = baseNs > 0 ? (r.nsPerOp / baseNs - 1.0) * 100.0 : 0;
+            bool slower = change > threshold;
+            bool allocs = r.allocsPerOp > baseAllocs + 0.01;
+
+            printf("%-28s %+7.1f%% %8.2f -> %.2f allocs/op%s\n", r.name.c_str(), change, baseAllocs,
+                r.allocsPerOp, slower || allocs ? "  REGRESSION" : "");
+
+            regressions += slower || allocs;
+            break;
+        }
+    }
+
+    return regressions;
+}
+
+static void usage()
+{
+    std::cerr << "Usage: el3dec_bench [options]\n"
+        "  -f, --fixtures PATH       hex text corpus (default: the test fixtures)\n"
+        "  -t, --min-time SECONDS    time spent measuring each benchmark (default 1)\n"
+        "  -k, --filter TEXT         only run benchmarks whose name contains TEXT\n"
+        "  -s, --seed N              seed for the synthetic corpora (default 1)\n"
+        "  -j, --json PATH           write the results as JSON\n"
+        "  -b, --baseline PATH       compare against a JSON report, exit 2 on regressions\n"
+        "  -r, --threshold PERCENT   slowdown tolerated against the baseline (default 10)\n";
+}
+
+int main(int argc, char **argv)
+{
+    std::string fixtures = EL3DEC_BENCH_FIXTURES "/telemetry-samples.txt";
+    std::string jsonPath, baselinePath;
+    double threshold = 10.0;
+    unsigned seed = 1;
+    BenchOptions opts = { 1.0, "" };
+    int opt;
+
+    static const struct option longopts[] = {
+        { "fixtures",   required_argument,  NULL,   'f' },
+        { "min-time",   required_argument,  NULL,   't' },
+        { "filter",     required_argument,  NULL,   'k' },
+        { "seed",       required_argument,  NULL,   's' },
+        { "json",       required_argument,  NULL,   'j' },
+        { "baseline",   required_argument,  NULL,   'b' },
+        { "threshold",  required_argument,  NULL,   'r' },
+        { "help",       no_argument,        NULL,   'h' },
+        { NULL,         0,                  NULL,   0 }
+    };
+
+    while ((opt = getopt_long(argc, argv, "f:t:k:s:j:b:r:h", longopts, NULL)) != -1)
+    {
+        switch (opt)
+        {
+            case 'f': fixtures = optarg; break;
+            case 't': opts.minTime = atof(optarg); break;
+            case 'k': opts.filter = optarg; break;
+            case 's': seed = strtoul(optarg, NULL, 0); break;
+            case 'j': jsonPath = optarg; break;
+            case 'b': baselinePath = optarg; break;
+            case 'r': threshold = atof(optarg); break;
+            default:
+                usage();
+                return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    std::vector<std::string> hex;
+    std::vector<Frame> frames, synthetic, truncated, garbage;
+    std::mt19937 rng(seed);
+
+    if (!loadFixtures(fixtures, hex, frames))
+    {
+        std::cerr << "No frames in " << fixtures << "\n";
+        return EXIT_FAILURE;
+    }
+
+    makeSynthetic(frames, rng, 4096, synthetic);
+    makeTruncated(frames, rng, 4096, truncated);
+    makeGarbage(rng, 4096, garbage);
+
+    std::vector<El3Telemetry *> decoded;
+    for (auto &f : frames)
+        decoded.push_back(el3Decode(f.data(), f.size(), FAULT_TOLERANT));
+
+    CycleCounter cycles;
+    std::vector<BenchResult> results;
+
+    printf("%zu fixture frames, %zu synthetic, hardware cycle counter %s\n\n", frames.size(),
+        synthetic.size(), cycles.available() ? "available" : "unavailable");
+
+    bench(opts, cycles, "hex/hex_to_bytes", [&] {
+        unsigned char buf[MAX_FRAME_BYTES];
+        for (auto &h : hex)
+            keep(hex_to_bytes(h.data(), h.size(), buf, sizeof(buf)));
+        return hex.size();
+    }, results);
+
+    bench(opts, cycles, "decode/valid", [&] { return decodeAll(frames); }, results);
+    bench(opts, cycles, "decode/synthetic", [&] { return decodeAll(synthetic); }, results);
+    bench(opts, cycles, "decode/truncated", [&] { return decodeAll(truncated); }, results);
+    bench(opts, cycles, "decode/garbage", [&] { return decodeAll(garbage); }, results);
+
+    /* what a busy band looks like: mostly noise, some frames, some cut short */
+    std::vector<Frame> mixed(garbage);
+    mixed.insert(mixed.end(), frames.begin(), frames.end());
+    mixed.insert(mixed.end(), truncated.begin(), truncated.end());
+    std::shuffle(mixed.begin(), mixed.end(), rng);
+
+    std::vector<const unsigned char *> mixedPtrs;
+    std::vector<size_t> mixedLens;
+    std::vector<uint8_t> screened(mixed.size());
+    for (auto &f : mixed)
+    {
+        mixedPtrs.push_back(f.data());
+        mixedLens.push_back(f.size());
+    }
+
+    const El3Screen &screen = el3DecodableScreen();
+
+    bench(opts, cycles, "decode/mixed", [&] { return decodeAll(mixed); }, results);
+
+    bench(opts, cycles, "screen/single", [&] {
+        for (size_t i = 0; i < mixed.size(); i++)
+            screened[i] = screen.screen(mixedPtrs[i], mixedLens[i]);
+        keep(screened[0]);
+        return mixed.size();
+    }, results);
+
+    bench(opts, cycles, "screen/batch", [&] {
+        screen.screen(mixedPtrs.data(), mixedLens.data(), mixed.size(), screened.data());
+        keep(screened[0]);
+        return mixed.size();
+    }, results);
+
+    bench(opts, cycles, "screen/decode", [&] {
+        screen.screen(mixedPtrs.data(), mixedLens.data(), mixed.size(), screened.data());
+        for (size_t i = 0; i < mixed.size(); i++)
+        {
+            if (EL3_SCREEN_VERDICT(screened[i]) == SCREEN_REJECT)
+                continue;
+            try {
+                El3Telemetry t(mixedPtrs[i], mixedLens[i], FAULT_TOLERANT);
+                keep(t);
+            } catch (const std::exception &) {
+            }
+        }
+        return mixed.size();
+    }, results);
+
+    /* what tracing costs per packet: off, then every packet sampled */
+    auto tracedDecode = [&] {
+        for (auto &f : frames)
+        {
+            el3TraceBegin();
+            El3Telemetry t(f.data(), f.size(), FAULT_TOLERANT);
+            keep(t);
+            el3TraceDetach();
+        }
+        return frames.size();
+    };
+
+    bench(opts, cycles, "trace/off", tracedDecode, results);
+    el3TraceSampling(1);
+    bench(opts, cycles, "trace/sampled", tracedDecode, results);
+    el3TraceSampling(0);
+    el3TraceClear();
+
+    bench(opts, cycles, "decode/el3Decode", [&] {
+        for (auto &f : frames)
+            delete el3Decode(f.data(), f.size(), FAULT_TOLERANT);
+        return frames.size();
+    }, results);
+
+    bench(opts, cycles, "json/toJson", [&] {
+        for (auto t : decoded)
+            keep(t->toJson(false));
+        return decoded.size();
+    }, results);
+
+    rapidjson::StringBuffer strbuf;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(strbuf);
+
+    bench(opts, cycles, "json/el3WriteJson", [&] {
+        for (auto t : decoded)
+        {
+            strbuf.Clear();
+            writer.Reset(strbuf);
+            el3WriteJson(t->Record(), writer);
+        }
+        return decoded.size();
+    }, results);
+
+    bench(opts, cycles, "log/format", [&] {
+        for (auto t : decoded)
+            keep(formatLogLine(*t));
+        return decoded.size();
+    }, results);
+
+    bench(opts, cycles, "e2e/batch", [&] {
+        unsigned char buf[MAX_FRAME_BYTES];
+        for (auto &h : hex)
+        {
+            size_t len = hex_to_bytes(h.data(), h.size(), buf, sizeof(buf));
+            El3Telemetry t(buf, len, FAULT_TOLERANT);
+
+            strbuf.Clear();
+            writer.Reset(strbuf);
+            el3WriteJson(t.Record(), writer);
+        }
+        return hex.size();
+    }, results);
+
+    bench(opts, cycles, "e2e/daemon", [&] {
+        unsigned char buf[MAX_FRAME_BYTES];
+        for (auto &h : hex)
+        {
+            size_t len = hex_to_bytes(h.data(), h.size(), buf, sizeof(buf));
+            El3Telemetry *t = el3Decode(buf, len, FAULT_TOLERANT);
+
+            keep(formatLogLine(*t));
+            keep(t->toJson(false));
+            delete t;
+        }
+        return hex.size();
+    }, results);
+
+    for (auto t : decoded)
+        delete t;
+
+    if (!jsonPath.empty() && !writeReport(jsonPath, results))
+    {
+        std::cerr << "cannot write " << jsonPath << "\n";
+        return EXIT_FAILURE;
+    }
+
+    if (!baselinePath.empty())
+    {
+        int regressions = compareBaseline(baselinePath, results, threshold);
+
+        if (regressions < 0)
+            return EXIT_FAILURE;
+
+        if (regressions)
+        {
+            printf("%d regression(s)\n", regressions);
+            return 2;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,210 @@
+"""
+Batch decoding of Eleron 3 telemetry from Python, over the C ABI of libel3dec.so (el3dec.h).
+
+Frames go in as NumPy uint8 buffers and come out as a NumPy structured array, one row per frame,
+without a copy on either side. The decoding loop runs in C; ctypes releases the GIL for the
+duration of each call, so other Python threads keep running.
+
+    import numpy as np, el3dec
+
+    frames = np.fromfile("frames.bin", dtype=np.uint8)      # back to back raw frames
+    recs, used = el3dec.decode_stream(frames)
+    print(recs["latitude"], recs["longitude"])
+
+The library is looked up in $EL3DEC_LIBRARY, next to this file, then in ../build/src and the system
+paths.
+"""
+
+import ctypes
+import os
+
+import numpy as np
+
+ABI_VERSION = 1
+
+FAULT_TOLERANT = 0
+FAULT_INTOLERANT = 1
+
+OK = 0
+INVALID = 1
+
+# mirrors el3dec_record, field for field
+RECORD_DTYPE = np.dtype([
+    ("uav_no", np.uint16),
+    ("flight_time", np.uint16),
+    ("status", np.uint8),
+    ("packet_type", np.uint8),
+    ("engine_type", np.uint8),
+    ("uav_type", np.uint8),
+    ("stamp_hours", np.uint8),
+    ("stamp_minutes", np.uint8),
+    ("stamp_seconds", np.uint8),
+    ("track_verdict", np.uint8),
+    ("altitude", np.uint16),
+    ("remaining_minutes", np.uint16),
+    ("video_channel", np.uint16),
+    ("video_freq", np.uint16),
+    ("latitude", np.float32),
+    ("longitude", np.float32),
+    ("ground_speed", np.float32),
+    ("careen", np.float32),
+    ("pitch", np.float32),
+    ("camera_angle", np.float32),
+    ("camera_position", np.float32),
+    ("camera_azimuth", np.float32),
+    ("track_confidence", np.float32),
+    ("reserved", np.uint32, (2,)),
+])
+
+
+def _load():
+    here = os.path.dirname(os.path.abspath(__file__))
+    candidates = [
+        os.environ.get("EL3DEC_LIBRARY"),
+        os.path.join(here, "libel3dec.so"),
+        os.path.join(here, "..", "build", "src", "libel3dec.so"),
+        "libel3dec.so.1",
+    ]
+
+    for path in candidates:
+        if not path:
+            continue
+        try:
+            return ctypes.CDLL(path)
+        except OSError:
+            pass
+
+    raise OSError("libel3dec.so not found, set EL3DEC_LIBRARY")
+
+
+_lib = _load()
+
+_u8p = ctypes.POINTER(ctypes.c_uint8)
+_u16p = ctypes.POINTER(ctypes.c_uint16)
+_u64p = ctypes.POINTER(ctypes.c_uint64)
+_sizep = ctypes.POINTER(ctypes.c_size_t)
+
+_lib.el3dec_abi_version.restype = ctypes.c_int
+_lib.el3dec_record_size.restype = ctypes.c_size_t
+_lib.el3dec_decode_batch.restype = ctypes.c_size_t
+_lib.el3dec_decode_batch.argtypes = [ctypes.c_void_p, ctypes.c_size_t, ctypes.c_void_p,
+                                     ctypes.c_size_t, ctypes.c_int, ctypes.c_void_p]
+_lib.el3dec_decode_indexed.restype = ctypes.c_size_t
+_lib.el3dec_decode_indexed.argtypes = [ctypes.c_void_p, ctypes.c_void_p, ctypes.c_void_p,
+                                       ctypes.c_size_t, ctypes.c_int, ctypes.c_void_p]
+_lib.el3dec_decode_stream.restype = ctypes.c_size_t
+_lib.el3dec_decode_stream.argtypes = [ctypes.c_void_p, ctypes.c_size_t, ctypes.c_int,
+                                      ctypes.c_void_p, ctypes.c_size_t, _sizep]
+
+if _lib.el3dec_abi_version() != ABI_VERSION or _lib.el3dec_record_size() != RECORD_DTYPE.itemsize:
+    raise ImportError("libel3dec.so ABI %d does not match these bindings (%d)"
+                      % (_lib.el3dec_abi_version(), ABI_VERSION))
+
+
+def _ptr(array):
+    return array.ctypes.data_as(ctypes.c_void_p) if array is not None else None
+
+
+def _frames(buf):
+    buf = np.asarray(buf)
+    if buf.dtype != np.uint8:
+        raise TypeError("frames must be a uint8 array")
+    return np.ascontiguousarray(buf)
+
+
+def decode_batch(frames, lengths=None, mode=FAULT_TOLERANT):
+    """
+    Decode a 2D uint8 array, one frame per row. Rows shorter than the array width give their
+    length in lengths. Returns the records and the amount decoded; check recs["status"] for
+    the ones that were not.
+    """
+    frames = _frames(frames)
+    if frames.ndim != 2:
+        raise ValueError("frames must be a 2D array, one frame per row")
+
+    if lengths is not None:
+        lengths = np.ascontiguousarray(lengths, dtype=np.uint16)
+        if lengths.shape != (frames.shape[0],):
+            raise ValueError("one length per frame")
+        if len(lengths) and int(lengths.max()) > frames.shape[1]:
+            raise ValueError("frame longer than its row")
+
+    recs = np.empty(frames.shape[0], dtype=RECORD_DTYPE)
+    ok = _lib.el3dec_decode_batch(_ptr(frames), frames.shape[1], _ptr(lengths), frames.shape[0],
+                                  mode, _ptr(recs))
+    return recs, ok
+
+
+def decode_indexed(buf, offsets, lengths, mode=FAULT_TOLERANT):
+    """Decode the frames found at offsets into a flat uint8 buffer."""
+    buf = _frames(buf)
+    offsets = np.ascontiguousarray(offsets, dtype=np.uint64)
+    lengths = np.ascontiguousarray(lengths, dtype=np.uint16)
+
+    if offsets.shape != lengths.shape or offsets.ndim != 1:
+        raise ValueError("one offset and length per frame")
+    if len(offsets) and int((offsets + lengths).max()) > buf.size:
+        raise ValueError("frame past the end of the buffer")
+
+    recs = np.empty(len(offsets), dtype=RECORD_DTYPE)
+    ok = _lib.el3dec_decode_indexed(_ptr(buf), _ptr(offsets), _ptr(lengths), len(offsets), mode,
+                                    _ptr(recs))
+    return recs, ok
+
+
+def decode_stream(buf, mode=FAULT_TOLERANT, max_records=None):
+    """
+    Decode a flat uint8 buffer of back to back raw frames, skipping anything undecodable. Returns
+    the records and the bytes consumed; a frame cut short at the end of buf is left for the next
+    call.
+    """
+    buf = _frames(buf).reshape(-1)
+
+    # the shortest frame that decodes is 6 bytes
+    if max_records is None:
+        max_records = buf.size // 6 + 1
+
+    recs = np.empty(max_records, dtype=RECORD_DTYPE)
+    used = ctypes.c_size_t(0)
+    n = _lib.el3dec_decode_stream(_ptr(buf), buf.size, mode, _ptr(recs), max_records,
+                                  ctypes.byref(used))
+    return recs[:n], used.value
+
+
+def from_hex_lines(path):
+    """Load a hex text recording (like tests/fixtures) as a 2D array and the frame lengths."""
+    with open(path) as f:
+        raw = [bytes.fromhex(line.strip()) for line in f if line.strip()]
+
+    width = max((len(r) for r in raw), default=0)
+    frames = np.zeros((len(raw), width), dtype=np.uint8)
+    lengths = np.empty(len(raw), dtype=np.uint16)
+
+    for i, r in enumerate(raw):
+        frames[i, :len(r)] = np.frombuffer(r, dtype=np.uint8)
+        lengths[i] = len(r)
+
+    return frames, lengths
+
+
+if __name__ == "__main__":
+    import sys
+    import time
+
+    path = sys.argv[1] if len(sys.argv) > 1 else os.path.join(
+        os.path.dirname(os.path.abspath(__file__)), "..", "tests", "fixtures", "telemetry-samples.txt")
+
+    frames, lengths = from_hex_lines(path)
+
+    # scale the recording up to a million frames
+    reps = max(1, 1000000 // len(frames))
+    frames = np.tile(frames, (reps, 1))
+    lengths = np.tile(lengths, reps)
+
+    start = time.perf_counter()
+    recs, ok = decode_batch(frames, lengths)
+    elapsed = time.perf_counter() - start
+
+    print("%d frames (%d decoded) in %.1f ms, %.0f frames/s" % (len(recs), ok, elapsed * 1000,
+                                                               len(recs) / elapsed))
+    print(recs[["uav_no", "latitude", "longitude", "altitude", "ground_speed"]][:3])
@@ -0,0 +1,202 @@
+/*
+ * Copyright (c) 2022 Subreption LLC. All rights reserved.
+ * Author: 12dc8242df1be0d6f4b73d68166552197936a27074c004c8af95b27194ec584d
+ *
+ * Dual-licensed under the Subreption Ukraine Defense License (SUDL, version 1) and the  Server Side
+ * Public License (SSPL, version 3). Both licenses are provided with this software distribution.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include <el3dec/telemetry.hpp>
+
+/* panes a window may span: the window length over the pane width, the GCD of window and slide */
+#define EL3_AGGREGATE_MAX_PANES     64
+
+/* heatmap cells kept per pane, packets in further cells are only counted */
+#define EL3_AGGREGATE_MAX_CELLS     4096
+
+/* closed windows held until advance() collects them, the oldest go first */
+#define EL3_AGGREGATE_MAX_CLOSED    64
+
+struct El3AggregateConfig {
+  uint32_t windowMs = 60000;
+  uint32_t slideMs = 60000;     /* the window length for tumbling windows, less for sliding ones */
+  float cellDegrees = 0.01f;    /* heatmap cell size, in latitude and longitude */
+};
+
+/* one UAV over a pane or window */
+struct El3UavRollup {
+  uint16_t uavNo;
+  uint16_t channels;            /* bit per video channel seen */
+  uint32_t packets;
+  double speedSum;
+  float speedMax;
+  uint16_t altitudeMin;
+  uint16_t altitudeMax;
+
+  float speedMean() const { return packets ? speedSum / packets : 0.0f; }
+};
+
+struct El3SensorRollup {
+  uint32_t sensorId;
+  uint32_t packets;
+};
+
+struct El3HeatCell {
+  float latitude;               /* south-west corner */
+  float longitude;
+  uint32_t packets;
+};
+
+struct El3WindowSummary {
+  int64_t startNs;
+  int64_t endNs;
+  uint64_t packets;
+  uint64_t cellsDropped;                /* packets outside the heatmap, its cells full */
+  std::vector<El3UavRollup> uavs;       /* by UAV ID */
+  std::vector<El3SensorRollup> sensors; /* by sensor ID */
+  std::vector<El3HeatCell> cells;       /* busiest first */
+};
+
+/*
+ * Rollups of decoded packets over tumbling or sliding windows: per UAV (packets, mean and top speed,
+ * altitude range, video channels), per sensor (reports received) and a coverage heatmap.
+ *
+ * Time is cut into panes, the GCD of window length and slide, and every UAV and sensor keeps one
+ * pre-aggregated pane per pane of the window, so a packet costs a constant amount of work. Windows
+ * are put together from their panes when they close, or when queried. UAVs and sensors that went
+ * quiet for a whole window are forgotten, which bounds memory by those active within a window.
+ *
+ * Packets are placed by their receive time. Those later than the oldest pane still held are only
+ * counted (late()); windows that closed before a packet arrived do not change. Not thread-safe.
+ */
+class El3Aggregator
+{
+  public:
+    /* throws std::invalid_argument on a slide longer than the window, or too many panes */
+    El3Aggregator(const El3AggregateConfig &config = El3AggregateConfig());
+
+    /* a decoded packet, for the UAV rollups and the heatmap */
+    void add(const El3TelemetryRecord &rec, int64_t recvNs);
+
+    /* a report heard by a sensor */
+    void receive(uint32_t sensorId, int64_t recvNs);
+
+    /* windows closed by nowNs, oldest first */
+    void advance(int64_t nowNs, std::vector<El3WindowSummary> &out);
+
+    /* the window ending with the pane nowNs falls in, partial */
+    void query(int64_t nowNs, El3WindowSummary &out) const;
+
+    const El3AggregateConfig &config() const { return m_config; }
+    size_t uavs() const { return m_uavIndex.size(); }
+    size_t sensors() const { return m_sensorIndex.size(); }
+    uint64_t late() const { return m_late; }
+    uint64_t closedDropped() const { return m_closedDropped; }
+
+  private:
+    struct UavPane {
+      int64_t index;            /* pane number, receive time over pane width */
+      El3UavRollup rollup;
+    };
+
+    struct SensorPane {
+      int64_t index;
+      uint32_t packets;
+    };
+
+    struct HeatPane {
+      int64_t index;
+      uint64_t dropped;
+      std::unordered_map<uint64_t, uint32_t> cells;
+    };
+
+    /* false for a packet too late to keep */
+    bool roll(int64_t pane);
+    void close(int64_t end);
+    void summarize(int64_t first, int64_t end, El3WindowSummary &out) const;
+    void evict();
+
+    El3AggregateConfig m_config;
+    int64_t m_paneNs;
+    uint32_t m_panes;           /* per window */
+    uint32_t m_slide;           /* panes */
+
+    int64_t m_pane;             /* newest pane seen, INT64_MIN before the first packet */
+    int64_t m_lastData;         /* newest pane holding anything */
+
+    /* m_panes slots per UAV and sensor, pane n in slot n % m_panes */
+    std::vector<UavPane> m_uavPanes;
+    std::unordered_map<uint16_t, uint32_t> m_uavIndex;
+    std::vector<uint16_t> m_uavNos;
+    std::vector<int64_t> m_uavNewest;
+    std::vector<SensorPane> m_sensorPanes;
+    std::unordered_map<uint32_t, uint32_t> m_sensorIndex;
+    std::vector<uint32_t> m_sensorIds;
+    std::vector<int64_t> m_sensorNewest;
+    std::vector<HeatPane> m_heat;
+
+    std::vector<El3WindowSummary> m_closed;
+    uint64_t m_late;
+    uint64_t m_closedDropped;
+};
+
+template <typename Writer>
+void el3WriteJson(const El3WindowSummary &summary, Writer &writer)
+{
+    writer.StartObject();
+    writer.Key("start_ns");         writer.Int64(summary.startNs);
+    writer.Key("end_ns");           writer.Int64(summary.endNs);
+    writer.Key("packets");          writer.Uint64(summary.packets);
+
+    writer.Key("uavs");
+    writer.StartArray();
+    for (auto &uav : summary.uavs)
+    {
+        writer.StartObject();
+        writer.Key("uav_id");       writer.Uint(uav.uavNo);
+        writer.Key("packets");      writer.Uint(uav.packets);
+        writer.Key("speed_mean");   writer.Double(uav.speedMean());
+        writer.Key("speed_max");    writer.Double(uav.speedMax);
+        writer.Key("altitude_min"); writer.Uint(uav.altitudeMin);
+        writer.Key("altitude_max"); writer.Uint(uav.altitudeMax);
+        writer.Key("video_channels");
+        writer.StartArray();
+        for (unsigned ch = 0; ch < 16; ch++)
+            if (uav.channels & (1u << ch))
+                writer.Uint(ch);
+        writer.EndArray();
+        writer.EndObject();
+    }
+    writer.EndArray();
+
+    writer.Key("sensors");
+    writer.StartArray();
+    for (auto &sensor : summary.sensors)
+    {
+        writer.StartObject();
+        writer.Key("sensor_id");    writer.Uint(sensor.sensorId);
+        writer.Key("packets");      writer.Uint(sensor.packets);
+        writer.EndObject();
+    }
+    writer.EndArray();
+
+    writer.Key("cells");
+    writer.StartArray();
+    for (auto &cell : summary.cells)
+    {
+        writer.StartObject();
+        writer.Key("latitude");     writer.Double(cell.latitude);
+        writer.Key("longitude");    writer.Double(cell.longitude);
+        writer.Key("packets");      writer.Uint(cell.packets);
+        writer.EndObject();
+    }
+    writer.EndArray();
+    writer.Key("cells_dropped");    writer.Uint64(summary.cellsDropped);
+    writer.EndObject();
+}
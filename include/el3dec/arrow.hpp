@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2022 Subreption LLC. All rights reserved.
+ * Author: 12dc8242df1be0d6f4b73d68166552197936a27074c004c8af95b27194ec584d
+ *
+ * Dual-licensed under the Subreption Ukraine Defense License (SUDL, version 1) and the  Server Side
+ * Public License (SSPL, version 3). Both licenses are provided with this software distribution.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <el3dec/telemetry.hpp>
+
+/*
+ * Decoded telemetry as Apache Arrow IPC, the columnar format pandas, polars and DuckDB load without
+ * parsing: the file format (Feather v2, .arrow) or the stream format. Just enough of Arrow is written
+ * here that there is no dependency on the Arrow libraries.
+ *
+ * One column per telemetry field, named after its JSON key (nested ones joined by an underscore:
+ * gps_latitude, camera_azimuth), in the record's own width: floats stay float32, counters and IDs
+ * unsigned 8 or 16 bits. recv_ns, a UTC nanosecond timestamp, comes first where receive times are
+ * known. Nothing is nullable, and buffers are 64 byte aligned, so a mapped file converts to NumPy
+ * arrays without copies.
+ */
+
+/* rows per record batch: with about 64 bytes a row, a batch stays within a core's L2 cache */
+#define EL3_ARROW_BATCH_ROWS    8192
+
+enum El3ArrowLayout {
+  ARROW_FILE,           /* random access, with a footer; complete once end() is written */
+  ARROW_STREAM          /* schema, then batches as they come, for pipes and sockets */
+};
+
+class El3ArrowWriter
+{
+  public:
+    El3ArrowWriter(El3ArrowLayout layout, bool receiveTimes = true);
+
+    /* the schema, after the file magic for ARROW_FILE; once, before any batch */
+    void begin(std::string &out);
+
+    /* a row for the next batch; recvNs is ignored without receive times */
+    void add(const El3TelemetryRecord &rec, int64_t recvNs = 0);
+
+    /* rows added since the last batch */
+    size_t pending() const { return m_pending; }
+
+    /* the pending rows as a record batch, nothing if there are none */
+    void batch(std::string &out);
+
+    /* pending rows, the end-of-stream marker and for ARROW_FILE the footer; the writer is done */
+    void end(std::string &out);
+
+    uint64_t rows() const { return m_rows; }
+    size_t batches() const { return m_blocks.size(); }
+
+  private:
+    /* where a batch went, for the file footer */
+    struct Block {
+      int64_t offset;
+      int32_t metaDataLength;
+      int32_t padding;
+      int64_t bodyLength;
+    };
+
+    void message(std::string &out, const std::string &meta, const std::string &body);
+
+    El3ArrowLayout m_layout;
+    bool m_receiveTimes;
+    std::vector<std::string> m_columns;     /* column data of the pending rows */
+    size_t m_pending;
+    uint64_t m_rows;
+    uint64_t m_written;                     /* bytes out so far, batch offsets in the file */
+    std::vector<Block> m_blocks;
+};
@@ -0,0 +1,336 @@
+/*
+ * Copyright (c) 2022 Subreption LLC. All rights reserved.
+ * Author: 12dc8242df1be0d6f4b73d68166552197936a27074c004c8af95b27194ec584d
+ *
+ * Dual-licensed under the Subreption Ukraine Defense License (SUDL, version 1) and the  Server Side
+ * Public License (SSPL, version 3). Both licenses are provided with this software distribution.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+class El3Uring;
+
+/*
+ * Capture archive format (all integers little-endian):
+ *
+ *   file header    El3CaptureFileHeader
+ *   block 0        El3CaptureBlockHeader, then records
+ *   ...
+ *   block N
+ *   index          El3CaptureIndexHeader, El3CaptureBlockEntry[blocks], El3CaptureUavEntry[postings]
+ *   trailer        El3CaptureTrailer
+ *
+ * A record is an El3CaptureRecordHeader followed by the raw frame, padded to 8 bytes. Blocks are
+ * written whole with buffered I/O, so a reader never sees a partial one; io_uring writes go out in
+ * segments regardless of block boundaries, a torn block at the end is simply not there yet. The
+ * index is only written when the archive is closed; archives without one (crash, still being
+ * written) are recovered by walking the block headers. Reopening an archive truncates its index
+ * and keeps appending blocks.
+ */
+
+#define EL3_CAPTURE_MAGIC           "EL3CAP01"
+#define EL3_CAPTURE_TRAILER_MAGIC   "EL3CEND1"
+#define EL3_CAPTURE_BLOCK_MAGIC     0x4b4c4245    /* "EBLK" */
+#define EL3_CAPTURE_INDEX_MAGIC     0x58444e49    /* "INDX" */
+#define EL3_CAPTURE_VERSION         1
+
+#define EL3_CAPTURE_DEFAULT_BLOCK   (64 * 1024)
+#define EL3_CAPTURE_MIN_BLOCK       1024
+#define EL3_CAPTURE_MAX_FRAME       0xffff
+
+/* O_DIRECT offsets, lengths and buffers are multiples of this */
+#define EL3_CAPTURE_DIRECT_ALIGN    4096
+
+/* uavNo of frames that do not carry a readable Eleron header */
+#define EL3_CAPTURE_NO_UAV          0xffffffff
+
+#pragma pack(push, 1)
+
+struct El3CaptureFileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t blockSize;
+  int64_t createdNs;
+  uint8_t reserved[40];
+};
+
+struct El3CaptureBlockHeader {
+  uint32_t magic;
+  uint32_t records;
+  uint32_t bytes;           /* record data following this header */
+  uint32_t reserved;
+  int64_t minNs;
+  int64_t maxNs;
+};
+
+struct El3CaptureRecordHeader {
+  int64_t recvNs;           /* receive time, ns since the epoch (UTC) */
+  uint32_t sensorId;
+  uint16_t length;
+  uint16_t reserved;
+};
+
+struct El3CaptureIndexHeader {
+  uint32_t magic;
+  uint32_t blocks;
+  uint32_t postings;
+  uint32_t reserved;
+};
+
+struct El3CaptureBlockEntry {
+  uint64_t offset;          /* of the block header, from the start of the file */
+  int64_t minNs;
+  int64_t maxNs;
+  uint32_t records;
+  uint32_t bytes;
+};
+
+/* one per (UAV, block) pair, sorted by UAV then block */
+struct El3CaptureUavEntry {
+  uint32_t uavNo;
+  uint32_t block;
+};
+
+struct El3CaptureTrailer {
+  uint64_t indexOffset;
+  char magic[8];
+};
+
+#pragma pack(pop)
+
+/* a record as seen through the reader's mapping, valid for the reader's lifetime */
+struct El3CaptureRecord {
+  int64_t recvNs;
+  uint32_t sensorId;
+  uint16_t length;
+  const unsigned char *data;
+};
+
+struct El3CaptureCursor {
+  uint32_t block;
+  uint32_t remaining;       /* records left in the current block */
+  size_t offset;            /* of the next record header */
+};
+
+enum El3CaptureIoMode {
+  CAPTURE_IO_AUTO,          /* io_uring where the kernel has it, buffered I/O otherwise */
+  CAPTURE_IO_BUFFERED,      /* write(2), mapped reads */
+  CAPTURE_IO_URING          /* io_uring or an exception */
+};
+
+/*
+ * How archives are written and streamed. With io_uring, up to depth buffers of bufferSize bytes
+ * are in flight at once, registered with the kernel when it allows. direct bypasses the page
+ * cache (O_DIRECT) on file systems that support it; buffered I/O ignores it.
+ */
+struct El3CaptureIoConfig {
+  El3CaptureIoMode mode = CAPTURE_IO_AUTO;
+  bool direct = false;
+  uint32_t depth = 8;
+  uint32_t bufferSize = 1024 * 1024;
+};
+
+/* auto, buffered, uring or direct (io_uring and O_DIRECT) into io, false for anything else */
+bool el3ParseCaptureIo(const std::string &name, El3CaptureIoConfig &io);
+
+/* UAV ID of a raw frame, EL3_CAPTURE_NO_UAV if the header is missing */
+uint32_t el3CaptureUav(const unsigned char *frame, size_t len);
+
+/*
+ * The records of blocks held in memory, laid out as in an archive (El3CaptureWriter::unwritten()),
+ * appended to out and pointing into data; stops at a damaged or truncated block.
+ */
+void el3CaptureRecords(const unsigned char *data, size_t len, std::vector<El3CaptureRecord> &out);
+
+/*
+ * Append-only archive writer. Records accumulate in a block-sized buffer which is written with a
+ * single call once full; the block and UAV indexes are kept in memory and written on close().
+ * With io_uring, full blocks are copied into the current segment buffer and segments are written
+ * asynchronously, so append() only waits when every buffer is still in flight. Errors throw
+ * std::runtime_error, those of asynchronous writes from the next call. Not thread-safe.
+ */
+class El3CaptureWriter
+{
+  public:
+    El3CaptureWriter(const std::string &path, uint32_t blockSize = EL3_CAPTURE_DEFAULT_BLOCK,
+        const El3CaptureIoConfig &io = El3CaptureIoConfig());
+    ~El3CaptureWriter();
+
+    void append(int64_t recvNs, uint32_t sensorId, const unsigned char *frame, size_t len);
+
+    /*
+     * Write out the current block even if it is not full yet. With O_DIRECT, what does not fill
+     * an aligned unit stays buffered until the next flush or close. With wait, io_uring writes are
+     * complete on return, for readers of the archive being written.
+     */
+    void flush(bool wait = false);
+
+    /*
+     * For reading the archive while it is written, without flushing it: how much of the file is
+     * complete, with what follows copied into tail as it will be written, the block being filled
+     * included. Only waits on the disk when io_uring completed writes out of order and the data
+     * between them is no longer buffered.
+     */
+    uint64_t unwritten(std::vector<unsigned char> &tail);
+
+    /* flush, write the index and trailer, close the file */
+    void close();
+
+    uint64_t records() const { return m_records; }
+    size_t blocks() const { return m_blocks.size(); }
+
+    /* writing through io_uring, and bypassing the page cache */
+    bool uring() const { return (bool) m_uring; }
+    bool direct() const { return m_direct; }
+
+  private:
+    struct Segment {
+      uint64_t fileOffset;      /* of the first byte of the buffer */
+      size_t used;
+      size_t writing;           /* bytes in flight, 0 when the buffer is free */
+    };
+
+    void open(const std::string &path);
+    void openUring(const std::string &path, bool resume);
+    void writeAll(const void *buf, size_t len);
+    void finishBlock();
+
+    void submitSegment();
+    void reap(bool wait);
+    void drain();
+    void checkIo();
+    unsigned char *segment(unsigned n) { return m_segmentMemory + (size_t) n * m_io.bufferSize; }
+
+    int m_fd;
+    uint32_t m_blockSize;
+    uint64_t m_offset;
+    uint64_t m_records;
+
+    El3CaptureIoConfig m_io;
+    std::unique_ptr<El3Uring> m_uring;
+    bool m_direct;
+    unsigned char *m_segmentMemory;
+    std::vector<Segment> m_segments;
+    unsigned m_segment;         /* being filled */
+    std::string m_ioError;
+
+    std::vector<unsigned char> m_block;
+    El3CaptureBlockHeader m_current;
+    std::vector<uint32_t> m_currentUavs;
+
+    std::vector<El3CaptureBlockEntry> m_blocks;
+    std::vector<El3CaptureUavEntry> m_postings;
+};
+
+/*
+ * Read-only, memory mapped archive reader. Lookups by time range and UAV only touch the index;
+ * record data is paged in when iterated. Errors throw std::runtime_error.
+ */
+class El3CaptureReader
+{
+  public:
+    /* with size, only the start of the file is read, as of an archive being written */
+    El3CaptureReader(const std::string &path, uint64_t size = UINT64_MAX);
+    ~El3CaptureReader();
+
+    size_t blocks() const { return m_blocks.size(); }
+    uint64_t records() const;
+    const El3CaptureBlockEntry &block(uint32_t n) const { return m_blocks[n]; }
+
+    /* true when the index had to be rebuilt from the block headers */
+    bool recovered() const { return m_recovered; }
+
+    /* blocks that may hold records received within [fromNs, toNs], in file order */
+    void blocksInRange(int64_t fromNs, int64_t toNs, std::vector<uint32_t> &out) const;
+
+    /* blocks holding at least one frame of the given UAV, in file order */
+    void blocksForUav(uint32_t uavNo, std::vector<uint32_t> &out) const;
+
+    /* iterate the records of a block */
+    void begin(uint32_t block, El3CaptureCursor &cursor) const;
+    bool next(El3CaptureCursor &cursor, El3CaptureRecord &rec) const;
+
+    /* size of the valid data (file header and complete blocks), where appending resumes */
+    uint64_t dataEnd() const { return m_dataEnd; }
+
+    /* the bytes past the last complete block of an archive without an index, out cleared first */
+    void partial(std::vector<unsigned char> &out) const;
+
+    const std::vector<El3CaptureUavEntry> &postings() const { return m_postings; }
+    const std::vector<El3CaptureBlockEntry> &blockEntries() const { return m_blocks; }
+
+  private:
+    bool loadIndex(uint64_t indexOffset);
+    void recover();
+
+    const unsigned char *m_map;
+    size_t m_size;
+    uint64_t m_dataEnd;
+    bool m_recovered;
+    bool m_sortedByTime;
+
+    std::vector<El3CaptureBlockEntry> m_blocks;
+    std::vector<El3CaptureUavEntry> m_postings;
+};
+
+/*
+ * Streams the records of a list of blocks of an archive, in list order, reading instead of
+ * touching the reader's mapping: ahead through io_uring into registered buffers, runs of
+ * consecutive blocks at once, or with pread(2) when io_uring is not available. For scans of
+ * archives larger than memory, with direct to keep them out of the page cache. Errors throw
+ * std::runtime_error.
+ */
+class El3CaptureBlockStream
+{
+  public:
+    El3CaptureBlockStream(const El3CaptureReader &reader, const std::string &path,
+        const std::vector<uint32_t> &blocks, const El3CaptureIoConfig &io = El3CaptureIoConfig());
+    ~El3CaptureBlockStream();
+
+    /* the next record, its data valid until the next call */
+    bool next(El3CaptureRecord &rec);
+
+    bool uring() const { return (bool) m_uring; }
+    bool direct() const { return m_direct; }
+
+  private:
+    /* consecutive blocks read at once */
+    struct Run {
+      size_t first;             /* in m_blocks */
+      size_t last;
+      uint64_t fileOffset;      /* aligned for O_DIRECT */
+      uint32_t length;
+      unsigned slot;
+      bool done;
+    };
+
+    void issue();
+    void wait(Run &run);
+    bool nextBlock();
+
+    const El3CaptureReader &m_reader;
+    std::vector<uint32_t> m_blocks;
+    El3CaptureIoConfig m_io;
+    std::unique_ptr<El3Uring> m_uring;
+    bool m_direct;
+    int m_fd;
+
+    size_t m_slotSize;
+    unsigned char *m_slotMemory;
+    std::vector<unsigned> m_freeSlots;
+
+    std::vector<Run> m_runs;
+    size_t m_nextRun;           /* to issue */
+    size_t m_run;               /* being consumed */
+    size_t m_block;             /* in m_blocks, being iterated */
+    const unsigned char *m_data;    /* record data of the block being iterated */
+    uint32_t m_remaining;
+    size_t m_offset;
+    size_t m_end;
+};
@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2022 Subreption LLC. All rights reserved.
+ * Author: 12dc8242df1be0d6f4b73d68166552197936a27074c004c8af95b27194ec584d
+ *
+ * Dual-licensed under the Subreption Ukraine Defense License (SUDL, version 1) and the  Server Side
+ * Public License (SSPL, version 3). Both licenses are provided with this software distribution.
+ */
+
+#pragma once
+
+/*
+ * Stable C ABI over the decoder, exported by libel3dec.so, for callers that are not C++ (the
+ * Python bindings in contrib/el3dec.py, FFIs in general). Nothing C++ crosses it: records are a
+ * fixed layout struct, errors are status codes, exceptions never escape.
+ *
+ * The layout of el3dec_record only ever grows at the end, into its reserved space first; bump
+ * EL3DEC_ABI_VERSION whenever it changes. Callers check el3dec_abi_version() and
+ * el3dec_record_size() against what they were written for.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define EL3DEC_ABI_VERSION      1
+
+#if defined(__GNUC__)
+#define EL3DEC_API              __attribute__((visibility("default")))
+#else
+#define EL3DEC_API
+#endif
+
+/* decoding modes, as El3DecOpMode */
+#define EL3DEC_FAULT_TOLERANT   0
+#define EL3DEC_FAULT_INTOLERANT 1
+
+/* el3dec_record.status */
+#define EL3DEC_OK               0
+#define EL3DEC_INVALID          1   /* no usable header, or rejected in fault intolerant mode */
+
+/* one decoded frame, 64 bytes */
+typedef struct el3dec_record {
+  uint16_t uav_no;
+  uint16_t flight_time;           /* s */
+  uint8_t status;
+  uint8_t packet_type;
+  uint8_t engine_type;
+  uint8_t uav_type;
+  uint8_t stamp_hours;            /* UTC */
+  uint8_t stamp_minutes;
+  uint8_t stamp_seconds;
+  uint8_t track_verdict;          /* El3TrackVerdict, always unchecked here */
+  uint16_t altitude;              /* m */
+  uint16_t remaining_minutes;
+  uint16_t video_channel;
+  uint16_t video_freq;            /* MHz */
+  float latitude;
+  float longitude;
+  float ground_speed;             /* km/h */
+  float careen;                   /* degrees */
+  float pitch;                    /* degrees */
+  float camera_angle;
+  float camera_position;
+  float camera_azimuth;
+  float track_confidence;
+  uint32_t reserved[2];
+} el3dec_record;
+
+EL3DEC_API int el3dec_abi_version(void);
+EL3DEC_API size_t el3dec_record_size(void);
+
+/* decode one frame, returns its status (also stored in out->status) */
+EL3DEC_API int el3dec_decode(const uint8_t *frame, size_t len, int mode, el3dec_record *out);
+
+/*
+ * Decode count frames laid out at a fixed stride (a 2D array of frames, one per row). Frame i is
+ * lengths[i] bytes long, or stride bytes when lengths is NULL; a length over the stride is
+ * EL3DEC_INVALID. Every frame gets a record in out, including undecodable ones (status set).
+ * Returns the amount decoded successfully.
+ */
+EL3DEC_API size_t el3dec_decode_batch(const uint8_t *buf, size_t stride, const uint16_t *lengths,
+    size_t count, int mode, el3dec_record *out);
+
+/* same, for frames at arbitrary offsets into buf */
+EL3DEC_API size_t el3dec_decode_indexed(const uint8_t *buf, const uint64_t *offsets,
+    const uint16_t *lengths, size_t count, int mode, el3dec_record *out);
+
+/*
+ * Decode a raw byte stream of back to back frames (as received, or as el3dec_app writes them with
+ * -i binary), splitting on the magic and length bytes and resyncing on anything undecodable, which
+ * is skipped. Stops when max records were written or at a frame cut short by the end of buf; the
+ * bytes used are stored in consumed so the caller can carry on from there. Returns the records
+ * written, all with an OK status.
+ */
+EL3DEC_API size_t el3dec_decode_stream(const uint8_t *buf, size_t len, int mode, el3dec_record *out,
+    size_t max, size_t *consumed);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,29 @@
+/*
+ * Copyright (c) 2022 Subreption LLC. All rights reserved.
+ * Author: 12dc8242df1be0d6f4b73d68166552197936a27074c004c8af95b27194ec584d
+ *
+ * Dual-licensed under the Subreption Ukraine Defense License (SUDL, version 1) and the  Server Side
+ * Public License (SSPL, version 3). Both licenses are provided with this software distribution.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <el3dec/telemetry.hpp>
+
+/* Size of the telemetry frames seen on the air, header and length byte included */
+#define EL3_TELEMETRY_FRAME_LEN     100
+
+/**
+ * Encode a record into an Eleron 3 telemetry frame (El3EleronTelemetryV1), the inverse of parseRaw().
+ * Values are quantized the way the air frames carry them (coordinates to 1/6e5 degree, speed and
+ * careen to 0.25, pitch, azimuth and camera position to 0.1, camera angle to 0.05) and clamped to
+ * the width of their fields. Bytes the decoder ignores are left zero. The packet type, length and
+ * track fields of the record are not used.
+ *
+ * @param  rec
+ * @param  out     receives EL3_TELEMETRY_FRAME_LEN bytes
+ * @param  outlen
+ * @return bytes written, 0 if out is too small
+ */
+size_t el3EncodeTelemetry(const El3TelemetryRecord &rec, unsigned char *out, size_t outlen);
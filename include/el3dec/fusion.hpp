@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2022 Subreption LLC. All rights reserved.
+ * Author: 12dc8242df1be0d6f4b73d68166552197936a27074c004c8af95b27194ec584d
+ *
+ * Dual-licensed under the Subreption Ukraine Defense License (SUDL, version 1) and the  Server Side
+ * Public License (SSPL, version 3). Both licenses are provided with this software distribution.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include <el3dec/telemetry.hpp>
+
+/* upper bound of reports merged into a single packet (one per sensor) */
+#define EL3_FUSION_MAX_REPORTS  16
+
+/* emitted packet keys remembered per UAV, to recognize late duplicates */
+#define EL3_FUSION_RECENT_KEYS  8
+
+/* consecutive implausible packets after which the track is re-anchored */
+#define EL3_FUSION_REANCHOR     3
+
+struct El3FusionConfig {
+  El3FusionConfig():
+      windowMs(250), maxSpeed(100.0), positionSlack(150.0) {}
+
+  /* how long a packet collects reports after the first one was received */
+  uint32_t windowMs;
+
+  /* m/s, generous upper bound for the airframe, used by the track plausibility check */
+  float maxSpeed;
+
+  /* meters tolerated on top of maxSpeed * elapsed flight time */
+  float positionSlack;
+};
+
+/* best-estimate record for one packet, merged from every sensor that heard it */
+struct El3FusedRecord {
+  El3TelemetryRecord record;
+
+  uint64_t firstSeenMs;   /* receive time of the earliest report */
+  uint32_t firstSensor;   /* sensor that delivered it */
+  uint8_t reports;        /* reports merged (distinct sensors) */
+  uint8_t agreeing;       /* reports identical to the fused record on every voted field */
+  uint8_t implausible;    /* reports whose position failed the track check */
+};
+
+struct El3SensorStats {
+  uint64_t received;      /* reports ingested */
+  uint64_t first;         /* reports that opened a packet (heard before any other sensor) */
+  uint64_t agreed;        /* reports matching the fused record */
+  uint64_t outvoted;      /* reports with at least one field overruled by the majority */
+  uint64_t implausible;   /* reports rejected by the track plausibility check */
+  uint64_t duplicates;    /* repeated reports of a packet this sensor already delivered */
+  uint64_t late;          /* reports arriving after their packet was emitted */
+  uint64_t overflow;      /* reports dropped, their packet already had EL3_FUSION_MAX_REPORTS */
+};
+
+/*
+ * Multi-sensor fusion stage.
+ *
+ * Reports of the same packet (same UAV, timestamp and flight time) heard by several receivers are
+ * held for a bounded window and collapsed into a single record, voting field by field. Positions are
+ * checked against the UAV's track before voting, so single-receiver bit errors in the packed
+ * coordinates lose even when only two sensors are available. Output rate is one record per packet
+ * regardless of the amount of sensors.
+ *
+ * Time is supplied by the caller (milliseconds, any monotonic origin). Not thread-safe.
+ */
+class El3Fusion
+{
+  public:
+    El3Fusion(const El3FusionConfig &config = El3FusionConfig());
+
+    void ingest(uint32_t sensorId, const El3TelemetryRecord &rec, uint64_t nowMs);
+    void ingest(uint32_t sensorId, const El3Telemetry &tele, uint64_t nowMs) {
+      ingest(sensorId, tele.Record(), nowMs);
+    }
+
+    /* append packets whose window expired by nowMs to out, oldest first */
+    size_t poll(uint64_t nowMs, std::vector<El3FusedRecord> &out);
+
+    /* append every pending packet to out, regardless of its window */
+    size_t flush(std::vector<El3FusedRecord> &out);
+
+    size_t pending() const { return m_groups.size(); }
+    size_t tracks() const { return m_tracks.size(); }
+
+    /* last fused fix accepted into the track of a given UAV */
+    bool lastFix(uint16_t uavNo, El3TelemetryRecord *out) const;
+
+    const std::unordered_map<uint32_t, El3SensorStats> &sensorStats() const { return m_sensors; }
+
+  private:
+    struct Report {
+      uint32_t sensorId;
+      uint64_t recvMs;
+      El3TelemetryRecord rec;
+    };
+
+    struct Group {
+      uint64_t firstSeenMs;
+      uint8_t count;
+      Report reports[EL3_FUSION_MAX_REPORTS];
+    };
+
+    struct Track {
+      bool valid;
+      El3TelemetryRecord last;
+      uint8_t rejected;
+      uint8_t recentPos;
+      uint64_t recent[EL3_FUSION_RECENT_KEYS];
+    };
+
+    static uint64_t packetKey(const El3TelemetryRecord &rec);
+
+    bool plausible(const Track &track, const El3TelemetryRecord &rec) const;
+    void emit(uint64_t key, Group &group, std::vector<El3FusedRecord> &out);
+
+    El3FusionConfig m_config;
+
+    std::unordered_map<uint64_t, Group> m_groups;
+    std::unordered_map<uint16_t, Track> m_tracks;
+    std::unordered_map<uint32_t, El3SensorStats> m_sensors;
+};
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2022 Subreption LLC. All rights reserved.
+ * Author: 12dc8242df1be0d6f4b73d68166552197936a27074c004c8af95b27194ec584d
+ *
+ * Dual-licensed under the Subreption Ukraine Defense License (SUDL, version 1) and the  Server Side
+ * Public License (SSPL, version 3). Both licenses are provided with this software distribution.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Packet layouts. A layout is a set of constexpr field offsets for one packet type and firmware
+ * revision; El3Telemetry instantiates a decoder per layout, so the offsets end up as immediates in
+ * straight-line code. Decoders are picked through a 256-entry table indexed by the packet type
+ * byte, built at compile time from El3Layouts. Packet types without a layout decode the header
+ * only.
+ *
+ * To add a layout, describe it like El3EleronTelemetryV1 and append it to El3Layouts. When several
+ * revisions of one packet type are registered the last one is active, el3SelectLayout() switches
+ * between them (before decoding starts, the table is not synchronized with decoders).
+ */
+
+#define ENICS_ELERON_PACKET_MAGICBYTE 0xAA
+#define ENICS_ELERON_PACKET_TELEMETRY 0x0F
+
+/* the header every packet type shares */
+#define EL3_HEADER_MAGIC        0x00
+#define EL3_HEADER_LENGTH       0x01
+#define EL3_HEADER_TYPE         0x02    /* engine type << 5 | UAV type */
+#define EL3_HEADER_UAV          0x03    /* big-endian */
+#define EL3_HEADER_PACKET_TYPE  0x05
+
+/* longest raw frame: the length byte, plus the magic, length and checksum bytes it does not count */
+#define EL3_MAX_FRAME_BYTES     (255 + 3)
+
+/* telemetry as seen from the field so far */
+struct El3EleronTelemetryV1 {
+  static constexpr uint8_t packetType = ENICS_ELERON_PACKET_TELEMETRY;
+  static constexpr uint8_t version = 1;
+
+  /* UTC hours, minutes, seconds; then big-endian flight time */
+  static constexpr size_t stamp = 0x06;
+  static constexpr size_t flightTime = 0x09;
+
+  /* 27-bit coordinates: low 24 bits big-endian, top 3 bits of both share one byte */
+  static constexpr size_t latitude = 0x0b;
+  static constexpr size_t longitude = 0x0f;
+  static constexpr size_t coordinateMsb = 0x0e;
+  static constexpr int latitudeShift = 5;
+  static constexpr int longitudeShift = 0;
+
+  /* speed low byte, both high nibbles, careen low byte */
+  static constexpr size_t speedCareen = 0x12;
+  /* low byte, then the high nibble on top of the next one */
+  static constexpr size_t pitch = 0x18;
+  static constexpr size_t altitude = 0x1f;
+  /* little-endian, unlike everything else */
+  static constexpr size_t remainingMinutes = 0x32;
+
+  static constexpr size_t videoChannel = 0x44;
+
+  /* angle low byte, then its top 3 bits on top of the next one */
+  static constexpr size_t cameraAngle = 0x3d;
+  /* azimuth low byte, both high nibbles, position low byte */
+  static constexpr size_t azimuthPosition = 0x4e;
+
+  /* a frame this long carries every field, the decoder skips all length checks */
+  static constexpr size_t fullLength = azimuthPosition + 3;
+};
+
+template <typename... Layouts>
+struct El3LayoutList {};
+
+/* every layout compiled in */
+typedef El3LayoutList<El3EleronTelemetryV1> El3Layouts;
+
+/* activate another registered revision of a packet type's layout, false if there is none */
+bool el3SelectLayout(uint8_t packetType, uint8_t version);
+
+/* revision active for a packet type, 0 if it has no layout */
+uint8_t el3LayoutVersion(uint8_t packetType);
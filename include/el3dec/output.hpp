@@ -0,0 +1,247 @@
+/*
+ * Copyright (c) 2022 Subreption LLC. All rights reserved.
+ * Author: 12dc8242df1be0d6f4b73d68166552197936a27074c004c8af95b27194ec584d
+ *
+ * Dual-licensed under the Subreption Ukraine Defense License (SUDL, version 1) and the  Server Side
+ * Public License (SSPL, version 3). Both licenses are provided with this software distribution.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <el3dec/arrow.hpp>
+#include <el3dec/telemetry.hpp>
+
+/*
+ * Output sinks, where decoded records go besides the sender: files, a TCP peer, an AMQP broker.
+ *
+ * Records pushed to a sink wait in a bounded queue and are written in batches by a thread of the
+ * sink's own, so a slow or unreachable destination never holds up decoding. What a full queue
+ * does is the sink's backpressure policy. A batch that cannot be written is kept and retried, with
+ * a growing pause, until it goes through or the sink stops; meanwhile the queue fills up.
+ *
+ * Records are written as NDJSON, one {"recv_ns":...,"telemetry":{...}} object per line, as raw
+ * El3TelemetryRecord structs or relayed records (El3RelayRecord, el3dec/relay.hpp) back to back, or
+ * as Arrow IPC (el3dec/arrow.hpp), a record batch per batch written.
+ */
+
+/* record encodings, shared with el3dec_app */
+enum El3OutputFormat {
+  OUTPUT_NDJSON,
+  OUTPUT_BINARY,        /* raw El3TelemetryRecord structs, host order, without the receive time */
+  OUTPUT_RELAY,         /* 58-byte El3RelayRecord, portable */
+  OUTPUT_ARROW          /* Arrow IPC */
+};
+
+enum El3OutputPolicy {
+  OUTPUT_BLOCK,         /* push() waits for room */
+  OUTPUT_DROP_NEWEST,   /* the record pushed is dropped */
+  OUTPUT_DROP_OLDEST    /* the oldest record queued is dropped */
+};
+
+struct El3OutputConfig {
+  El3OutputFormat format = OUTPUT_NDJSON;
+  El3OutputPolicy policy = OUTPUT_DROP_OLDEST;
+  size_t queue = 65536;         /* records */
+  size_t batch = 512;           /* records written at once, at most */
+  uint32_t flushMs = 100;       /* longest a record waits for its batch to fill up */
+};
+
+struct El3OutputCounters {
+  uint64_t queued;
+  uint64_t written;
+  uint64_t dropped;
+  uint64_t failures;            /* batches that had to be retried */
+};
+
+struct El3OutputItem {
+  int64_t recvNs;
+  El3TelemetryRecord record;
+};
+
+class El3OutputSink
+{
+  public:
+    El3OutputSink(const std::string &name, const El3OutputConfig &config);
+    virtual ~El3OutputSink();
+
+    /* the writer thread; the derived class constructor is done by then */
+    void start();
+
+    /*
+     * Write what is queued, giving up on it after timeoutMs if the destination is gone. Derived
+     * classes call it from their destructor, the writer thread uses them.
+     */
+    void stop(uint32_t timeoutMs = 5000);
+
+    /* thread-safe, false if the record was dropped */
+    bool push(const El3TelemetryRecord &rec, int64_t recvNs);
+
+    const std::string &name() const { return m_name; }
+    const El3OutputConfig &config() const { return m_config; }
+    El3OutputCounters counters();
+
+    /* why the last batch failed, empty once one went through */
+    std::string lastError();
+
+  protected:
+    /* write one batch, throwing std::runtime_error when it did not make it; called by one thread */
+    virtual void write(const std::vector<El3OutputItem> &batch) = 0;
+
+    /* records written since the previous call made it out of the process, called when idle */
+    virtual void flush() {}
+
+    /* the writer thread is leaving */
+    virtual void close() {}
+
+    /* append a batch in the configured format, for Arrow a stream of its own */
+    void format(const std::vector<El3OutputItem> &batch, std::string &out) const;
+
+  private:
+    void run();
+
+    std::string m_name;
+    El3OutputConfig m_config;
+
+    std::mutex m_mutex;
+    std::condition_variable m_ready;    /* records queued, or stopping */
+    std::condition_variable m_room;     /* room in the queue, for OUTPUT_BLOCK */
+    std::deque<El3OutputItem> m_queue;
+    El3OutputCounters m_counters;
+    std::string m_lastError;
+    bool m_stopping;
+    int64_t m_deadlineMs;               /* when stopping, steady clock */
+
+    std::thread m_thread;
+};
+
+/*
+ * Rotating files. A %N in the path is replaced by a number, counting up from the first file that
+ * does not exist yet; without one, rotated files get a .N suffix. Files are rotated once they
+ * reach rotateBytes or are rotateSeconds old (0 turns either off), and synced when the sink idles.
+ *
+ * Arrow files are complete, footer and all, once rotated or closed. They are never appended to:
+ * a file that is there already, or was left behind by a failed write, is moved aside as on rotation.
+ */
+class El3FileOutput : public El3OutputSink
+{
+  public:
+    El3FileOutput(const std::string &path, const El3OutputConfig &config,
+        uint64_t rotateBytes = 0, uint32_t rotateSeconds = 0);
+    ~El3FileOutput() override;
+
+    /* the file being written, empty before the first batch */
+    std::string currentPath();
+
+  protected:
+    void write(const std::vector<El3OutputItem> &batch) override;
+    void flush() override;
+    void close() override;
+
+  private:
+    void open();
+    void closeFile();
+    void writeOut(const std::string &buf);
+
+    std::string m_path;
+    uint64_t m_rotateBytes;
+    uint32_t m_rotateSeconds;
+
+    int m_fd;
+    unsigned m_index;
+    uint64_t m_size;
+    int64_t m_openedMs;
+    std::string m_current;
+    std::mutex m_currentMutex;
+    std::string m_buf;
+    std::unique_ptr<El3ArrowWriter> m_arrow;
+};
+
+/*
+ * Pushes records to a TCP peer, reconnecting as needed. There are no acknowledgements: what the
+ * kernel took before the link broke may be lost, a batch that failed is sent again whole. Arrow
+ * goes out in the stream format, a new stream (schema first) on every connection.
+ */
+class El3TcpOutput : public El3OutputSink
+{
+  public:
+    El3TcpOutput(const std::string &host, const std::string &port, const El3OutputConfig &config);
+    ~El3TcpOutput() override;
+
+  protected:
+    void write(const std::vector<El3OutputItem> &batch) override;
+    void close() override;
+
+  private:
+    std::string m_host;
+    std::string m_port;
+    int m_fd;
+    std::string m_buf;
+    std::unique_ptr<El3ArrowWriter> m_arrow;
+};
+
+struct El3AmqpConfig {
+  std::string host = "127.0.0.1";
+  std::string port = "5672";
+  std::string vhost = "/";
+  std::string user = "guest";
+  std::string password = "guest";
+  std::string exchange = "el3dec";
+  std::string routingKey = "telemetry";
+};
+
+/*
+ * Publishes records to an AMQP 0-9-1 broker (RabbitMQ), one persistent message per record. The
+ * channel is in confirm mode: a batch counts as written once the broker acknowledged every message
+ * in it, a negative acknowledgement or a lost connection has it published again. The exchange is
+ * not declared, it has to exist (the default exchange, "", routes by queue name).
+ */
+class El3AmqpOutput : public El3OutputSink
+{
+  public:
+    El3AmqpOutput(const El3AmqpConfig &amqp, const El3OutputConfig &config);
+    ~El3AmqpOutput() override;
+
+  protected:
+    void write(const std::vector<El3OutputItem> &batch) override;
+    void close() override;
+
+  private:
+    void connect();
+    void disconnect();
+
+    void sendMethod(uint16_t channel, uint16_t classId, uint16_t methodId, const std::string &args);
+    void sendFrame(uint8_t type, uint16_t channel, const char *payload, size_t len);
+    void readFrame(uint8_t &type, uint16_t &channel, std::string &payload);
+    void expectMethod(uint16_t classId, uint16_t methodId, std::string &args);
+
+    El3AmqpConfig m_amqp;
+    int m_fd;
+    uint32_t m_frameMax;
+    uint64_t m_deliveryTag;             /* of the last message published on this channel */
+    std::string m_out;
+    std::string m_in;
+    size_t m_inPos;
+};
+
+/*
+ * A sink from a command line spec, KIND:TARGET[,key=value...]:
+ *
+ *   file:PATH          rotate-mb, rotate-s
+ *   tcp:HOST:PORT
+ *   amqp:HOST:PORT     exchange, routing-key, vhost, user, password
+ *
+ * and for all of them format (ndjson, binary, relay, or arrow for files and TCP), policy (block,
+ * drop-newest or drop-oldest), queue, batch and flush-ms. Arrow batches default to
+ * EL3_ARROW_BATCH_ROWS records. Throws std::invalid_argument on a spec it cannot make sense of. The
+ * sink is not started.
+ */
+std::unique_ptr<El3OutputSink> el3OutputSink(const std::string &spec);
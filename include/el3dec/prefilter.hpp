@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2022 Subreption LLC. All rights reserved.
+ * Author: 12dc8242df1be0d6f4b73d68166552197936a27074c004c8af95b27194ec584d
+ *
+ * Dual-licensed under the Subreption Ukraine Defense License (SUDL, version 1) and the  Server Side
+ * Public License (SSPL, version 3). Both licenses are provided with this software distribution.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <el3dec/layout.hpp>
+
+/*
+ * Pre-filter for candidate frames, from their first six bytes. Most of what a busy band hands us
+ * is not Eleron telemetry; screening it out here is a handful of loads and compares, where a full
+ * decode of it costs an exception.
+ *
+ * Verdicts are for FAULT_TOLERANT decoding:
+ *   ACCEPT   decodes, every field of the packet's layout is within the frame
+ *   DECODE   the header is sound but the frame is short, only a decode tells
+ *   REJECT   would not decode, or is not a packet we are interested in (see the reason)
+ */
+
+enum El3ScreenVerdict {
+  SCREEN_ACCEPT,
+  SCREEN_DECODE,
+  SCREEN_REJECT
+};
+
+/* why a frame was rejected, in the order the checks apply */
+enum El3ScreenReason {
+  SCREEN_OK,
+  SCREEN_SHORT,             /* shorter than the six byte header */
+  SCREEN_MAGIC,             /* no magic byte */
+  SCREEN_LENGTH,            /* length byte zero or past the end of the frame */
+  SCREEN_ENGINE_TYPE,       /* engine type not in the configured set */
+  SCREEN_UAV_TYPE,          /* UAV type not in the configured set */
+  SCREEN_PACKET_TYPE,       /* packet type without a layout, when those are not wanted */
+  SCREEN_REASONS
+};
+
+/* screening result: reason in the low bits, verdict above */
+#define EL3_SCREEN_REASON(r)    ((El3ScreenReason) ((r) & 0x0f))
+#define EL3_SCREEN_VERDICT(r)   ((El3ScreenVerdict) ((r) >> 4))
+
+struct El3ScreenConfig {
+  uint8_t engineTypes;      /* bit n set: engine type n is plausible */
+  uint32_t uavTypes;        /* bit n set: UAV type n is plausible */
+  bool layoutsOnly;         /* reject packet types no layout decodes */
+
+  /* everything the header can express is plausible, header-only packets are rejected */
+  El3ScreenConfig(): engineTypes(0xff), uavTypes(0xffffffff), layoutsOnly(true) {}
+};
+
+struct El3ScreenCounters {
+  uint64_t accepted;
+  uint64_t decode;
+  uint64_t rejected[SCREEN_REASONS];   /* by reason, [SCREEN_OK] unused */
+
+  uint64_t screened() const;
+};
+
+/*
+ * A screen compiles a configuration into lookup tables, then screens frames against it. Read-only
+ * once built, so one screen can serve many threads; counters are the callers'.
+ */
+class El3Screen
+{
+  public:
+    El3Screen(const El3ScreenConfig &config = El3ScreenConfig());
+
+    /* one frame, the result packs the verdict and reason (EL3_SCREEN_VERDICT/REASON) */
+    uint8_t screen(const unsigned char *frame, size_t len) const
+    {
+      if (len < EL3_HEADER_PACKET_TYPE + 1)
+        return SCREEN_REJECT << 4 | SCREEN_SHORT;
+
+      return classify(frame[EL3_HEADER_MAGIC], frame[EL3_HEADER_LENGTH], frame[EL3_HEADER_TYPE],
+          frame[EL3_HEADER_PACKET_TYPE], len > 0xff ? 0xff : len);
+    }
+
+    /*
+     * Many frames at once: the header bytes are gathered into columns and checked in blocks the
+     * compiler vectorizes. Results go to out, one per frame; counters are added to if given.
+     */
+    void screen(const unsigned char *const *frames, const size_t *lens, size_t count, uint8_t *out,
+        El3ScreenCounters *counters = NULL) const;
+
+    /* frames laid out at a fixed stride, as rows */
+    void screen(const unsigned char *frames, size_t stride, const uint16_t *lens, size_t count,
+        uint8_t *out, El3ScreenCounters *counters = NULL) const;
+
+    static void count(const uint8_t *results, size_t count, El3ScreenCounters &counters);
+
+  private:
+    /* the checks, without branches; len is clamped to a byte, the length byte cannot exceed it */
+    uint8_t classify(uint8_t magic, uint8_t length, uint8_t type, uint8_t packetType, uint8_t len) const
+    {
+      unsigned fails =
+        (magic != ENICS_ELERON_PACKET_MAGICBYTE) |
+        ((length == 0) | (length > len)) << 1 |
+        m_typeFails[type] << 2 |
+        m_packetFails[packetType] << 4;
+
+      unsigned reason = fails ? __builtin_ctz(fails) + SCREEN_MAGIC : SCREEN_OK;
+      unsigned verdict = fails ? SCREEN_REJECT :
+        len < m_fullLength[packetType] ? SCREEN_DECODE : SCREEN_ACCEPT;
+
+      return verdict << 4 | reason;
+    }
+
+    /* by header type byte: bit 0 engine type fails, bit 1 UAV type fails */
+    uint8_t m_typeFails[256];
+    /* by packet type: 1 if rejected */
+    uint8_t m_packetFails[256];
+    /* by packet type: frame length from which every field is present, 0 for header-only types */
+    uint8_t m_fullLength[256];
+};
+
+const char *el3ScreenReasonName(El3ScreenReason reason);
+
+/*
+ * Every header plausible and every packet type wanted: rejects exactly the frames a FAULT_TOLERANT
+ * decode would throw on for their header, so decoders can skip the exception.
+ */
+const El3Screen &el3DecodableScreen();
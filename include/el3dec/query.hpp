@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2022 Subreption LLC. All rights reserved.
+ * Author: 12dc8242df1be0d6f4b73d68166552197936a27074c004c8af95b27194ec584d
+ *
+ * Dual-licensed under the Subreption Ukraine Defense License (SUDL, version 1) and the  Server Side
+ * Public License (SSPL, version 3). Both licenses are provided with this software distribution.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <el3dec/capture.hpp>
+#include <el3dec/telemetry.hpp>
+#include <el3dec/trackstore.hpp>
+
+/* every fix of one UAV received within [fromNs, toNs] */
+struct El3TrackQuery {
+  uint16_t uavNo;
+  int64_t fromNs;           /* receive times, ns since the epoch (UTC) */
+  int64_t toNs;
+};
+
+struct El3QueryFix {
+  int64_t recvNs;
+  uint32_t sensorId;
+  El3TelemetryRecord record;
+};
+
+struct El3QueryStats {
+  uint32_t archives;        /* with blocks to read */
+  uint64_t blocks;          /* in every archive planned */
+  uint64_t blocksInRange;   /* by the time index */
+  uint64_t blocksRead;      /* in range and holding the UAV */
+  uint64_t framesScanned;
+  uint64_t framesDecoded;   /* in range and of the UAV */
+  uint64_t fixes;           /* returned, archived and live */
+};
+
+/*
+ * A time range of a UAV's track, from capture archives and the live track store, handed out a chunk
+ * at a time. Each archive is planned from its indexes alone: only blocks the time index puts in range
+ * and the UAV index says hold the UAV are read, streamed through El3CaptureBlockStream, and only
+ * frames in range carrying the UAV's ID are decoded. Memory is the archive indexes and the stream's
+ * buffers, whatever the number of fixes, and the fixes of an archive being written that are not in
+ * its file yet.
+ *
+ * Archives come in the order of their first block to read, their fixes as recorded, then those not
+ * written yet; live fixes last, but for those an archive already returned (same receive time), as
+ * when the daemon archives what it keeps. Errors throw std::runtime_error. Not thread-safe.
+ */
+class El3TrackQueryCursor
+{
+  public:
+    El3TrackQueryCursor(const El3TrackQuery &query, const El3CaptureIoConfig &io = El3CaptureIoConfig());
+    ~El3TrackQueryCursor();
+
+    /* archives and live fixes are added before the first call to next() */
+
+    /* an archive to search, dropped right away if it has nothing in range for the UAV */
+    void addArchive(const std::string &path);
+
+    /* the archive being written, as El3CaptureWriter::unwritten() left it: the file to written, then tail */
+    void addCapture(const std::string &path, uint64_t written, const std::vector<unsigned char> &tail);
+
+    /* the UAV's fixes in range held by the store, taken with the store locked */
+    void addLive(const El3TrackStore &store, uint32_t sensorId);
+
+    /* up to max further fixes into out (cleared first), false once there are none left */
+    bool next(std::vector<El3QueryFix> &out, size_t max);
+
+    const El3TrackQuery &query() const { return m_query; }
+    const El3QueryStats &stats() const { return m_stats; }
+
+  private:
+    struct Archive {
+      std::string path;
+      std::unique_ptr<El3CaptureReader> reader;     /* released once read */
+      std::vector<uint32_t> blocks;
+    };
+
+    void plan(const std::string &path, std::unique_ptr<El3CaptureReader> reader);
+    bool scan(std::vector<El3QueryFix> &out, size_t max);
+    bool match(const El3CaptureRecord &rec, El3QueryFix &fix);
+    void returned(int64_t recvNs);
+
+    El3TrackQuery m_query;
+    El3CaptureIoConfig m_io;
+    El3QueryStats m_stats;
+
+    std::vector<Archive> m_archives;
+    bool m_planned;
+    size_t m_archive;           /* being read */
+    std::unique_ptr<El3CaptureBlockStream> m_stream;
+
+    std::vector<El3QueryFix> m_unwritten;   /* of the archive being written, as recorded */
+    size_t m_nextUnwritten;
+
+    std::vector<El3QueryFix> m_live;    /* by receive time */
+    std::vector<bool> m_archived;       /* per live fix, returned from an archive */
+    size_t m_nextLive;
+};
+
+/* ISO 8601 UTC (2022-09-13T14:00:00Z, fractions allowed) or seconds since the epoch, into ns */
+bool el3ParseTime(const std::string &text, int64_t &ns);
+
+template <typename Writer>
+void el3WriteJson(const El3QueryFix &fix, Writer &writer)
+{
+    writer.StartObject();
+    writer.Key("recv_ns");          writer.Int64(fix.recvNs);
+    writer.Key("sensor_id");        writer.Uint(fix.sensorId);
+    writer.Key("telemetry");        el3WriteJson(fix.record, writer);
+    writer.EndObject();
+}
+
+template <typename Writer>
+void el3WriteJson(const El3QueryStats &stats, Writer &writer)
+{
+    writer.StartObject();
+    writer.Key("archives");         writer.Uint(stats.archives);
+    writer.Key("blocks");           writer.Uint64(stats.blocks);
+    writer.Key("blocks_in_range");  writer.Uint64(stats.blocksInRange);
+    writer.Key("blocks_read");      writer.Uint64(stats.blocksRead);
+    writer.Key("frames_scanned");   writer.Uint64(stats.framesScanned);
+    writer.Key("frames_decoded");   writer.Uint64(stats.framesDecoded);
+    writer.Key("fixes");            writer.Uint64(stats.fixes);
+    writer.EndObject();
+}
@@ -0,0 +1,207 @@
+/*
+ * Copyright (c) 2022 Subreption LLC. All rights reserved.
+ * Author: 12dc8242df1be0d6f4b73d68166552197936a27074c004c8af95b27194ec584d
+ *
+ * Dual-licensed under the Subreption Ukraine Defense License (SUDL, version 1) and the  Server Side
+ * Public License (SSPL, version 3). Both licenses are provided with this software distribution.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <el3dec/telemetry.hpp>
+
+/*
+ * Daemon to daemon relay protocol, edge daemons forwarding decoded records to an aggregator over a
+ * persistent TCP link. All integers little-endian. Every message is
+ *
+ *   uint32 length      of what follows
+ *   uint8 type         El3RelayType
+ *   body
+ *
+ * The edge opens with HELLO, naming its sensor and session (random per edge process). The
+ * aggregator answers WELCOME with the last sequence number it holds for that session, 0 for a
+ * session it does not know, and the edge resends everything after it. Records then flow in BATCHes
+ * carrying the sequence number of their first record, and the aggregator ACKs what it has, so the
+ * edge can let go of it. Records the aggregator sees twice, resent after a reconnect, are dropped
+ * by sequence number.
+ */
+
+#define EL3_RELAY_MAGIC         "EL3R"
+#define EL3_RELAY_VERSION       1
+
+/* longest message accepted, anything longer is a broken or foreign peer */
+#define EL3_RELAY_MAX_MESSAGE   (1024 * 1024)
+
+/* records per batch, keeps batches well under the message limit */
+#define EL3_RELAY_MAX_BATCH     1024
+
+enum El3RelayType {
+  RELAY_HELLO = 1,
+  RELAY_WELCOME,
+  RELAY_BATCH,
+  RELAY_ACK
+};
+
+#pragma pack(push, 1)
+
+struct El3RelayHello {
+  char magic[4];
+  uint16_t version;
+  uint16_t reserved;
+  uint32_t sensorId;
+  uint64_t session;
+};
+
+struct El3RelayWelcome {
+  uint64_t lastSeq;
+};
+
+struct El3RelayBatchHeader {
+  uint64_t firstSeq;
+  uint32_t count;           /* El3RelayRecord following */
+};
+
+struct El3RelayAck {
+  uint64_t seq;             /* every record up to this one arrived */
+};
+
+/*
+ * A decoded record on the wire, 58 bytes: every El3TelemetryRecord field, the video channel narrowed
+ * to a byte and the track confidence to steps of 1/255.
+ */
+struct El3RelayRecord {
+  int64_t recvNs;           /* at the edge, ns since the epoch */
+  uint16_t uavNo;
+  uint16_t flightTime;
+  uint8_t packetType;
+  uint8_t types;            /* engine type << 5 | UAV type, as in the header */
+  uint8_t stamp[3];         /* hours, minutes, seconds */
+  uint8_t trackVerdict;
+  uint8_t trackConfidence;  /* 0-255 */
+  uint8_t videoTxChannel;
+  uint16_t videoTxFreq;
+  uint16_t altitude;
+  uint16_t remainingMinutes;
+  float latitude;
+  float longitude;
+  float groundSpeed;
+  float careen;
+  float pitch;
+  float cameraAngle;
+  float cameraPosition;
+  float cameraAzimuth;
+};
+
+#pragma pack(pop)
+
+void el3RelayPack(const El3TelemetryRecord &rec, int64_t recvNs, El3RelayRecord &out);
+void el3RelayUnpack(const El3RelayRecord &in, El3TelemetryRecord &rec);
+
+/* append one whole message to out */
+void el3RelayMessage(std::string &out, El3RelayType type, const void *body, size_t len);
+
+struct El3RelayMessageView {
+  El3RelayType type;
+  const unsigned char *body;
+  size_t len;
+};
+
+/*
+ * Splits a byte stream into messages. Malformed input (oversized or unknown messages, bodies of
+ * the wrong size) throws std::runtime_error; the link is beyond saving then.
+ */
+class El3RelayReader
+{
+  public:
+    El3RelayReader(): m_pos(0) {}
+
+    void feed(const void *data, size_t len);
+
+    /* the next complete message, valid until the next feed() */
+    bool next(El3RelayMessageView &msg);
+
+  private:
+    std::string m_buf;
+    size_t m_pos;
+};
+
+/*
+ * Edge side: records waiting to be relayed, numbered from 1. Records stay until acknowledged and
+ * are resent after a reconnect; past the capacity the oldest are dropped (and counted). Not
+ * thread-safe.
+ */
+class El3RelayOutbox
+{
+  public:
+    El3RelayOutbox(uint32_t sensorId, size_t capacity = 1 << 16);
+
+    void push(const El3TelemetryRecord &rec, int64_t recvNs);
+
+    /* start of a connection: the HELLO to send */
+    void hello(std::string &out) const;
+
+    /* the aggregator's WELCOME: forget what it has, resend the rest */
+    void resume(uint64_t lastSeq);
+
+    /* append a BATCH of records not sent on this connection yet; false if there are none */
+    bool batch(std::string &out, size_t maxRecords = EL3_RELAY_MAX_BATCH);
+
+    void ack(uint64_t seq);
+
+    uint64_t session() const { return m_session; }
+    size_t unsent() const { return m_nextSeq - m_sendSeq; }
+    size_t pending() const { return m_records.size(); }
+    uint64_t dropped() const { return m_dropped; }
+
+  private:
+    uint32_t m_sensorId;
+    uint64_t m_session;
+    size_t m_capacity;
+
+    /* m_records[0] holds sequence number m_nextSeq - m_records.size() */
+    std::deque<El3RelayRecord> m_records;
+    uint64_t m_nextSeq;
+    uint64_t m_sendSeq;
+    uint64_t m_dropped;
+};
+
+/*
+ * Aggregator side: the last record received from each sensor's session, to answer HELLOs and drop
+ * resent records. A sensor ID belongs to one session at a time: while a link of that session is up,
+ * HELLOs of any other session with the same ID are refused. Not thread-safe.
+ */
+class El3RelayPeers
+{
+  public:
+    /*
+     * A sensor says HELLO: false if its ID is held by another session still connected, otherwise
+     * the link counts as up and lastSeq is the sequence number to WELCOME it with.
+     */
+    bool hello(const El3RelayHello &hello, uint64_t &lastSeq);
+
+    /* a link that was welcomed is gone */
+    void closed(uint32_t sensorId, uint64_t session);
+
+    /*
+     * Sort out a BATCH from a sensor: returns how many of its records are new (they are the last
+     * ones) and notes them as received.
+     */
+    uint32_t receive(uint32_t sensorId, uint64_t firstSeq, uint32_t count);
+
+    uint64_t lastSeq(uint32_t sensorId) const;
+    size_t size() const { return m_peers.size(); }
+
+  private:
+    struct Peer {
+      uint64_t session;
+      uint64_t lastSeq;
+      uint32_t links;           /* up, of this session; a reconnect may beat the old link's close */
+    };
+
+    std::unordered_map<uint32_t, Peer> m_peers;
+};
@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2022 Subreption LLC. All rights reserved.
+ * Author: 12dc8242df1be0d6f4b73d68166552197936a27074c004c8af95b27194ec584d
+ *
+ * Dual-licensed under the Subreption Ukraine Defense License (SUDL, version 1) and the  Server Side
+ * Public License (SSPL, version 3). Both licenses are provided with this software distribution.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <el3dec/telemetry.hpp>
+
+/* how the absolute timestamp of a record was obtained */
+#define EL3_TS_STAMP        0x01    /* packet hours/minutes/seconds, dated by the receive time */
+#define EL3_TS_FLIGHTTIME   0x02    /* stamp missing or glitched, extrapolated from the flight time */
+#define EL3_TS_RECEIVE      0x04    /* no usable reference at all, receive time taken as-is */
+
+/* release conditions */
+#define EL3_TS_LATE         0x10    /* older than a record already released for the UAV */
+#define EL3_TS_UNTRACKED    0x20    /* no track slot available, passed through unordered */
+
+#define EL3_MS_PER_DAY      86400000LL
+
+/* consecutive stamp/flight time disagreements after which the stamp wins (counter reset) */
+#define EL3_REORDER_REANCHOR    3
+
+#define EL3_REORDER_NO_TRACK    0xFFFF
+
+struct El3ReorderConfig {
+  El3ReorderConfig():
+      maxLatencyMs(500), slots(32), maxTracks(1024), stampToleranceMs(2500) {}
+
+  /* maximum delay added to any record before it is released */
+  uint32_t maxLatencyMs;
+
+  /* ring capacity per UAV; a full ring forces its oldest record out */
+  uint32_t slots;
+
+  /* UAVs tracked at once (below EL3_REORDER_NO_TRACK), everything is preallocated for this many */
+  uint32_t maxTracks;
+
+  /* disagreement between the stamp and the flight time extrapolation still taken as jitter */
+  uint32_t stampToleranceMs;
+};
+
+struct El3TimedRecord {
+  El3TelemetryRecord record;
+
+  int64_t utcMs;        /* rebuilt absolute time of the packet, ms since the epoch (UTC) */
+  uint64_t recvMs;      /* receive time, same clock */
+  uint32_t sensorId;
+  uint8_t flags;        /* EL3_TS_* */
+};
+
+/*
+ * Per-UAV reorder (jitter) buffer.
+ *
+ * Packets only carry a time of day and a 16-bit flight time counter (seconds). Each UAV track keeps
+ * an anchor pairing both, which dates packets across midnight and replaces glitched stamps with an
+ * extrapolation from the flight time. Records are held in a per-track ring sorted by absolute time
+ * and released in order once the oldest of them reaches maxLatencyMs of added delay.
+ *
+ * All rings are allocated at construction; steady-state operation does not allocate as long as the
+ * output vector keeps its capacity. Not thread-safe.
+ */
+class El3ReorderBuffer
+{
+  public:
+    El3ReorderBuffer(const El3ReorderConfig &config = El3ReorderConfig());
+
+    /* recvMs is wall clock UTC in milliseconds; records forced out by a full ring are appended to out */
+    void ingest(const El3TelemetryRecord &rec, uint64_t recvMs, uint32_t sensorId,
+        std::vector<El3TimedRecord> &out);
+
+    /* append records whose latency budget ran out by nowMs, in timestamp order per UAV */
+    size_t poll(uint64_t nowMs, std::vector<El3TimedRecord> &out);
+
+    /* append everything still buffered */
+    size_t flush(std::vector<El3TimedRecord> &out);
+
+    size_t buffered() const;
+
+    /* date a time of day to the day that puts it closest to the reference (UTC ms) */
+    static int64_t dateStamp(int hours, int minutes, int seconds, uint64_t refMs);
+
+  private:
+    struct Track {
+      uint16_t uavNo;
+      bool active;
+      bool anchored;
+      uint8_t disagreements;
+      int64_t anchorUtcMs;
+      uint16_t anchorFlightTime;
+      int64_t lastUtcMs;
+      int64_t lastReleasedMs;
+      uint64_t deadline;       /* earliest release deadline among the buffered records */
+      uint64_t lastSeenMs;
+      uint32_t head;
+      uint32_t count;
+    };
+
+    int64_t rebuild(Track &track, const El3TelemetryRecord &rec, uint64_t recvMs, uint8_t *flags);
+
+    Track *track(uint16_t uavNo, uint64_t recvMs);
+    El3TimedRecord &slot(const Track &track, uint32_t pos);
+
+    void release(Track &track, uint32_t n, std::vector<El3TimedRecord> &out);
+    void refreshDeadline(Track &track);
+
+    El3ReorderConfig m_config;
+
+    /* uavNo -> index into m_tracks, EL3_REORDER_NO_TRACK when untracked */
+    std::vector<uint16_t> m_index;
+    std::vector<Track> m_tracks;
+    std::vector<El3TimedRecord> m_slots;
+};
@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2022 Subreption LLC. All rights reserved.
+ * Author: 12dc8242df1be0d6f4b73d68166552197936a27074c004c8af95b27194ec584d
+ *
+ * Dual-licensed under the Subreption Ukraine Defense License (SUDL, version 1) and the  Server Side
+ * Public License (SSPL, version 3). Both licenses are provided with this software distribution.
+ */
+
+#pragma once
+
+/*
+ * Shared memory frame ring, for demodulators running on the same host as the decoder.
+ *
+ * A named POSIX shared memory segment holds a header and a power of two sized data area. The single
+ * producer appends records (an el3_shm_ring_record followed by the raw frame, padded to 16 bytes)
+ * and publishes them by advancing head; the single consumer reads them in place and hands the space
+ * back by advancing tail. A record never wraps: when it does not fit before the end of the data area
+ * a filler record takes the rest and the record starts over at offset 0. When the ring is full the
+ * producer drops the frame and counts it, it never waits on the consumer.
+ *
+ * An idle consumer sleeps on the seq futex word, the producer only wakes it when it says it waits.
+ *
+ * This header and the producer are plain C, link el3dec_shmring from the DSP side.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define EL3_SHM_RING_MAGIC              0x474e5233    /* "3RNG" */
+#define EL3_SHM_RING_VERSION            1
+
+#define EL3_SHM_RING_DEFAULT_CAPACITY   (4 * 1024 * 1024)
+#define EL3_SHM_RING_MIN_CAPACITY       4096
+#define EL3_SHM_RING_ALIGN              16
+
+/* record length of the filler at the end of the data area */
+#define EL3_SHM_RING_FILLER             0xffff
+#define EL3_SHM_RING_MAX_FRAME          (EL3_SHM_RING_FILLER - 1)
+
+/* head and tail live on their own cache lines, the two sides never write the same one */
+struct el3_shm_ring_header {
+  uint32_t magic;               /* set last by whoever created the segment */
+  uint32_t version;
+  uint32_t capacity;            /* of the data area following this header */
+  uint32_t reserved0;
+  uint8_t pad0[48];
+
+  /* written by the producer */
+  uint64_t head;                /* bytes ever published */
+  uint64_t dropped;             /* frames refused because the ring was full */
+  uint32_t seq;                 /* futex word, bumped on every publish */
+  uint8_t pad1[44];
+
+  /* written by the consumer */
+  uint64_t tail;                /* bytes ever consumed */
+  uint32_t waiting;             /* set while the consumer sleeps on seq */
+  uint8_t pad2[52];
+};
+
+struct el3_shm_ring_record {
+  int64_t recv_ns;              /* receive time, ns since the epoch (UTC) */
+  uint32_t sensor_id;
+  uint16_t length;              /* of the frame following, or EL3_SHM_RING_FILLER */
+  uint16_t reserved;
+};
+
+/*
+ * Map a ring, creating and initializing it if the name is not taken yet. Whichever side comes up
+ * first creates it; capacity is rounded up to a power of two, and ignored if the ring exists.
+ * Returns the header (the data area follows it) or NULL with errno set.
+ */
+struct el3_shm_ring_header *el3_shm_ring_map(const char *name, uint32_t capacity, size_t *size);
+void el3_shm_ring_unmap(struct el3_shm_ring_header *ring, size_t size);
+
+/* remove the name, mappings stay valid */
+int el3_shm_ring_unlink(const char *name);
+
+typedef struct el3_shm_producer el3_shm_producer;
+
+el3_shm_producer *el3_shm_producer_open(const char *name, uint32_t capacity);
+void el3_shm_producer_close(el3_shm_producer *producer);
+
+/*
+ * Zero-copy producing: reserve room for a frame of up to len bytes, write it in place, then commit
+ * it with its actual length. Reserve returns NULL if the ring is full (the frame is counted as
+ * dropped) or len is too large. A commit longer than the reservation is dropped, and counted.
+ */
+unsigned char *el3_shm_producer_reserve(el3_shm_producer *producer, size_t len);
+void el3_shm_producer_commit(el3_shm_producer *producer, int64_t recv_ns, uint32_t sensor_id,
+    size_t len);
+
+/* reserve, copy and commit; 0 on success, -1 if the frame was dropped */
+int el3_shm_producer_write(el3_shm_producer *producer, int64_t recv_ns, uint32_t sensor_id,
+    const unsigned char *frame, size_t len);
+
+uint64_t el3_shm_producer_dropped(const el3_shm_producer *producer);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2022 Subreption LLC. All rights reserved.
+ * Author: 12dc8242df1be0d6f4b73d68166552197936a27074c004c8af95b27194ec584d
+ *
+ * Dual-licensed under the Subreption Ukraine Defense License (SUDL, version 1) and the  Server Side
+ * Public License (SSPL, version 3). Both licenses are provided with this software distribution.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <el3dec/capture.hpp>
+#include <el3dec/shmring.h>
+
+/*
+ * Consumer end of a shared memory frame ring (see shmring.h). Frames are handed out in place: the
+ * record returned by next() points into the ring and stays valid until the following next() or
+ * release(), which give its space back to the producer. The producer is not trusted: a record
+ * running past the ring or what was published is counted as corrupt, and everything published up
+ * to then is skipped. Errors throw std::runtime_error. A single consumer per ring, not thread-safe.
+ */
+class El3ShmRingReader
+{
+  public:
+    El3ShmRingReader(const std::string &name, uint32_t capacity = EL3_SHM_RING_DEFAULT_CAPACITY);
+    ~El3ShmRingReader();
+
+    /* next frame, false if the ring is empty */
+    bool next(El3CaptureRecord &rec);
+
+    /* give back the space of the frame returned last */
+    void release();
+
+    /* sleep until the producer publishes something, false on timeout */
+    bool wait(int timeoutMs);
+
+    uint32_t capacity() const { return m_capacity; }
+    uint64_t dropped() const;
+    uint64_t corrupt() const { return m_corrupt; }
+
+  private:
+    El3ShmRingReader(const El3ShmRingReader &);
+    El3ShmRingReader &operator=(const El3ShmRingReader &);
+
+    el3_shm_ring_header *m_ring;
+    const unsigned char *m_data;
+    size_t m_size;
+    uint32_t m_capacity;        /* as mapped, the shared copy is not trusted afterwards */
+    uint64_t m_corrupt;
+    uint64_t m_head;            /* last head seen, reloaded when caught up */
+    uint64_t m_tail;            /* end of the frame returned last */
+};
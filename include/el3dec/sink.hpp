@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2022 Subreption LLC. All rights reserved.
+ * Author: 12dc8242df1be0d6f4b73d68166552197936a27074c004c8af95b27194ec584d
+ *
+ * Dual-licensed under the Subreption Ukraine Defense License (SUDL, version 1) and the  Server Side
+ * Public License (SSPL, version 3). Both licenses are provided with this software distribution.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+class El3Telemetry;
+
+/*
+ * Sinks are handed every packet that decoded, once parsing is done.
+ *
+ * Runtime sinks sit in a table indexed by packet type, one per type, and are called from
+ * El3Telemetry::parsingDone(): a table load and, if set, one indirect call. The table is not
+ * synchronized with decoding, set sinks up before decoding threads start. A sink that needs several
+ * consumers fans out itself.
+ *
+ * Compile-time sinks are passed to the El3Telemetry constructor and called right after the runtime
+ * one. They are function objects taking a const El3Telemetry &, so they inline; El3NoSink compiles
+ * to nothing. El3PacketSink and El3SinkChain route and combine them.
+ */
+
+typedef void (*El3SinkFn)(const El3Telemetry &telemetry, void *ctx);
+
+/* replace the runtime sink for a packet type, NULL fn clears it */
+void el3SetSink(uint8_t packetType, El3SinkFn fn, void *ctx);
+void el3ClearSinks();
+
+/* prints the decoded fields to the FILE * given as ctx (stdout if NULL), the DEBUG build's default */
+void el3PrintSink(const El3Telemetry &telemetry, void *ctx);
+
+struct El3NoSink {
+  void operator()(const El3Telemetry &) const {}
+};
+
+/* only passes packets of one type on */
+template <uint8_t PacketType, typename Sink>
+struct El3PacketSink {
+  Sink sink;
+
+  El3PacketSink(const Sink &s = Sink()): sink(s) {}
+
+  void operator()(const El3Telemetry &telemetry);
+};
+
+/* calls both, in order */
+template <typename First, typename Second>
+struct El3SinkChain {
+  First first;
+  Second second;
+
+  El3SinkChain(const First &f = First(), const Second &s = Second()): first(f), second(s) {}
+
+  void operator()(const El3Telemetry &telemetry) {
+    first(telemetry);
+    second(telemetry);
+  }
+};
+
+template <uint8_t PacketType, typename Sink>
+El3PacketSink<PacketType, Sink> el3PacketSink(const Sink &sink)
+{
+  return El3PacketSink<PacketType, Sink>(sink);
+}
+
+template <typename First, typename Second>
+El3SinkChain<First, Second> el3SinkChain(const First &first, const Second &second)
+{
+  return El3SinkChain<First, Second>(first, second);
+}
@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2022 Subreption LLC. All rights reserved.
+ * Author: 12dc8242df1be0d6f4b73d68166552197936a27074c004c8af95b27194ec584d
+ *
+ * Dual-licensed under the Subreption Ukraine Defense License (SUDL, version 1) and the  Server Side
+ * Public License (SSPL, version 3). Both licenses are provided with this software distribution.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <sys/types.h>
+#include <el3dec/trackfilter.hpp>
+#include <el3dec/trackstore.hpp>
+
+/*
+ * Warm restart snapshot (host order, written and read by the same build):
+ *
+ *   header         El3SnapshotHeader
+ *   tracks         El3TrackEntry[tracks]
+ *   filter         El3TrackState[filterTracks]
+ *
+ * Snapshots go to a temporary file renamed over the previous one, so a crash mid-write leaves the
+ * last good snapshot. On load the file is mapped and checked (magic, version, record sizes, length,
+ * checksum) before anything is restored from it.
+ */
+
+#define EL3_SNAPSHOT_MAGIC      "EL3SNAP1"
+#define EL3_SNAPSHOT_VERSION    2
+
+#pragma pack(push, 1)
+
+struct El3SnapshotHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t headerSize;
+  uint32_t entrySize;       /* sizeof(El3TrackEntry), a mismatch means another build */
+  uint32_t stateSize;       /* sizeof(El3TrackState) */
+  uint32_t tracks;
+  uint32_t filterTracks;
+  int64_t createdNs;
+  El3TrackStoreCounters counters;
+  uint64_t payloadBytes;
+  uint64_t checksum;        /* FNV-1a over the payload, 64-bit words */
+  uint8_t reserved[40];
+};
+
+#pragma pack(pop)
+
+/* write the store (and the filter's tracks, if given) to path; false with errno set on failure */
+bool el3WriteSnapshot(const std::string &path, const El3TrackStore &store,
+    const El3TrackFilter *filter);
+
+/*
+ * Snapshot from a forked child, so ingest only stops for the fork itself and a copy of the filter's
+ * tracks: call with the store and filter locked, unlock when it returns, reap the child with
+ * waitpid() (exit status 0 on success). The child does not allocate, it only checksums and writes.
+ * Returns the child's pid, -1 if fork() failed.
+ */
+pid_t el3ForkSnapshot(const std::string &path, const El3TrackStore &store,
+    const El3TrackFilter *filter);
+
+/* Memory mapped, validated snapshot. Errors throw std::runtime_error. */
+class El3SnapshotReader
+{
+  public:
+    El3SnapshotReader(const std::string &path);
+    ~El3SnapshotReader();
+
+    const El3SnapshotHeader &header() const { return *m_header; }
+
+    const El3TrackEntry *tracks() const { return m_tracks; }
+    const El3TrackState *filterTracks() const { return m_filterTracks; }
+
+    /* load the store, and the filter if given */
+    void restore(El3TrackStore &store, El3TrackFilter *filter) const;
+
+  private:
+    void *m_map;
+    size_t m_size;
+    const El3SnapshotHeader *m_header;
+    const El3TrackEntry *m_tracks;
+    const El3TrackState *m_filterTracks;
+};
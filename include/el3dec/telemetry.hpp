@@ -11,14 +11,15 @@
 #include <vector>
 #include <cstddef>
 #include <cstdint>
+#include <cstdio>
 #include "rapidjson/document.h"
+#include "rapidjson/writer.h"
 #include <el3dec/utils.hpp>
+#include <el3dec/sink.hpp>
+#include <el3dec/layout.hpp>
 
 #define EL3DEC_VERSION  1
 
-#define ENICS_ELERON_PACKET_MAGICBYTE 0xAA
-#define ENICS_ELERON_PACKET_TELEMETRY 0x0F
-
 struct GpsLocation {
   float latitude;
   float longitude;
@@ -31,6 +32,135 @@ struct El3CameraSetting {
   float azimuth;
 };
 
+/* Consistency of a position fix with the UAV's track, see El3TrackFilter */
+enum El3TrackVerdict {
+  TRACK_UNCHECKED,      /* no filter ran, or no position to check */
+  TRACK_NEW,            /* first fix of a track, nothing to compare against */
+  TRACK_CONSISTENT,     /* matches the constant-velocity prediction */
+  TRACK_SUSPECT,        /* off the prediction, but physically reachable */
+  TRACK_GLITCH          /* physically impossible jump, most likely corrupted coordinates */
+};
+
+const char *el3TrackVerdictName(El3TrackVerdict verdict);
+
+/* Flat copy of every decoded field, independent from the source buffer lifetime */
+struct El3TelemetryRecord {
+  uint8_t packetType;
+  uint8_t engineType;
+  uint8_t uavType;
+  uint16_t uavNo;
+  uint16_t flightTime;
+
+  uint8_t stampHours;
+  uint8_t stampMinutes;
+  uint8_t stampSeconds;
+
+  struct GpsLocation gpsData;
+  float groundSpeed;
+  float careen;
+  float pitch;
+  uint16_t remainingMinutes;
+
+  uint16_t videoTxChannel;
+  uint16_t videoTxFreq;
+  struct El3CameraSetting camera;
+
+  uint8_t trackVerdict;     /* El3TrackVerdict */
+  float trackConfidence;
+};
+
+/*
+ * Serialize a record through any RapidJSON writer. Callers decoding in bulk keep one writer and
+ * output buffer around and Reset() the writer between records, instead of building a Document
+ * per packet as toJson() used to.
+ */
+template <typename Writer>
+void el3WriteJson(const El3TelemetryRecord &rec, Writer &writer)
+{
+    writer.StartObject();
+
+    writer.Key("el3dec_version");   writer.Int(EL3DEC_VERSION);
+    writer.Key("packet_type");      writer.Int(rec.packetType);
+    writer.Key("engine_type");      writer.Int(rec.engineType);
+    writer.Key("uav_type");         writer.Int(rec.uavType);
+    writer.Key("uav_id");           writer.Int(rec.uavNo);
+
+    if (rec.flightTime)
+    {
+        writer.Key("flight_time");
+        writer.Int(rec.flightTime);
+    }
+
+    if (rec.remainingMinutes)
+    {
+        writer.Key("remaining_min");
+        writer.Int(rec.remainingMinutes);
+    }
+
+    if (rec.careen)
+    {
+        writer.Key("careen");
+        writer.Double(rec.careen);
+    }
+
+    if (rec.pitch)
+    {
+        writer.Key("pitch");
+        writer.Double(rec.pitch);
+    }
+
+    if (rec.stampHours && rec.stampMinutes && rec.stampSeconds)
+    {
+        writer.Key("timestamp");
+        writer.StartObject();
+        writer.Key("hours");        writer.Int(rec.stampHours);
+        writer.Key("minutes");      writer.Int(rec.stampMinutes);
+        writer.Key("seconds");      writer.Int(rec.stampSeconds);
+        writer.EndObject();
+    }
+
+    if (rec.gpsData.latitude && rec.gpsData.longitude && rec.gpsData.altitude)
+    {
+        writer.Key("gps");
+        writer.StartObject();
+        writer.Key("latitude");     writer.Double(rec.gpsData.latitude);
+        writer.Key("longitude");    writer.Double(rec.gpsData.longitude);
+        writer.Key("altitude");     writer.Int(rec.gpsData.altitude);
+        writer.Key("speed");        writer.Double(rec.groundSpeed);
+        writer.EndObject();
+    }
+
+    if (rec.videoTxChannel && rec.videoTxFreq)
+    {
+        writer.Key("video");
+        writer.StartObject();
+        writer.Key("tx_freq");      writer.Int(rec.videoTxFreq);
+        writer.Key("tx_chan");      writer.Int(rec.videoTxChannel);
+        writer.EndObject();
+    }
+
+    if (rec.camera.angle && rec.camera.azimuth && rec.camera.position)
+    {
+        writer.Key("camera");
+        writer.StartObject();
+        writer.Key("angle");        writer.Double(rec.camera.angle);
+        writer.Key("azimuth");      writer.Double(rec.camera.azimuth);
+        writer.Key("pos");          writer.Double(rec.camera.position);
+        writer.EndObject();
+    }
+
+    if (rec.trackVerdict != TRACK_UNCHECKED)
+    {
+        writer.Key("track");
+        writer.StartObject();
+        writer.Key("verdict");      writer.String(el3TrackVerdictName((El3TrackVerdict) rec.trackVerdict));
+        writer.Key("confidence");   writer.Double(rec.trackConfidence);
+        writer.EndObject();
+    }
+
+    writer.EndObject();
+}
+
 enum El3DecOpMode {
   FAULT_TOLERANT,
   FAULT_INTOLERANT
@@ -40,38 +170,74 @@ class El3Telemetry
 {
   public:
     El3Telemetry(const unsigned char *buf, const size_t len, El3DecOpMode opmode);
+
+    /* decode, then hand the packet to a compile-time sink too (see sink.hpp) */
+    template <typename Sink>
+    El3Telemetry(const unsigned char *buf, const size_t len, El3DecOpMode opmode, Sink &&sink):
+      El3Telemetry(buf, len, opmode) {
+      sink(*this);
+    }
+
     ~El3Telemetry();
 
     std::string toJson(bool pretty);
 
-    float Latitude() { return gpsData.latitude; }
-    float Longitude() { return gpsData.longitude; }
-    float Altitude() { return gpsData.altitude; }
-    int ID() { return uavNo; }
-    int Type() { return uavType; }
-    float Groundspeed() { return groundSpeed; }
-    int VideoFreq() { return videoTxFreq; }
-    int RemainingFlightMinutes() { return remainingMinutes; }
-    float CameraPosition() { return camera.position; }
-    float CameraAzimuth() { return camera.azimuth; }
-    float CameraAngle() { return camera.angle; }
-
-    std::string Timestamp() {
-      return string_format("%d:%d:%d", stampHours, stampMinutes, stampSeconds);
+    float Latitude() const { return gpsData.latitude; }
+    float Longitude() const { return gpsData.longitude; }
+    float Altitude() const { return gpsData.altitude; }
+    int ID() const { return uavNo; }
+    int Type() const { return uavType; }
+    int EngineType() const { return engineType; }
+    int PacketType() const { return packetType; }
+    int FlightTime() const { return flightTime; }
+    float Groundspeed() const { return groundSpeed; }
+    float Careen() const { return careen; }
+    float Pitch() const { return pitch; }
+    int VideoChannel() const { return videoTxChannel; }
+    int VideoFreq() const { return videoTxFreq; }
+    int RemainingFlightMinutes() const { return remainingMinutes; }
+    float CameraPosition() const { return camera.position; }
+    float CameraAzimuth() const { return camera.azimuth; }
+    float CameraAngle() const { return camera.angle; }
+
+    int StampHours() const { return stampHours; }
+    int StampMinutes() const { return stampMinutes; }
+    int StampSeconds() const { return stampSeconds; }
+
+    /* fits the small string buffer, no allocation */
+    std::string Timestamp() const {
+      char buf[16];
+      snprintf(buf, sizeof(buf), "%d:%d:%d", stampHours, stampMinutes, stampSeconds);
+      return buf;
+    }
+
+    El3TrackVerdict TrackVerdict() const { return trackVerdict; }
+    float TrackConfidence() const { return trackConfidence; }
+
+    void setTrackVerdict(El3TrackVerdict verdict, float confidence) {
+      trackVerdict = verdict;
+      trackConfidence = confidence;
     }
 
+    El3TelemetryRecord Record() const;
+
   private:
+    friend struct El3LayoutTable;
+
     void parseRaw();
-    void parseTimestamp();
-    void parseFlightData();
-    void parseVideoParams();
+
+    /* per layout decoders, see layout.hpp */
+    void parseHeaderOnly() {}
+    template <typename Layout> void parseLayout();
+    template <typename Layout> void parseFull();
+    template <typename Layout> void parseTimestamp();
+    template <typename Layout> void parseFlightData();
+    template <typename Layout> void parseVideoParams();
 
     void parsingDone();
 
     bool checkReadBufferSanity(size_t offset, size_t toread);
 
-    float getPackedCoordinate(size_t off, size_t msboff, int bitshift);
-
   protected:
     uint8_t magicByte;
     uint8_t dataLength;
@@ -99,6 +265,10 @@ class El3Telemetry
     uint16_t videoTxFreq;
     struct El3CameraSetting camera;
 
+    /* track consistency, only set when a track filter checked this fix */
+    El3TrackVerdict trackVerdict;
+    float trackConfidence;
+
     El3DecOpMode m_opmode;
     const unsigned char *m_origbuf;
     const size_t m_origlen;
@@ -106,3 +276,10 @@ class El3Telemetry
     /* this variable functions as a read counter/offset (how deep we are into m_origbuf) */
     size_t m_readxfer;
 };
+
+template <uint8_t PacketType, typename Sink>
+void El3PacketSink<PacketType, Sink>::operator()(const El3Telemetry &telemetry)
+{
+  if (telemetry.PacketType() == PacketType)
+    sink(telemetry);
+}
@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2022 Subreption LLC. All rights reserved.
+ * Author: 12dc8242df1be0d6f4b73d68166552197936a27074c004c8af95b27194ec584d
+ *
+ * Dual-licensed under the Subreption Ukraine Defense License (SUDL, version 1) and the  Server Side
+ * Public License (SSPL, version 3). Both licenses are provided with this software distribution.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+/*
+ * Sampled per-packet latency tracing. One packet in every N (per thread) is traced: each stage it
+ * goes through records a span ending at the stage boundary, into a buffer owned by the thread.
+ * Buffers are single writer rings, written without locks and read by el3TraceJson(), which exports
+ * what they hold as Chrome trace JSON (chrome://tracing, ui.perfetto.dev).
+ *
+ * The receiving code calls el3TraceBegin() when a packet arrives and el3TraceMark() after each
+ * stage; the library marks decode and JSON serialization itself. Work continuing in a completion
+ * handler detaches the trace and finishes it there. With sampling off el3TraceBegin() is one
+ * relaxed load and a branch, and every mark is a branch on a thread local flag.
+ */
+
+enum El3TraceStage {
+  TRACE_READ,           /* receive, up to the frame bytes being in hand */
+  TRACE_UNHEX,
+  TRACE_CAPTURE,
+  TRACE_SCREEN,
+  TRACE_DECODE,         /* marked by the library */
+  TRACE_TRACK,
+  TRACE_LOG,
+  TRACE_JSON,           /* marked by the library */
+  TRACE_WRITE,          /* until the reply was written */
+  TRACE_STAGES
+};
+
+const char *el3TraceStageName(El3TraceStage stage);
+
+/* a trace carried across threads or completion handlers, packet 0 if not sampled */
+struct El3TraceToken {
+  uint32_t packet;
+  uint64_t last;
+};
+
+struct El3TraceThread {
+  bool active;
+  uint32_t packet;
+  uint64_t last;            /* end of the previous stage */
+  uint32_t countdown;       /* packets until the next sample */
+};
+
+extern std::atomic<uint32_t> el3_trace_period;
+inline thread_local El3TraceThread el3_trace_thread;
+
+/* TSC where there is one, converted at export; CLOCK_MONOTONIC nanoseconds otherwise */
+inline uint64_t el3TraceClock()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+}
+
+/* trace one packet in every period, per thread; 0 turns tracing off */
+void el3TraceSampling(uint32_t period);
+
+void el3TraceSample();
+void el3TraceRecord(uint32_t packet, El3TraceStage stage, uint64_t start, uint64_t end);
+
+/* a packet arrived on this thread */
+inline void el3TraceBegin()
+{
+  el3_trace_thread.active = false;
+
+  if (__builtin_expect(el3_trace_period.load(std::memory_order_relaxed) != 0, 0))
+    el3TraceSample();
+}
+
+/* the packet on this thread is done with a stage */
+inline void el3TraceMark(El3TraceStage stage)
+{
+  El3TraceThread &t = el3_trace_thread;
+
+  if (__builtin_expect(t.active, 0))
+  {
+    uint64_t now = el3TraceClock();
+
+    el3TraceRecord(t.packet, stage, t.last, now);
+    t.last = now;
+  }
+}
+
+/* hand the packet's trace over to a completion handler, this thread is free for the next one */
+inline El3TraceToken el3TraceDetach()
+{
+  El3TraceThread &t = el3_trace_thread;
+  El3TraceToken token = { t.active ? t.packet : 0, t.last };
+
+  t.active = false;
+  return token;
+}
+
+/* the detached packet is done with a last stage */
+inline void el3TraceFinish(const El3TraceToken &token, El3TraceStage stage)
+{
+  if (__builtin_expect(token.packet != 0, 0))
+    el3TraceRecord(token.packet, stage, token.last, el3TraceClock());
+}
+
+/* every span buffered so far, as Chrome trace JSON */
+std::string el3TraceJson();
+bool el3TraceDump(const std::string &path);
+
+/* forget the spans buffered so far */
+void el3TraceClear();
@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2022 Subreption LLC. All rights reserved.
+ * Author: 12dc8242df1be0d6f4b73d68166552197936a27074c004c8af95b27194ec584d
+ *
+ * Dual-licensed under the Subreption Ukraine Defense License (SUDL, version 1) and the  Server Side
+ * Public License (SSPL, version 3). Both licenses are provided with this software distribution.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include <el3dec/telemetry.hpp>
+
+struct El3TrackFilterConfig {
+  El3TrackFilterConfig():
+      maxSpeed(60.0), positionSlack(50.0), predictionTolerance(60.0), reanchorSeconds(5),
+      suppress(false) {}
+
+  /* m/s, anything covering more ground between two fixes is a glitch */
+  float maxSpeed;
+
+  /* meters tolerated on top of maxSpeed * elapsed flight time (GPS noise, one second stamps) */
+  float positionSlack;
+
+  /* meters off the constant-velocity prediction before a fix is suspect */
+  float predictionTolerance;
+
+  /* flight time seconds of uninterrupted glitches after which the track is started over */
+  unsigned reanchorSeconds;
+
+  /* report glitches as suppressed, so callers drop them instead of only flagging them */
+  bool suppress;
+};
+
+/* a UAV's track as saved across restarts, see El3TrackFilter::saveTracks() */
+struct El3TrackState {
+  uint16_t uavNo;
+  uint8_t moving;
+  uint8_t glitches;
+  uint16_t flightTime;
+  uint16_t reserved;
+  double latitude;
+  double longitude;
+  double course;
+};
+
+/*
+ * Track consistency filter.
+ *
+ * Each fix is scored against a constant-velocity prediction from the UAV's last accepted fix: the
+ * reported ground speed (km/h) projected along the course observed between the last two accepted
+ * fixes. careen stands in for the course until the track has moved, as the fixtures suggest it is
+ * not a course over ground. Fixes farther from the last accepted one than the airframe can fly are
+ * glitches (typically a flipped bit in the packed coordinates) and never move the track.
+ *
+ * O(1) per fix, one small state per UAV. Not thread-safe.
+ */
+class El3TrackFilter
+{
+  public:
+    El3TrackFilter(const El3TrackFilterConfig &config = El3TrackFilterConfig());
+
+    /* score the fix and annotate it with the verdict and confidence */
+    El3TrackVerdict check(El3Telemetry &tele);
+    El3TrackVerdict check(El3TelemetryRecord &rec);
+
+    /* true for the fixes callers should drop under the configured policy */
+    bool suppressed(El3TrackVerdict verdict) const {
+      return m_config.suppress && verdict == TRACK_GLITCH;
+    }
+
+    size_t tracks() const { return m_tracks.size(); }
+
+    /* every track, so a restarted filter can carry on where this one was */
+    void saveTracks(std::vector<El3TrackState> &out) const;
+    void restoreTracks(const El3TrackState *tracks, size_t count);
+
+  private:
+    struct Track {
+      bool moving;
+      uint8_t glitches;
+      uint16_t flightTime;
+      double latitude;
+      double longitude;
+      double course;          /* degrees, clockwise from north */
+    };
+
+    El3TrackVerdict score(uint16_t uavNo, uint16_t flightTime, double latitude, double longitude,
+        float groundSpeed, float careen, float *confidence);
+
+    El3TrackFilterConfig m_config;
+    std::unordered_map<uint16_t, Track> m_tracks;
+};
@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2022 Subreption LLC. All rights reserved.
+ * Author: 12dc8242df1be0d6f4b73d68166552197936a27074c004c8af95b27194ec584d
+ *
+ * Dual-licensed under the Subreption Ukraine Defense License (SUDL, version 1) and the  Server Side
+ * Public License (SSPL, version 3). Both licenses are provided with this software distribution.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include <el3dec/telemetry.hpp>
+
+/* fixes kept per UAV */
+#define EL3_TRACK_HISTORY   32
+
+struct El3TrackStoreCounters {
+  uint64_t frames;          /* received */
+  uint64_t decoded;
+  uint64_t rejected;        /* screened out or undecodable */
+  uint64_t suppressed;      /* decoded, but dropped by the track filter */
+};
+
+/* one UAV and its most recent fixes; flat, so snapshots store it as is */
+struct El3TrackEntry {
+  uint16_t uavNo;
+  uint16_t count;           /* fixes held in history */
+  uint32_t next;            /* history slot the next fix goes to */
+  uint64_t fixes;           /* seen since the UAV first showed up */
+  int64_t firstNs;          /* receive times, ns since the epoch */
+  int64_t lastNs;
+  El3TelemetryRecord history[EL3_TRACK_HISTORY];
+  int64_t historyNs[EL3_TRACK_HISTORY];     /* receive time of each fix */
+
+  const El3TelemetryRecord &latest() const {
+    return history[(next + EL3_TRACK_HISTORY - 1) % EL3_TRACK_HISTORY];
+  }
+};
+
+/*
+ * Live state of every UAV heard from: the last EL3_TRACK_HISTORY fixes of each, plus frame
+ * counters. Entries live in one vector in the order UAVs showed up, updates only allocate for a new
+ * UAV. Not thread-safe.
+ */
+class El3TrackStore
+{
+  public:
+    El3TrackStore();
+
+    void update(const El3TelemetryRecord &rec, int64_t recvNs);
+
+    const El3TrackEntry *find(uint16_t uavNo) const;
+
+    /* a UAV's fixes, oldest first */
+    void history(uint16_t uavNo, std::vector<El3TelemetryRecord> &out) const;
+
+    size_t size() const { return m_entries.size(); }
+    const El3TrackEntry *entries() const { return m_entries.data(); }
+
+    El3TrackStoreCounters &counters() { return m_counters; }
+    const El3TrackStoreCounters &counters() const { return m_counters; }
+
+    /* replace the contents, as from a snapshot */
+    void restore(const El3TrackEntry *entries, size_t count, const El3TrackStoreCounters &counters);
+    void clear();
+
+  private:
+    std::vector<El3TrackEntry> m_entries;
+    std::unordered_map<uint16_t, uint32_t> m_index;
+    El3TrackStoreCounters m_counters;
+};
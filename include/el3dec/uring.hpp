@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2022 Subreption LLC. All rights reserved.
+ * Author: 12dc8242df1be0d6f4b73d68166552197936a27074c004c8af95b27194ec584d
+ *
+ * Dual-licensed under the Subreption Ukraine Defense License (SUDL, version 1) and the  Server Side
+ * Public License (SSPL, version 3). Both licenses are provided with this software distribution.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+struct iovec;
+
+/*
+ * The little of io_uring file I/O needs: reads and writes at an offset, from registered buffers
+ * where the kernel allows it, queued and submitted in batches. Talks to the kernel directly, there
+ * is no liburing dependency. Errors throw std::runtime_error. Not thread-safe.
+ */
+class El3Uring
+{
+  public:
+    /* throws when the kernel has no usable io_uring, or it is disabled */
+    El3Uring(unsigned entries);
+    ~El3Uring();
+
+    El3Uring(const El3Uring &) = delete;
+    El3Uring &operator=(const El3Uring &) = delete;
+
+    /* io_uring with the read and write opcodes used here (5.6 and later), probed once */
+    static bool available();
+
+    /* false if the kernel refused (locked memory limits), unregistered reads and writes still work */
+    bool registerBuffers(const struct iovec *iov, unsigned count);
+    bool registered() const { return m_registered; }
+
+    /* queue a request; buffer is the registered buffer index, ignored when none are registered */
+    void read(int fd, void *buf, uint32_t len, uint64_t offset, uint16_t buffer, uint64_t userData);
+    void write(int fd, const void *buf, uint32_t len, uint64_t offset, uint16_t buffer, uint64_t userData);
+
+    /* hand what is queued to the kernel without waiting for any of it */
+    void submit();
+
+    /* the next completion, false if there is none and wait is false; res is as for read(2)/write(2), or -errno */
+    bool complete(uint64_t &userData, int32_t &res, bool wait);
+
+    unsigned inFlight() const { return m_inFlight; }
+
+  private:
+    void release();
+    void queue(uint8_t op, int fd, const void *buf, uint32_t len, uint64_t offset, uint16_t buffer,
+        uint64_t userData);
+
+    int m_fd;
+    unsigned m_entries;
+    bool m_registered;
+    unsigned m_queued;          /* not submitted yet */
+    unsigned m_inFlight;        /* queued or submitted, not completed */
+
+    void *m_sqRing;
+    size_t m_sqRingSize;
+    void *m_cqRing;
+    size_t m_cqRingSize;
+    void *m_sqes;
+    size_t m_sqesSize;
+
+    unsigned *m_sqHead;
+    unsigned *m_sqTail;
+    unsigned *m_sqMask;
+    unsigned *m_sqArray;
+    unsigned *m_cqHead;
+    unsigned *m_cqTail;
+    unsigned *m_cqMask;
+    void *m_cqes;
+};
@@ -35,3 +35,12 @@ static inline size_t get_byte_from_buf(const unsigned char *buf, size_t offset,
 
 size_t get_be_u16_from_buf(const unsigned char *buf, size_t offset, uint16_t *out);
 size_t get_u16_from_buf(const unsigned char *buf, size_t offset, uint16_t *out);
+
+/*
+ * Decode a hex string (either case, no separators) into out. Returns the amount of bytes written,
+ * or 0 if the string has an odd length, a non-hex character or does not fit.
+ */
+size_t hex_to_bytes(const char *hex, size_t hexlen, unsigned char *out, size_t outlen);
+
+/* Equirectangular approximation, good to well under 1% at the ranges a single track covers */
+double ground_distance_m(double lat1, double lon1, double lat2, double lon2);
@@ -0,0 +1,375 @@
+/*
+ * Copyright (c) 2022 Subreption LLC. All rights reserved.
+ * Author: 12dc8242df1be0d6f4b73d68166552197936a27074c004c8af95b27194ec584d
+ *
+ * Dual-licensed under the Subreption Ukraine Defense License (SUDL, version 1) and the  Server Side
+ * Public License (SSPL, version 3). Both licenses are provided with this software distribution.
+ */
+
+#include <el3dec/aggregate.hpp>
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <stdexcept>
+
+using namespace std;
+
+#define NO_PANE     INT64_MIN
+
+static int64_t floorDiv(int64_t a, int64_t b)
+{
+    return a / b - (a % b && (a < 0) != (b < 0));
+}
+
+static uint64_t cellKey(float latitude, float longitude, float degrees)
+{
+    int32_t lat = (int32_t) floor(latitude / degrees);
+    int32_t lon = (int32_t) floor(longitude / degrees);
+
+    return (uint64_t) (uint32_t) lat << 32 | (uint32_t) lon;
+}
+
+static void merge(El3UavRollup &into, const El3UavRollup &from)
+{
+    if (!into.packets)
+    {
+        into = from;
+        return;
+    }
+
+    into.packets += from.packets;
+    into.speedSum += from.speedSum;
+    into.speedMax = max(into.speedMax, from.speedMax);
+    into.altitudeMin = min(into.altitudeMin, from.altitudeMin);
+    into.altitudeMax = max(into.altitudeMax, from.altitudeMax);
+    into.channels |= from.channels;
+}
+
+El3Aggregator::El3Aggregator(const El3AggregateConfig &config):
+    m_config(config), m_pane(NO_PANE), m_lastData(NO_PANE), m_late(0), m_closedDropped(0)
+{
+    if (!config.windowMs || !config.slideMs || config.slideMs > config.windowMs)
+        throw invalid_argument("aggregation slide must be between zero and the window length");
+    if (!(config.cellDegrees > 0))
+        throw invalid_argument("heatmap cells must be larger than zero degrees");
+
+    uint32_t paneMs = gcd(config.windowMs, config.slideMs);
+
+    m_paneNs = (int64_t) paneMs * 1000000;
+    m_panes = config.windowMs / paneMs;
+    m_slide = config.slideMs / paneMs;
+
+    if (m_panes > EL3_AGGREGATE_MAX_PANES)
+        throw invalid_argument("aggregation window spans more than " +
+            to_string(EL3_AGGREGATE_MAX_PANES) + " panes, make the slide divide it evenly");
+
+    m_heat.resize(m_panes);
+    for (auto &heat : m_heat)
+    {
+        heat.index = NO_PANE;
+        heat.dropped = 0;
+    }
+}
+
+bool El3Aggregator::roll(int64_t pane)
+{
+    if (m_pane == NO_PANE)
+    {
+        m_pane = pane;
+        return true;
+    }
+
+    /* its slot already holds a newer pane */
+    if (pane <= m_pane - m_panes)
+    {
+        m_late++;
+        return false;
+    }
+
+    if (pane <= m_pane)
+        return true;
+
+    /* windows ending at a slide boundary the clock passed, those with data in them */
+    if (m_lastData != NO_PANE)
+    {
+        int64_t last = min(pane, m_lastData + m_panes);
+
+        for (int64_t end = (floorDiv(m_pane, m_slide) + 1) * m_slide; end <= last; end += m_slide)
+            close(end);
+    }
+
+    m_pane = pane;
+    evict();
+    return true;
+}
+
+void El3Aggregator::close(int64_t end)
+{
+    if (m_closed.size() == EL3_AGGREGATE_MAX_CLOSED)
+    {
+        m_closed.erase(m_closed.begin());
+        m_closedDropped++;
+    }
+
+    m_closed.emplace_back();
+    summarize(end - m_panes, end, m_closed.back());
+}
+
+void El3Aggregator::evict()
+{
+    int64_t oldest = m_pane - m_panes + 1;
+
+    for (size_t i = m_uavNewest.size(); i-- > 0; )
+    {
+        if (m_uavNewest[i] >= oldest)
+            continue;
+
+        size_t last = m_uavNewest.size() - 1;
+
+        m_uavIndex.erase(m_uavNos[i]);
+
+        if (i != last)
+        {
+            copy_n(m_uavPanes.begin() + last * m_panes, m_panes, m_uavPanes.begin() + i * m_panes);
+            m_uavNewest[i] = m_uavNewest[last];
+            m_uavNos[i] = m_uavNos[last];
+            m_uavIndex[m_uavNos[i]] = i;
+        }
+
+        m_uavPanes.resize(last * m_panes);
+        m_uavNewest.pop_back();
+        m_uavNos.pop_back();
+    }
+
+    for (size_t i = m_sensorNewest.size(); i-- > 0; )
+    {
+        if (m_sensorNewest[i] >= oldest)
+            continue;
+
+        size_t last = m_sensorNewest.size() - 1;
+
+        m_sensorIndex.erase(m_sensorIds[i]);
+
+        if (i != last)
+        {
+            copy_n(m_sensorPanes.begin() + last * m_panes, m_panes, m_sensorPanes.begin() + i * m_panes);
+            m_sensorNewest[i] = m_sensorNewest[last];
+            m_sensorIds[i] = m_sensorIds[last];
+            m_sensorIndex[m_sensorIds[i]] = i;
+        }
+
+        m_sensorPanes.resize(last * m_panes);
+        m_sensorNewest.pop_back();
+        m_sensorIds.pop_back();
+    }
+}
+
+void El3Aggregator::add(const El3TelemetryRecord &rec, int64_t recvNs)
+{
+    int64_t pane = floorDiv(recvNs, m_paneNs);
+
+    if (!roll(pane))
+        return;
+
+    uint32_t slot = (uint32_t) (pane - floorDiv(pane, m_panes) * m_panes);
+    auto it = m_uavIndex.find(rec.uavNo);
+    uint32_t i;
+
+    if (it == m_uavIndex.end())
+    {
+        i = m_uavNewest.size();
+        m_uavIndex.emplace(rec.uavNo, i);
+        m_uavNos.push_back(rec.uavNo);
+        m_uavNewest.push_back(pane);
+        m_uavPanes.resize(m_uavPanes.size() + m_panes, UavPane{NO_PANE, {}});
+    }
+    else
+    {
+        i = it->second;
+        m_uavNewest[i] = max(m_uavNewest[i], pane);
+    }
+
+    UavPane &entry = m_uavPanes[i * m_panes + slot];
+    El3UavRollup &rollup = entry.rollup;
+
+    if (entry.index != pane)
+    {
+        entry.index = pane;
+        rollup = El3UavRollup();
+        rollup.uavNo = rec.uavNo;
+    }
+
+    if (!rollup.packets)
+    {
+        rollup.speedMax = rec.groundSpeed;
+        rollup.altitudeMin = rollup.altitudeMax = rec.gpsData.altitude;
+    }
+
+    rollup.packets++;
+    rollup.speedSum += rec.groundSpeed;
+    rollup.speedMax = max(rollup.speedMax, rec.groundSpeed);
+    rollup.altitudeMin = min(rollup.altitudeMin, rec.gpsData.altitude);
+    rollup.altitudeMax = max(rollup.altitudeMax, rec.gpsData.altitude);
+
+    if (rec.videoTxChannel < 16)
+        rollup.channels |= 1u << rec.videoTxChannel;
+
+    /* no fix, nothing to place */
+    if (rec.gpsData.latitude || rec.gpsData.longitude)
+    {
+        HeatPane &heat = m_heat[slot];
+
+        if (heat.index != pane)
+        {
+            heat.index = pane;
+            heat.dropped = 0;
+            heat.cells.clear();
+        }
+
+        uint64_t key = cellKey(rec.gpsData.latitude, rec.gpsData.longitude, m_config.cellDegrees);
+        auto cell = heat.cells.find(key);
+
+        if (cell != heat.cells.end())
+            cell->second++;
+        else if (heat.cells.size() < EL3_AGGREGATE_MAX_CELLS)
+            heat.cells.emplace(key, 1);
+        else
+            heat.dropped++;
+    }
+
+    m_lastData = max(m_lastData, pane);
+}
+
+void El3Aggregator::receive(uint32_t sensorId, int64_t recvNs)
+{
+    int64_t pane = floorDiv(recvNs, m_paneNs);
+
+    if (!roll(pane))
+        return;
+
+    uint32_t slot = (uint32_t) (pane - floorDiv(pane, m_panes) * m_panes);
+    auto it = m_sensorIndex.find(sensorId);
+    uint32_t i;
+
+    if (it == m_sensorIndex.end())
+    {
+        i = m_sensorNewest.size();
+        m_sensorIndex.emplace(sensorId, i);
+        m_sensorIds.push_back(sensorId);
+        m_sensorNewest.push_back(pane);
+        m_sensorPanes.resize(m_sensorPanes.size() + m_panes, SensorPane{NO_PANE, 0});
+    }
+    else
+    {
+        i = it->second;
+        m_sensorNewest[i] = max(m_sensorNewest[i], pane);
+    }
+
+    SensorPane &entry = m_sensorPanes[i * m_panes + slot];
+
+    if (entry.index != pane)
+    {
+        entry.index = pane;
+        entry.packets = 0;
+    }
+
+    entry.packets++;
+    m_lastData = max(m_lastData, pane);
+}
+
+void El3Aggregator::summarize(int64_t first, int64_t end, El3WindowSummary &out) const
+{
+    out.startNs = first * m_paneNs;
+    out.endNs = end * m_paneNs;
+    out.packets = 0;
+    out.cellsDropped = 0;
+    out.uavs.clear();
+    out.sensors.clear();
+    out.cells.clear();
+
+    for (size_t i = 0; i < m_uavNewest.size(); i++)
+    {
+        El3UavRollup total = El3UavRollup();
+
+        for (uint32_t s = 0; s < m_panes; s++)
+        {
+            const UavPane &pane = m_uavPanes[i * m_panes + s];
+
+            if (pane.index >= first && pane.index < end)
+                merge(total, pane.rollup);
+        }
+
+        if (total.packets)
+        {
+            out.packets += total.packets;
+            out.uavs.push_back(total);
+        }
+    }
+
+    for (size_t i = 0; i < m_sensorNewest.size(); i++)
+    {
+        El3SensorRollup total = { m_sensorIds[i], 0 };
+
+        for (uint32_t s = 0; s < m_panes; s++)
+        {
+            const SensorPane &pane = m_sensorPanes[i * m_panes + s];
+
+            if (pane.index >= first && pane.index < end)
+                total.packets += pane.packets;
+        }
+
+        if (total.packets)
+            out.sensors.push_back(total);
+    }
+
+    unordered_map<uint64_t, uint32_t> cells;
+
+    for (auto &heat : m_heat)
+    {
+        if (heat.index < first || heat.index >= end)
+            continue;
+
+        out.cellsDropped += heat.dropped;
+        for (auto &cell : heat.cells)
+            cells[cell.first] += cell.second;
+    }
+
+    out.cells.reserve(cells.size());
+    for (auto &cell : cells)
+    {
+        int32_t lat = (int32_t) (cell.first >> 32), lon = (int32_t) (uint32_t) cell.first;
+
+        out.cells.push_back({ lat * m_config.cellDegrees, lon * m_config.cellDegrees, cell.second });
+    }
+
+    sort(out.uavs.begin(), out.uavs.end(),
+        [](const El3UavRollup &a, const El3UavRollup &b) { return a.uavNo < b.uavNo; });
+    sort(out.sensors.begin(), out.sensors.end(),
+        [](const El3SensorRollup &a, const El3SensorRollup &b) { return a.sensorId < b.sensorId; });
+    sort(out.cells.begin(), out.cells.end(), [](const El3HeatCell &a, const El3HeatCell &b) {
+        if (a.packets != b.packets)
+            return a.packets > b.packets;
+        return a.latitude != b.latitude ? a.latitude < b.latitude : a.longitude < b.longitude;
+    });
+}
+
+void El3Aggregator::advance(int64_t nowNs, vector<El3WindowSummary> &out)
+{
+    if (m_pane != NO_PANE)
+        roll(max(m_pane, floorDiv(nowNs, m_paneNs)));
+
+    for (auto &summary : m_closed)
+        out.push_back(move(summary));
+
+    m_closed.clear();
+}
+
+void El3Aggregator::query(int64_t nowNs, El3WindowSummary &out) const
+{
+    int64_t pane = floorDiv(nowNs, m_paneNs);
+
+    if (m_pane != NO_PANE)
+        pane = max(pane, m_pane);
+
+    summarize(pane - m_panes + 1, pane + 1, out);
+}
@@ -0,0 +1,400 @@
+/*
+ * Copyright (c) 2022 Subreption LLC. All rights reserved.
+ * Author: 12dc8242df1be0d6f4b73d68166552197936a27074c004c8af95b27194ec584d
+ *
+ * Dual-licensed under the Subreption Ukraine Defense License (SUDL, version 1) and the  Server Side
+ * Public License (SSPL, version 3). Both licenses are provided with this software distribution.
+ */
+
+#include <el3dec/arrow.hpp>
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "Arrow buffers are written in host order, which must be little-endian"
+#endif
+
+using namespace std;
+
+/* Arrow's Schema.fbs and Message.fbs, the parts used here */
+#define ARROW_METADATA_V5       4
+#define ARROW_HEADER_SCHEMA     1
+#define ARROW_HEADER_BATCH      3
+#define ARROW_TYPE_INT          2
+#define ARROW_TYPE_FLOAT        3
+#define ARROW_TYPE_TIMESTAMP    10
+#define ARROW_PRECISION_SINGLE  1
+#define ARROW_UNIT_NANOSECOND   3
+
+#define ARROW_MAGIC             "ARROW1"
+#define ARROW_CONTINUATION      0xffffffffu
+
+/* buffers in a batch body start at this alignment, what Arrow itself uses */
+#define ARROW_BUFFER_ALIGN      64
+
+enum ArrowKind {
+  KIND_UINT,
+  KIND_FLOAT
+};
+
+struct ArrowColumn {
+  const char *name;
+  size_t offset;            /* in El3TelemetryRecord */
+  uint8_t width;
+  ArrowKind kind;
+};
+
+#define COLUMN(name, field, kind) \
+    { name, offsetof(El3TelemetryRecord, field), sizeof(((El3TelemetryRecord *) 0)->field), kind }
+
+static const ArrowColumn columns[] = {
+    COLUMN("packet_type",       packetType,         KIND_UINT),
+    COLUMN("engine_type",       engineType,         KIND_UINT),
+    COLUMN("uav_type",          uavType,            KIND_UINT),
+    COLUMN("uav_id",            uavNo,              KIND_UINT),
+    COLUMN("flight_time",       flightTime,         KIND_UINT),
+    COLUMN("remaining_min",     remainingMinutes,   KIND_UINT),
+    COLUMN("careen",            careen,             KIND_FLOAT),
+    COLUMN("pitch",             pitch,              KIND_FLOAT),
+    COLUMN("timestamp_hours",   stampHours,         KIND_UINT),
+    COLUMN("timestamp_minutes", stampMinutes,       KIND_UINT),
+    COLUMN("timestamp_seconds", stampSeconds,       KIND_UINT),
+    COLUMN("gps_latitude",      gpsData.latitude,   KIND_FLOAT),
+    COLUMN("gps_longitude",     gpsData.longitude,  KIND_FLOAT),
+    COLUMN("gps_altitude",      gpsData.altitude,   KIND_UINT),
+    COLUMN("gps_speed",         groundSpeed,        KIND_FLOAT),
+    COLUMN("video_tx_freq",     videoTxFreq,        KIND_UINT),
+    COLUMN("video_tx_chan",     videoTxChannel,     KIND_UINT),
+    COLUMN("camera_angle",      camera.angle,       KIND_FLOAT),
+    COLUMN("camera_azimuth",    camera.azimuth,     KIND_FLOAT),
+    COLUMN("camera_pos",        camera.position,    KIND_FLOAT),
+    COLUMN("track_verdict",     trackVerdict,       KIND_UINT),
+    COLUMN("track_confidence",  trackConfidence,    KIND_FLOAT),
+};
+
+#define COLUMNS (sizeof(columns) / sizeof(columns[0]))
+
+/* RecordBatch.nodes and .buffers */
+struct ArrowFieldNode {
+  int64_t length;
+  int64_t nullCount;
+};
+
+struct ArrowBuffer {
+  int64_t offset;
+  int64_t length;
+};
+
+/*
+ * Just enough of a FlatBuffers builder for Arrow's metadata. Like the real one it builds back to
+ * front, children before the tables referring to them, and references are sizes of the buffer at
+ * the time an object was finished; alignment is kept relative to the end, which finish() makes a
+ * multiple of 8.
+ */
+class FlatBuilder
+{
+  public:
+    FlatBuilder(): m_tableStart(0) {}
+
+    uint32_t size() const { return m_buf.size(); }
+
+    uint32_t string(const std::string &s)
+    {
+        align(4, s.size() + 1);
+        m_buf.insert(0, 1, '\0');
+        m_buf.insert(0, s);
+        push<uint32_t>(s.size());
+        return size();
+    }
+
+    /* a vector of structs of up to 8 byte alignment */
+    uint32_t structs(const void *data, size_t elemSize, size_t count)
+    {
+        align(8, elemSize * count);
+        if (count)
+            m_buf.insert(0, (const char *) data, elemSize * count);
+        push<uint32_t>(count);
+        return size();
+    }
+
+    /* a vector of tables or strings */
+    uint32_t offsets(const vector<uint32_t> &refs)
+    {
+        align(4, refs.size() * sizeof(uint32_t));
+        for (size_t i = refs.size(); i > 0; i--)
+            push<uint32_t>(size() + sizeof(uint32_t) - refs[i - 1]);
+        push<uint32_t>(refs.size());
+        return size();
+    }
+
+    void startTable()
+    {
+        m_fields.clear();
+        m_tableStart = size();
+    }
+
+    template <typename T>
+    void field(uint16_t id, T value)
+    {
+        push<T>(value);
+        m_fields.push_back(make_pair(id, size()));
+    }
+
+    void reference(uint16_t id, uint32_t ref)
+    {
+        align(4);
+        field<uint32_t>(id, size() + sizeof(uint32_t) - ref);
+    }
+
+    uint32_t endTable()
+    {
+        push<int32_t>(0);
+
+        uint32_t table = size();
+        uint16_t slots = 0;
+
+        for (auto &f : m_fields)
+            slots = max<uint16_t>(slots, f.first + 1);
+
+        vector<uint16_t> vtable(slots, 0);
+
+        for (auto &f : m_fields)
+            vtable[f.first] = table - f.second;
+
+        for (size_t i = slots; i > 0; i--)
+            push<uint16_t>(vtable[i - 1]);
+        push<uint16_t>(table - m_tableStart);
+        push<uint16_t>((slots + 2) * sizeof(uint16_t));
+
+        /* the table points back at its vtable, just in front of it */
+        int32_t soffset = size() - table;
+        memcpy(&m_buf[m_buf.size() - table], &soffset, sizeof(soffset));
+        return table;
+    }
+
+    const std::string &finish(uint32_t root)
+    {
+        align(8, sizeof(uint32_t));
+        push<uint32_t>(size() + sizeof(uint32_t) - root);
+        return m_buf;
+    }
+
+  private:
+    /* pad so that the next len bytes end aligned */
+    void align(size_t alignment, size_t len = 0)
+    {
+        m_buf.insert(0, (alignment - (m_buf.size() + len) % alignment) % alignment, '\0');
+    }
+
+    template <typename T>
+    void push(T value)
+    {
+        align(sizeof(T));
+        m_buf.insert(0, (const char *) &value, sizeof(value));
+    }
+
+    std::string m_buf;
+    vector<pair<uint16_t, uint32_t>> m_fields;      /* id, reference */
+    uint32_t m_tableStart;
+};
+
+static uint32_t typeTable(FlatBuilder &fb, const ArrowColumn &col, uint8_t &type)
+{
+    fb.startTable();
+
+    if (col.kind == KIND_FLOAT)
+    {
+        fb.field<int16_t>(0, ARROW_PRECISION_SINGLE);
+        type = ARROW_TYPE_FLOAT;
+    }
+    else
+    {
+        fb.field<int32_t>(0, col.width * 8);
+        fb.field<uint8_t>(1, 0);
+        type = ARROW_TYPE_INT;
+    }
+
+    return fb.endTable();
+}
+
+static uint32_t fieldTable(FlatBuilder &fb, const char *name, uint8_t type, uint32_t typeRef)
+{
+    uint32_t nameRef = fb.string(name);
+    uint32_t children = fb.offsets(vector<uint32_t>());
+
+    fb.startTable();
+    fb.reference(0, nameRef);
+    fb.reference(3, typeRef);
+    fb.reference(5, children);
+    fb.field<uint8_t>(1, 0);            /* not nullable */
+    fb.field<uint8_t>(2, type);
+    return fb.endTable();
+}
+
+static uint32_t schemaTable(FlatBuilder &fb, bool receiveTimes)
+{
+    vector<uint32_t> fields;
+
+    if (receiveTimes)
+    {
+        uint32_t timezone = fb.string("UTC");
+
+        fb.startTable();
+        fb.reference(1, timezone);
+        fb.field<int16_t>(0, ARROW_UNIT_NANOSECOND);
+        fields.push_back(fieldTable(fb, "recv_ns", ARROW_TYPE_TIMESTAMP, fb.endTable()));
+    }
+
+    for (auto &col : columns)
+    {
+        uint8_t type;
+        uint32_t typeRef = typeTable(fb, col, type);
+
+        fields.push_back(fieldTable(fb, col.name, type, typeRef));
+    }
+
+    uint32_t fieldsRef = fb.offsets(fields);
+
+    fb.startTable();
+    fb.reference(1, fieldsRef);
+    fb.field<int16_t>(0, 0);            /* little-endian */
+    return fb.endTable();
+}
+
+static uint32_t messageTable(FlatBuilder &fb, uint8_t type, uint32_t header, int64_t bodyLength)
+{
+    fb.startTable();
+    fb.field<int64_t>(3, bodyLength);
+    fb.reference(2, header);
+    fb.field<int16_t>(0, ARROW_METADATA_V5);
+    fb.field<uint8_t>(1, type);
+    return fb.endTable();
+}
+
+//------------------------------------------------------------------------------
+
+El3ArrowWriter::El3ArrowWriter(El3ArrowLayout layout, bool receiveTimes):
+    m_layout(layout), m_receiveTimes(receiveTimes), m_columns(COLUMNS + receiveTimes),
+    m_pending(0), m_rows(0), m_written(0)
+{
+    size_t c = 0;
+
+    if (m_receiveTimes)
+        m_columns[c++].reserve(EL3_ARROW_BATCH_ROWS * sizeof(int64_t));
+
+    for (auto &col : columns)
+        m_columns[c++].reserve(EL3_ARROW_BATCH_ROWS * col.width);
+}
+
+void El3ArrowWriter::begin(string &out)
+{
+    size_t before = out.size();
+    FlatBuilder fb;
+
+    if (m_layout == ARROW_FILE)
+        out.append(ARROW_MAGIC "\0\0", 8);
+
+    m_written += out.size() - before;
+    message(out, fb.finish(messageTable(fb, ARROW_HEADER_SCHEMA, schemaTable(fb, m_receiveTimes), 0)), "");
+}
+
+void El3ArrowWriter::add(const El3TelemetryRecord &rec, int64_t recvNs)
+{
+    size_t c = 0;
+
+    if (m_receiveTimes)
+        m_columns[c++].append((const char *) &recvNs, sizeof(recvNs));
+
+    for (auto &col : columns)
+        m_columns[c++].append((const char *) &rec + col.offset, col.width);
+
+    m_pending++;
+}
+
+void El3ArrowWriter::batch(string &out)
+{
+    if (!m_pending)
+        return;
+
+    vector<ArrowFieldNode> nodes(m_columns.size(), ArrowFieldNode{ (int64_t) m_pending, 0 });
+    vector<ArrowBuffer> buffers;
+    string body;
+
+    for (auto &data : m_columns)
+    {
+        /* no validity bitmap, nothing is null */
+        buffers.push_back(ArrowBuffer{ (int64_t) body.size(), 0 });
+        buffers.push_back(ArrowBuffer{ (int64_t) body.size(), (int64_t) data.size() });
+
+        body += data;
+        body.append((ARROW_BUFFER_ALIGN - body.size() % ARROW_BUFFER_ALIGN) % ARROW_BUFFER_ALIGN, '\0');
+        data.clear();
+    }
+
+    FlatBuilder fb;
+    uint32_t buffersRef = fb.structs(buffers.data(), sizeof(ArrowBuffer), buffers.size());
+    uint32_t nodesRef = fb.structs(nodes.data(), sizeof(ArrowFieldNode), nodes.size());
+
+    fb.startTable();
+    fb.field<int64_t>(0, m_pending);
+    fb.reference(1, nodesRef);
+    fb.reference(2, buffersRef);
+
+    uint32_t batchRef = fb.endTable();
+    Block block = { (int64_t) m_written, 0, 0, (int64_t) body.size() };
+    uint64_t before = m_written;
+
+    message(out, fb.finish(messageTable(fb, ARROW_HEADER_BATCH, batchRef, body.size())), body);
+
+    block.metaDataLength = m_written - before - body.size();
+    m_blocks.push_back(block);
+
+    m_rows += m_pending;
+    m_pending = 0;
+}
+
+void El3ArrowWriter::end(string &out)
+{
+    uint32_t eos[2] = { ARROW_CONTINUATION, 0 };
+
+    batch(out);
+
+    out.append((const char *) eos, sizeof(eos));
+    m_written += sizeof(eos);
+
+    if (m_layout != ARROW_FILE)
+        return;
+
+    FlatBuilder fb;
+    uint32_t blocks = fb.structs(m_blocks.data(), sizeof(Block), m_blocks.size());
+    uint32_t dictionaries = fb.structs(NULL, sizeof(Block), 0);
+    uint32_t schema = schemaTable(fb, m_receiveTimes);
+
+    fb.startTable();
+    fb.reference(1, schema);
+    fb.reference(2, dictionaries);
+    fb.reference(3, blocks);
+    fb.field<int16_t>(0, ARROW_METADATA_V5);
+
+    const string &footer = fb.finish(fb.endTable());
+    int32_t length = footer.size();
+
+    out += footer;
+    out.append((const char *) &length, sizeof(length));
+    out.append(ARROW_MAGIC, strlen(ARROW_MAGIC));
+    m_written += footer.size() + sizeof(length) + strlen(ARROW_MAGIC);
+}
+
+/* an encapsulated message: continuation marker, metadata length, metadata padded to 8, body */
+void El3ArrowWriter::message(string &out, const string &meta, const string &body)
+{
+    uint32_t prefix[2] = { ARROW_CONTINUATION, (uint32_t) ((meta.size() + 7) & ~(size_t) 7) };
+
+    out.append((const char *) prefix, sizeof(prefix));
+    out += meta;
+    out.append(prefix[1] - meta.size(), '\0');
+    out += body;
+
+    m_written += sizeof(prefix) + prefix[1] + body.size();
+}
@@ -0,0 +1,157 @@
+/*
+ * Copyright (c) 2022 Subreption LLC. All rights reserved.
+ * Author: 12dc8242df1be0d6f4b73d68166552197936a27074c004c8af95b27194ec584d
+ *
+ * Dual-licensed under the Subreption Ukraine Defense License (SUDL, version 1) and the  Server Side
+ * Public License (SSPL, version 3). Both licenses are provided with this software distribution.
+ */
+
+#include <el3dec/el3dec.h>
+#include <el3dec/prefilter.hpp>
+#include <el3dec/telemetry.hpp>
+#include <cstring>
+#include <exception>
+
+static_assert(sizeof(el3dec_record) == 64, "el3dec_record is part of the ABI");
+
+/* the length byte does not count the magic, length and trailing bytes */
+#define ELERON_FRAME_OVERHEAD   3
+
+static void copyRecord(const El3TelemetryRecord &rec, el3dec_record *out)
+{
+    out->uav_no            = rec.uavNo;
+    out->flight_time       = rec.flightTime;
+    out->status            = EL3DEC_OK;
+    out->packet_type       = rec.packetType;
+    out->engine_type       = rec.engineType;
+    out->uav_type          = rec.uavType;
+    out->stamp_hours       = rec.stampHours;
+    out->stamp_minutes     = rec.stampMinutes;
+    out->stamp_seconds     = rec.stampSeconds;
+    out->track_verdict     = rec.trackVerdict;
+    out->altitude          = rec.gpsData.altitude;
+    out->remaining_minutes = rec.remainingMinutes;
+    out->video_channel     = rec.videoTxChannel;
+    out->video_freq        = rec.videoTxFreq;
+    out->latitude          = rec.gpsData.latitude;
+    out->longitude         = rec.gpsData.longitude;
+    out->ground_speed      = rec.groundSpeed;
+    out->careen            = rec.careen;
+    out->pitch             = rec.pitch;
+    out->camera_angle      = rec.camera.angle;
+    out->camera_position   = rec.camera.position;
+    out->camera_azimuth    = rec.camera.azimuth;
+    out->track_confidence  = rec.trackConfidence;
+    out->reserved[0]       = 0;
+    out->reserved[1]       = 0;
+}
+
+int el3dec_abi_version(void)
+{
+    return EL3DEC_ABI_VERSION;
+}
+
+size_t el3dec_record_size(void)
+{
+    return sizeof(el3dec_record);
+}
+
+int el3dec_decode(const uint8_t *frame, size_t len, int mode, el3dec_record *out)
+{
+    /* garbage is common in a stream being resynchronized, spare it the exception */
+    if (EL3_SCREEN_VERDICT(el3DecodableScreen().screen(frame, len)) == SCREEN_REJECT)
+    {
+        memset(out, 0, sizeof(*out));
+        out->status = EL3DEC_INVALID;
+        return out->status;
+    }
+
+    try {
+        El3Telemetry telemetry(frame, len,
+            mode == EL3DEC_FAULT_INTOLERANT ? FAULT_INTOLERANT : FAULT_TOLERANT);
+
+        copyRecord(telemetry.Record(), out);
+    } catch (const std::exception &) {
+        memset(out, 0, sizeof(*out));
+        out->status = EL3DEC_INVALID;
+    }
+
+    return out->status;
+}
+
+size_t el3dec_decode_batch(const uint8_t *buf, size_t stride, const uint16_t *lengths,
+    size_t count, int mode, el3dec_record *out)
+{
+    size_t ok = 0;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        /* a length past the row would read into the next ones, or past the buffer */
+        if (lengths && lengths[i] > stride)
+        {
+            memset(&out[i], 0, sizeof(out[i]));
+            out[i].status = EL3DEC_INVALID;
+            continue;
+        }
+
+        if (el3dec_decode(buf + i * stride, lengths ? lengths[i] : stride, mode, &out[i]) == EL3DEC_OK)
+            ok++;
+    }
+
+    return ok;
+}
+
+size_t el3dec_decode_indexed(const uint8_t *buf, const uint64_t *offsets,
+    const uint16_t *lengths, size_t count, int mode, el3dec_record *out)
+{
+    size_t ok = 0;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if (el3dec_decode(buf + offsets[i], lengths[i], mode, &out[i]) == EL3DEC_OK)
+            ok++;
+    }
+
+    return ok;
+}
+
+size_t el3dec_decode_stream(const uint8_t *buf, size_t len, int mode, el3dec_record *out,
+    size_t max, size_t *consumed)
+{
+    size_t pos = 0, n = 0;
+
+    while (pos < len && n < max)
+    {
+        if (buf[pos] != ENICS_ELERON_PACKET_MAGICBYTE)
+        {
+            const void *magic = memchr(buf + pos, ENICS_ELERON_PACKET_MAGICBYTE, len - pos);
+
+            pos = magic ? (const uint8_t *) magic - buf : len;
+            continue;
+        }
+
+        if (len - pos < 2)
+            break;
+
+        size_t flen = buf[pos + 1] + ELERON_FRAME_OVERHEAD;
+
+        if (len - pos < flen)
+            break;
+
+        if (el3dec_decode(buf + pos, flen, mode, &out[n]) == EL3DEC_OK)
+        {
+            n++;
+            pos += flen;
+        }
+        else
+        {
+            /* a false magic byte, try from the next one */
+            pos++;
+        }
+    }
+
+    if (consumed)
+        *consumed = pos;
+
+    return n;
+}
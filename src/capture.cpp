@@ -0,0 +1,1110 @@
+/*
+ * Copyright (c) 2022 Subreption LLC. All rights reserved.
+ * Author: 12dc8242df1be0d6f4b73d68166552197936a27074c004c8af95b27194ec584d
+ *
+ * Dual-licensed under the Subreption Ukraine Defense License (SUDL, version 1) and the  Server Side
+ * Public License (SSPL, version 3). Both licenses are provided with this software distribution.
+ */
+
+#include <el3dec/capture.hpp>
+#include <el3dec/telemetry.hpp>
+#include <el3dec/uring.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <new>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "capture archives are read and written in host order, which must be little-endian"
+#endif
+
+using namespace std;
+
+static inline size_t recordSpan(size_t len)
+{
+    return sizeof(El3CaptureRecordHeader) + ((len + 7) & ~(size_t) 7);
+}
+
+static bool postingLess(const El3CaptureUavEntry &a, const El3CaptureUavEntry &b)
+{
+    return a.uavNo < b.uavNo || (a.uavNo == b.uavNo && a.block < b.block);
+}
+
+static runtime_error captureError(const string &what, const string &path)
+{
+    return runtime_error(what + " (" + path + "): " + strerror(errno));
+}
+
+static inline uint64_t alignDown(uint64_t n, uint64_t align)
+{
+    return n / align * align;
+}
+
+static inline uint64_t alignUp(uint64_t n, uint64_t align)
+{
+    return alignDown(n + align - 1, align);
+}
+
+static El3CaptureIoConfig normalizedIo(const El3CaptureIoConfig &io)
+{
+    El3CaptureIoConfig n = io;
+
+    n.depth = min<uint32_t>(max<uint32_t>(n.depth, 1), 256);
+    n.bufferSize = alignUp(max<uint32_t>(n.bufferSize, EL3_CAPTURE_DIRECT_ALIGN), EL3_CAPTURE_DIRECT_ALIGN);
+    return n;
+}
+
+static bool useUring(const El3CaptureIoConfig &io)
+{
+    return io.mode == CAPTURE_IO_URING || (io.mode == CAPTURE_IO_AUTO && El3Uring::available());
+}
+
+bool el3ParseCaptureIo(const string &name, El3CaptureIoConfig &io)
+{
+    io.direct = name == "direct";
+
+    if (name == "auto")
+        io.mode = CAPTURE_IO_AUTO;
+    else if (name == "buffered")
+        io.mode = CAPTURE_IO_BUFFERED;
+    else if (name == "uring" || name == "direct")
+        io.mode = CAPTURE_IO_URING;
+    else
+        return false;
+
+    return true;
+}
+
+uint32_t el3CaptureUav(const unsigned char *frame, size_t len)
+{
+    if (len < 6 || frame[0] != ENICS_ELERON_PACKET_MAGICBYTE)
+        return EL3_CAPTURE_NO_UAV;
+
+    return (frame[3] << 8) | frame[4];
+}
+
+void el3CaptureRecords(const unsigned char *data, size_t len, vector<El3CaptureRecord> &out)
+{
+    size_t offset = 0;
+
+    while (offset + sizeof(El3CaptureBlockHeader) <= len)
+    {
+        El3CaptureBlockHeader bh;
+
+        memcpy(&bh, data + offset, sizeof(bh));
+
+        if (bh.magic != EL3_CAPTURE_BLOCK_MAGIC || bh.bytes > len - offset - sizeof(bh))
+            return;
+
+        size_t at = offset + sizeof(bh);
+        size_t end = at + bh.bytes;
+
+        for (uint32_t i = 0; i < bh.records && at + sizeof(El3CaptureRecordHeader) <= end; i++)
+        {
+            El3CaptureRecordHeader rh;
+            El3CaptureRecord rec;
+
+            memcpy(&rh, data + at, sizeof(rh));
+            if (at + recordSpan(rh.length) > end)
+                return;
+
+            rec.recvNs = rh.recvNs;
+            rec.sensorId = rh.sensorId;
+            rec.length = rh.length;
+            rec.data = data + at + sizeof(rh);
+            out.push_back(rec);
+
+            at += recordSpan(rh.length);
+        }
+
+        offset = end;
+    }
+}
+
+//------------------------------------------------------------------------------
+
+El3CaptureWriter::El3CaptureWriter(const string &path, uint32_t blockSize, const El3CaptureIoConfig &io):
+    m_fd(-1), m_blockSize(blockSize), m_offset(0), m_records(0), m_io(normalizedIo(io)), m_direct(false),
+    m_segmentMemory(NULL), m_segment(0)
+{
+    /* a frame that does not fit gets an oversized block of its own */
+    if (m_blockSize < EL3_CAPTURE_MIN_BLOCK)
+        m_blockSize = EL3_CAPTURE_MIN_BLOCK;
+
+    m_block.reserve(m_blockSize);
+
+    try {
+        open(path);
+    } catch (...) {
+        if (m_fd >= 0)
+            ::close(m_fd);
+        free(m_segmentMemory);
+        throw;
+    }
+}
+
+El3CaptureWriter::~El3CaptureWriter()
+{
+    try {
+        close();
+    } catch (const exception &) {
+        /* nothing sensible left to do with the error here */
+    }
+
+    /* buffers the kernel may still be writing from are not freed under it */
+    try {
+        if (m_uring)
+            drain();
+    } catch (const exception &) {
+    }
+
+    m_uring.reset();
+    free(m_segmentMemory);
+
+    if (m_fd >= 0)
+        ::close(m_fd);
+}
+
+void El3CaptureWriter::open(const string &path)
+{
+    struct stat st;
+    bool resume = stat(path.c_str(), &st) == 0 && st.st_size > 0;
+
+    if (resume)
+    {
+        /* resume: keep the complete blocks, drop the index, it is rewritten on close */
+        El3CaptureReader existing(path);
+
+        m_blocks = existing.blockEntries();
+        m_postings = existing.postings();
+        m_records = existing.records();
+        m_offset = existing.dataEnd();
+
+        m_fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC);
+        if (m_fd < 0)
+            throw captureError("cannot open capture", path);
+
+        if (ftruncate(m_fd, m_offset) < 0)
+            throw captureError("cannot truncate capture index", path);
+    }
+    else
+    {
+        m_fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (m_fd < 0)
+            throw captureError("cannot create capture", path);
+    }
+
+    if (useUring(m_io))
+        openUring(path, resume);
+    else if (resume && lseek(m_fd, m_offset, SEEK_SET) < 0)
+        throw captureError("cannot truncate capture index", path);
+
+    if (resume)
+        return;
+
+    El3CaptureFileHeader hdr;
+    struct timespec now;
+
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, EL3_CAPTURE_MAGIC, sizeof(hdr.magic));
+    hdr.version = EL3_CAPTURE_VERSION;
+    hdr.blockSize = m_blockSize;
+    hdr.createdNs = now.tv_sec * 1000000000LL + now.tv_nsec;
+
+    writeAll(&hdr, sizeof(hdr));
+}
+
+void El3CaptureWriter::openUring(const string &path, bool resume)
+{
+    void *memory;
+
+    m_uring.reset(new El3Uring(m_io.depth));
+
+    if (posix_memalign(&memory, EL3_CAPTURE_DIRECT_ALIGN, (size_t) m_io.depth * m_io.bufferSize))
+        throw bad_alloc();
+
+    m_segmentMemory = (unsigned char *) memory;
+    m_segments.assign(m_io.depth, Segment());
+
+    vector<struct iovec> iov(m_io.depth);
+
+    for (unsigned i = 0; i < m_io.depth; i++)
+    {
+        iov[i].iov_base = segment(i);
+        iov[i].iov_len = m_io.bufferSize;
+    }
+
+    /* unregistered buffers only cost a page walk per write */
+    m_uring->registerBuffers(&iov[0], m_io.depth);
+
+    Segment &seg = m_segments[0];
+
+    seg.fileOffset = m_offset;
+
+    if (m_io.direct)
+    {
+        /* O_DIRECT writes start aligned, the start of the unit being appended to is written again */
+        seg.fileOffset = alignDown(m_offset, EL3_CAPTURE_DIRECT_ALIGN);
+        seg.used = m_offset - seg.fileOffset;
+
+        if (resume && seg.used && pread(m_fd, segment(0), seg.used, seg.fileOffset) != (ssize_t) seg.used)
+            throw captureError("cannot read capture", path);
+
+        int flags = fcntl(m_fd, F_GETFL);
+
+        /* file systems without O_DIRECT get the page cache */
+        m_direct = flags >= 0 && fcntl(m_fd, F_SETFL, flags | O_DIRECT) == 0;
+
+        if (!m_direct)
+        {
+            seg.fileOffset = m_offset;
+            seg.used = 0;
+        }
+    }
+}
+
+void El3CaptureWriter::writeAll(const void *buf, size_t len)
+{
+    const char *p = (const char *) buf;
+
+    if (m_uring)
+    {
+        checkIo();
+
+        while (len)
+        {
+            Segment &seg = m_segments[m_segment];
+            size_t n = min<size_t>(len, m_io.bufferSize - seg.used);
+
+            memcpy(segment(m_segment) + seg.used, p, n);
+            seg.used += n;
+            p += n;
+            len -= n;
+            m_offset += n;
+
+            if (seg.used == m_io.bufferSize)
+                submitSegment();
+        }
+        return;
+    }
+
+    while (len)
+    {
+        ssize_t n = ::write(m_fd, p, len);
+
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            throw runtime_error(string("capture write failed: ") + strerror(errno));
+        }
+
+        p += n;
+        len -= n;
+        m_offset += n;
+    }
+}
+
+/* write what the current segment holds, and carry on in a free one */
+void El3CaptureWriter::submitSegment()
+{
+    Segment &seg = m_segments[m_segment];
+    size_t len = m_direct ? alignDown(seg.used, EL3_CAPTURE_DIRECT_ALIGN) : seg.used;
+
+    if (!len)
+        return;
+
+    m_uring->write(m_fd, segment(m_segment), len, seg.fileOffset, m_segment, m_segment);
+    m_uring->submit();
+    seg.writing = len;
+
+    unsigned next = m_segment;
+    bool found = false;
+
+    reap(false);
+
+    while (!found)
+    {
+        for (unsigned i = 1; i <= m_io.depth && !found; i++)
+        {
+            next = (m_segment + i) % m_io.depth;
+            found = !m_segments[next].writing;
+        }
+
+        /* the disk is behind, this is the only place appending waits */
+        if (!found)
+            reap(true);
+    }
+
+    Segment &free = m_segments[next];
+
+    free.fileOffset = seg.fileOffset + len;
+    free.used = seg.used - len;
+    memmove(segment(next), segment(m_segment) + len, free.used);
+
+    m_segment = next;
+}
+
+void El3CaptureWriter::reap(bool wait)
+{
+    uint64_t n;
+    int32_t res;
+
+    while (m_uring->complete(n, res, wait))
+    {
+        Segment &seg = m_segments[n];
+
+        if (m_ioError.empty() && res < 0)
+            m_ioError = strerror(-res);
+        else if (m_ioError.empty() && (size_t) res != seg.writing)
+            m_ioError = "short write";
+
+        seg.writing = 0;
+        wait = false;
+    }
+}
+
+void El3CaptureWriter::drain()
+{
+    while (m_uring->inFlight())
+        reap(true);
+}
+
+void El3CaptureWriter::checkIo()
+{
+    if (m_uring)
+        reap(false);
+
+    if (!m_ioError.empty())
+        throw runtime_error("capture write failed: " + m_ioError);
+}
+
+void El3CaptureWriter::append(int64_t recvNs, uint32_t sensorId, const unsigned char *frame, size_t len)
+{
+    if (m_fd < 0)
+        throw runtime_error("capture is closed");
+
+    if (len > EL3_CAPTURE_MAX_FRAME)
+        throw invalid_argument("frame too large for capture");
+
+    size_t span = recordSpan(len);
+
+    if (!m_block.empty() && m_block.size() + span > m_blockSize)
+        finishBlock();
+
+    if (m_block.empty())
+    {
+        m_block.resize(sizeof(El3CaptureBlockHeader));
+
+        memset(&m_current, 0, sizeof(m_current));
+        m_current.magic = EL3_CAPTURE_BLOCK_MAGIC;
+        m_current.minNs = INT64_MAX;
+        m_current.maxNs = INT64_MIN;
+    }
+
+    El3CaptureRecordHeader rh;
+    size_t at = m_block.size();
+
+    rh.recvNs = recvNs;
+    rh.sensorId = sensorId;
+    rh.length = len;
+    rh.reserved = 0;
+
+    /* zero fill takes care of the padding */
+    m_block.resize(at + span);
+    memcpy(&m_block[at], &rh, sizeof(rh));
+    memcpy(&m_block[at + sizeof(rh)], frame, len);
+
+    m_current.records++;
+    m_current.minNs = min(m_current.minNs, recvNs);
+    m_current.maxNs = max(m_current.maxNs, recvNs);
+    m_records++;
+
+    uint32_t uav = el3CaptureUav(frame, len);
+    if (uav != EL3_CAPTURE_NO_UAV &&
+        find(m_currentUavs.begin(), m_currentUavs.end(), uav) == m_currentUavs.end())
+        m_currentUavs.push_back(uav);
+}
+
+void El3CaptureWriter::flush(bool wait)
+{
+    if (m_fd < 0)
+        return;
+
+    finishBlock();
+
+    if (m_uring)
+    {
+        submitSegment();
+        if (wait)
+            drain();
+        checkIo();
+    }
+}
+
+uint64_t El3CaptureWriter::unwritten(vector<unsigned char> &tail)
+{
+    uint64_t written = m_offset;
+
+    tail.clear();
+
+    if (m_uring)
+    {
+        vector<unsigned> held;
+
+        for (;;)
+        {
+            reap(false);
+
+            /* buffers holding data not known to be in the file: those in flight, then the current one */
+            held.clear();
+            for (unsigned i = 0; i < m_io.depth; i++)
+            {
+                if (m_segments[i].writing && i != m_segment)
+                    held.push_back(i);
+            }
+
+            sort(held.begin(), held.end(),
+                [this](unsigned a, unsigned b) {
+                    return m_segments[a].fileOffset < m_segments[b].fileOffset;
+                });
+            held.push_back(m_segment);
+
+            bool contiguous = true;
+
+            for (size_t i = 1; i < held.size(); i++)
+            {
+                const Segment &prev = m_segments[held[i - 1]];
+
+                contiguous = contiguous && prev.fileOffset + prev.writing == m_segments[held[i]].fileOffset;
+            }
+
+            if (contiguous)
+                break;
+
+            /* a later write completed first and its buffer was taken again, the gap is only on disk */
+            reap(true);
+        }
+
+        written = m_segments[held[0]].fileOffset;
+
+        for (unsigned n : held)
+        {
+            size_t len = n == m_segment ? m_segments[n].used : m_segments[n].writing;
+
+            tail.insert(tail.end(), segment(n), segment(n) + len);
+        }
+    }
+
+    if (!m_block.empty())
+    {
+        El3CaptureBlockHeader current = m_current;
+        size_t at = tail.size();
+
+        current.bytes = m_block.size() - sizeof(El3CaptureBlockHeader);
+        tail.insert(tail.end(), m_block.begin(), m_block.end());
+        memcpy(&tail[at], &current, sizeof(current));
+    }
+
+    return written;
+}
+
+void El3CaptureWriter::finishBlock()
+{
+    if (m_block.empty())
+        return;
+
+    El3CaptureBlockEntry entry;
+
+    m_current.bytes = m_block.size() - sizeof(El3CaptureBlockHeader);
+    memcpy(&m_block[0], &m_current, sizeof(m_current));
+
+    entry.offset = m_offset;
+    entry.minNs = m_current.minNs;
+    entry.maxNs = m_current.maxNs;
+    entry.records = m_current.records;
+    entry.bytes = m_current.bytes;
+
+    writeAll(&m_block[0], m_block.size());
+
+    for (size_t i = 0; i < m_currentUavs.size(); i++)
+    {
+        El3CaptureUavEntry posting = { m_currentUavs[i], (uint32_t) m_blocks.size() };
+        m_postings.push_back(posting);
+    }
+
+    m_blocks.push_back(entry);
+    m_block.clear();
+    m_currentUavs.clear();
+}
+
+void El3CaptureWriter::close()
+{
+    if (m_fd < 0)
+        return;
+
+    finishBlock();
+
+    El3CaptureIndexHeader ih;
+    El3CaptureTrailer trailer;
+
+    stable_sort(m_postings.begin(), m_postings.end(), postingLess);
+
+    memset(&ih, 0, sizeof(ih));
+    ih.magic = EL3_CAPTURE_INDEX_MAGIC;
+    ih.blocks = m_blocks.size();
+    ih.postings = m_postings.size();
+
+    trailer.indexOffset = m_offset;
+    memcpy(trailer.magic, EL3_CAPTURE_TRAILER_MAGIC, sizeof(trailer.magic));
+
+    writeAll(&ih, sizeof(ih));
+    if (!m_blocks.empty())
+        writeAll(&m_blocks[0], m_blocks.size() * sizeof(El3CaptureBlockEntry));
+    if (!m_postings.empty())
+        writeAll(&m_postings[0], m_postings.size() * sizeof(El3CaptureUavEntry));
+    writeAll(&trailer, sizeof(trailer));
+
+    int fd = m_fd;
+    string error;
+
+    if (m_uring)
+    {
+        submitSegment();
+        drain();
+
+        Segment &seg = m_segments[m_segment];
+
+        /* O_DIRECT cannot write the unaligned tail, the page cache takes it */
+        if (seg.used && m_ioError.empty())
+        {
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+
+            if (pwrite(fd, segment(m_segment), seg.used, seg.fileOffset) != (ssize_t) seg.used)
+                m_ioError = strerror(errno);
+        }
+
+        error = m_ioError;
+        m_uring.reset();
+    }
+
+    m_fd = -1;
+
+    if (::close(fd) < 0)
+        throw runtime_error(string("capture close failed: ") + strerror(errno));
+
+    if (!error.empty())
+        throw runtime_error("capture write failed: " + error);
+}
+
+//------------------------------------------------------------------------------
+
+El3CaptureReader::El3CaptureReader(const string &path, uint64_t size):
+    m_map(NULL), m_size(0), m_dataEnd(0), m_recovered(false), m_sortedByTime(true)
+{
+    struct stat st;
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0)
+        throw captureError("cannot open capture", path);
+
+    if (fstat(fd, &st) < 0 || (size_t) st.st_size < sizeof(El3CaptureFileHeader))
+    {
+        ::close(fd);
+        throw runtime_error("not a capture archive (" + path + ")");
+    }
+
+    m_size = min<uint64_t>(st.st_size, size);
+    if (m_size < sizeof(El3CaptureFileHeader))
+    {
+        ::close(fd);
+        throw runtime_error("not a capture archive (" + path + ")");
+    }
+
+    void *map = mmap(NULL, m_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+
+    if (map == MAP_FAILED)
+        throw captureError("cannot map capture", path);
+
+    m_map = (const unsigned char *) map;
+
+    El3CaptureFileHeader hdr;
+    memcpy(&hdr, m_map, sizeof(hdr));
+
+    if (memcmp(hdr.magic, EL3_CAPTURE_MAGIC, sizeof(hdr.magic)) || hdr.version != EL3_CAPTURE_VERSION)
+    {
+        munmap(map, m_size);
+        throw runtime_error("not a capture archive (" + path + ")");
+    }
+
+    /* pages are only touched by iteration, let the kernel read ahead for it */
+    madvise(map, m_size, MADV_SEQUENTIAL);
+
+    El3CaptureTrailer trailer;
+    bool indexed = false;
+
+    if (m_size >= sizeof(hdr) + sizeof(El3CaptureIndexHeader) + sizeof(trailer))
+    {
+        memcpy(&trailer, m_map + m_size - sizeof(trailer), sizeof(trailer));
+
+        indexed = !memcmp(trailer.magic, EL3_CAPTURE_TRAILER_MAGIC, sizeof(trailer.magic)) &&
+            trailer.indexOffset >= sizeof(hdr) &&
+            trailer.indexOffset <= m_size - sizeof(El3CaptureIndexHeader) - sizeof(trailer);
+    }
+
+    if (!indexed || !loadIndex(trailer.indexOffset))
+        recover();
+
+    for (size_t i = 1; i < m_blocks.size(); i++)
+    {
+        if (m_blocks[i].minNs < m_blocks[i - 1].minNs || m_blocks[i].maxNs < m_blocks[i - 1].maxNs)
+            m_sortedByTime = false;
+    }
+}
+
+El3CaptureReader::~El3CaptureReader()
+{
+    if (m_map)
+        munmap((void *) m_map, m_size);
+}
+
+bool El3CaptureReader::loadIndex(uint64_t indexOffset)
+{
+    El3CaptureIndexHeader ih;
+
+    memcpy(&ih, m_map + indexOffset, sizeof(ih));
+
+    uint64_t need = sizeof(ih) + (uint64_t) ih.blocks * sizeof(El3CaptureBlockEntry) +
+        (uint64_t) ih.postings * sizeof(El3CaptureUavEntry) + sizeof(El3CaptureTrailer);
+
+    if (ih.magic != EL3_CAPTURE_INDEX_MAGIC || indexOffset + need != m_size)
+        return false;
+
+    const unsigned char *p = m_map + indexOffset + sizeof(ih);
+
+    m_blocks.resize(ih.blocks);
+    if (ih.blocks)
+        memcpy(&m_blocks[0], p, ih.blocks * sizeof(El3CaptureBlockEntry));
+
+    p += ih.blocks * sizeof(El3CaptureBlockEntry);
+
+    m_postings.resize(ih.postings);
+    if (ih.postings)
+        memcpy(&m_postings[0], p, ih.postings * sizeof(El3CaptureUavEntry));
+
+    /* an index that does not describe this file is rebuilt rather than trusted */
+    for (auto &entry : m_blocks)
+    {
+        if (entry.offset < sizeof(El3CaptureFileHeader) ||
+            entry.offset > indexOffset - sizeof(El3CaptureBlockHeader) ||
+            entry.bytes > indexOffset - sizeof(El3CaptureBlockHeader) - entry.offset)
+            return false;
+    }
+
+    for (auto &posting : m_postings)
+    {
+        if (posting.block >= ih.blocks)
+            return false;
+    }
+
+    if (!is_sorted(m_postings.begin(), m_postings.end(), postingLess))
+        return false;
+
+    m_dataEnd = indexOffset;
+    return true;
+}
+
+/* walk the block headers; a torn block at the end is where the data stops */
+void El3CaptureReader::recover()
+{
+    uint64_t offset = sizeof(El3CaptureFileHeader);
+
+    m_blocks.clear();
+    m_postings.clear();
+    m_recovered = true;
+
+    while (offset + sizeof(El3CaptureBlockHeader) <= m_size)
+    {
+        El3CaptureBlockHeader bh;
+
+        memcpy(&bh, m_map + offset, sizeof(bh));
+
+        if (bh.magic != EL3_CAPTURE_BLOCK_MAGIC || offset + sizeof(bh) + bh.bytes > m_size)
+            break;
+
+        El3CaptureBlockEntry entry = { offset, bh.minNs, bh.maxNs, bh.records, bh.bytes };
+        uint32_t block = m_blocks.size();
+        vector<uint32_t> uavs;
+
+        m_blocks.push_back(entry);
+
+        El3CaptureCursor cursor;
+        El3CaptureRecord rec;
+
+        begin(block, cursor);
+        while (next(cursor, rec))
+        {
+            uint32_t uav = el3CaptureUav(rec.data, rec.length);
+
+            if (uav != EL3_CAPTURE_NO_UAV && find(uavs.begin(), uavs.end(), uav) == uavs.end())
+            {
+                El3CaptureUavEntry posting = { uav, block };
+
+                uavs.push_back(uav);
+                m_postings.push_back(posting);
+            }
+        }
+
+        offset += sizeof(bh) + bh.bytes;
+    }
+
+    stable_sort(m_postings.begin(), m_postings.end(), postingLess);
+    m_dataEnd = offset;
+}
+
+void El3CaptureReader::partial(vector<unsigned char> &out) const
+{
+    if (m_recovered)
+        out.assign(m_map + m_dataEnd, m_map + m_size);
+    else
+        out.clear();
+}
+
+uint64_t El3CaptureReader::records() const
+{
+    uint64_t n = 0;
+
+    for (size_t i = 0; i < m_blocks.size(); i++)
+        n += m_blocks[i].records;
+
+    return n;
+}
+
+static bool blockEndsBefore(const El3CaptureBlockEntry &entry, int64_t ns)
+{
+    return entry.maxNs < ns;
+}
+
+void El3CaptureReader::blocksInRange(int64_t fromNs, int64_t toNs, vector<uint32_t> &out) const
+{
+    size_t first = 0;
+
+    /* receive times only go backwards across blocks when captures were appended out of order */
+    if (m_sortedByTime)
+    {
+        first = lower_bound(m_blocks.begin(), m_blocks.end(), fromNs, blockEndsBefore) - m_blocks.begin();
+    }
+
+    for (size_t i = first; i < m_blocks.size(); i++)
+    {
+        if (m_blocks[i].minNs > toNs)
+        {
+            if (m_sortedByTime)
+                break;
+            continue;
+        }
+
+        if (m_blocks[i].maxNs >= fromNs)
+            out.push_back(i);
+    }
+}
+
+static bool postingBefore(const El3CaptureUavEntry &entry, uint32_t uavNo)
+{
+    return entry.uavNo < uavNo;
+}
+
+void El3CaptureReader::blocksForUav(uint32_t uavNo, vector<uint32_t> &out) const
+{
+    vector<El3CaptureUavEntry>::const_iterator it =
+        lower_bound(m_postings.begin(), m_postings.end(), uavNo, postingBefore);
+
+    for (; it != m_postings.end() && it->uavNo == uavNo; ++it)
+        out.push_back(it->block);
+}
+
+void El3CaptureReader::begin(uint32_t block, El3CaptureCursor &cursor) const
+{
+    cursor.block = block;
+    cursor.remaining = m_blocks[block].records;
+    cursor.offset = m_blocks[block].offset + sizeof(El3CaptureBlockHeader);
+}
+
+bool El3CaptureReader::next(El3CaptureCursor &cursor, El3CaptureRecord &rec) const
+{
+    El3CaptureRecordHeader rh;
+    const El3CaptureBlockEntry &entry = m_blocks[cursor.block];
+    uint64_t end = entry.offset + sizeof(El3CaptureBlockHeader) + entry.bytes;
+
+    if (!cursor.remaining || cursor.offset + sizeof(rh) > end)
+        return false;
+
+    memcpy(&rh, m_map + cursor.offset, sizeof(rh));
+
+    if (cursor.offset + recordSpan(rh.length) > end)
+        return false;
+
+    rec.recvNs = rh.recvNs;
+    rec.sensorId = rh.sensorId;
+    rec.length = rh.length;
+    rec.data = m_map + cursor.offset + sizeof(rh);
+
+    cursor.offset += recordSpan(rh.length);
+    cursor.remaining--;
+
+    return true;
+}
+
+//------------------------------------------------------------------------------
+
+El3CaptureBlockStream::El3CaptureBlockStream(const El3CaptureReader &reader, const string &path,
+    const vector<uint32_t> &blocks, const El3CaptureIoConfig &io):
+    m_reader(reader), m_blocks(blocks), m_io(normalizedIo(io)), m_direct(false), m_fd(-1),
+    m_slotSize(0), m_slotMemory(NULL), m_nextRun(0), m_run(0), m_block(0), m_data(NULL),
+    m_remaining(0), m_offset(0), m_end(0)
+{
+    bool uring = useUring(m_io);
+
+    if (uring && m_io.direct)
+    {
+        m_fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC | O_DIRECT);
+        m_direct = m_fd >= 0;
+    }
+
+    if (m_fd < 0)
+        m_fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+    if (m_fd < 0)
+        throw captureError("cannot open capture", path);
+
+    uint64_t align = m_direct ? EL3_CAPTURE_DIRECT_ALIGN : 1;
+    uint64_t largest = 0;
+
+    for (auto b : m_blocks)
+    {
+        if (b >= m_reader.blocks())
+        {
+            ::close(m_fd);
+            throw out_of_range("no such capture block");
+        }
+
+        largest = max<uint64_t>(largest, sizeof(El3CaptureBlockHeader) + m_reader.block(b).bytes);
+    }
+
+    /* a slot holds a run of blocks, or one block larger than the buffer size, plus alignment */
+    m_slotSize = alignUp(max<uint64_t>(m_io.bufferSize, largest) + 2 * align, EL3_CAPTURE_DIRECT_ALIGN);
+
+    for (size_t i = 0; i < m_blocks.size(); i++)
+    {
+        const El3CaptureBlockEntry &entry = m_reader.block(m_blocks[i]);
+        uint64_t end = alignUp(entry.offset + sizeof(El3CaptureBlockHeader) + entry.bytes, align);
+
+        if (!m_runs.empty())
+        {
+            Run &run = m_runs.back();
+            const El3CaptureBlockEntry &prev = m_reader.block(m_blocks[i - 1]);
+
+            if (entry.offset == prev.offset + sizeof(El3CaptureBlockHeader) + prev.bytes &&
+                end - run.fileOffset <= m_slotSize)
+            {
+                run.last = i + 1;
+                run.length = end - run.fileOffset;
+                continue;
+            }
+        }
+
+        uint64_t start = alignDown(entry.offset, align);
+        Run run = { i, i + 1, start, (uint32_t) (end - start), 0, false };
+
+        m_runs.push_back(run);
+    }
+
+    unsigned slots = uring ? m_io.depth : 1;
+    void *memory;
+
+    if (posix_memalign(&memory, EL3_CAPTURE_DIRECT_ALIGN, slots * m_slotSize))
+    {
+        ::close(m_fd);
+        throw bad_alloc();
+    }
+
+    m_slotMemory = (unsigned char *) memory;
+
+    for (unsigned i = slots; i > 0; i--)
+        m_freeSlots.push_back(i - 1);
+
+    if (uring)
+    {
+        try {
+            m_uring.reset(new El3Uring(slots));
+        } catch (...) {
+            ::close(m_fd);
+            free(m_slotMemory);
+            throw;
+        }
+
+        vector<struct iovec> iov(slots);
+
+        for (unsigned i = 0; i < slots; i++)
+        {
+            iov[i].iov_base = m_slotMemory + i * m_slotSize;
+            iov[i].iov_len = m_slotSize;
+        }
+
+        m_uring->registerBuffers(&iov[0], slots);
+        issue();
+    }
+}
+
+El3CaptureBlockStream::~El3CaptureBlockStream()
+{
+    uint64_t n;
+    int32_t res;
+
+    /* reads still landing in the slots are waited for */
+    try {
+        while (m_uring && m_uring->complete(n, res, true))
+            ;
+    } catch (const exception &) {
+    }
+
+    m_uring.reset();
+    free(m_slotMemory);
+    ::close(m_fd);
+}
+
+/* read ahead, as far as there are free slots */
+void El3CaptureBlockStream::issue()
+{
+    if (!m_uring)
+        return;
+
+    while (m_nextRun < m_runs.size() && !m_freeSlots.empty())
+    {
+        Run &run = m_runs[m_nextRun];
+
+        run.slot = m_freeSlots.back();
+        m_freeSlots.pop_back();
+
+        m_uring->read(m_fd, m_slotMemory + run.slot * m_slotSize, run.length, run.fileOffset, run.slot,
+            m_nextRun);
+        m_nextRun++;
+    }
+
+    m_uring->submit();
+}
+
+void El3CaptureBlockStream::wait(Run &run)
+{
+    while (!run.done)
+    {
+        uint64_t n = &run - &m_runs[0];
+        int32_t res;
+
+        if (m_uring)
+        {
+            if (!m_uring->complete(n, res, true))
+                throw runtime_error("capture read lost");
+        }
+        else
+        {
+            /* one slot, read on demand */
+            res = pread(m_fd, m_slotMemory, run.length, run.fileOffset);
+
+            if (res < 0 && errno == EINTR)
+                continue;
+            if (res < 0)
+                res = -errno;
+        }
+
+        Run &done = m_runs[n];
+        const El3CaptureBlockEntry &last = m_reader.block(m_blocks[done.last - 1]);
+        uint64_t needed = last.offset + sizeof(El3CaptureBlockHeader) + last.bytes - done.fileOffset;
+
+        if (res < 0)
+            throw runtime_error(string("capture read failed: ") + strerror(-res));
+
+        /* aligned reads may run past the end of the file, not into missing data */
+        if ((uint64_t) res < needed)
+            throw runtime_error("capture read failed: archive truncated");
+
+        done.done = true;
+    }
+}
+
+bool El3CaptureBlockStream::nextBlock()
+{
+    while (m_run < m_runs.size())
+    {
+        Run &run = m_runs[m_run];
+
+        if (m_block < run.last)
+        {
+            wait(run);
+
+            const El3CaptureBlockEntry &entry = m_reader.block(m_blocks[m_block]);
+            const unsigned char *base = m_slotMemory + run.slot * m_slotSize + (entry.offset - run.fileOffset);
+            El3CaptureBlockHeader bh;
+
+            memcpy(&bh, base, sizeof(bh));
+
+            if (bh.magic != EL3_CAPTURE_BLOCK_MAGIC || bh.bytes != entry.bytes)
+                throw runtime_error("capture block damaged");
+
+            m_data = base;
+            m_offset = sizeof(bh);
+            m_end = sizeof(bh) + entry.bytes;
+            m_remaining = entry.records;
+            m_block++;
+            return true;
+        }
+
+        /* the caller is done with this run, its slot reads further ahead */
+        m_freeSlots.push_back(run.slot);
+        m_run++;
+        issue();
+    }
+
+    m_data = NULL;
+    return false;
+}
+
+bool El3CaptureBlockStream::next(El3CaptureRecord &rec)
+{
+    El3CaptureRecordHeader rh;
+
+    for (;;)
+    {
+        if (m_data && m_remaining && m_offset + sizeof(rh) <= m_end)
+        {
+            memcpy(&rh, m_data + m_offset, sizeof(rh));
+
+            if (m_offset + recordSpan(rh.length) <= m_end)
+            {
+                rec.recvNs = rh.recvNs;
+                rec.sensorId = rh.sensorId;
+                rec.length = rh.length;
+                rec.data = m_data + m_offset + sizeof(rh);
+
+                m_offset += recordSpan(rh.length);
+                m_remaining--;
+                return true;
+            }
+        }
+
+        if (!nextBlock())
+            return false;
+    }
+}
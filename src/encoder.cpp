@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2022 Subreption LLC. All rights reserved.
+ * Author: 12dc8242df1be0d6f4b73d68166552197936a27074c004c8af95b27194ec584d
+ *
+ * Dual-licensed under the Subreption Ukraine Defense License (SUDL, version 1) and the  Server Side
+ * Public License (SSPL, version 3). Both licenses are provided with this software distribution.
+ */
+
+#include <el3dec/encoder.hpp>
+#include <cmath>
+#include <cstring>
+
+/* round to the field's unit and clamp to what its bits can hold */
+static inline int quantize(double value, double scale, int lo, int hi)
+{
+    long v = lround(value * scale);
+
+    if (v < lo)
+        return lo;
+    if (v > hi)
+        return hi;
+
+    return (int) v;
+}
+
+static inline void put_be_u16(unsigned char *buf, size_t offset, unsigned int value)
+{
+    buf[offset] = (value >> 8) & 0xff;
+    buf[offset + 1] = value & 0xff;
+}
+
+/* 27-bit signed coordinate: low 24 bits big-endian at off, top 3 bits into the shared MSB byte */
+static inline void put_packed_coordinate(unsigned char *buf, size_t off, size_t msboff, int bitshift,
+    double coord)
+{
+    int v = quantize(coord, 6e5, -(1 << 26), (1 << 26) - 1);
+
+    buf[off] = (v >> 16) & 0xff;
+    buf[off + 1] = (v >> 8) & 0xff;
+    buf[off + 2] = v & 0xff;
+    buf[msboff] |= ((v >> 24) & 0x7) << bitshift;
+}
+
+size_t el3EncodeTelemetry(const El3TelemetryRecord &rec, unsigned char *out, size_t outlen)
+{
+    typedef El3EleronTelemetryV1 L;
+    int tmpint;
+
+    if (outlen < EL3_TELEMETRY_FRAME_LEN)
+        return 0;
+
+    memset(out, 0, EL3_TELEMETRY_FRAME_LEN);
+
+    /* header: the length byte counts what follows the type byte */
+    out[EL3_HEADER_MAGIC] = ENICS_ELERON_PACKET_MAGICBYTE;
+    out[EL3_HEADER_LENGTH] = EL3_TELEMETRY_FRAME_LEN - 3;
+    out[EL3_HEADER_TYPE] = ((rec.engineType & 0x7) << 5) | (rec.uavType & 0x1f);
+    put_be_u16(out, EL3_HEADER_UAV, rec.uavNo);
+    out[EL3_HEADER_PACKET_TYPE] = L::packetType;
+
+    /* timestamp, UTC */
+    out[L::stamp] = rec.stampHours & 0x1f;
+    out[L::stamp + 1] = rec.stampMinutes & 0x3f;
+    out[L::stamp + 2] = rec.stampSeconds & 0x3f;
+    put_be_u16(out, L::flightTime, rec.flightTime);
+
+    /* coordinates share one byte for their MSBs */
+    put_packed_coordinate(out, L::latitude, L::coordinateMsb, L::latitudeShift, rec.gpsData.latitude);
+    put_packed_coordinate(out, L::longitude, L::coordinateMsb, L::longitudeShift, rec.gpsData.longitude);
+
+    /* speed and careen are 12-bit, their high nibbles share the middle byte */
+    tmpint = quantize(rec.groundSpeed, 4, 0, 0xfff);
+    out[L::speedCareen] = tmpint & 0xff;
+    out[L::speedCareen + 1] = (tmpint >> 4) & 0xf0;
+
+    tmpint = quantize(rec.careen, 4, 0, 0xfff);
+    out[L::speedCareen + 1] |= (tmpint >> 8) & 0x0f;
+    out[L::speedCareen + 2] = tmpint & 0xff;
+
+    /* 12-bit signed pitch, high nibble on top of the second byte */
+    tmpint = quantize(rec.pitch, 10, -0x800, 0x7ff);
+    out[L::pitch] = tmpint & 0xff;
+    out[L::pitch + 1] = ((tmpint >> 8) & 0x0f) << 4;
+
+    put_be_u16(out, L::altitude, rec.gpsData.altitude);
+
+    /* remaining flight time is the one little-endian field */
+    out[L::remainingMinutes] = rec.remainingMinutes & 0xff;
+    out[L::remainingMinutes + 1] = (rec.remainingMinutes >> 8) & 0xff;
+
+    /* 11-bit camera angle, top 3 bits on top of the second byte */
+    tmpint = quantize(rec.camera.angle, 20, 0, 0x7ff);
+    out[L::cameraAngle] = tmpint & 0xff;
+    out[L::cameraAngle + 1] = ((tmpint >> 8) & 0x7) << 5;
+
+    out[L::videoChannel] = rec.videoTxChannel & 0x0f;
+
+    /* 12-bit signed azimuth and camera position, their high nibbles share the middle byte */
+    tmpint = quantize(rec.camera.azimuth, 10, -0x800, 0x7ff);
+    out[L::azimuthPosition] = tmpint & 0xff;
+    out[L::azimuthPosition + 1] = ((tmpint >> 8) & 0x0f) << 4;
+
+    tmpint = quantize(rec.camera.position, 10, -0x800, 0x7ff);
+    out[L::azimuthPosition + 1] |= (tmpint >> 8) & 0x0f;
+    out[L::azimuthPosition + 2] = tmpint & 0xff;
+
+    return EL3_TELEMETRY_FRAME_LEN;
+}
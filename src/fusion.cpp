@@ -0,0 +1,291 @@
+/*
+ * Copyright (c) 2022 Subreption LLC. All rights reserved.
+ * Author: 12dc8242df1be0d6f4b73d68166552197936a27074c004c8af95b27194ec584d
+ *
+ * Dual-licensed under the Subreption Ukraine Defense License (SUDL, version 1) and the  Server Side
+ * Public License (SSPL, version 3). Both licenses are provided with this software distribution.
+ */
+
+#include <el3dec/fusion.hpp>
+#include <el3dec/utils.hpp>
+#include <algorithm>
+#include <cstdlib>
+
+using namespace std;
+
+/*
+ * Field groups voted on independently. Fields unpacked from the same bytes are voted together,
+ * since a bit error there corrupts them as a unit.
+ */
+static bool eqHeader(const El3TelemetryRecord &a, const El3TelemetryRecord &b)
+{
+    return a.packetType == b.packetType && a.engineType == b.engineType && a.uavType == b.uavType;
+}
+
+static bool eqPosition(const El3TelemetryRecord &a, const El3TelemetryRecord &b)
+{
+    return a.gpsData.latitude == b.gpsData.latitude && a.gpsData.longitude == b.gpsData.longitude;
+}
+
+static bool eqAltitude(const El3TelemetryRecord &a, const El3TelemetryRecord &b)
+{
+    return a.gpsData.altitude == b.gpsData.altitude;
+}
+
+static bool eqMotion(const El3TelemetryRecord &a, const El3TelemetryRecord &b)
+{
+    return a.groundSpeed == b.groundSpeed && a.careen == b.careen && a.pitch == b.pitch;
+}
+
+static bool eqRemaining(const El3TelemetryRecord &a, const El3TelemetryRecord &b)
+{
+    return a.remainingMinutes == b.remainingMinutes;
+}
+
+static bool eqVideo(const El3TelemetryRecord &a, const El3TelemetryRecord &b)
+{
+    return a.videoTxChannel == b.videoTxChannel && a.videoTxFreq == b.videoTxFreq;
+}
+
+static bool eqCamera(const El3TelemetryRecord &a, const El3TelemetryRecord &b)
+{
+    return a.camera.angle == b.camera.angle && a.camera.azimuth == b.camera.azimuth &&
+        a.camera.position == b.camera.position;
+}
+
+/* index of the value most reports agree on; ties go to the earliest report */
+template <typename Eq>
+static size_t majority(const El3TelemetryRecord **recs, size_t n, Eq eq)
+{
+    size_t best = 0;
+    size_t bestVotes = 0;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        size_t votes = 0;
+
+        for (size_t j = 0; j < n; j++)
+        {
+            if (eq(*recs[i], *recs[j]))
+                votes++;
+        }
+
+        if (votes > bestVotes)
+        {
+            best = i;
+            bestVotes = votes;
+        }
+    }
+
+    return best;
+}
+
+El3Fusion::El3Fusion(const El3FusionConfig &config):
+    m_config(config)
+{
+}
+
+uint64_t El3Fusion::packetKey(const El3TelemetryRecord &rec)
+{
+    return ((uint64_t) rec.uavNo << 48) | ((uint64_t) rec.stampHours << 40) |
+        ((uint64_t) rec.stampMinutes << 32) | ((uint64_t) rec.stampSeconds << 24) | rec.flightTime;
+}
+
+bool El3Fusion::plausible(const Track &track, const El3TelemetryRecord &rec) const
+{
+    /* flight time ticks in seconds; packets within the same second still get one second of slack */
+    int elapsed = abs((int16_t) (rec.flightTime - track.last.flightTime));
+    double reach = m_config.maxSpeed * max(elapsed, 1) + m_config.positionSlack;
+
+    return ground_distance_m(track.last.gpsData.latitude, track.last.gpsData.longitude,
+        rec.gpsData.latitude, rec.gpsData.longitude) <= reach;
+}
+
+void El3Fusion::ingest(uint32_t sensorId, const El3TelemetryRecord &rec, uint64_t nowMs)
+{
+    El3SensorStats &stats = m_sensors[sensorId];
+    uint64_t key = packetKey(rec);
+
+    stats.received++;
+
+    unordered_map<uint16_t, Track>::const_iterator t = m_tracks.find(rec.uavNo);
+    if (t != m_tracks.end())
+    {
+        for (size_t i = 0; i < EL3_FUSION_RECENT_KEYS; i++)
+        {
+            if (t->second.recent[i] == key + 1)
+            {
+                stats.late++;
+                return;
+            }
+        }
+    }
+
+    Group &group = m_groups[key];
+
+    if (!group.count)
+    {
+        group.firstSeenMs = nowMs;
+        stats.first++;
+    }
+
+    for (size_t i = 0; i < group.count; i++)
+    {
+        if (group.reports[i].sensorId == sensorId)
+        {
+            stats.duplicates++;
+            return;
+        }
+    }
+
+    if (group.count == EL3_FUSION_MAX_REPORTS)
+    {
+        stats.overflow++;
+        return;
+    }
+
+    Report &report = group.reports[group.count++];
+
+    report.sensorId = sensorId;
+    report.recvMs = nowMs;
+    report.rec = rec;
+}
+
+void El3Fusion::emit(uint64_t key, Group &group, vector<El3FusedRecord> &out)
+{
+    const El3TelemetryRecord *all[EL3_FUSION_MAX_REPORTS] = {};
+    const El3TelemetryRecord *fixes[EL3_FUSION_MAX_REPORTS] = {};
+    bool ok[EL3_FUSION_MAX_REPORTS] = {};
+    size_t nfixes = 0;
+    size_t n = group.count;
+
+    /* value-initialized on first sight, ie. an invalid track */
+    Track &track = m_tracks[group.reports[0].rec.uavNo];
+
+    for (size_t i = 0; i < n; i++)
+    {
+        all[i] = &group.reports[i].rec;
+        ok[i] = !track.valid || plausible(track, *all[i]);
+
+        if (ok[i])
+            fixes[nfixes++] = all[i];
+    }
+
+    /* nothing fits the track: either every sensor got it wrong or the UAV really moved, vote anyway */
+    bool reject = (nfixes == 0);
+    if (reject)
+    {
+        copy(all, all + n, fixes);
+        nfixes = n;
+    }
+
+    El3FusedRecord fused;
+    El3TelemetryRecord &rec = fused.record;
+
+    rec = *all[majority(all, n, eqHeader)];
+
+    const El3TelemetryRecord *pick = fixes[majority(fixes, nfixes, eqPosition)];
+    rec.gpsData.latitude = pick->gpsData.latitude;
+    rec.gpsData.longitude = pick->gpsData.longitude;
+
+    rec.gpsData.altitude = all[majority(all, n, eqAltitude)]->gpsData.altitude;
+
+    pick = all[majority(all, n, eqMotion)];
+    rec.groundSpeed = pick->groundSpeed;
+    rec.careen = pick->careen;
+    rec.pitch = pick->pitch;
+
+    rec.remainingMinutes = all[majority(all, n, eqRemaining)]->remainingMinutes;
+
+    pick = all[majority(all, n, eqVideo)];
+    rec.videoTxChannel = pick->videoTxChannel;
+    rec.videoTxFreq = pick->videoTxFreq;
+
+    rec.camera = all[majority(all, n, eqCamera)]->camera;
+
+    fused.firstSeenMs = group.firstSeenMs;
+    fused.firstSensor = group.reports[0].sensorId;
+    fused.reports = n;
+    fused.agreeing = 0;
+    fused.implausible = 0;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        El3SensorStats &stats = m_sensors[group.reports[i].sensorId];
+        const El3TelemetryRecord &r = *all[i];
+
+        if (!ok[i])
+        {
+            stats.implausible++;
+            fused.implausible++;
+        }
+
+        if (eqHeader(r, rec) && eqPosition(r, rec) && eqAltitude(r, rec) && eqMotion(r, rec) &&
+            eqRemaining(r, rec) && eqVideo(r, rec) && eqCamera(r, rec))
+        {
+            stats.agreed++;
+            fused.agreeing++;
+        }
+        else
+        {
+            stats.outvoted++;
+        }
+    }
+
+    /* a track that keeps rejecting every fix is stale (new flight, long gap): start over */
+    if (!reject || ++track.rejected >= EL3_FUSION_REANCHOR)
+    {
+        track.valid = true;
+        track.last = rec;
+        track.rejected = 0;
+    }
+
+    track.recent[track.recentPos] = key + 1;
+    track.recentPos = (track.recentPos + 1) % EL3_FUSION_RECENT_KEYS;
+
+    out.push_back(fused);
+}
+
+static bool olderGroup(const pair<uint64_t, uint64_t> &a, const pair<uint64_t, uint64_t> &b)
+{
+    return a.second < b.second;
+}
+
+size_t El3Fusion::poll(uint64_t nowMs, vector<El3FusedRecord> &out)
+{
+    vector<pair<uint64_t, uint64_t> > expired;
+
+    for (unordered_map<uint64_t, Group>::const_iterator it = m_groups.begin(); it != m_groups.end(); ++it)
+    {
+        if (it->second.firstSeenMs + m_config.windowMs <= nowMs)
+            expired.push_back(make_pair(it->first, it->second.firstSeenMs));
+    }
+
+    sort(expired.begin(), expired.end(), olderGroup);
+
+    for (size_t i = 0; i < expired.size(); i++)
+    {
+        unordered_map<uint64_t, Group>::iterator it = m_groups.find(expired[i].first);
+
+        emit(it->first, it->second, out);
+        m_groups.erase(it);
+    }
+
+    return expired.size();
+}
+
+size_t El3Fusion::flush(vector<El3FusedRecord> &out)
+{
+    return poll(UINT64_MAX - m_config.windowMs, out);
+}
+
+bool El3Fusion::lastFix(uint16_t uavNo, El3TelemetryRecord *out) const
+{
+    unordered_map<uint16_t, Track>::const_iterator t = m_tracks.find(uavNo);
+
+    if (t == m_tracks.end() || !t->second.valid)
+        return false;
+
+    *out = t->second.last;
+    return true;
+}
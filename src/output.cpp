@@ -0,0 +1,1114 @@
+/*
+ * Copyright (c) 2022 Subreption LLC. All rights reserved.
+ * Author: 12dc8242df1be0d6f4b73d68166552197936a27074c004c8af95b27194ec584d
+ *
+ * Dual-licensed under the Subreption Ukraine Defense License (SUDL, version 1) and the  Server Side
+ * Public License (SSPL, version 3). Both licenses are provided with this software distribution.
+ */
+
+#include <el3dec/output.hpp>
+#include <el3dec/relay.hpp>
+#include "rapidjson/stringbuffer.h"
+#include "rapidjson/writer.h"
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+
+using namespace std;
+
+/* connecting, and any single read or write on a connection */
+#define OUTPUT_IO_TIMEOUT_MS    5000
+
+/* pause between retries of a failed batch, doubling up to the maximum */
+#define OUTPUT_RETRY_MIN_MS     10
+#define OUTPUT_RETRY_MAX_MS     2000
+
+static int64_t steadyMs()
+{
+    return chrono::duration_cast<chrono::milliseconds>(
+        chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static runtime_error systemError(const string &what)
+{
+    return runtime_error(what + ": " + strerror(errno));
+}
+
+static int connectTcp(const string &host, const string &port)
+{
+    struct addrinfo hints = {}, *res;
+
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    int err = getaddrinfo(host.c_str(), port.c_str(), &hints, &res);
+    if (err)
+        throw runtime_error(host + ": " + gai_strerror(err));
+
+    int fd = -1;
+    errno = ECONNREFUSED;
+
+    for (struct addrinfo *ai = res; ai && fd < 0; ai = ai->ai_next)
+    {
+        fd = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, ai->ai_protocol);
+        if (fd < 0)
+            continue;
+
+        int err = connect(fd, ai->ai_addr, ai->ai_addrlen) == 0 ? 0 : errno;
+
+        if (err == EINPROGRESS)
+        {
+            struct pollfd pfd = { fd, POLLOUT, 0 };
+            socklen_t len = sizeof(err);
+
+            err = ETIMEDOUT;
+            if (poll(&pfd, 1, OUTPUT_IO_TIMEOUT_MS) == 1)
+                getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len);
+        }
+
+        if (err)
+        {
+            ::close(fd);
+            fd = -1;
+            errno = err;
+        }
+    }
+
+    freeaddrinfo(res);
+
+    if (fd < 0)
+        throw systemError(host + ":" + port);
+
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+/* all of it, or an exception; fd is non-blocking */
+static void sendAll(int fd, const char *data, size_t len)
+{
+    while (len)
+    {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            if (errno != EAGAIN)
+                throw systemError("send");
+
+            struct pollfd pfd = { fd, POLLOUT, 0 };
+            if (poll(&pfd, 1, OUTPUT_IO_TIMEOUT_MS) == 0)
+                throw runtime_error("send: timed out");
+            continue;
+        }
+
+        data += n;
+        len -= n;
+    }
+}
+
+//------------------------------------------------------------------------------
+
+El3OutputSink::El3OutputSink(const string &name, const El3OutputConfig &config):
+    m_name(name), m_config(config), m_counters(), m_stopping(false), m_deadlineMs(0)
+{
+    m_config.queue = max<size_t>(m_config.queue, 1);
+    m_config.batch = max<size_t>(min(m_config.batch, m_config.queue), 1);
+}
+
+El3OutputSink::~El3OutputSink()
+{
+    /* derived classes stop in their destructor, the writer must not outlive them */
+    stop(0);
+}
+
+void El3OutputSink::start()
+{
+    m_thread = thread(&El3OutputSink::run, this);
+}
+
+void El3OutputSink::stop(uint32_t timeoutMs)
+{
+    {
+        lock_guard<mutex> guard(m_mutex);
+
+        if (m_stopping)
+            return;
+
+        m_stopping = true;
+        m_deadlineMs = steadyMs() + timeoutMs;
+    }
+
+    m_ready.notify_all();
+    m_room.notify_all();
+
+    if (m_thread.joinable())
+        m_thread.join();
+}
+
+bool El3OutputSink::push(const El3TelemetryRecord &rec, int64_t recvNs)
+{
+    unique_lock<mutex> lock(m_mutex);
+
+    if (m_queue.size() >= m_config.queue)
+    {
+        switch (m_config.policy)
+        {
+            case OUTPUT_BLOCK:
+                m_room.wait(lock, [this] { return m_queue.size() < m_config.queue || m_stopping; });
+                break;
+            case OUTPUT_DROP_NEWEST:
+                m_counters.dropped++;
+                return false;
+            case OUTPUT_DROP_OLDEST:
+                m_queue.pop_front();
+                m_counters.dropped++;
+                break;
+        }
+    }
+
+    if (m_stopping)
+    {
+        m_counters.dropped++;
+        return false;
+    }
+
+    m_queue.push_back({ recvNs, rec });
+    m_counters.queued++;
+
+    /* the writer sleeps until a batch is full or flushMs passed */
+    if (m_queue.size() == m_config.batch)
+        m_ready.notify_one();
+
+    return true;
+}
+
+El3OutputCounters El3OutputSink::counters()
+{
+    lock_guard<mutex> guard(m_mutex);
+    return m_counters;
+}
+
+string El3OutputSink::lastError()
+{
+    lock_guard<mutex> guard(m_mutex);
+    return m_lastError;
+}
+
+void El3OutputSink::format(const vector<El3OutputItem> &batch, string &out) const
+{
+    if (m_config.format == OUTPUT_ARROW)
+    {
+        El3ArrowWriter arrow(ARROW_STREAM);
+
+        arrow.begin(out);
+        for (auto &item : batch)
+            arrow.add(item.record, item.recvNs);
+        arrow.end(out);
+        return;
+    }
+
+    if (m_config.format == OUTPUT_BINARY)
+    {
+        for (auto &item : batch)
+            out.append((const char *) &item.record, sizeof(item.record));
+        return;
+    }
+
+    if (m_config.format == OUTPUT_RELAY)
+    {
+        El3RelayRecord packed;
+
+        for (auto &item : batch)
+        {
+            el3RelayPack(item.record, item.recvNs, packed);
+            out.append((const char *) &packed, sizeof(packed));
+        }
+        return;
+    }
+
+    rapidjson::StringBuffer strbuf;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(strbuf);
+
+    for (auto &item : batch)
+    {
+        writer.Reset(strbuf);
+        writer.StartObject();
+        writer.Key("recv_ns");      writer.Int64(item.recvNs);
+        writer.Key("telemetry");    el3WriteJson(item.record, writer);
+        writer.EndObject();
+        strbuf.Put('\n');
+    }
+
+    out.append(strbuf.GetString(), strbuf.GetSize());
+}
+
+void El3OutputSink::run()
+{
+    vector<El3OutputItem> batch;
+    uint32_t retryMs = 0;
+    bool dirty = false;
+
+    batch.reserve(m_config.batch);
+
+    for (;;)
+    {
+        if (batch.empty())
+        {
+            unique_lock<mutex> lock(m_mutex);
+
+            if (m_queue.empty())
+            {
+                if (m_stopping)
+                    break;
+
+                if (dirty)
+                {
+                    lock.unlock();
+                    try {
+                        flush();
+                    } catch (const exception &e) {
+                        lock_guard<mutex> guard(m_mutex);
+                        m_lastError = e.what();
+                    }
+                    dirty = false;
+                    continue;
+                }
+            }
+
+            m_ready.wait_for(lock, chrono::milliseconds(m_config.flushMs),
+                [this] { return m_queue.size() >= m_config.batch || m_stopping; });
+
+            size_t count = min(m_queue.size(), m_config.batch);
+
+            batch.assign(m_queue.begin(), m_queue.begin() + count);
+            m_queue.erase(m_queue.begin(), m_queue.begin() + count);
+
+            if (count)
+                m_room.notify_all();
+            else
+                continue;
+        }
+
+        try {
+            write(batch);
+
+            lock_guard<mutex> guard(m_mutex);
+            m_counters.written += batch.size();
+            m_lastError.clear();
+            batch.clear();
+            retryMs = 0;
+            dirty = true;
+        } catch (const exception &e) {
+            unique_lock<mutex> lock(m_mutex);
+
+            m_counters.failures++;
+            m_lastError = e.what();
+
+            /* stopping, and out of time: what is left is lost */
+            if (m_stopping && steadyMs() >= m_deadlineMs)
+            {
+                m_counters.dropped += batch.size() + m_queue.size();
+                m_queue.clear();
+                batch.clear();
+                break;
+            }
+
+            retryMs = min<uint32_t>(max<uint32_t>(retryMs * 2, OUTPUT_RETRY_MIN_MS), OUTPUT_RETRY_MAX_MS);
+            if (m_stopping)
+                retryMs = min<int64_t>(retryMs, max<int64_t>(m_deadlineMs - steadyMs(), 0));
+
+            m_ready.wait_for(lock, chrono::milliseconds(retryMs));
+        }
+    }
+
+    close();
+}
+
+//------------------------------------------------------------------------------
+
+El3FileOutput::El3FileOutput(const string &path, const El3OutputConfig &config,
+    uint64_t rotateBytes, uint32_t rotateSeconds):
+    El3OutputSink("file:" + path, config), m_path(path), m_rotateBytes(rotateBytes),
+    m_rotateSeconds(rotateSeconds), m_fd(-1), m_index(0), m_size(0), m_openedMs(0)
+{
+}
+
+El3FileOutput::~El3FileOutput()
+{
+    stop();
+}
+
+string El3FileOutput::currentPath()
+{
+    lock_guard<mutex> guard(m_currentMutex);
+    return m_current;
+}
+
+void El3FileOutput::open()
+{
+    size_t placeholder = m_path.find("%N");
+    string path = m_path;
+    bool rotate = m_fd >= 0;
+
+    closeFile();
+
+    /* an Arrow file ends in a footer, there is no appending to it */
+    if (config().format == OUTPUT_ARROW && access(m_path.c_str(), F_OK) == 0)
+        rotate = true;
+
+    if (rotate)
+    {
+        /* without a %N the file keeps its name, and what it held moves aside */
+        if (placeholder == string::npos)
+        {
+            string rotated;
+
+            do {
+                rotated = m_path + "." + to_string(m_index++);
+            } while (access(rotated.c_str(), F_OK) == 0);
+
+            if (rename(m_path.c_str(), rotated.c_str()) < 0)
+                throw systemError(m_path);
+        }
+    }
+
+    if (placeholder != string::npos)
+    {
+        do {
+            path = m_path;
+            path.replace(placeholder, 2, to_string(m_index++));
+        } while (access(path.c_str(), F_OK) == 0);
+    }
+
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    struct stat st;
+
+    if (fd < 0)
+        throw systemError(path);
+
+    m_fd = fd;
+    m_size = fstat(fd, &st) == 0 ? st.st_size : 0;
+    m_openedMs = steadyMs();
+
+    {
+        lock_guard<mutex> guard(m_currentMutex);
+        m_current = path;
+    }
+
+    if (config().format == OUTPUT_ARROW)
+    {
+        m_arrow.reset(new El3ArrowWriter(ARROW_FILE));
+        m_buf.clear();
+        m_arrow->begin(m_buf);
+        writeOut(m_buf);
+    }
+}
+
+void El3FileOutput::closeFile()
+{
+    if (m_fd < 0)
+        return;
+
+    if (m_arrow)
+    {
+        string footer;
+
+        m_arrow->end(footer);
+        m_arrow.reset();
+
+        /* without its footer the file is lost to readers, but so it would be anyway */
+        try {
+            writeOut(footer);
+        } catch (const exception &) {
+        }
+    }
+
+    if (m_fd >= 0)
+    {
+        fdatasync(m_fd);
+        ::close(m_fd);
+        m_fd = -1;
+    }
+}
+
+void El3FileOutput::writeOut(const string &buf)
+{
+    const char *p = buf.data();
+    size_t left = buf.size();
+
+    while (left)
+    {
+        ssize_t n = ::write(m_fd, p, left);
+
+        if (n < 0 && errno == EINTR)
+            continue;
+
+        if (n < 0)
+        {
+            runtime_error e = systemError(currentPath());
+
+            /* the next attempt appends to a freshly opened file */
+            ::close(m_fd);
+            m_fd = -1;
+            m_arrow.reset();
+            throw e;
+        }
+
+        p += n;
+        left -= n;
+    }
+
+    m_size += buf.size();
+}
+
+void El3FileOutput::write(const vector<El3OutputItem> &batch)
+{
+    bool rotate = m_fd >= 0 &&
+        ((m_rotateBytes && m_size >= m_rotateBytes) ||
+         (m_rotateSeconds && steadyMs() - m_openedMs >= (int64_t) m_rotateSeconds * 1000));
+
+    if (m_fd < 0 || rotate)
+        open();
+
+    m_buf.clear();
+
+    if (m_arrow)
+    {
+        for (auto &item : batch)
+            m_arrow->add(item.record, item.recvNs);
+        m_arrow->batch(m_buf);
+    }
+    else
+        format(batch, m_buf);
+
+    writeOut(m_buf);
+}
+
+void El3FileOutput::flush()
+{
+    if (m_fd >= 0 && fdatasync(m_fd) < 0)
+        throw systemError(currentPath());
+}
+
+void El3FileOutput::close()
+{
+    closeFile();
+}
+
+//------------------------------------------------------------------------------
+
+El3TcpOutput::El3TcpOutput(const string &host, const string &port, const El3OutputConfig &config):
+    El3OutputSink("tcp:" + host + ":" + port, config), m_host(host), m_port(port), m_fd(-1)
+{
+}
+
+El3TcpOutput::~El3TcpOutput()
+{
+    stop();
+}
+
+void El3TcpOutput::write(const vector<El3OutputItem> &batch)
+{
+    m_buf.clear();
+
+    if (m_fd < 0)
+    {
+        m_fd = connectTcp(m_host, m_port);
+
+        if (config().format == OUTPUT_ARROW)
+        {
+            m_arrow.reset(new El3ArrowWriter(ARROW_STREAM));
+            m_arrow->begin(m_buf);
+        }
+    }
+
+    if (m_arrow)
+    {
+        for (auto &item : batch)
+            m_arrow->add(item.record, item.recvNs);
+        m_arrow->batch(m_buf);
+    }
+    else
+        format(batch, m_buf);
+
+    try {
+        sendAll(m_fd, m_buf.data(), m_buf.size());
+    } catch (...) {
+        ::close(m_fd);
+        m_fd = -1;
+        throw;
+    }
+}
+
+void El3TcpOutput::close()
+{
+    if (m_fd >= 0)
+    {
+        if (m_arrow)
+        {
+            m_buf.clear();
+            m_arrow->end(m_buf);
+
+            try {
+                sendAll(m_fd, m_buf.data(), m_buf.size());
+            } catch (const exception &) {
+            }
+        }
+
+        ::close(m_fd);
+        m_fd = -1;
+    }
+}
+
+//------------------------------------------------------------------------------
+
+/* AMQP 0-9-1, as much of it as publishing with confirms takes */
+#define AMQP_FRAME_METHOD       1
+#define AMQP_FRAME_HEADER       2
+#define AMQP_FRAME_BODY         3
+#define AMQP_FRAME_HEARTBEAT    8
+#define AMQP_FRAME_END          0xce
+
+#define AMQP_CONNECTION         10
+#define AMQP_CHANNEL            20
+#define AMQP_BASIC              60
+#define AMQP_CONFIRM            85
+
+/* what we offer in Tune-Ok, the broker may want less */
+#define AMQP_FRAME_MAX          131072
+
+static void putU8(string &out, uint8_t v)
+{
+    out.push_back((char) v);
+}
+
+static void putU16(string &out, uint16_t v)
+{
+    putU8(out, v >> 8);
+    putU8(out, v);
+}
+
+static void putU32(string &out, uint32_t v)
+{
+    putU16(out, v >> 16);
+    putU16(out, v);
+}
+
+static void putU64(string &out, uint64_t v)
+{
+    putU32(out, v >> 32);
+    putU32(out, v);
+}
+
+static void putShortStr(string &out, const string &s)
+{
+    if (s.size() > 255)
+        throw invalid_argument("AMQP short string too long: " + s);
+
+    putU8(out, s.size());
+    out.append(s);
+}
+
+static void putLongStr(string &out, const string &s)
+{
+    putU32(out, s.size());
+    out.append(s);
+}
+
+/* reads the arguments of a method, throwing on a short one */
+struct AmqpArgs {
+  const string &s;
+  size_t pos;
+
+  AmqpArgs(const string &args): s(args), pos(0) {}
+
+  uint64_t get(size_t bytes) {
+    if (s.size() - pos < bytes)
+      throw runtime_error("AMQP method too short");
+
+    uint64_t v = 0;
+    while (bytes--)
+      v = v << 8 | (uint8_t) s[pos++];
+    return v;
+  }
+
+  string shortStr() {
+    size_t len = get(1);
+    if (s.size() - pos < len)
+      throw runtime_error("AMQP method too short");
+    pos += len;
+    return s.substr(pos - len, len);
+  }
+};
+
+/* the reply text of a Connection.Close or Channel.Close */
+static string amqpCloseReason(const string &args)
+{
+    AmqpArgs in(args);
+    unsigned code = in.get(2);
+
+    return "AMQP " + to_string(code) + " " + in.shortStr();
+}
+
+El3AmqpOutput::El3AmqpOutput(const El3AmqpConfig &amqp, const El3OutputConfig &config):
+    El3OutputSink("amqp:" + amqp.host + ":" + amqp.port + "/" + amqp.exchange, config),
+    m_amqp(amqp), m_fd(-1), m_frameMax(AMQP_FRAME_MAX), m_deliveryTag(0), m_inPos(0)
+{
+}
+
+El3AmqpOutput::~El3AmqpOutput()
+{
+    stop();
+}
+
+void El3AmqpOutput::sendFrame(uint8_t type, uint16_t channel, const char *payload, size_t len)
+{
+    putU8(m_out, type);
+    putU16(m_out, channel);
+    putU32(m_out, len);
+    m_out.append(payload, len);
+    putU8(m_out, AMQP_FRAME_END);
+}
+
+void El3AmqpOutput::sendMethod(uint16_t channel, uint16_t classId, uint16_t methodId, const string &args)
+{
+    string payload;
+
+    putU16(payload, classId);
+    putU16(payload, methodId);
+    payload.append(args);
+
+    sendFrame(AMQP_FRAME_METHOD, channel, payload.data(), payload.size());
+}
+
+void El3AmqpOutput::readFrame(uint8_t &type, uint16_t &channel, string &payload)
+{
+    for (;;)
+    {
+        size_t avail = m_in.size() - m_inPos;
+
+        if (avail >= 7)
+        {
+            const unsigned char *p = (const unsigned char *) m_in.data() + m_inPos;
+            uint32_t len = (uint32_t) p[3] << 24 | p[4] << 16 | p[5] << 8 | p[6];
+
+            if (len > AMQP_FRAME_MAX)
+                throw runtime_error("AMQP frame too large");
+
+            if (avail >= 7 + (size_t) len + 1)
+            {
+                if (p[7 + len] != AMQP_FRAME_END)
+                    throw runtime_error("AMQP frame out of sync");
+
+                type = p[0];
+                channel = p[1] << 8 | p[2];
+                payload.assign((const char *) p + 7, len);
+                m_inPos += 7 + len + 1;
+                return;
+            }
+        }
+
+        if (m_inPos)
+        {
+            m_in.erase(0, m_inPos);
+            m_inPos = 0;
+        }
+
+        char buf[4096];
+        ssize_t n = recv(m_fd, buf, sizeof(buf), 0);
+
+        if (n > 0)
+            m_in.append(buf, n);
+        else if (n == 0)
+            throw runtime_error("AMQP broker closed the connection");
+        else if (errno == EAGAIN)
+        {
+            struct pollfd pfd = { m_fd, POLLIN, 0 };
+            if (poll(&pfd, 1, OUTPUT_IO_TIMEOUT_MS) == 0)
+                throw runtime_error("AMQP broker timed out");
+        }
+        else if (errno != EINTR)
+            throw systemError("recv");
+    }
+}
+
+void El3AmqpOutput::expectMethod(uint16_t classId, uint16_t methodId, string &args)
+{
+    uint8_t type;
+    uint16_t channel;
+    string payload;
+
+    for (;;)
+    {
+        readFrame(type, channel, payload);
+
+        if (type == AMQP_FRAME_HEARTBEAT)
+            continue;
+
+        if (type != AMQP_FRAME_METHOD || payload.size() < 4)
+            throw runtime_error("unexpected AMQP frame");
+
+        AmqpArgs in(payload);
+        uint16_t c = in.get(2), m = in.get(2);
+
+        args = payload.substr(4);
+
+        if ((c == AMQP_CONNECTION && m == 50) || (c == AMQP_CHANNEL && m == 40))
+            throw runtime_error(amqpCloseReason(args));
+
+        if (c != classId || m != methodId)
+            throw runtime_error("unexpected AMQP method " + to_string(c) + "." + to_string(m));
+
+        return;
+    }
+}
+
+void El3AmqpOutput::connect()
+{
+    string args;
+
+    m_fd = connectTcp(m_amqp.host, m_amqp.port);
+    m_in.clear();
+    m_inPos = 0;
+    m_out.assign("AMQP\x00\x00\x09\x01", 8);
+    sendAll(m_fd, m_out.data(), m_out.size());
+    m_out.clear();
+
+    expectMethod(AMQP_CONNECTION, 10, args);                    /* Start */
+
+    args.clear();
+    putU32(args, 0);                                            /* client properties */
+    putShortStr(args, "PLAIN");
+    putLongStr(args, string(1, '\0') + m_amqp.user + string(1, '\0') + m_amqp.password);
+    putShortStr(args, "en_US");
+    sendMethod(0, AMQP_CONNECTION, 11, args);                   /* Start-Ok */
+    sendAll(m_fd, m_out.data(), m_out.size());
+    m_out.clear();
+
+    expectMethod(AMQP_CONNECTION, 30, args);                    /* Tune */
+
+    AmqpArgs tune(args);
+    uint16_t channelMax = tune.get(2);
+    uint32_t frameMax = tune.get(4);
+
+    m_frameMax = frameMax ? min<uint32_t>(frameMax, AMQP_FRAME_MAX) : AMQP_FRAME_MAX;
+
+    args.clear();
+    putU16(args, channelMax ? min<uint16_t>(channelMax, 1) : 1);
+    putU32(args, m_frameMax);
+    putU16(args, 0);                                            /* no heartbeats */
+    sendMethod(0, AMQP_CONNECTION, 31, args);                   /* Tune-Ok */
+
+    args.clear();
+    putShortStr(args, m_amqp.vhost);
+    putShortStr(args, "");
+    putU8(args, 0);
+    sendMethod(0, AMQP_CONNECTION, 40, args);                   /* Open */
+    sendAll(m_fd, m_out.data(), m_out.size());
+    m_out.clear();
+
+    expectMethod(AMQP_CONNECTION, 41, args);                    /* Open-Ok */
+
+    args.clear();
+    putShortStr(args, "");
+    sendMethod(1, AMQP_CHANNEL, 10, args);                      /* Channel.Open */
+
+    args.clear();
+    putU8(args, 0);
+    sendMethod(1, AMQP_CONFIRM, 10, args);                      /* Confirm.Select */
+    sendAll(m_fd, m_out.data(), m_out.size());
+    m_out.clear();
+
+    expectMethod(AMQP_CHANNEL, 11, args);
+    expectMethod(AMQP_CONFIRM, 11, args);
+
+    /* delivery tags count from 1 on a channel in confirm mode */
+    m_deliveryTag = 0;
+}
+
+void El3AmqpOutput::disconnect()
+{
+    if (m_fd >= 0)
+    {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+
+    m_out.clear();
+}
+
+void El3AmqpOutput::write(const vector<El3OutputItem> &batch)
+{
+    try {
+        if (m_fd < 0)
+            connect();
+
+        string publish, body, header;
+        uint64_t firstTag = m_deliveryTag + 1;
+
+        putU16(publish, 0);
+        putShortStr(publish, m_amqp.exchange);
+        putShortStr(publish, m_amqp.routingKey);
+        putU8(publish, 0);                                      /* not mandatory, not immediate */
+
+        vector<El3OutputItem> one(1);
+
+        for (auto &item : batch)
+        {
+            one[0] = item;
+            body.clear();
+            format(one, body);
+
+            /* NDJSON messages do without the line feed */
+            if (config().format == OUTPUT_NDJSON)
+                body.pop_back();
+
+            header.clear();
+            putU16(header, AMQP_BASIC);
+            putU16(header, 0);
+            putU64(header, body.size());
+            putU16(header, 0x8000 | 0x1000);                    /* content type, delivery mode */
+            putShortStr(header, config().format == OUTPUT_NDJSON ? "application/json"
+                : "application/octet-stream");
+            putU8(header, 2);                                   /* persistent */
+
+            sendMethod(1, AMQP_BASIC, 40, publish);
+            sendFrame(AMQP_FRAME_HEADER, 1, header.data(), header.size());
+
+            for (size_t off = 0; off < body.size(); off += m_frameMax - 8)
+                sendFrame(AMQP_FRAME_BODY, 1, body.data() + off, min<size_t>(body.size() - off, m_frameMax - 8));
+
+            m_deliveryTag++;
+        }
+
+        sendAll(m_fd, m_out.data(), m_out.size());
+        m_out.clear();
+
+        /* the broker confirms in any order, singly or up to a tag */
+        vector<bool> acked(batch.size());
+        size_t pending = batch.size();
+        uint8_t type;
+        uint16_t channel;
+        string payload;
+
+        while (pending)
+        {
+            readFrame(type, channel, payload);
+
+            if (type != AMQP_FRAME_METHOD || payload.size() < 4)
+                continue;
+
+            AmqpArgs in(payload);
+            uint16_t c = in.get(2), m = in.get(2);
+
+            if ((c == AMQP_CONNECTION && m == 50) || (c == AMQP_CHANNEL && m == 40))
+                throw runtime_error(amqpCloseReason(payload.substr(4)));
+
+            if (c != AMQP_BASIC || (m != 80 && m != 120))
+                continue;
+
+            uint64_t tag = in.get(8);
+            bool multiple = in.get(1) & 1;
+
+            if (m == 120)
+                throw runtime_error("AMQP broker refused message " + to_string(tag));
+
+            for (uint64_t t = multiple ? firstTag : tag; t <= tag; t++)
+            {
+                if (t >= firstTag && t < firstTag + batch.size() && !acked[t - firstTag])
+                {
+                    acked[t - firstTag] = true;
+                    pending--;
+                }
+            }
+        }
+    } catch (...) {
+        /* the batch is published again on a new connection */
+        disconnect();
+        throw;
+    }
+}
+
+void El3AmqpOutput::close()
+{
+    if (m_fd < 0)
+        return;
+
+    string args;
+
+    putU16(args, 200);
+    putShortStr(args, "");
+    putU16(args, 0);
+    putU16(args, 0);
+    sendMethod(0, AMQP_CONNECTION, 50, args);
+
+    try {
+        sendAll(m_fd, m_out.data(), m_out.size());
+        m_out.clear();
+        expectMethod(AMQP_CONNECTION, 51, args);
+    } catch (const exception &) {
+        /* leaving anyway */
+    }
+
+    disconnect();
+}
+
+//------------------------------------------------------------------------------
+
+static unsigned long optionNumber(const string &key, const string &value)
+{
+    size_t end = 0;
+    unsigned long n = 0;
+
+    try {
+        n = stoul(value, &end);
+    } catch (const exception &) {
+    }
+
+    if (value.empty() || end != value.size())
+        throw invalid_argument("output option " + key + " needs a number: " + value);
+
+    return n;
+}
+
+static void splitHostPort(const string &target, string &host, string &port)
+{
+    size_t colon = target.rfind(':');
+
+    if (colon == string::npos || colon == 0 || colon + 1 == target.size())
+        throw invalid_argument("output target must be host:port: " + target);
+
+    host = target.substr(0, colon);
+    port = target.substr(colon + 1);
+}
+
+unique_ptr<El3OutputSink> el3OutputSink(const string &spec)
+{
+    size_t colon = spec.find(':');
+
+    if (colon == string::npos)
+        throw invalid_argument("output must be file:, tcp: or amqp:, not " + spec);
+
+    string kind = spec.substr(0, colon);
+    vector<string> parts;
+
+    for (size_t pos = colon + 1;;)
+    {
+        size_t comma = spec.find(',', pos);
+
+        parts.push_back(spec.substr(pos, comma - pos));
+        if (comma == string::npos)
+            break;
+        pos = comma + 1;
+    }
+
+    string target = parts[0];
+    El3OutputConfig config;
+    El3AmqpConfig amqp;
+    uint64_t rotateBytes = 0;
+    uint32_t rotateSeconds = 0;
+    size_t batch = 0;
+
+    if (target.empty())
+        throw invalid_argument("output without a target: " + spec);
+
+    for (size_t i = 1; i < parts.size(); i++)
+    {
+        size_t eq = parts[i].find('=');
+        string key = parts[i].substr(0, eq);
+        string value = eq == string::npos ? "" : parts[i].substr(eq + 1);
+        bool known = true;
+
+        if (key == "format")
+        {
+            if (value == "ndjson")
+                config.format = OUTPUT_NDJSON;
+            else if (value == "binary")
+                config.format = OUTPUT_BINARY;
+            else if (value == "relay")
+                config.format = OUTPUT_RELAY;
+            else if (value == "arrow" && kind != "amqp")
+                config.format = OUTPUT_ARROW;
+            else
+                throw invalid_argument("output format must be ndjson, binary, relay or (not for amqp) arrow: " + value);
+        }
+        else if (key == "policy")
+        {
+            if (value == "block")
+                config.policy = OUTPUT_BLOCK;
+            else if (value == "drop-newest")
+                config.policy = OUTPUT_DROP_NEWEST;
+            else if (value == "drop-oldest")
+                config.policy = OUTPUT_DROP_OLDEST;
+            else
+                throw invalid_argument("output policy must be block, drop-newest or drop-oldest: " + value);
+        }
+        else if (key == "queue")
+            config.queue = optionNumber(key, value);
+        else if (key == "batch")
+            batch = optionNumber(key, value);
+        else if (key == "flush-ms")
+            config.flushMs = optionNumber(key, value);
+        else if (kind == "file" && key == "rotate-mb")
+            rotateBytes = optionNumber(key, value) << 20;
+        else if (kind == "file" && key == "rotate-s")
+            rotateSeconds = optionNumber(key, value);
+        else if (kind == "amqp" && key == "exchange")
+            amqp.exchange = value;
+        else if (kind == "amqp" && key == "routing-key")
+            amqp.routingKey = value;
+        else if (kind == "amqp" && key == "vhost")
+            amqp.vhost = value;
+        else if (kind == "amqp" && key == "user")
+            amqp.user = value;
+        else if (kind == "amqp" && key == "password")
+            amqp.password = value;
+        else
+            known = false;
+
+        if (!known)
+            throw invalid_argument("unknown " + kind + " output option: " + key);
+    }
+
+    if (batch)
+        config.batch = batch;
+    else if (config.format == OUTPUT_ARROW)
+        config.batch = EL3_ARROW_BATCH_ROWS;
+
+    if (kind == "file")
+        return unique_ptr<El3OutputSink>(new El3FileOutput(target, config, rotateBytes, rotateSeconds));
+
+    if (kind == "tcp")
+    {
+        string host, port;
+
+        splitHostPort(target, host, port);
+        return unique_ptr<El3OutputSink>(new El3TcpOutput(host, port, config));
+    }
+
+    if (kind == "amqp")
+    {
+        if (target.find(':') == string::npos)
+            amqp.host = target;
+        else
+            splitHostPort(target, amqp.host, amqp.port);
+
+        return unique_ptr<El3OutputSink>(new El3AmqpOutput(amqp, config));
+    }
+
+    throw invalid_argument("output must be file:, tcp: or amqp:, not " + spec);
+}
@@ -0,0 +1,178 @@
+/*
+ * Copyright (c) 2022 Subreption LLC. All rights reserved.
+ * Author: 12dc8242df1be0d6f4b73d68166552197936a27074c004c8af95b27194ec584d
+ *
+ * Dual-licensed under the Subreption Ukraine Defense License (SUDL, version 1) and the  Server Side
+ * Public License (SSPL, version 3). Both licenses are provided with this software distribution.
+ */
+
+#include <el3dec/prefilter.hpp>
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+/* frames screened per block in the batch versions, the columns stay in L1 */
+#define SCREEN_BLOCK    64
+
+uint64_t El3ScreenCounters::screened() const
+{
+    uint64_t total = accepted + decode;
+
+    for (int r = SCREEN_SHORT; r < SCREEN_REASONS; r++)
+        total += rejected[r];
+
+    return total;
+}
+
+/* the full length of the active revision of each packet type's layout */
+template <typename... Layouts>
+static void activeFullLengths(uint8_t *fullLength, El3LayoutList<Layouts...>)
+{
+    ((el3LayoutVersion(Layouts::packetType) == Layouts::version ?
+        (void) (fullLength[Layouts::packetType] = Layouts::fullLength) : (void) 0), ...);
+}
+
+El3Screen::El3Screen(const El3ScreenConfig &config)
+{
+    for (int type = 0; type < 256; type++)
+    {
+        m_typeFails[type] = (!((config.engineTypes >> (type >> 5)) & 1)) |
+            ((!((config.uavTypes >> (type & 0x1f)) & 1)) << 1);
+
+        m_packetFails[type] = config.layoutsOnly && !el3LayoutVersion(type);
+    }
+
+    memset(m_fullLength, 0, sizeof(m_fullLength));
+    activeFullLengths(m_fullLength, El3Layouts());
+}
+
+void El3Screen::count(const uint8_t *results, size_t count, El3ScreenCounters &counters)
+{
+    uint64_t byResult[256] = { 0 };
+
+    for (size_t i = 0; i < count; i++)
+        byResult[results[i]]++;
+
+    for (int r = 0; r < 256; r++)
+    {
+        if (!byResult[r])
+            continue;
+
+        switch (EL3_SCREEN_VERDICT(r))
+        {
+            case SCREEN_ACCEPT: counters.accepted += byResult[r]; break;
+            case SCREEN_DECODE: counters.decode += byResult[r]; break;
+            default:            counters.rejected[EL3_SCREEN_REASON(r)] += byResult[r]; break;
+        }
+    }
+}
+
+/*
+ * The checks of classify(), over columns, in byte arithmetic the compiler turns into vector code;
+ * the table lookups are done beforehand, while gathering. The lowest failing check is the reason.
+ */
+static void classifyBlock(const uint8_t *magic, const uint8_t *length, const uint8_t *len,
+    const uint8_t *typeFails, const uint8_t *packetFails, const uint8_t *fullLength,
+    const uint8_t *tooShort, size_t n, uint8_t *out)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        uint8_t fails = tooShort[i] |
+            (magic[i] != ENICS_ELERON_PACKET_MAGICBYTE) << 1 |
+            ((length[i] == 0) | (length[i] > len[i])) << 2 |
+            typeFails[i] << 3 |
+            packetFails[i] << 5;
+
+        uint8_t lowest = fails & -fails;
+        uint8_t reason = (lowest >= 0x01) + (lowest >= 0x02) + (lowest >= 0x04) +
+            (lowest >= 0x08) + (lowest >= 0x10) + (lowest >= 0x20);
+        uint8_t verdict = (fails != 0) * SCREEN_REJECT | (!fails & (len[i] < fullLength[i])) * SCREEN_DECODE;
+
+        out[i] = verdict << 4 | reason;
+    }
+}
+
+void El3Screen::screen(const unsigned char *const *frames, const size_t *lens, size_t count,
+    uint8_t *out, El3ScreenCounters *counters) const
+{
+    static const unsigned char noHeader[EL3_HEADER_PACKET_TYPE + 1] = { 0 };
+
+    uint8_t magic[SCREEN_BLOCK], length[SCREEN_BLOCK], len[SCREEN_BLOCK], tooShort[SCREEN_BLOCK];
+    uint8_t typeFails[SCREEN_BLOCK], packetFails[SCREEN_BLOCK], fullLength[SCREEN_BLOCK];
+
+    for (size_t base = 0; base < count; base += SCREEN_BLOCK)
+    {
+        size_t n = min((size_t) SCREEN_BLOCK, count - base);
+
+        /* gather the header bytes; frames too short to have one read a blank header instead */
+        for (size_t i = 0; i < n; i++)
+        {
+            size_t l = lens[base + i];
+            const unsigned char *h = l < sizeof(noHeader) ? noHeader : frames[base + i];
+
+            tooShort[i] = l < sizeof(noHeader);
+            magic[i] = h[EL3_HEADER_MAGIC];
+            length[i] = h[EL3_HEADER_LENGTH];
+            len[i] = l > 0xff ? 0xff : l;
+            typeFails[i] = m_typeFails[h[EL3_HEADER_TYPE]];
+            packetFails[i] = m_packetFails[h[EL3_HEADER_PACKET_TYPE]];
+            fullLength[i] = m_fullLength[h[EL3_HEADER_PACKET_TYPE]];
+        }
+
+        classifyBlock(magic, length, len, typeFails, packetFails, fullLength, tooShort, n, out + base);
+    }
+
+    if (counters)
+        El3Screen::count(out, count, *counters);
+}
+
+void El3Screen::screen(const unsigned char *frames, size_t stride, const uint16_t *lens, size_t count,
+    uint8_t *out, El3ScreenCounters *counters) const
+{
+    const unsigned char *ptrs[SCREEN_BLOCK];
+    size_t sizes[SCREEN_BLOCK];
+
+    for (size_t base = 0; base < count; base += SCREEN_BLOCK)
+    {
+        size_t n = min((size_t) SCREEN_BLOCK, count - base);
+
+        for (size_t i = 0; i < n; i++)
+        {
+            ptrs[i] = frames + (base + i) * stride;
+            sizes[i] = lens ? lens[base + i] : stride;
+        }
+
+        screen(ptrs, sizes, n, out + base);
+    }
+
+    if (counters)
+        El3Screen::count(out, count, *counters);
+}
+
+const char *el3ScreenReasonName(El3ScreenReason reason)
+{
+    switch (reason)
+    {
+        case SCREEN_OK:             return "ok";
+        case SCREEN_SHORT:          return "short";
+        case SCREEN_MAGIC:          return "magic";
+        case SCREEN_LENGTH:         return "length";
+        case SCREEN_ENGINE_TYPE:    return "engine_type";
+        case SCREEN_UAV_TYPE:       return "uav_type";
+        case SCREEN_PACKET_TYPE:    return "packet_type";
+        default:                    return "unknown";
+    }
+}
+
+const El3Screen &el3DecodableScreen()
+{
+    static const El3Screen screen = [] {
+        El3ScreenConfig config;
+
+        config.layoutsOnly = false;
+        return El3Screen(config);
+    }();
+
+    return screen;
+}
@@ -0,0 +1,293 @@
+/*
+ * Copyright (c) 2022 Subreption LLC. All rights reserved.
+ * Author: 12dc8242df1be0d6f4b73d68166552197936a27074c004c8af95b27194ec584d
+ *
+ * Dual-licensed under the Subreption Ukraine Defense License (SUDL, version 1) and the  Server Side
+ * Public License (SSPL, version 3). Both licenses are provided with this software distribution.
+ */
+
+#include <el3dec/query.hpp>
+#include <el3dec/lib.hpp>
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iterator>
+
+using namespace std;
+
+El3TrackQueryCursor::El3TrackQueryCursor(const El3TrackQuery &query, const El3CaptureIoConfig &io):
+    m_query(query), m_io(io), m_planned(false), m_archive(0), m_nextUnwritten(0), m_nextLive(0)
+{
+    memset(&m_stats, 0, sizeof(m_stats));
+}
+
+El3TrackQueryCursor::~El3TrackQueryCursor()
+{
+    /* streams reference their reader */
+    m_stream.reset();
+}
+
+void El3TrackQueryCursor::addArchive(const string &path)
+{
+    if (m_planned)
+        throw runtime_error("archives must be added before the first fixes are read");
+
+    plan(path, unique_ptr<El3CaptureReader>(new El3CaptureReader(path)));
+}
+
+void El3TrackQueryCursor::addCapture(const string &path, uint64_t written, const vector<unsigned char> &tail)
+{
+    if (m_planned)
+        throw runtime_error("archives must be added before the first fixes are read");
+
+    vector<unsigned char> pending;
+    vector<El3CaptureRecord> records;
+    El3QueryFix fix;
+
+    if (written < sizeof(El3CaptureFileHeader))
+    {
+        /* not even the file header is in the file yet */
+        size_t header = sizeof(El3CaptureFileHeader) - written;
+
+        if (tail.size() > header)
+            pending.assign(tail.begin() + header, tail.end());
+    }
+    else
+    {
+        unique_ptr<El3CaptureReader> reader(new El3CaptureReader(path, written));
+
+        /* the file may end inside a block the tail completes */
+        reader->partial(pending);
+        pending.insert(pending.end(), tail.begin(), tail.end());
+        plan(path, move(reader));
+    }
+
+    el3CaptureRecords(pending.data(), pending.size(), records);
+
+    for (auto &rec : records)
+    {
+        if (match(rec, fix))
+            m_unwritten.push_back(fix);
+    }
+}
+
+void El3TrackQueryCursor::plan(const string &path, unique_ptr<El3CaptureReader> reader)
+{
+    vector<uint32_t> inRange, withUav;
+
+    m_stats.blocks += reader->blocks();
+
+    reader->blocksInRange(m_query.fromNs, m_query.toNs, inRange);
+    m_stats.blocksInRange += inRange.size();
+    if (inRange.empty())
+        return;
+
+    reader->blocksForUav(m_query.uavNo, withUav);
+
+    Archive archive;
+
+    set_intersection(inRange.begin(), inRange.end(), withUav.begin(), withUav.end(),
+        back_inserter(archive.blocks));
+    if (archive.blocks.empty())
+        return;
+
+    m_stats.archives++;
+    m_stats.blocksRead += archive.blocks.size();
+
+    archive.path = path;
+    archive.reader = move(reader);
+    m_archives.push_back(move(archive));
+}
+
+void El3TrackQueryCursor::addLive(const El3TrackStore &store, uint32_t sensorId)
+{
+    if (m_planned)
+        throw runtime_error("live fixes must be added before the first fixes are read");
+
+    const El3TrackEntry *entry = store.find(m_query.uavNo);
+
+    if (!entry)
+        return;
+
+    uint32_t first = (entry->next + EL3_TRACK_HISTORY - entry->count) % EL3_TRACK_HISTORY;
+
+    for (uint32_t i = 0; i < entry->count; i++)
+    {
+        uint32_t slot = (first + i) % EL3_TRACK_HISTORY;
+        int64_t recvNs = entry->historyNs[slot];
+
+        if (recvNs >= m_query.fromNs && recvNs <= m_query.toNs)
+            m_live.push_back({ recvNs, sensorId, entry->history[slot] });
+    }
+
+    stable_sort(m_live.begin(), m_live.end(),
+        [](const El3QueryFix &a, const El3QueryFix &b) { return a.recvNs < b.recvNs; });
+    m_archived.assign(m_live.size(), false);
+}
+
+bool El3TrackQueryCursor::scan(vector<El3QueryFix> &out, size_t max)
+{
+    while (out.size() < max)
+    {
+        if (!m_stream)
+        {
+            if (m_archive == m_archives.size())
+                return false;
+
+            Archive &archive = m_archives[m_archive];
+
+            m_stream.reset(new El3CaptureBlockStream(*archive.reader, archive.path, archive.blocks, m_io));
+        }
+
+        El3CaptureRecord rec;
+
+        if (!m_stream->next(rec))
+        {
+            m_stream.reset();
+            m_archives[m_archive].reader.reset();
+            m_archives[m_archive].blocks = vector<uint32_t>();
+            m_archive++;
+            continue;
+        }
+
+        El3QueryFix fix;
+
+        if (match(rec, fix))
+        {
+            out.push_back(fix);
+            returned(fix.recvNs);
+        }
+    }
+
+    return true;
+}
+
+/* blocks in range may still hold frames outside it, and frames of other UAVs */
+bool El3TrackQueryCursor::match(const El3CaptureRecord &rec, El3QueryFix &fix)
+{
+    m_stats.framesScanned++;
+
+    if (rec.recvNs < m_query.fromNs || rec.recvNs > m_query.toNs ||
+        el3CaptureUav(rec.data, rec.length) != m_query.uavNo)
+        return false;
+
+    unique_ptr<El3Telemetry> telemetry;
+
+    try {
+        telemetry.reset(el3Decode(rec.data, rec.length, FAULT_TOLERANT));
+    } catch (const exception &) {
+        return false;
+    }
+
+    m_stats.framesDecoded++;
+    fix = { rec.recvNs, rec.sensorId, telemetry->Record() };
+    return true;
+}
+
+/* live fixes an archive returned are not returned again */
+void El3TrackQueryCursor::returned(int64_t recvNs)
+{
+    auto live = lower_bound(m_live.begin(), m_live.end(), recvNs,
+        [](const El3QueryFix &fix, int64_t ns) { return fix.recvNs < ns; });
+
+    for (; live != m_live.end() && live->recvNs == recvNs; ++live)
+        m_archived[live - m_live.begin()] = true;
+}
+
+bool El3TrackQueryCursor::next(vector<El3QueryFix> &out, size_t max)
+{
+    out.clear();
+
+    if (!m_planned)
+    {
+        m_planned = true;
+        stable_sort(m_archives.begin(), m_archives.end(), [](const Archive &a, const Archive &b) {
+            return a.reader->block(a.blocks.front()).minNs < b.reader->block(b.blocks.front()).minNs;
+        });
+    }
+
+    if (!scan(out, max))
+    {
+        for (; m_nextUnwritten < m_unwritten.size() && out.size() < max; m_nextUnwritten++)
+        {
+            out.push_back(m_unwritten[m_nextUnwritten]);
+            returned(m_unwritten[m_nextUnwritten].recvNs);
+        }
+
+        for (; m_nextLive < m_live.size() && out.size() < max; m_nextLive++)
+            if (!m_archived[m_nextLive])
+                out.push_back(m_live[m_nextLive]);
+    }
+
+    m_stats.fixes += out.size();
+
+    return !out.empty();
+}
+
+bool el3ParseTime(const string &text, int64_t &ns)
+{
+    const char *s = text.c_str();
+    const char *end;
+    int64_t seconds;
+
+    struct tm tm;
+    int n = 0;
+    char sep;
+    bool negative = false;
+
+    memset(&tm, 0, sizeof(tm));
+
+    if (sscanf(s, "%4d-%2d-%2d%c%2d:%2d:%2d%n", &tm.tm_year, &tm.tm_mon, &tm.tm_mday, &sep,
+            &tm.tm_hour, &tm.tm_min, &tm.tm_sec, &n) == 7 && n && (sep == 'T' || sep == ' '))
+    {
+        if (tm.tm_mon < 1 || tm.tm_mon > 12 || tm.tm_mday < 1 || tm.tm_mday > 31 ||
+            tm.tm_hour > 23 || tm.tm_min > 59 || tm.tm_sec > 60)
+            return false;
+
+        tm.tm_year -= 1900;
+        tm.tm_mon -= 1;
+        seconds = timegm(&tm);
+        end = s + n;
+    }
+    else
+    {
+        char *stop;
+
+        if (!isdigit((unsigned char) *s) && !(*s == '-' && isdigit((unsigned char) s[1])))
+            return false;
+
+        negative = *s == '-';
+        errno = 0;
+        seconds = strtoll(s, &stop, 10);
+        if (errno || seconds > INT64_MAX / 1000000000 || seconds < INT64_MIN / 1000000000)
+            return false;
+
+        end = stop;
+    }
+
+    int64_t fraction = 0;
+
+    if (*end == '.')
+    {
+        int64_t scale = 100000000;
+
+        if (!isdigit((unsigned char) *++end))
+            return false;
+
+        for (; isdigit((unsigned char) *end); end++, scale /= 10)
+            fraction += (*end - '0') * scale;
+    }
+
+    if (n && *end == 'Z')
+        end++;
+
+    if (*end)
+        return false;
+
+    ns = seconds * 1000000000 + (negative ? -fraction : fraction);
+    return true;
+}
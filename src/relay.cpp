@@ -0,0 +1,285 @@
+/*
+ * Copyright (c) 2022 Subreption LLC. All rights reserved.
+ * Author: 12dc8242df1be0d6f4b73d68166552197936a27074c004c8af95b27194ec584d
+ *
+ * Dual-licensed under the Subreption Ukraine Defense License (SUDL, version 1) and the  Server Side
+ * Public License (SSPL, version 3). Both licenses are provided with this software distribution.
+ */
+
+#include <el3dec/relay.hpp>
+#include <algorithm>
+#include <cstring>
+#include <random>
+#include <stdexcept>
+
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "relay messages are read and written in host order, which must be little-endian"
+#endif
+
+using namespace std;
+
+static_assert(sizeof(El3RelayRecord) == 58, "El3RelayRecord is part of the relay protocol");
+
+void el3RelayPack(const El3TelemetryRecord &rec, int64_t recvNs, El3RelayRecord &out)
+{
+    out.recvNs = recvNs;
+    out.uavNo = rec.uavNo;
+    out.flightTime = rec.flightTime;
+    out.packetType = rec.packetType;
+    out.types = rec.engineType << 5 | (rec.uavType & 0x1f);
+    out.stamp[0] = rec.stampHours;
+    out.stamp[1] = rec.stampMinutes;
+    out.stamp[2] = rec.stampSeconds;
+    out.trackVerdict = rec.trackVerdict;
+    out.trackConfidence = (uint8_t) (min(max(rec.trackConfidence, 0.0f), 1.0f) * 255.0f + 0.5f);
+    out.videoTxChannel = rec.videoTxChannel;
+    out.videoTxFreq = rec.videoTxFreq;
+    out.altitude = rec.gpsData.altitude;
+    out.remainingMinutes = rec.remainingMinutes;
+    out.latitude = rec.gpsData.latitude;
+    out.longitude = rec.gpsData.longitude;
+    out.groundSpeed = rec.groundSpeed;
+    out.careen = rec.careen;
+    out.pitch = rec.pitch;
+    out.cameraAngle = rec.camera.angle;
+    out.cameraPosition = rec.camera.position;
+    out.cameraAzimuth = rec.camera.azimuth;
+}
+
+void el3RelayUnpack(const El3RelayRecord &in, El3TelemetryRecord &rec)
+{
+    memset(&rec, 0, sizeof(rec));
+
+    rec.uavNo = in.uavNo;
+    rec.flightTime = in.flightTime;
+    rec.packetType = in.packetType;
+    rec.engineType = in.types >> 5;
+    rec.uavType = in.types & 0x1f;
+    rec.stampHours = in.stamp[0];
+    rec.stampMinutes = in.stamp[1];
+    rec.stampSeconds = in.stamp[2];
+    rec.trackVerdict = in.trackVerdict;
+    rec.trackConfidence = in.trackConfidence / 255.0f;
+    rec.videoTxChannel = in.videoTxChannel;
+    rec.videoTxFreq = in.videoTxFreq;
+    rec.gpsData.altitude = in.altitude;
+    rec.remainingMinutes = in.remainingMinutes;
+    rec.gpsData.latitude = in.latitude;
+    rec.gpsData.longitude = in.longitude;
+    rec.groundSpeed = in.groundSpeed;
+    rec.careen = in.careen;
+    rec.pitch = in.pitch;
+    rec.camera.angle = in.cameraAngle;
+    rec.camera.position = in.cameraPosition;
+    rec.camera.azimuth = in.cameraAzimuth;
+}
+
+static void appendHeader(string &out, El3RelayType type, size_t len)
+{
+    uint32_t length = len + 1;
+    uint8_t t = type;
+
+    out.append((const char *) &length, sizeof(length));
+    out.append((const char *) &t, sizeof(t));
+}
+
+void el3RelayMessage(string &out, El3RelayType type, const void *body, size_t len)
+{
+    appendHeader(out, type, len);
+    out.append((const char *) body, len);
+}
+
+//------------------------------------------------------------------------------
+
+void El3RelayReader::feed(const void *data, size_t len)
+{
+    if (m_pos)
+    {
+        m_buf.erase(0, m_pos);
+        m_pos = 0;
+    }
+
+    m_buf.append((const char *) data, len);
+}
+
+bool El3RelayReader::next(El3RelayMessageView &msg)
+{
+    size_t avail = m_buf.size() - m_pos;
+    uint32_t length;
+
+    if (avail < sizeof(length) + 1)
+        return false;
+
+    memcpy(&length, m_buf.data() + m_pos, sizeof(length));
+
+    if (!length || length > EL3_RELAY_MAX_MESSAGE)
+        throw runtime_error("relay message of invalid length");
+
+    if (avail < sizeof(length) + length)
+        return false;
+
+    const unsigned char *p = (const unsigned char *) m_buf.data() + m_pos + sizeof(length);
+    size_t bodyLen = length - 1;
+    bool valid;
+
+    switch (p[0])
+    {
+        case RELAY_HELLO:   valid = bodyLen == sizeof(El3RelayHello); break;
+        case RELAY_WELCOME: valid = bodyLen == sizeof(El3RelayWelcome); break;
+        case RELAY_ACK:     valid = bodyLen == sizeof(El3RelayAck); break;
+        case RELAY_BATCH:
+        {
+            El3RelayBatchHeader hdr;
+
+            valid = bodyLen >= sizeof(hdr);
+            if (valid)
+            {
+                memcpy(&hdr, p + 1, sizeof(hdr));
+                valid = bodyLen - sizeof(hdr) == (uint64_t) hdr.count * sizeof(El3RelayRecord);
+            }
+            break;
+        }
+        default:
+            throw runtime_error("unknown relay message type");
+    }
+
+    if (!valid)
+        throw runtime_error("relay message of invalid length");
+
+    msg.type = (El3RelayType) p[0];
+    msg.body = p + 1;
+    msg.len = bodyLen;
+
+    m_pos += sizeof(length) + length;
+    return true;
+}
+
+//------------------------------------------------------------------------------
+
+El3RelayOutbox::El3RelayOutbox(uint32_t sensorId, size_t capacity):
+    m_sensorId(sensorId), m_capacity(max<size_t>(capacity, 1)), m_nextSeq(1), m_sendSeq(1),
+    m_dropped(0)
+{
+    random_device rd;
+
+    /* a new session per process, the aggregator must not mistake a restarted edge for the old one */
+    m_session = (uint64_t) rd() << 32 | rd();
+}
+
+void El3RelayOutbox::push(const El3TelemetryRecord &rec, int64_t recvNs)
+{
+    if (m_records.size() == m_capacity)
+    {
+        m_records.pop_front();
+        m_dropped++;
+        m_sendSeq = max(m_sendSeq, m_nextSeq - m_records.size());
+    }
+
+    m_records.emplace_back();
+    el3RelayPack(rec, recvNs, m_records.back());
+    m_nextSeq++;
+}
+
+void El3RelayOutbox::hello(string &out) const
+{
+    El3RelayHello hello;
+
+    memcpy(hello.magic, EL3_RELAY_MAGIC, sizeof(hello.magic));
+    hello.version = EL3_RELAY_VERSION;
+    hello.reserved = 0;
+    hello.sensorId = m_sensorId;
+    hello.session = m_session;
+
+    el3RelayMessage(out, RELAY_HELLO, &hello, sizeof(hello));
+}
+
+void El3RelayOutbox::resume(uint64_t lastSeq)
+{
+    ack(lastSeq);
+
+    /* everything still held is resent, the aggregator drops what it already had */
+    m_sendSeq = m_nextSeq - m_records.size();
+}
+
+bool El3RelayOutbox::batch(string &out, size_t maxRecords)
+{
+    size_t count = min<uint64_t>(min<size_t>(maxRecords, EL3_RELAY_MAX_BATCH), m_nextSeq - m_sendSeq);
+
+    if (!count)
+        return false;
+
+    El3RelayBatchHeader hdr = { m_sendSeq, (uint32_t) count };
+    size_t first = m_sendSeq - (m_nextSeq - m_records.size());
+
+    appendHeader(out, RELAY_BATCH, sizeof(hdr) + count * sizeof(El3RelayRecord));
+    out.append((const char *) &hdr, sizeof(hdr));
+
+    for (size_t i = 0; i < count; i++)
+        out.append((const char *) &m_records[first + i], sizeof(El3RelayRecord));
+
+    m_sendSeq += count;
+    return true;
+}
+
+void El3RelayOutbox::ack(uint64_t seq)
+{
+    uint64_t firstSeq = m_nextSeq - m_records.size();
+
+    while (!m_records.empty() && firstSeq <= seq)
+    {
+        m_records.pop_front();
+        firstSeq++;
+    }
+
+    m_sendSeq = max(m_sendSeq, firstSeq);
+}
+
+//------------------------------------------------------------------------------
+
+bool El3RelayPeers::hello(const El3RelayHello &hello, uint64_t &lastSeq)
+{
+    Peer &peer = m_peers[hello.sensorId];
+
+    if (peer.session != hello.session)
+    {
+        if (peer.links)
+            return false;
+
+        peer.session = hello.session;
+        peer.lastSeq = 0;
+    }
+
+    peer.links++;
+    lastSeq = peer.lastSeq;
+    return true;
+}
+
+void El3RelayPeers::closed(uint32_t sensorId, uint64_t session)
+{
+    auto it = m_peers.find(sensorId);
+
+    if (it != m_peers.end() && it->second.session == session && it->second.links)
+        it->second.links--;
+}
+
+uint32_t El3RelayPeers::receive(uint32_t sensorId, uint64_t firstSeq, uint32_t count)
+{
+    Peer &peer = m_peers[sensorId];
+    uint64_t last = firstSeq + count - 1;
+
+    if (!count || !firstSeq || last <= peer.lastSeq)
+        return 0;
+
+    /* a gap (records the edge dropped) is accepted, nothing will fill it */
+    uint32_t fresh = last - max(peer.lastSeq, firstSeq - 1);
+
+    peer.lastSeq = last;
+    return fresh;
+}
+
+uint64_t El3RelayPeers::lastSeq(uint32_t sensorId) const
+{
+    auto it = m_peers.find(sensorId);
+
+    return it == m_peers.end() ? 0 : it->second.lastSeq;
+}
@@ -0,0 +1,284 @@
+/*
+ * Copyright (c) 2022 Subreption LLC. All rights reserved.
+ * Author: 12dc8242df1be0d6f4b73d68166552197936a27074c004c8af95b27194ec584d
+ *
+ * Dual-licensed under the Subreption Ukraine Defense License (SUDL, version 1) and the  Server Side
+ * Public License (SSPL, version 3). Both licenses are provided with this software distribution.
+ */
+
+#include <el3dec/reorder.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+using namespace std;
+
+El3ReorderBuffer::El3ReorderBuffer(const El3ReorderConfig &config):
+    m_config(config)
+{
+    if (!m_config.slots || !m_config.maxTracks || m_config.maxTracks >= EL3_REORDER_NO_TRACK)
+        throw invalid_argument("invalid reorder buffer geometry");
+
+    m_index.assign(65536, EL3_REORDER_NO_TRACK);
+    m_tracks.resize(m_config.maxTracks);
+    m_slots.resize((size_t) m_config.maxTracks * m_config.slots);
+
+    memset(&m_tracks[0], 0, sizeof(Track) * m_tracks.size());
+}
+
+int64_t El3ReorderBuffer::dateStamp(int hours, int minutes, int seconds, uint64_t refMs)
+{
+    int64_t ref = (int64_t) refMs;
+    int64_t stamp = (ref / EL3_MS_PER_DAY) * EL3_MS_PER_DAY + ((hours * 60 + minutes) * 60 + seconds) * 1000LL;
+
+    /* the receive time and the stamp may sit on different sides of midnight */
+    if (stamp - ref > EL3_MS_PER_DAY / 2)
+        stamp -= EL3_MS_PER_DAY;
+    else if (ref - stamp > EL3_MS_PER_DAY / 2)
+        stamp += EL3_MS_PER_DAY;
+
+    return stamp;
+}
+
+/*
+ * The stamp is authoritative but has a one second resolution and is exposed to bit errors in any of
+ * its three bytes; the flight time is a steady seconds counter from an unknown origin. Agreeing
+ * stamps keep the anchor fresh, a lone disagreeing one is replaced by the extrapolation, and a
+ * persistent disagreement means the flight time counter itself was reset.
+ */
+int64_t El3ReorderBuffer::rebuild(Track &track, const El3TelemetryRecord &rec, uint64_t recvMs,
+    uint8_t *flags)
+{
+    bool valid = rec.stampHours < 24 && rec.stampMinutes < 60 && rec.stampSeconds < 60;
+    int64_t stamped = 0;
+
+    if (valid)
+        stamped = dateStamp(rec.stampHours, rec.stampMinutes, rec.stampSeconds, recvMs);
+
+    if (track.anchored)
+    {
+        int64_t predicted = track.anchorUtcMs +
+            (int16_t) (rec.flightTime - track.anchorFlightTime) * 1000LL;
+
+        if (valid && llabs(stamped - predicted) <= m_config.stampToleranceMs)
+        {
+            track.anchorUtcMs = stamped;
+            track.anchorFlightTime = rec.flightTime;
+            track.disagreements = 0;
+
+            *flags = EL3_TS_STAMP;
+            return stamped;
+        }
+
+        if (valid && ++track.disagreements < EL3_REORDER_REANCHOR)
+        {
+            /* stamp consistent with the track's recent past: the flight time is what got corrupted */
+            int64_t elapsed = (int64_t) (recvMs - track.lastSeenMs);
+            if (llabs(stamped - track.lastUtcMs) <= m_config.stampToleranceMs + elapsed)
+            {
+                *flags = EL3_TS_STAMP;
+                return stamped;
+            }
+        }
+
+        if (!valid || track.disagreements < EL3_REORDER_REANCHOR)
+        {
+            *flags = EL3_TS_FLIGHTTIME;
+            return predicted;
+        }
+    }
+
+    if (valid)
+    {
+        track.anchored = true;
+        track.anchorUtcMs = stamped;
+        track.anchorFlightTime = rec.flightTime;
+        track.disagreements = 0;
+
+        *flags = EL3_TS_STAMP;
+        return stamped;
+    }
+
+    *flags = EL3_TS_RECEIVE;
+    return recvMs;
+}
+
+El3ReorderBuffer::Track *El3ReorderBuffer::track(uint16_t uavNo, uint64_t recvMs)
+{
+    uint16_t idx = m_index[uavNo];
+
+    if (idx != EL3_REORDER_NO_TRACK)
+        return &m_tracks[idx];
+
+    /* new UAV: take a free track, or recycle the one idle for the longest time */
+    Track *victim = NULL;
+
+    for (size_t i = 0; i < m_tracks.size(); i++)
+    {
+        Track &t = m_tracks[i];
+
+        if (!t.active)
+        {
+            victim = &t;
+            break;
+        }
+
+        if (!t.count && (!victim || t.lastSeenMs < victim->lastSeenMs))
+            victim = &t;
+    }
+
+    if (!victim)
+        return NULL;
+
+    if (victim->active)
+        m_index[victim->uavNo] = EL3_REORDER_NO_TRACK;
+
+    memset(victim, 0, sizeof(Track));
+    victim->uavNo = uavNo;
+    victim->active = true;
+    victim->lastReleasedMs = INT64_MIN;
+    victim->lastSeenMs = recvMs;
+    victim->deadline = UINT64_MAX;
+
+    m_index[uavNo] = victim - &m_tracks[0];
+
+    return victim;
+}
+
+El3TimedRecord &El3ReorderBuffer::slot(const Track &track, uint32_t pos)
+{
+    size_t base = (size_t) (&track - &m_tracks[0]) * m_config.slots;
+
+    return m_slots[base + (track.head + pos) % m_config.slots];
+}
+
+void El3ReorderBuffer::refreshDeadline(Track &track)
+{
+    track.deadline = UINT64_MAX;
+
+    for (uint32_t i = 0; i < track.count; i++)
+        track.deadline = min(track.deadline, slot(track, i).recvMs + m_config.maxLatencyMs);
+}
+
+void El3ReorderBuffer::release(Track &track, uint32_t n, vector<El3TimedRecord> &out)
+{
+    for (uint32_t i = 0; i < n; i++)
+    {
+        El3TimedRecord &tr = slot(track, 0);
+
+        track.lastReleasedMs = tr.utcMs;
+        out.push_back(tr);
+
+        track.head = (track.head + 1) % m_config.slots;
+        track.count--;
+    }
+
+    refreshDeadline(track);
+}
+
+void El3ReorderBuffer::ingest(const El3TelemetryRecord &rec, uint64_t recvMs, uint32_t sensorId,
+    vector<El3TimedRecord> &out)
+{
+    El3TimedRecord tr;
+
+    tr.record = rec;
+    tr.recvMs = recvMs;
+    tr.sensorId = sensorId;
+
+    Track *t = track(rec.uavNo, recvMs);
+
+    if (!t)
+    {
+        if (rec.stampHours < 24 && rec.stampMinutes < 60 && rec.stampSeconds < 60)
+        {
+            tr.utcMs = dateStamp(rec.stampHours, rec.stampMinutes, rec.stampSeconds, recvMs);
+            tr.flags = EL3_TS_STAMP | EL3_TS_UNTRACKED;
+        }
+        else
+        {
+            tr.utcMs = recvMs;
+            tr.flags = EL3_TS_RECEIVE | EL3_TS_UNTRACKED;
+        }
+
+        out.push_back(tr);
+        return;
+    }
+
+    tr.utcMs = rebuild(*t, rec, recvMs, &tr.flags);
+
+    t->lastUtcMs = tr.utcMs;
+    t->lastSeenMs = recvMs;
+
+    /* its place in the sequence was already given away */
+    if (tr.utcMs < t->lastReleasedMs)
+    {
+        tr.flags |= EL3_TS_LATE;
+        out.push_back(tr);
+        return;
+    }
+
+    if (t->count == m_config.slots)
+        release(*t, 1, out);
+
+    /* insertion from the tail, equal timestamps keep their arrival order */
+    uint32_t pos = t->count;
+    while (pos > 0 && slot(*t, pos - 1).utcMs > tr.utcMs)
+    {
+        slot(*t, pos) = slot(*t, pos - 1);
+        pos--;
+    }
+
+    slot(*t, pos) = tr;
+    t->count++;
+    t->deadline = min(t->deadline, recvMs + m_config.maxLatencyMs);
+}
+
+size_t El3ReorderBuffer::poll(uint64_t nowMs, vector<El3TimedRecord> &out)
+{
+    size_t released = 0;
+
+    for (size_t i = 0; i < m_tracks.size(); i++)
+    {
+        Track &t = m_tracks[i];
+
+        if (!t.count || t.deadline > nowMs)
+            continue;
+
+        /* everything up to the last expired record goes, so order holds and no budget is exceeded */
+        uint32_t n = 0;
+        for (uint32_t pos = 0; pos < t.count; pos++)
+        {
+            if (slot(t, pos).recvMs + m_config.maxLatencyMs <= nowMs)
+                n = pos + 1;
+        }
+
+        release(t, n, out);
+        released += n;
+    }
+
+    return released;
+}
+
+size_t El3ReorderBuffer::flush(vector<El3TimedRecord> &out)
+{
+    size_t released = 0;
+
+    for (size_t i = 0; i < m_tracks.size(); i++)
+    {
+        released += m_tracks[i].count;
+        release(m_tracks[i], m_tracks[i].count, out);
+    }
+
+    return released;
+}
+
+size_t El3ReorderBuffer::buffered() const
+{
+    size_t n = 0;
+
+    for (size_t i = 0; i < m_tracks.size(); i++)
+        n += m_tracks[i].count;
+
+    return n;
+}
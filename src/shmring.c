@@ -0,0 +1,291 @@
+/*
+ * Copyright (c) 2022 Subreption LLC. All rights reserved.
+ * Author: 12dc8242df1be0d6f4b73d68166552197936a27074c004c8af95b27194ec584d
+ *
+ * Dual-licensed under the Subreption Ukraine Defense License (SUDL, version 1) and the  Server Side
+ * Public License (SSPL, version 3). Both licenses are provided with this software distribution.
+ */
+
+#include <el3dec/shmring.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+/* both sides map the same layout, whatever compiled them */
+_Static_assert(sizeof(struct el3_shm_ring_header) == 192, "ring header layout");
+_Static_assert(sizeof(struct el3_shm_ring_record) == EL3_SHM_RING_ALIGN, "ring record layout");
+
+#define RING_ALIGNED(len)   (((len) + EL3_SHM_RING_ALIGN - 1) & ~(size_t) (EL3_SHM_RING_ALIGN - 1))
+
+struct el3_shm_producer {
+  struct el3_shm_ring_header *ring;
+  unsigned char *data;
+  size_t size;
+  uint32_t capacity;            /* as mapped, the shared copy is not trusted afterwards */
+  uint64_t head;                /* private copy, only published on commit */
+  uint64_t reserved;            /* where the reserved record starts */
+  size_t reservedLen;
+  int pending;
+};
+
+static uint32_t round_capacity(uint32_t capacity)
+{
+    uint32_t cap = EL3_SHM_RING_MIN_CAPACITY;
+
+    while (cap < capacity && cap < 0x80000000u)
+        cap <<= 1;
+
+    return cap;
+}
+
+/* the creator may not have sized or initialized the segment yet, give it a second */
+static struct el3_shm_ring_header *attach(int fd, size_t *size)
+{
+    struct timespec pause = { 0, 1000000 };
+    struct stat st;
+    int tries;
+
+    for (tries = 0; tries < 1000; tries++)
+    {
+        if (fstat(fd, &st) < 0)
+            return NULL;
+
+        if ((size_t) st.st_size > sizeof(struct el3_shm_ring_header))
+        {
+            struct el3_shm_ring_header *ring = (struct el3_shm_ring_header *) mmap(NULL, st.st_size,
+                PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+            if (ring == MAP_FAILED)
+                return NULL;
+
+            if (__atomic_load_n(&ring->magic, __ATOMIC_ACQUIRE) == EL3_SHM_RING_MAGIC)
+            {
+                if (ring->version != EL3_SHM_RING_VERSION ||
+                    ring->capacity < EL3_SHM_RING_MIN_CAPACITY ||
+                    (ring->capacity & (ring->capacity - 1)) ||
+                    sizeof(*ring) + (size_t) ring->capacity > (size_t) st.st_size)
+                {
+                    munmap(ring, st.st_size);
+                    errno = EPROTO;
+                    return NULL;
+                }
+
+                *size = st.st_size;
+                return ring;
+            }
+
+            munmap(ring, st.st_size);
+        }
+
+        nanosleep(&pause, NULL);
+    }
+
+    errno = ETIMEDOUT;
+    return NULL;
+}
+
+struct el3_shm_ring_header *el3_shm_ring_map(const char *name, uint32_t capacity, size_t *size)
+{
+    struct el3_shm_ring_header *ring;
+    int fd, saved;
+
+    fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+
+    if (fd < 0)
+    {
+        if (errno != EEXIST)
+            return NULL;
+
+        fd = shm_open(name, O_RDWR, 0600);
+        if (fd < 0)
+            return NULL;
+
+        ring = attach(fd, size);
+        saved = errno;
+        close(fd);
+        errno = saved;
+
+        return ring;
+    }
+
+    capacity = round_capacity(capacity);
+    *size = sizeof(*ring) + capacity;
+
+    if (ftruncate(fd, *size) < 0)
+        goto fail;
+
+    ring = (struct el3_shm_ring_header *) mmap(NULL, *size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (ring == MAP_FAILED)
+        goto fail;
+
+    close(fd);
+
+    /* a fresh segment is zero filled, only the geometry needs setting before the magic */
+    ring->version = EL3_SHM_RING_VERSION;
+    ring->capacity = capacity;
+    __atomic_store_n(&ring->magic, EL3_SHM_RING_MAGIC, __ATOMIC_RELEASE);
+
+    return ring;
+
+fail:
+    saved = errno;
+    close(fd);
+    shm_unlink(name);
+    errno = saved;
+
+    return NULL;
+}
+
+void el3_shm_ring_unmap(struct el3_shm_ring_header *ring, size_t size)
+{
+    if (ring)
+        munmap(ring, size);
+}
+
+int el3_shm_ring_unlink(const char *name)
+{
+    return shm_unlink(name);
+}
+
+el3_shm_producer *el3_shm_producer_open(const char *name, uint32_t capacity)
+{
+    el3_shm_producer *producer = (el3_shm_producer *) calloc(1, sizeof(*producer));
+
+    if (!producer)
+        return NULL;
+
+    producer->ring = el3_shm_ring_map(name, capacity, &producer->size);
+
+    if (!producer->ring)
+    {
+        int saved = errno;
+
+        free(producer);
+        errno = saved;
+
+        return NULL;
+    }
+
+    /* a restarted producer carries on where the previous one stopped */
+    producer->data = (unsigned char *) (producer->ring + 1);
+    producer->capacity = producer->ring->capacity;
+    producer->head = __atomic_load_n(&producer->ring->head, __ATOMIC_ACQUIRE);
+
+    return producer;
+}
+
+void el3_shm_producer_close(el3_shm_producer *producer)
+{
+    if (!producer)
+        return;
+
+    el3_shm_ring_unmap(producer->ring, producer->size);
+    free(producer);
+}
+
+unsigned char *el3_shm_producer_reserve(el3_shm_producer *producer, size_t len)
+{
+    struct el3_shm_ring_header *ring = producer->ring;
+    uint32_t capacity = producer->capacity;
+    size_t need = sizeof(struct el3_shm_ring_record) + RING_ALIGNED(len);
+    uint64_t tail, head = producer->head;
+    size_t offset = head & (capacity - 1);
+    size_t skip = 0;
+
+    if (len > EL3_SHM_RING_MAX_FRAME || need > capacity)
+    {
+        errno = EMSGSIZE;
+        return NULL;
+    }
+
+    /* records do not wrap, a filler takes what is left at the end */
+    if (capacity - offset < need)
+        skip = capacity - offset;
+
+    tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+    if (head + skip + need - tail > capacity)
+    {
+        __atomic_fetch_add(&ring->dropped, 1, __ATOMIC_RELAXED);
+        errno = EAGAIN;
+        return NULL;
+    }
+
+    if (skip)
+    {
+        struct el3_shm_ring_record *filler = (struct el3_shm_ring_record *) (producer->data + offset);
+
+        memset(filler, 0, sizeof(*filler));
+        filler->length = EL3_SHM_RING_FILLER;
+
+        head += skip;
+        offset = 0;
+    }
+
+    producer->reserved = head;
+    producer->reservedLen = len;
+    producer->pending = 1;
+
+    return producer->data + offset + sizeof(struct el3_shm_ring_record);
+}
+
+void el3_shm_producer_commit(el3_shm_producer *producer, int64_t recv_ns, uint32_t sensor_id,
+    size_t len)
+{
+    struct el3_shm_ring_header *ring = producer->ring;
+    struct el3_shm_ring_record *rec;
+
+    if (!producer->pending)
+        return;
+
+    /* longer than reserved would run into space the consumer may still be reading */
+    if (len > producer->reservedLen)
+    {
+        producer->pending = 0;
+        __atomic_fetch_add(&ring->dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    rec = (struct el3_shm_ring_record *) (producer->data + (producer->reserved & (producer->capacity - 1)));
+    rec->recv_ns = recv_ns;
+    rec->sensor_id = sensor_id;
+    rec->length = len;
+    rec->reserved = 0;
+
+    producer->head = producer->reserved + sizeof(*rec) + RING_ALIGNED(len);
+    producer->pending = 0;
+
+    /* pairs with the consumer setting waiting and then checking head again */
+    __atomic_store_n(&ring->head, producer->head, __ATOMIC_SEQ_CST);
+    __atomic_fetch_add(&ring->seq, 1, __ATOMIC_RELEASE);
+
+    if (__atomic_load_n(&ring->waiting, __ATOMIC_SEQ_CST))
+        syscall(SYS_futex, &ring->seq, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+int el3_shm_producer_write(el3_shm_producer *producer, int64_t recv_ns, uint32_t sensor_id,
+    const unsigned char *frame, size_t len)
+{
+    unsigned char *buf = el3_shm_producer_reserve(producer, len);
+
+    if (!buf)
+        return -1;
+
+    memcpy(buf, frame, len);
+    el3_shm_producer_commit(producer, recv_ns, sensor_id, len);
+
+    return 0;
+}
+
+uint64_t el3_shm_producer_dropped(const el3_shm_producer *producer)
+{
+    return __atomic_load_n(&producer->ring->dropped, __ATOMIC_RELAXED);
+}
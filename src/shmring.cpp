@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2022 Subreption LLC. All rights reserved.
+ * Author: 12dc8242df1be0d6f4b73d68166552197936a27074c004c8af95b27194ec584d
+ *
+ * Dual-licensed under the Subreption Ukraine Defense License (SUDL, version 1) and the  Server Side
+ * Public License (SSPL, version 3). Both licenses are provided with this software distribution.
+ */
+
+#include <el3dec/shmring.hpp>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <linux/futex.h>
+#include <stdexcept>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+using namespace std;
+
+El3ShmRingReader::El3ShmRingReader(const string &name, uint32_t capacity)
+{
+    m_ring = el3_shm_ring_map(name.c_str(), capacity, &m_size);
+
+    if (!m_ring)
+        throw runtime_error("cannot map ring " + name + ": " + strerror(errno));
+
+    m_data = (const unsigned char *) (m_ring + 1);
+    m_capacity = m_ring->capacity;
+    m_corrupt = 0;
+    m_tail = __atomic_load_n(&m_ring->tail, __ATOMIC_ACQUIRE);
+    m_head = __atomic_load_n(&m_ring->head, __ATOMIC_ACQUIRE);
+}
+
+El3ShmRingReader::~El3ShmRingReader()
+{
+    release();
+    el3_shm_ring_unmap(m_ring, m_size);
+}
+
+void El3ShmRingReader::release()
+{
+    if (m_ring->tail != m_tail)
+        __atomic_store_n(&m_ring->tail, m_tail, __ATOMIC_RELEASE);
+}
+
+bool El3ShmRingReader::next(El3CaptureRecord &rec)
+{
+    release();
+
+    for (;;)
+    {
+        /* only touch the producer's cache line once the frames seen so far are consumed */
+        if (m_tail == m_head)
+        {
+            m_head = __atomic_load_n(&m_ring->head, __ATOMIC_ACQUIRE);
+
+            if (m_tail == m_head)
+                return false;
+        }
+
+        size_t offset = m_tail & (m_capacity - 1);
+        const el3_shm_ring_record *hdr = (const el3_shm_ring_record *) (m_data + offset);
+        uint16_t length = __atomic_load_n(&hdr->length, __ATOMIC_RELAXED);
+        uint64_t end;
+
+        if (length == EL3_SHM_RING_FILLER)
+            end = m_tail + m_capacity - offset;
+        else
+            end = m_tail + sizeof(*hdr) + ((length + EL3_SHM_RING_ALIGN - 1) & ~(EL3_SHM_RING_ALIGN - 1));
+
+        /* a record must start aligned and end within the ring and what was published */
+        if (m_head - m_tail > m_capacity || (offset & (EL3_SHM_RING_ALIGN - 1)) ||
+            (length != EL3_SHM_RING_FILLER && sizeof(*hdr) + length > m_capacity - offset) ||
+            end > m_head)
+        {
+            m_corrupt++;
+            m_tail = m_head;
+            continue;
+        }
+
+        m_tail = end;
+
+        if (length == EL3_SHM_RING_FILLER)
+            continue;
+
+        rec.recvNs = hdr->recv_ns;
+        rec.sensorId = hdr->sensor_id;
+        rec.length = length;
+        rec.data = (const unsigned char *) (hdr + 1);
+
+        return true;
+    }
+}
+
+bool El3ShmRingReader::wait(int timeoutMs)
+{
+    uint32_t seq = __atomic_load_n(&m_ring->seq, __ATOMIC_ACQUIRE);
+    struct timespec timeout = { timeoutMs / 1000, (timeoutMs % 1000) * 1000000L };
+
+    /* pairs with the producer publishing head and then checking waiting */
+    __atomic_store_n(&m_ring->waiting, 1, __ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(&m_ring->head, __ATOMIC_SEQ_CST) == m_tail)
+        syscall(SYS_futex, &m_ring->seq, FUTEX_WAIT, seq, &timeout, NULL, 0);
+
+    __atomic_store_n(&m_ring->waiting, 0, __ATOMIC_RELAXED);
+
+    return __atomic_load_n(&m_ring->head, __ATOMIC_ACQUIRE) != m_tail;
+}
+
+uint64_t El3ShmRingReader::dropped() const
+{
+    return __atomic_load_n(&m_ring->dropped, __ATOMIC_RELAXED);
+}
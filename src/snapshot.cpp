@@ -0,0 +1,242 @@
+/*
+ * Copyright (c) 2022 Subreption LLC. All rights reserved.
+ * Author: 12dc8242df1be0d6f4b73d68166552197936a27074c004c8af95b27194ec584d
+ *
+ * Dual-licensed under the Subreption Ukraine Defense License (SUDL, version 1) and the  Server Side
+ * Public License (SSPL, version 3). Both licenses are provided with this software distribution.
+ */
+
+#include <el3dec/snapshot.hpp>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <stdexcept>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+static_assert(sizeof(El3SnapshotHeader) == 128, "snapshot header size");
+static_assert(sizeof(El3TrackEntry) % 8 == 0 && sizeof(El3TrackState) % 8 == 0,
+    "snapshot payload is checksummed in 64-bit words");
+
+#define FNV_OFFSET  0xcbf29ce484222325ull
+#define FNV_PRIME   0x100000001b3ull
+
+static uint64_t checksum(uint64_t hash, const void *buf, size_t len)
+{
+    const unsigned char *p = (const unsigned char *) buf;
+
+    for (size_t i = 0; i < len; i += 8)
+    {
+        uint64_t word;
+
+        memcpy(&word, p + i, sizeof(word));
+        hash = (hash ^ word) * FNV_PRIME;
+    }
+
+    return hash;
+}
+
+static bool writeAll(int fd, const void *buf, size_t len)
+{
+    const char *p = (const char *) buf;
+
+    while (len)
+    {
+        ssize_t n = ::write(fd, p, len);
+
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            return false;
+        }
+
+        p += n;
+        len -= n;
+    }
+
+    return true;
+}
+
+/* what a snapshot is made of, gathered with the state locked; the checksum comes later */
+struct SnapshotImage {
+  El3SnapshotHeader hdr;
+  const El3TrackEntry *tracks;
+  vector<El3TrackState> states;
+  string tmp;
+};
+
+static void prepareSnapshot(const string &path, const El3TrackStore &store, const El3TrackFilter *filter,
+    SnapshotImage &image)
+{
+    struct timespec now;
+    El3SnapshotHeader &hdr = image.hdr;
+
+    if (filter)
+        filter->saveTracks(image.states);
+
+    memset(&hdr, 0, sizeof(hdr));
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    memcpy(hdr.magic, EL3_SNAPSHOT_MAGIC, sizeof(hdr.magic));
+    hdr.version = EL3_SNAPSHOT_VERSION;
+    hdr.headerSize = sizeof(hdr);
+    hdr.entrySize = sizeof(El3TrackEntry);
+    hdr.stateSize = sizeof(El3TrackState);
+    hdr.tracks = store.size();
+    hdr.filterTracks = image.states.size();
+    hdr.createdNs = now.tv_sec * 1000000000ll + now.tv_nsec;
+    hdr.counters = store.counters();
+    hdr.payloadBytes = (uint64_t) hdr.tracks * sizeof(El3TrackEntry) +
+        (uint64_t) hdr.filterTracks * sizeof(El3TrackState);
+
+    image.tracks = store.entries();
+    image.tmp = path + ".tmp";
+}
+
+/* checksum and write a prepared image; allocates nothing, so it is safe in a forked child */
+static bool writeSnapshot(const char *path, SnapshotImage &image)
+{
+    El3SnapshotHeader &hdr = image.hdr;
+    size_t trackBytes = hdr.tracks * sizeof(El3TrackEntry);
+    size_t stateBytes = hdr.filterTracks * sizeof(El3TrackState);
+
+    hdr.checksum = checksum(checksum(FNV_OFFSET, image.tracks, trackBytes), image.states.data(),
+        stateBytes);
+
+    int fd = ::open(image.tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+    if (fd < 0)
+        return false;
+
+    bool ok = writeAll(fd, &hdr, sizeof(hdr)) &&
+        writeAll(fd, image.tracks, trackBytes) &&
+        writeAll(fd, image.states.data(), stateBytes) &&
+        fsync(fd) == 0;
+
+    int saved = errno;
+    ::close(fd);
+
+    if (!ok || rename(image.tmp.c_str(), path) < 0)
+    {
+        saved = ok ? errno : saved;
+        unlink(image.tmp.c_str());
+        errno = saved;
+        return false;
+    }
+
+    return true;
+}
+
+bool el3WriteSnapshot(const string &path, const El3TrackStore &store, const El3TrackFilter *filter)
+{
+    SnapshotImage image;
+
+    prepareSnapshot(path, store, filter, image);
+    return writeSnapshot(path.c_str(), image);
+}
+
+pid_t el3ForkSnapshot(const string &path, const El3TrackStore &store, const El3TrackFilter *filter)
+{
+    SnapshotImage image;
+
+    /* malloc in the child of a multithreaded process may deadlock, everything is allocated here */
+    prepareSnapshot(path, store, filter, image);
+
+    pid_t pid = fork();
+
+    /* the child has a copy-on-write image of the state as it was at fork(), and only this thread */
+    if (pid == 0)
+        _exit(writeSnapshot(path.c_str(), image) ? 0 : 1);
+
+    return pid;
+}
+
+//------------------------------------------------------------------------------
+
+El3SnapshotReader::El3SnapshotReader(const string &path):
+    m_map(NULL), m_size(0), m_header(NULL), m_tracks(NULL), m_filterTracks(NULL)
+{
+    struct stat st;
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0)
+        throw runtime_error("cannot open snapshot (" + path + "): " + strerror(errno));
+
+    if (fstat(fd, &st) < 0 || (size_t) st.st_size < sizeof(El3SnapshotHeader))
+    {
+        ::close(fd);
+        throw runtime_error("not a snapshot (" + path + ")");
+    }
+
+    m_size = st.st_size;
+    m_map = mmap(NULL, m_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    ::close(fd);
+
+    if (m_map == MAP_FAILED)
+    {
+        m_map = NULL;
+        throw runtime_error("cannot map snapshot (" + path + "): " + strerror(errno));
+    }
+
+    const unsigned char *base = (const unsigned char *) m_map;
+    const El3SnapshotHeader *hdr = (const El3SnapshotHeader *) base;
+    const char *invalid = NULL;
+
+    uint64_t trackBytes = (uint64_t) hdr->tracks * sizeof(El3TrackEntry);
+    uint64_t stateBytes = (uint64_t) hdr->filterTracks * sizeof(El3TrackState);
+
+    if (memcmp(hdr->magic, EL3_SNAPSHOT_MAGIC, sizeof(hdr->magic)))
+        invalid = "not a snapshot";
+    else if (hdr->version != EL3_SNAPSHOT_VERSION || hdr->headerSize != sizeof(El3SnapshotHeader))
+        invalid = "unsupported snapshot version";
+    else if (hdr->entrySize != sizeof(El3TrackEntry) || hdr->stateSize != sizeof(El3TrackState))
+        invalid = "snapshot written by an incompatible build";
+    else if (hdr->payloadBytes != trackBytes + stateBytes ||
+            sizeof(El3SnapshotHeader) + hdr->payloadBytes != m_size)
+        invalid = "truncated snapshot";
+    else if (checksum(FNV_OFFSET, base + sizeof(El3SnapshotHeader), hdr->payloadBytes) != hdr->checksum)
+        invalid = "corrupted snapshot";
+
+    if (!invalid)
+    {
+        m_tracks = (const El3TrackEntry *) (base + sizeof(El3SnapshotHeader));
+        m_filterTracks = (const El3TrackState *) (base + sizeof(El3SnapshotHeader) + trackBytes);
+
+        /* the checksum only vouches for what was written, not that it makes sense */
+        for (uint32_t i = 0; i < hdr->tracks && !invalid; i++)
+        {
+            if (m_tracks[i].count > EL3_TRACK_HISTORY || m_tracks[i].next >= EL3_TRACK_HISTORY)
+                invalid = "inconsistent snapshot";
+        }
+    }
+
+    if (invalid)
+    {
+        munmap(m_map, m_size);
+        m_map = NULL;
+        throw runtime_error(string(invalid) + " (" + path + ")");
+    }
+
+    m_header = hdr;
+}
+
+El3SnapshotReader::~El3SnapshotReader()
+{
+    if (m_map)
+        munmap(m_map, m_size);
+}
+
+void El3SnapshotReader::restore(El3TrackStore &store, El3TrackFilter *filter) const
+{
+    store.restore(m_tracks, m_header->tracks, m_header->counters);
+
+    if (filter)
+        filter->restoreTracks(m_filterTracks, m_header->filterTracks);
+}
@@ -8,6 +8,7 @@
 
 #include <el3dec/lib.hpp>
 #include <el3dec/telemetry.hpp>
+#include <el3dec/trace.hpp>
 #include <el3dec/utils.hpp>
 #include "rapidjson/document.h"
 #include "rapidjson/writer.h"
@@ -47,6 +48,9 @@ El3Telemetry::El3Telemetry(const unsigned char *buf, const size_t len, El3DecOpM
 
     videoTxFreq      = 0;
 
+    trackVerdict     = TRACK_UNCHECKED;
+    trackConfidence  = 0.0;
+
     memset(&camera, 0, sizeof(struct El3CameraSetting));
     memset(&gpsData, 0, sizeof(struct GpsLocation));
 
@@ -66,6 +70,127 @@ bool El3Telemetry::checkReadBufferSanity(size_t offset, size_t toread)
     return true;
 }
 
+/*
+ * Field unpacking, shared by the checked and the full length decoders so both give the same
+ * results bit for bit.
+ */
+static inline float unpack_coordinate(const unsigned char *buf, size_t off, size_t msboff, int bitshift)
+{
+    unsigned int coord_int;
+
+    /* extract the MSB for the given coordinate */
+    coord_int = ((buf[msboff] >> bitshift) & 0x7);
+    if (coord_int & 4)
+        coord_int |= -8;
+
+    coord_int <<= 24;
+    coord_int |= (buf[off] << 16) + (buf[off+1] << 8) + buf[off+2];
+
+    return (float) coord_int / 6e5;
+}
+
+static inline uint16_t unpack_altitude(const unsigned char *buf, size_t off)
+{
+    uint16_t altitude = ((buf[off] << 8) + buf[off + 1]);
+
+    if (altitude >= std::pow(2, 15))
+        altitude -= std::pow(2, 16);
+
+    return altitude;
+}
+
+/* similar to how coordinates are handled */
+static inline float unpack_speed(const unsigned char *buf, size_t off)
+{
+    return (buf[off] + ((buf[off + 1] & 0xf0) << 4)) * 0.25;
+}
+
+static inline float unpack_careen(const unsigned char *buf, size_t off)
+{
+    return (((buf[off + 1] & 0x0f) << 8) + buf[off + 2]) * 0.25;
+}
+
+static inline float unpack_pitch(const unsigned char *buf, size_t off)
+{
+    int tmpint = (buf[off + 1] >> 4);
+
+    if (tmpint & 8)
+        tmpint |= -0x10;
+
+    tmpint <<= 8;
+    tmpint |= buf[off];
+
+    return ((float) tmpint) / 10.0;
+}
+
+static inline float unpack_camera_angle(const unsigned char *buf, size_t off)
+{
+    return (((buf[off + 1] & 0xe0) << 3) + buf[off]) / 20.0;
+}
+
+static inline float unpack_camera_position(const unsigned char *buf, size_t off)
+{
+    int tmpint = buf[off + 1] & 0x0f;
+
+    if (tmpint & 8)
+        tmpint |= -0x10;
+
+    tmpint <<= 8;
+    tmpint |= buf[off + 2];
+
+    return (float) tmpint / 10.0;
+}
+
+static inline float unpack_camera_azimuth(const unsigned char *buf, size_t off)
+{
+    int tmpint = buf[off + 1] & 0xf0;
+
+    if (tmpint & 0x80)
+        tmpint |= -0x100;
+
+    tmpint <<= 4;
+    tmpint |= buf[off];
+
+    return (float) tmpint / 10.0;
+}
+
+/* one decoder per packet type byte, the active layout's or the header-only one */
+struct El3LayoutEntry {
+  void (El3Telemetry::*parse)();
+  uint8_t version;
+};
+
+struct El3LayoutTable {
+  El3LayoutEntry entries[256];
+
+  template <typename... Layouts>
+  constexpr El3LayoutTable(El3LayoutList<Layouts...>): entries() {
+    for (El3LayoutEntry &entry: entries)
+      entry = { &El3Telemetry::parseHeaderOnly, 0 };
+
+    ((entries[Layouts::packetType] = { &El3Telemetry::parseLayout<Layouts>, Layouts::version }), ...);
+  }
+
+  template <typename... Layouts>
+  bool select(uint8_t packetType, uint8_t version, El3LayoutList<Layouts...>) {
+    return ((Layouts::packetType == packetType && Layouts::version == version &&
+      (entries[packetType] = { &El3Telemetry::parseLayout<Layouts>, version }, true)) || ...);
+  }
+};
+
+/* constant initialized, the offsets and decoders are all known at compile time */
+static El3LayoutTable el3_layouts{El3Layouts()};
+
+bool el3SelectLayout(uint8_t packetType, uint8_t version)
+{
+    return el3_layouts.select(packetType, version, El3Layouts());
+}
+
+uint8_t el3LayoutVersion(uint8_t packetType)
+{
+    return el3_layouts.entries[packetType].version;
+}
+
 /*
  * Length verifications:
  * Could have used a macro or helper but in order to avoid obscuring the process and making this a
@@ -80,18 +205,18 @@ void El3Telemetry::parseRaw()
     if (m_origlen < 3)
         throw invalid_argument("invalid packet (no header)");
 
-    m_readxfer += get_byte_from_buf(m_origbuf, 0, &magicByte);
+    m_readxfer += get_byte_from_buf(m_origbuf, EL3_HEADER_MAGIC, &magicByte);
 
     if (magicByte != ENICS_ELERON_PACKET_MAGICBYTE)
         throw invalid_argument("invalid packet (magic byte missing)");
 
-    m_readxfer += get_byte_from_buf(m_origbuf, 1, &dataLength);
+    m_readxfer += get_byte_from_buf(m_origbuf, EL3_HEADER_LENGTH, &dataLength);
 
     /* we do not put any implicit trust in the packet length field, but check sanity */
     if (!dataLength || dataLength > m_origlen)
         throw invalid_argument(exc_invalid_packet_length);
 
-    m_readxfer += get_byte_from_buf(m_origbuf, 2, &typeval);
+    m_readxfer += get_byte_from_buf(m_origbuf, EL3_HEADER_TYPE, &typeval);
 
     engineType  = typeval >> 5;
     uavType     = typeval & 0x1F;
@@ -101,125 +226,136 @@ void El3Telemetry::parseRaw()
         throw invalid_argument(exc_invalid_packet_length);
 
     /* UAV ID number (16-bit) */
-    m_readxfer += get_be_u16_from_buf(m_origbuf, 3, &uavNo);
+    m_readxfer += get_be_u16_from_buf(m_origbuf, EL3_HEADER_UAV, &uavNo);
 
     /* packet type */
-    m_readxfer += get_byte_from_buf(m_origbuf, 5, &packetType);
+    m_readxfer += get_byte_from_buf(m_origbuf, EL3_HEADER_PACKET_TYPE, &packetType);
 
-    /* We are handling a telemetry packet: unpack the data */
-    if (packetType == ENICS_ELERON_PACKET_TELEMETRY)
+    /* unpack the body with the layout registered for this packet type, if any */
+    (this->*el3_layouts.entries[packetType].parse)();
+
+    parsingDone();
+}
+
+template <typename L>
+void El3Telemetry::parseLayout()
+{
+    if (m_origlen >= L::fullLength)
     {
-        parseTimestamp();
-        parseFlightData();
-        parseVideoParams();
+        parseFull<L>();
+        return;
     }
 
-    parsingDone();
+    parseTimestamp<L>();
+    parseFlightData<L>();
+    parseVideoParams<L>();
 }
 
-void El3Telemetry::parseTimestamp()
+/* every field is within the frame: no length checks, offsets are constants */
+template <typename L>
+void El3Telemetry::parseFull()
 {
-    /* timestamp occupies 3 consecutive bytes */
-    if (m_origlen - m_readxfer < sizeof(uint8_t) * 3)
-        throw invalid_argument(exc_invalid_packet_length);
+    const unsigned char *buf = m_origbuf;
 
-    /* stamp is UTC */
-    m_readxfer += get_byte_from_buf(m_origbuf, 6, &stampHours);
-    m_readxfer += get_byte_from_buf(m_origbuf, 7, &stampMinutes);
-    m_readxfer += get_byte_from_buf(m_origbuf, 8, &stampSeconds);
+    stampHours = buf[L::stamp] & 0x1f;
+    stampMinutes = buf[L::stamp + 1] & 0x3f;
+    stampSeconds = buf[L::stamp + 2] & 0x3f;
+    flightTime = (buf[L::flightTime] << 8) | buf[L::flightTime + 1];
 
-    stampHours &= 31;
-    stampMinutes &= 61;
-    stampSeconds &= 61;
+    gpsData.latitude = unpack_coordinate(buf, L::latitude, L::coordinateMsb, L::latitudeShift);
+    gpsData.longitude = unpack_coordinate(buf, L::longitude, L::coordinateMsb, L::longitudeShift);
+    gpsData.altitude = unpack_altitude(buf, L::altitude);
 
-    /* flight time is another uint16_t in big-endian */
-    if (checkReadBufferSanity(9, sizeof(uint16_t)))
-        m_readxfer += get_be_u16_from_buf(m_origbuf, 9, &flightTime);
+    groundSpeed = unpack_speed(buf, L::speedCareen);
+    careen = unpack_careen(buf, L::speedCareen);
+    pitch = unpack_pitch(buf, L::pitch);
+
+    remainingMinutes = buf[L::remainingMinutes] | (buf[L::remainingMinutes + 1] << 8);
+
+    videoTxChannel = buf[L::videoChannel] & 0x0f;
+    videoTxFreq = 1205 + videoTxChannel * 3;
+
+    if (m_opmode == FAULT_INTOLERANT && (videoTxFreq < 1205 || videoTxFreq > 1248))
+        throw invalid_argument("video tx frequency out of spec, bogus data?");
+
+    camera.angle = unpack_camera_angle(buf, L::cameraAngle);
+    camera.position = unpack_camera_position(buf, L::azimuthPosition);
+    camera.azimuth = unpack_camera_azimuth(buf, L::azimuthPosition);
+
+    m_readxfer = L::fullLength;
 }
 
-float El3Telemetry::getPackedCoordinate(size_t off, size_t msboff, int bitshift)
+template <typename L>
+void El3Telemetry::parseTimestamp()
 {
-    float retval;
-    unsigned int coord_int;
-
-    /* extract the MSB for the given coordinate */
-    coord_int = ((m_origbuf[msboff] >> bitshift) & 0x7);
-    if (coord_int & 4)
-        coord_int |= -8;
+    /* timestamp occupies 3 consecutive bytes */
+    if (m_origlen - m_readxfer < sizeof(uint8_t) * 3)
+        throw invalid_argument(exc_invalid_packet_length);
 
-    coord_int <<= 24;
-    coord_int |= (m_origbuf[off] << 16) + (m_origbuf[off+1] << 8) + m_origbuf[off+2];
-    retval = (float) coord_int / 6e5;
+    /* stamp is UTC */
+    m_readxfer += get_byte_from_buf(m_origbuf, L::stamp, &stampHours);
+    m_readxfer += get_byte_from_buf(m_origbuf, L::stamp + 1, &stampMinutes);
+    m_readxfer += get_byte_from_buf(m_origbuf, L::stamp + 2, &stampSeconds);
 
-    /* we dont register the MSB byte yet, do it in the caller when done */
-    m_readxfer += 3;
+    /* the upper bits carry flags, which 0x3d used to clear along with bit 1 of the actual value */
+    stampHours &= 0x1f;
+    stampMinutes &= 0x3f;
+    stampSeconds &= 0x3f;
 
-    return retval;
+    /* flight time is another uint16_t in big-endian */
+    if (checkReadBufferSanity(L::flightTime, sizeof(uint16_t)))
+        m_readxfer += get_be_u16_from_buf(m_origbuf, L::flightTime, &flightTime);
 }
 
+template <typename L>
 void El3Telemetry::parseFlightData()
 {
-    int tmpint;
-
     /* coordinates are packed with MSB in one single integer, floats with LSB in their own ints */
     if (m_origlen - m_readxfer < (sizeof(uint32_t) * 2) - 1)
         throw invalid_argument(exc_invalid_packet_length);
 
-    gpsData.latitude    = getPackedCoordinate(0xb, 0xe, 5);
-    gpsData.longitude   = getPackedCoordinate(0xf, 0xe, 0);
+    gpsData.latitude    = unpack_coordinate(m_origbuf, L::latitude, L::coordinateMsb, L::latitudeShift);
+    gpsData.longitude   = unpack_coordinate(m_origbuf, L::longitude, L::coordinateMsb, L::longitudeShift);
 
-    /* account for MSB byte for the gps coordinates */
-    m_readxfer += 1;
+    /* both coordinates, and their MSB byte */
+    m_readxfer += 3 + 3 + 1;
 
     /* verify altitude field is present */
     if (m_origlen - m_readxfer < sizeof(uint16_t))
         throw invalid_argument(exc_invalid_packet_length);
 
     /* unpack altitude in meters */
-    gpsData.altitude = ((m_origbuf[0x1f] << 8) + m_origbuf[0x20]);
-    if (gpsData.altitude >= std::pow(2, 15))
-        gpsData.altitude -= std::pow(2, 16);
-
+    gpsData.altitude = unpack_altitude(m_origbuf, L::altitude);
     m_readxfer += 2;
 
     /* We are ignoring some fields, in-between.
      * Therefore, maximize the amount of unpacked data by checking we can read far enough into
      * the buffer. Offsets suffice for that.
      */
-    if (checkReadBufferSanity(0x12, 0x20 - 0x12))
+    if (checkReadBufferSanity(L::speedCareen, L::altitude + 1 - L::speedCareen))
     {
-        
-        /* similar to how coordinates are handled */
-        groundSpeed = (m_origbuf[0x12] + ((m_origbuf[0x13] & 0xf0) << 4)) * 0.25;
-        careen = (((m_origbuf[0x13] & 0x0f) << 8) + m_origbuf[0x14]) * 0.25;
+        groundSpeed = unpack_speed(m_origbuf, L::speedCareen);
+        careen = unpack_careen(m_origbuf, L::speedCareen);
         m_readxfer += 3;
 
-        /* unpack the pitch */
-        tmpint = (m_origbuf[0x19] >> 4);
-        if (tmpint & 8)
-            tmpint |= -0x10;
-
-        tmpint <<= 8;
-        tmpint |= m_origbuf[0x18];
-        pitch = ((float) tmpint) / 10.0;
+        pitch = unpack_pitch(m_origbuf, L::pitch);
         m_readxfer += 2;
     }
 
-    if (checkReadBufferSanity(0x32, sizeof(uint16_t)))
-        m_readxfer += get_u16_from_buf(m_origbuf, 0x32, &remainingMinutes);
+    if (checkReadBufferSanity(L::remainingMinutes, sizeof(uint16_t)))
+        m_readxfer += get_u16_from_buf(m_origbuf, L::remainingMinutes, &remainingMinutes);
 }
 
+template <typename L>
 void El3Telemetry::parseVideoParams()
 {
-    int tmpint;
-
     /* Frequency should stay within the DVB-T transmitter's capabilities:
      * - The bandpass filter (Mini Circuits CSBP-1228) limits operations to 1203-1253MHz.
      * - Maximum ceiling with DTC D681 downcoverter is 1-1.5GHz.
      */
-    if (checkReadBufferSanity(0x44, sizeof(uint8_t)))
+    if (checkReadBufferSanity(L::videoChannel, sizeof(uint8_t)))
     {
-        videoTxChannel = m_origbuf[0x44] & 0x0f;
+        videoTxChannel = m_origbuf[L::videoChannel] & 0x0f;
         videoTxFreq = 1205 + videoTxChannel * 3;
 
         /* Verify frequency is within spec */
@@ -232,133 +368,137 @@ void El3Telemetry::parseVideoParams()
     }
 
     /* Read-through to the end of the expected position of camera state information */
-    if (m_origlen > 0x50 && checkReadBufferSanity(0x3d, 19))
+    if (m_origlen > L::azimuthPosition + 2 &&
+        checkReadBufferSanity(L::cameraAngle, L::azimuthPosition + 2 - L::cameraAngle))
     {
-        camera.angle = (((m_origbuf[0x3e] & 0xe0) << 3) + m_origbuf[0x3d]) / 20.0;
+        camera.angle = unpack_camera_angle(m_origbuf, L::cameraAngle);
+        camera.position = unpack_camera_position(m_origbuf, L::azimuthPosition);
+        camera.azimuth = unpack_camera_azimuth(m_origbuf, L::azimuthPosition);
+    }
+}
 
-        tmpint = m_origbuf[0x4f] & 0x0f;
-        if (tmpint & 8)
-            tmpint |= -0x10;
+struct El3SinkSlot {
+  El3SinkFn fn;
+  void *ctx;
+};
 
-        tmpint <<= 8;
-        tmpint |= m_origbuf[0x50];
-        camera.position = (float) tmpint / 10.0;
+/* constant initialized, so sinks set from static constructors are never overwritten */
+static El3SinkSlot el3_sinks[256];
 
-        /* azimuth unpacking */
-        tmpint = m_origbuf[0x4f] & 0xf0;
-        if (tmpint & 0x80)
-            tmpint |= -0x100;
+void el3SetSink(uint8_t packetType, El3SinkFn fn, void *ctx)
+{
+    el3_sinks[packetType].fn = fn;
+    el3_sinks[packetType].ctx = fn ? ctx : NULL;
+}
 
-        tmpint <<= 4;
-        tmpint |= m_origbuf[0x4e];
-        camera.azimuth = (float) tmpint / 10.0;
-    }
+void el3ClearSinks()
+{
+    memset(el3_sinks, 0, sizeof(el3_sinks));
 }
 
-void El3Telemetry::parsingDone()
+void el3PrintSink(const El3Telemetry &telemetry, void *ctx)
 {
-#ifdef DEBUG
-    printf(
+    FILE *out = ctx ? (FILE *) ctx : stdout;
+
+    fprintf(out,
         "PACKET: TYPE=%d ENGINE=%d UAV_TYPE=%d ID=%d LAT/LON=%f/%f (ALT=%u) SPEED=%f TIME=%d:%d:%d\n"
         "  Flight time: %d\n"
         "  Careen: %f\n"
         "  Minutes remaining: %d\n"
         "  Video: channel %d, freq=%uMHz\n",
-        packetType, engineType, uavType, uavNo,
-        gpsData.latitude, gpsData.longitude, gpsData.altitude, groundSpeed,
-        stampHours, stampMinutes, stampSeconds,
-        flightTime,
-        careen,
-        remainingMinutes,
-        videoTxChannel, videoTxFreq
+        telemetry.PacketType(), telemetry.EngineType(), telemetry.Type(), telemetry.ID(),
+        telemetry.Latitude(), telemetry.Longitude(), (unsigned) telemetry.Altitude(),
+        telemetry.Groundspeed(),
+        telemetry.StampHours(), telemetry.StampMinutes(), telemetry.StampSeconds(),
+        telemetry.FlightTime(),
+        telemetry.Careen(),
+        telemetry.RemainingFlightMinutes(),
+        telemetry.VideoChannel(), (unsigned) telemetry.VideoFreq()
         );
-#endif
-
-    /* Place your callbacks here if needed */
 }
 
-std::string El3Telemetry::toJson(bool pretty)
-{
-    rapidjson::Document d;
-    d.SetObject();
-
-    rapidjson::Document::AllocatorType& allocator = d.GetAllocator();
-
-    size_t sz = allocator.Size();
-
-    d.AddMember("el3dec_version",   EL3DEC_VERSION, allocator);
-    d.AddMember("packet_type",      packetType,     allocator);
-    d.AddMember("engine_type",      engineType,     allocator);
-    d.AddMember("uav_type",         uavType,        allocator);
-    d.AddMember("uav_id",           uavNo,          allocator);
-
-    if (flightTime)
-        d.AddMember("flight_time", flightTime, allocator);
-
-    if (remainingMinutes)
-        d.AddMember("remaining_min", remainingMinutes, allocator);
-
-    if (careen)
-        d.AddMember("careen", careen, allocator);
-
-    if (pitch)
-        d.AddMember("pitch", pitch, allocator);
-
-    if (stampHours && stampMinutes && stampSeconds)
-    {
-        rapidjson::Value time_obj(rapidjson::kObjectType);
-
-        time_obj.AddMember("hours",      stampHours,     allocator);
-        time_obj.AddMember("minutes",    stampMinutes,   allocator);
-        time_obj.AddMember("seconds",    stampSeconds,   allocator);
-
-        d.AddMember("timestamp", time_obj, allocator);
-    }
+#ifdef DEBUG
+/* debug builds print every packet, as parsingDone() always did */
+static struct El3DebugSink {
+  El3DebugSink() {
+    for (int type = 0; type < 256; type++)
+      el3SetSink(type, el3PrintSink, NULL);
+  }
+} el3_debug_sink;
+#endif
 
-    if (gpsData.latitude && gpsData.longitude && gpsData.altitude)
-    {
-        rapidjson::Value gps_obj(rapidjson::kObjectType);
+void El3Telemetry::parsingDone()
+{
+    const El3SinkSlot &slot = el3_sinks[packetType];
 
-        gps_obj.AddMember("latitude",   gpsData.latitude,   allocator);
-        gps_obj.AddMember("longitude",  gpsData.longitude,  allocator);
-        gps_obj.AddMember("altitude",   gpsData.altitude,   allocator);
-        gps_obj.AddMember("speed",      groundSpeed,        allocator);
+    if (slot.fn)
+        slot.fn(*this, slot.ctx);
 
-        d.AddMember("gps", gps_obj, allocator);
-    }
+    el3TraceMark(TRACE_DECODE);
+}
 
-    if (videoTxChannel && videoTxFreq)
+const char *el3TrackVerdictName(El3TrackVerdict verdict)
+{
+    switch (verdict)
     {
-        rapidjson::Value video_obj(rapidjson::kObjectType);
-
-        video_obj.AddMember("tx_freq",  videoTxFreq,        allocator);
-        video_obj.AddMember("tx_chan",  videoTxChannel,     allocator);
-
-        d.AddMember("video", video_obj, allocator);
+        case TRACK_NEW:         return "new";
+        case TRACK_CONSISTENT:  return "consistent";
+        case TRACK_SUSPECT:     return "suspect";
+        case TRACK_GLITCH:      return "glitch";
+        default:                return "unchecked";
     }
+}
 
-    if (camera.angle && camera.azimuth  && camera.position)
-    {
-        rapidjson::Value cam_obj(rapidjson::kObjectType);
-
-        cam_obj.AddMember("angle",    camera.angle,       allocator);
-        cam_obj.AddMember("azimuth",  camera.azimuth,     allocator);
-        cam_obj.AddMember("pos",      camera.position,    allocator);
+El3TelemetryRecord El3Telemetry::Record() const
+{
+    El3TelemetryRecord rec;
+
+    /* records are written out raw, keep the padding deterministic */
+    memset(&rec, 0, sizeof(rec));
+
+    rec.packetType       = packetType;
+    rec.engineType       = engineType;
+    rec.uavType          = uavType;
+    rec.uavNo            = uavNo;
+    rec.flightTime       = flightTime;
+    rec.stampHours       = stampHours;
+    rec.stampMinutes     = stampMinutes;
+    rec.stampSeconds     = stampSeconds;
+    rec.gpsData          = gpsData;
+    rec.groundSpeed      = groundSpeed;
+    rec.careen           = careen;
+    rec.pitch            = pitch;
+    rec.remainingMinutes = remainingMinutes;
+    rec.videoTxChannel   = videoTxChannel;
+    rec.videoTxFreq      = videoTxFreq;
+    rec.camera           = camera;
+    rec.trackVerdict     = trackVerdict;
+    rec.trackConfidence  = trackConfidence;
+
+    return rec;
+}
 
-        d.AddMember("camera", cam_obj, allocator);
-    }
+std::string El3Telemetry::toJson(bool pretty)
+{
+    /* per thread scratch: after the first call only the returned string allocates */
+    static thread_local rapidjson::StringBuffer strbuf;
+    static thread_local rapidjson::Writer<rapidjson::StringBuffer> writer(strbuf);
+    static thread_local rapidjson::PrettyWriter<rapidjson::StringBuffer> prettyWriter(strbuf);
 
-    rapidjson::StringBuffer strbuf;
+    strbuf.Clear();
 
     if (!pretty) {
-        rapidjson::Writer<rapidjson::StringBuffer> writer(strbuf);
-        d.Accept(writer);
+        writer.Reset(strbuf);
+        el3WriteJson(Record(), writer);
     } else {
-         rapidjson::PrettyWriter<rapidjson::StringBuffer> writer(strbuf);
-        d.Accept(writer);
+        prettyWriter.Reset(strbuf);
+        el3WriteJson(Record(), prettyWriter);
     }
 
-    return strbuf.GetString();
+    std::string json(strbuf.GetString(), strbuf.GetSize());
+
+    el3TraceMark(TRACE_JSON);
+    return json;
 }
 
 El3Telemetry::~El3Telemetry() {
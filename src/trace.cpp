@@ -0,0 +1,230 @@
+/*
+ * Copyright (c) 2022 Subreption LLC. All rights reserved.
+ * Author: 12dc8242df1be0d6f4b73d68166552197936a27074c004c8af95b27194ec584d
+ *
+ * Dual-licensed under the Subreption Ukraine Defense License (SUDL, version 1) and the  Server Side
+ * Public License (SSPL, version 3). Both licenses are provided with this software distribution.
+ */
+
+#include <el3dec/trace.hpp>
+#include "rapidjson/stringbuffer.h"
+#include "rapidjson/writer.h"
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <time.h>
+#include <algorithm>
+#include <fstream>
+#include <mutex>
+#include <vector>
+
+using namespace std;
+
+/* spans kept per thread, the oldest are overwritten */
+#define TRACE_BUFFER_EVENTS     4096
+
+struct El3TraceEvent {
+  uint64_t start;
+  uint64_t end;
+  uint32_t packet;
+  uint8_t stage;
+};
+
+struct El3TraceBuffer {
+  atomic<uint64_t> head;    /* spans ever written */
+  atomic<uint64_t> floor;   /* spans before this one were cleared */
+  uint32_t tid;
+  El3TraceEvent events[TRACE_BUFFER_EVENTS];
+};
+
+atomic<uint32_t> el3_trace_period(0);
+
+static atomic<uint32_t> el3_trace_packets(0);
+
+/* buffers outlive their threads, spans of a thread that exited still get exported */
+static mutex el3_trace_buffers_mutex;
+static vector<El3TraceBuffer *> el3_trace_buffers;
+static thread_local El3TraceBuffer *el3_trace_buffer;
+
+/* clock reading at a known CLOCK_MONOTONIC time, to convert spans at export */
+static uint64_t el3_trace_origin_clock;
+static uint64_t el3_trace_origin_ns;
+
+static uint64_t monotonicNs()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static struct El3TraceOrigin {
+  El3TraceOrigin() {
+    el3_trace_origin_clock = el3TraceClock();
+    el3_trace_origin_ns = monotonicNs();
+  }
+} el3_trace_origin;
+
+const char *el3TraceStageName(El3TraceStage stage)
+{
+    switch (stage)
+    {
+        case TRACE_READ:    return "read";
+        case TRACE_UNHEX:   return "unhex";
+        case TRACE_CAPTURE: return "capture";
+        case TRACE_SCREEN:  return "screen";
+        case TRACE_DECODE:  return "decode";
+        case TRACE_TRACK:   return "track";
+        case TRACE_LOG:     return "log";
+        case TRACE_JSON:    return "json";
+        case TRACE_WRITE:   return "write";
+        default:            return "unknown";
+    }
+}
+
+void el3TraceSampling(uint32_t period)
+{
+    el3_trace_period.store(period, memory_order_relaxed);
+}
+
+void el3TraceSample()
+{
+    El3TraceThread &t = el3_trace_thread;
+    uint32_t period = el3_trace_period.load(memory_order_relaxed);
+
+    if (t.countdown == 0 || t.countdown > period)
+        t.countdown = period;
+
+    if (--t.countdown)
+        return;
+
+    t.countdown = period;
+    t.packet = el3_trace_packets.fetch_add(1, memory_order_relaxed) + 1;
+
+    /* 0 means untraced */
+    if (!t.packet)
+        t.packet = el3_trace_packets.fetch_add(1, memory_order_relaxed) + 1;
+
+    t.active = true;
+    t.last = el3TraceClock();
+}
+
+void el3TraceRecord(uint32_t packet, El3TraceStage stage, uint64_t start, uint64_t end)
+{
+    El3TraceBuffer *buf = el3_trace_buffer;
+
+    if (!buf)
+    {
+        buf = new El3TraceBuffer();
+        buf->tid = syscall(SYS_gettid);
+
+        lock_guard<mutex> guard(el3_trace_buffers_mutex);
+        el3_trace_buffers.push_back(buf);
+        el3_trace_buffer = buf;
+    }
+
+    uint64_t head = buf->head.load(memory_order_relaxed);
+    El3TraceEvent &ev = buf->events[head % TRACE_BUFFER_EVENTS];
+
+    ev.start = start;
+    ev.end = end;
+    ev.packet = packet;
+    ev.stage = stage;
+
+    buf->head.store(head + 1, memory_order_release);
+}
+
+/*
+ * Copy out a buffer's spans. Those the writer lapped while copying are dropped, counting the one
+ * it may be writing right now.
+ */
+static void collect(El3TraceBuffer *buf, vector<El3TraceEvent> &out)
+{
+    uint64_t head = buf->head.load(memory_order_acquire);
+    uint64_t from = max(buf->floor.load(memory_order_relaxed),
+        head > TRACE_BUFFER_EVENTS ? head - TRACE_BUFFER_EVENTS : 0);
+    size_t first = out.size();
+
+    for (uint64_t i = from; i < head; i++)
+        out.push_back(buf->events[i % TRACE_BUFFER_EVENTS]);
+
+    uint64_t after = buf->head.load(memory_order_acquire) + 1;
+
+    if (after > from + TRACE_BUFFER_EVENTS)
+    {
+        size_t lapped = min<uint64_t>(after - from - TRACE_BUFFER_EVENTS, head - from);
+        out.erase(out.begin() + first, out.begin() + first + lapped);
+    }
+}
+
+string el3TraceJson()
+{
+    vector<El3TraceBuffer *> buffers;
+
+    {
+        lock_guard<mutex> guard(el3_trace_buffers_mutex);
+        buffers = el3_trace_buffers;
+    }
+
+    /* clock ticks per nanosecond, measured over the process lifetime */
+    uint64_t ticks = el3TraceClock() - el3_trace_origin_clock;
+    uint64_t ns = monotonicNs() - el3_trace_origin_ns;
+    double nsPerTick = ticks && ns ? (double) ns / ticks : 1.0;
+
+    rapidjson::StringBuffer strbuf;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(strbuf);
+    vector<El3TraceEvent> events;
+    int pid = getpid();
+
+    writer.StartObject();
+    writer.Key("displayTimeUnit");  writer.String("ns");
+    writer.Key("traceEvents");
+    writer.StartArray();
+
+    for (auto buf : buffers)
+    {
+        events.clear();
+        collect(buf, events);
+
+        for (auto &ev : events)
+        {
+            /* Chrome wants microseconds */
+            double ts = (int64_t) (ev.start - el3_trace_origin_clock) * nsPerTick / 1000.0;
+            double dur = (ev.end - ev.start) * nsPerTick / 1000.0;
+
+            writer.StartObject();
+            writer.Key("name");     writer.String(el3TraceStageName((El3TraceStage) ev.stage));
+            writer.Key("cat");      writer.String("el3dec");
+            writer.Key("ph");       writer.String("X");
+            writer.Key("ts");       writer.Double(ts);
+            writer.Key("dur");      writer.Double(dur);
+            writer.Key("pid");      writer.Int(pid);
+            writer.Key("tid");      writer.Uint(buf->tid);
+            writer.Key("args");
+            writer.StartObject();
+            writer.Key("packet");   writer.Uint(ev.packet);
+            writer.EndObject();
+            writer.EndObject();
+        }
+    }
+
+    writer.EndArray();
+    writer.EndObject();
+
+    return string(strbuf.GetString(), strbuf.GetSize());
+}
+
+bool el3TraceDump(const string &path)
+{
+    ofstream out(path, ios::binary | ios::trunc);
+
+    out << el3TraceJson();
+    return out.good();
+}
+
+void el3TraceClear()
+{
+    lock_guard<mutex> guard(el3_trace_buffers_mutex);
+
+    for (auto buf : el3_trace_buffers)
+        buf->floor.store(buf->head.load(memory_order_acquire), memory_order_relaxed);
+}
@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) 2022 Subreption LLC. All rights reserved.
+ * Author: 12dc8242df1be0d6f4b73d68166552197936a27074c004c8af95b27194ec584d
+ *
+ * Dual-licensed under the Subreption Ukraine Defense License (SUDL, version 1) and the  Server Side
+ * Public License (SSPL, version 3). Both licenses are provided with this software distribution.
+ */
+
+#include <el3dec/trackfilter.hpp>
+#include <el3dec/utils.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+using namespace std;
+
+static const double earth_radius_m = 6371008.8;
+static const double deg2rad = M_PI / 180.0;
+
+/* glitches in a row needed (besides reanchorSeconds) before a track is started over */
+#define EL3_TRACK_REANCHOR_GLITCHES 3
+
+/* movement below this is GPS noise and says nothing about the course */
+#define EL3_TRACK_MIN_COURSE_M      5.0
+
+El3TrackFilter::El3TrackFilter(const El3TrackFilterConfig &config):
+    m_config(config)
+{
+}
+
+El3TrackVerdict El3TrackFilter::score(uint16_t uavNo, uint16_t flightTime, double latitude,
+    double longitude, float groundSpeed, float careen, float *confidence)
+{
+    *confidence = 0.0;
+
+    /* no fix at all */
+    if (!latitude && !longitude)
+        return TRACK_UNCHECKED;
+
+    unordered_map<uint16_t, Track>::iterator it = m_tracks.find(uavNo);
+
+    if (it == m_tracks.end())
+    {
+        Track track = { false, 0, flightTime, latitude, longitude, careen };
+
+        m_tracks.insert(make_pair(uavNo, track));
+
+        *confidence = 0.5;
+        return TRACK_NEW;
+    }
+
+    Track &t = it->second;
+
+    int elapsed = abs((int16_t) (flightTime - t.flightTime));
+    double reach = m_config.maxSpeed * max(elapsed, 1) + m_config.positionSlack;
+    double jump = ground_distance_m(t.latitude, t.longitude, latitude, longitude);
+
+    /* constant velocity along the course, over the flight time elapsed since the last fix */
+    double travel = groundSpeed / 3.6 * elapsed;
+    double course = (t.moving ? t.course : careen) * deg2rad;
+    double predLat = t.latitude + travel * cos(course) / earth_radius_m / deg2rad;
+    double predLon = t.longitude +
+        travel * sin(course) / (earth_radius_m * cos(t.latitude * deg2rad)) / deg2rad;
+
+    double error = ground_distance_m(predLat, predLon, latitude, longitude);
+
+    *confidence = max(0.0, 1.0 - error / reach);
+
+    El3TrackVerdict verdict = error > m_config.predictionTolerance ? TRACK_SUSPECT : TRACK_CONSISTENT;
+
+    if (jump > reach)
+    {
+        if (t.glitches < UINT8_MAX)
+            t.glitches++;
+
+        /* a sustained "glitch" is the track that is stale (new flight, long gap), start over */
+        if (t.glitches < EL3_TRACK_REANCHOR_GLITCHES || elapsed < (int) m_config.reanchorSeconds)
+            return TRACK_GLITCH;
+
+        t.moving = false;
+        t.course = careen;
+        verdict = TRACK_NEW;
+        *confidence = 0.5;
+    }
+    else if (jump >= EL3_TRACK_MIN_COURSE_M)
+    {
+        double north = (latitude - t.latitude) * deg2rad;
+        double east = (longitude - t.longitude) * deg2rad * cos(t.latitude * deg2rad);
+
+        t.course = fmod(atan2(east, north) / deg2rad + 360.0, 360.0);
+        t.moving = true;
+    }
+
+    t.glitches = 0;
+    t.flightTime = flightTime;
+    t.latitude = latitude;
+    t.longitude = longitude;
+
+    return verdict;
+}
+
+El3TrackVerdict El3TrackFilter::check(El3Telemetry &tele)
+{
+    float confidence;
+    El3TrackVerdict verdict = score(tele.ID(), tele.FlightTime(), tele.Latitude(), tele.Longitude(),
+        tele.Groundspeed(), tele.Careen(), &confidence);
+
+    tele.setTrackVerdict(verdict, confidence);
+
+    return verdict;
+}
+
+El3TrackVerdict El3TrackFilter::check(El3TelemetryRecord &rec)
+{
+    float confidence;
+    El3TrackVerdict verdict = score(rec.uavNo, rec.flightTime, rec.gpsData.latitude,
+        rec.gpsData.longitude, rec.groundSpeed, rec.careen, &confidence);
+
+    rec.trackVerdict = verdict;
+    rec.trackConfidence = confidence;
+
+    return verdict;
+}
+
+void El3TrackFilter::saveTracks(vector<El3TrackState> &out) const
+{
+    out.reserve(out.size() + m_tracks.size());
+
+    for (auto &it : m_tracks)
+    {
+        const Track &t = it.second;
+        El3TrackState state = { it.first, t.moving, t.glitches, t.flightTime, 0, t.latitude,
+            t.longitude, t.course };
+
+        out.push_back(state);
+    }
+}
+
+void El3TrackFilter::restoreTracks(const El3TrackState *tracks, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        const El3TrackState &s = tracks[i];
+        Track track = { s.moving != 0, s.glitches, s.flightTime, s.latitude, s.longitude, s.course };
+
+        m_tracks[s.uavNo] = track;
+    }
+}
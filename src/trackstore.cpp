@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2022 Subreption LLC. All rights reserved.
+ * Author: 12dc8242df1be0d6f4b73d68166552197936a27074c004c8af95b27194ec584d
+ *
+ * Dual-licensed under the Subreption Ukraine Defense License (SUDL, version 1) and the  Server Side
+ * Public License (SSPL, version 3). Both licenses are provided with this software distribution.
+ */
+
+#include <el3dec/trackstore.hpp>
+#include <cstring>
+
+using namespace std;
+
+El3TrackStore::El3TrackStore()
+{
+    memset(&m_counters, 0, sizeof(m_counters));
+}
+
+void El3TrackStore::update(const El3TelemetryRecord &rec, int64_t recvNs)
+{
+    auto it = m_index.find(rec.uavNo);
+    El3TrackEntry *entry;
+
+    if (it == m_index.end())
+    {
+        m_index.emplace(rec.uavNo, (uint32_t) m_entries.size());
+        m_entries.emplace_back();
+
+        entry = &m_entries.back();
+        memset(entry, 0, sizeof(*entry));
+        entry->uavNo = rec.uavNo;
+        entry->firstNs = recvNs;
+    }
+    else
+    {
+        entry = &m_entries[it->second];
+    }
+
+    entry->history[entry->next] = rec;
+    entry->historyNs[entry->next] = recvNs;
+    entry->next = (entry->next + 1) % EL3_TRACK_HISTORY;
+
+    if (entry->count < EL3_TRACK_HISTORY)
+        entry->count++;
+
+    entry->fixes++;
+    entry->lastNs = recvNs;
+}
+
+const El3TrackEntry *El3TrackStore::find(uint16_t uavNo) const
+{
+    auto it = m_index.find(uavNo);
+
+    return it == m_index.end() ? NULL : &m_entries[it->second];
+}
+
+void El3TrackStore::history(uint16_t uavNo, vector<El3TelemetryRecord> &out) const
+{
+    const El3TrackEntry *entry = find(uavNo);
+
+    if (!entry)
+        return;
+
+    uint32_t first = (entry->next + EL3_TRACK_HISTORY - entry->count) % EL3_TRACK_HISTORY;
+
+    for (uint32_t i = 0; i < entry->count; i++)
+        out.push_back(entry->history[(first + i) % EL3_TRACK_HISTORY]);
+}
+
+void El3TrackStore::restore(const El3TrackEntry *entries, size_t count,
+    const El3TrackStoreCounters &counters)
+{
+    m_entries.assign(entries, entries + count);
+    m_index.clear();
+    m_index.reserve(count);
+
+    for (size_t i = 0; i < count; i++)
+        m_index[m_entries[i].uavNo] = i;
+
+    m_counters = counters;
+}
+
+void El3TrackStore::clear()
+{
+    m_entries.clear();
+    m_index.clear();
+    memset(&m_counters, 0, sizeof(m_counters));
+}
@@ -0,0 +1,254 @@
+/*
+ * Copyright (c) 2022 Subreption LLC. All rights reserved.
+ * Author: 12dc8242df1be0d6f4b73d68166552197936a27074c004c8af95b27194ec584d
+ *
+ * Dual-licensed under the Subreption Ukraine Defense License (SUDL, version 1) and the  Server Side
+ * Public License (SSPL, version 3). Both licenses are provided with this software distribution.
+ */
+
+#include <el3dec/uring.hpp>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+static int uringSetup(unsigned entries, struct io_uring_params *params)
+{
+    return syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int uringEnter(int fd, unsigned submit, unsigned wait, unsigned flags)
+{
+    return syscall(__NR_io_uring_enter, fd, submit, wait, flags, NULL, 0);
+}
+
+static int uringRegister(int fd, unsigned opcode, const void *arg, unsigned count)
+{
+    return syscall(__NR_io_uring_register, fd, opcode, arg, count);
+}
+
+static runtime_error uringError(const string &what)
+{
+    return runtime_error("io_uring " + what + ": " + strerror(errno));
+}
+
+/* the opcodes read() and write() queue, with and without registered buffers */
+static bool uringProbe()
+{
+    static const uint8_t needed[] = {
+        IORING_OP_READ, IORING_OP_WRITE, IORING_OP_READ_FIXED, IORING_OP_WRITE_FIXED
+    };
+    struct io_uring_params params;
+
+    memset(&params, 0, sizeof(params));
+
+    int fd = uringSetup(1, &params);
+    if (fd < 0)
+        return false;
+
+    /* probing came with IORING_OP_READ and IORING_OP_WRITE (5.6), older kernels fail it */
+    size_t size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    vector<unsigned char> buf(size);
+    struct io_uring_probe *probe = (struct io_uring_probe *) buf.data();
+    bool ok = uringRegister(fd, IORING_REGISTER_PROBE, probe, 256) == 0;
+
+    close(fd);
+
+    for (size_t i = 0; ok && i < sizeof(needed); i++)
+        ok = needed[i] <= probe->last_op && needed[i] < probe->ops_len &&
+            (probe->ops[needed[i]].flags & IO_URING_OP_SUPPORTED);
+
+    return ok;
+}
+
+bool El3Uring::available()
+{
+    /* initialized once, whichever thread gets here first */
+    static const bool supported = uringProbe();
+
+    return supported;
+}
+
+El3Uring::El3Uring(unsigned entries):
+    m_fd(-1), m_registered(false), m_queued(0), m_inFlight(0), m_sqRing(MAP_FAILED),
+    m_cqRing(MAP_FAILED), m_sqes(MAP_FAILED)
+{
+    struct io_uring_params params;
+
+    memset(&params, 0, sizeof(params));
+
+    m_fd = uringSetup(entries, &params);
+    if (m_fd < 0)
+        throw uringError("setup");
+
+    if (!available())
+    {
+        release();
+        throw runtime_error("io_uring lacks the read and write opcodes (Linux 5.6 or later)");
+    }
+
+    m_entries = params.sq_entries;
+    m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+    /* one mapping holds both rings on kernels that say so */
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+        m_sqRingSize = m_cqRingSize = max(m_sqRingSize, m_cqRingSize);
+
+    m_sqRing = mmap(NULL, m_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd,
+        IORING_OFF_SQ_RING);
+
+    if (m_sqRing != MAP_FAILED)
+    {
+        m_cqRing = params.features & IORING_FEAT_SINGLE_MMAP ? m_sqRing :
+            mmap(NULL, m_cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd,
+                IORING_OFF_CQ_RING);
+
+        m_sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+        m_sqes = mmap(NULL, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd,
+            IORING_OFF_SQES);
+    }
+
+    if (m_sqRing == MAP_FAILED || m_cqRing == MAP_FAILED || m_sqes == MAP_FAILED)
+    {
+        runtime_error e = uringError("mmap");
+        release();
+        throw e;
+    }
+
+    char *sq = (char *) m_sqRing, *cq = (char *) m_cqRing;
+
+    m_sqHead = (unsigned *) (sq + params.sq_off.head);
+    m_sqTail = (unsigned *) (sq + params.sq_off.tail);
+    m_sqMask = (unsigned *) (sq + params.sq_off.ring_mask);
+    m_sqArray = (unsigned *) (sq + params.sq_off.array);
+    m_cqHead = (unsigned *) (cq + params.cq_off.head);
+    m_cqTail = (unsigned *) (cq + params.cq_off.tail);
+    m_cqMask = (unsigned *) (cq + params.cq_off.ring_mask);
+    m_cqes = cq + params.cq_off.cqes;
+}
+
+El3Uring::~El3Uring()
+{
+    release();
+}
+
+void El3Uring::release()
+{
+    if (m_sqes != MAP_FAILED)
+        munmap(m_sqes, m_sqesSize);
+    if (m_cqRing != MAP_FAILED && m_cqRing != m_sqRing)
+        munmap(m_cqRing, m_cqRingSize);
+    if (m_sqRing != MAP_FAILED)
+        munmap(m_sqRing, m_sqRingSize);
+    if (m_fd >= 0)
+        close(m_fd);
+
+    m_sqes = m_cqRing = m_sqRing = MAP_FAILED;
+    m_fd = -1;
+}
+
+bool El3Uring::registerBuffers(const struct iovec *iov, unsigned count)
+{
+    m_registered = uringRegister(m_fd, IORING_REGISTER_BUFFERS, iov, count) == 0;
+    return m_registered;
+}
+
+void El3Uring::queue(uint8_t op, int fd, const void *buf, uint32_t len, uint64_t offset,
+    uint16_t buffer, uint64_t userData)
+{
+    unsigned tail = *m_sqTail;
+
+    /* callers keep no more requests in flight than the ring has entries */
+    if (m_inFlight >= m_entries)
+        throw runtime_error("io_uring submission queue full");
+
+    struct io_uring_sqe *sqe = (struct io_uring_sqe *) m_sqes + (tail & *m_sqMask);
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = op;
+    sqe->fd = fd;
+    sqe->addr = (uintptr_t) buf;
+    sqe->len = len;
+    sqe->off = offset;
+    sqe->user_data = userData;
+
+    if (m_registered)
+    {
+        sqe->opcode = op == IORING_OP_READ ? IORING_OP_READ_FIXED : IORING_OP_WRITE_FIXED;
+        sqe->buf_index = buffer;
+    }
+
+    m_sqArray[tail & *m_sqMask] = tail & *m_sqMask;
+
+    /* the kernel reads the entry once it sees the new tail */
+    __atomic_store_n(m_sqTail, tail + 1, __ATOMIC_RELEASE);
+
+    m_queued++;
+    m_inFlight++;
+}
+
+void El3Uring::read(int fd, void *buf, uint32_t len, uint64_t offset, uint16_t buffer, uint64_t userData)
+{
+    queue(IORING_OP_READ, fd, buf, len, offset, buffer, userData);
+}
+
+void El3Uring::write(int fd, const void *buf, uint32_t len, uint64_t offset, uint16_t buffer,
+    uint64_t userData)
+{
+    queue(IORING_OP_WRITE, fd, buf, len, offset, buffer, userData);
+}
+
+void El3Uring::submit()
+{
+    while (m_queued)
+    {
+        int n = uringEnter(m_fd, m_queued, 0, 0);
+
+        if (n < 0)
+        {
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+                continue;
+            throw uringError("submit");
+        }
+
+        m_queued -= n;
+    }
+}
+
+bool El3Uring::complete(uint64_t &userData, int32_t &res, bool wait)
+{
+    for (;;)
+    {
+        unsigned head = *m_cqHead;
+
+        if (head != __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE))
+        {
+            struct io_uring_cqe *cqe = (struct io_uring_cqe *) m_cqes + (head & *m_cqMask);
+
+            userData = cqe->user_data;
+            res = cqe->res;
+
+            __atomic_store_n(m_cqHead, head + 1, __ATOMIC_RELEASE);
+            m_inFlight--;
+            return true;
+        }
+
+        if (!wait || !m_inFlight)
+            return false;
+
+        submit();
+
+        if (uringEnter(m_fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR)
+            throw uringError("wait");
+    }
+}
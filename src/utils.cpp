@@ -9,6 +9,7 @@
 #include <cstdlib> 
 #include <cstdio>
 #include <arpa/inet.h>
+#include <cmath>
 #include <el3dec/utils.hpp>
 
 size_t get_be_u16_from_buf(const unsigned char *buf, size_t offset, uint16_t *out)
@@ -27,3 +28,45 @@ size_t get_u16_from_buf(const unsigned char *buf, size_t offset, uint16_t *out)
 
     return sizeof(unsigned short);
 }
+
+static inline int hex_nibble(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+
+    return -1;
+}
+
+size_t hex_to_bytes(const char *hex, size_t hexlen, unsigned char *out, size_t outlen)
+{
+    if (hexlen % 2 || hexlen / 2 > outlen)
+        return 0;
+
+    for (size_t i = 0; i < hexlen / 2; i++)
+    {
+        int hi = hex_nibble(hex[i * 2]);
+        int lo = hex_nibble(hex[i * 2 + 1]);
+
+        if (hi < 0 || lo < 0)
+            return 0;
+
+        out[i] = (hi << 4) | lo;
+    }
+
+    return hexlen / 2;
+}
+
+double ground_distance_m(double lat1, double lon1, double lat2, double lon2)
+{
+    const double earth_radius_m = 6371008.8;
+    const double deg2rad = M_PI / 180.0;
+
+    double x = (lon2 - lon1) * deg2rad * std::cos((lat1 + lat2) * 0.5 * deg2rad);
+    double y = (lat2 - lat1) * deg2rad;
+
+    return std::sqrt(x * x + y * y) * earth_radius_m;
+}
@@ -2,12 +2,45 @@
 #include <catch2/catch.hpp>
 #include <el3dec/lib.hpp>
 #include <el3dec/telemetry.hpp>
+#include <el3dec/fusion.hpp>
+#include <el3dec/reorder.hpp>
+#include <el3dec/trackfilter.hpp>
+#include <el3dec/capture.hpp>
+#include <el3dec/encoder.hpp>
+#include <el3dec/shmring.hpp>
+#include <el3dec/prefilter.hpp>
+#include <el3dec/trace.hpp>
+#include <el3dec/snapshot.hpp>
+#include <el3dec/relay.hpp>
+#include <el3dec/output.hpp>
+#include <el3dec/arrow.hpp>
+#include <el3dec/aggregate.hpp>
+#include <el3dec/query.hpp>
+#include <el3dec/uring.hpp>
+#include <el3dec/el3dec.h>
+#include <alloccount.hpp>
+#include <el3dec/utils.hpp>
+#include "rapidjson/stringbuffer.h"
+#include <filesystem>
 #include <fstream>
 #include <string>
 #include <iostream>
 #include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <atomic>
 #include <functional>
 #include <memory>
+#include <random>
+#include <thread>
 #include <vector>
 
 #define MAX_PAYLOAD_BYTES 256
@@ -187,7 +220,7 @@ TEST_CASE("el3dec Telemetry Decoding (from samples)")
     timespec start, finish, delta;
 
     std::vector<std::string> vecHexLines;
-    readSamples("../tests/fixtures/telemetry-samples.txt", vecHexLines, 0);
+    readSamples(EL3DEC_TEST_FIXTURES "/telemetry-samples.txt", vecHexLines, 0);
 
     if (!vecHexLines.size())
         FAIL("Failed to load any samples, check file exists!");
@@ -208,3 +241,3137 @@ TEST_CASE("el3dec Telemetry Decoding (from samples)")
     printf("Processing %lu samples took %d.%.9ld seconds\n", vecHexLines.size(), (int)delta.tv_sec,
         delta.tv_nsec);
 }
+
+static El3TelemetryRecord decodeSampleRecord(const std::string &hex)
+{
+    auto bindata = str2bin(hex);
+    El3Telemetry telemetry(bindata.data(), bindata.size(), FAULT_TOLERANT);
+
+    return telemetry.Record();
+}
+
+TEST_CASE("el3dec JSON serialization with a reused writer")
+{
+    /* as the Document based serializer wrote them */
+    static const struct { const char *frame, *json; } expected[] = {
+        { "aa612105390f10303903c9b45fb2314e3116de014962abda86bfff02580257030d0c210106002d0204301f81101400cd38525a009806a94b312600003a3f01e96f0002f70300000000000000000086cf7b0101086310032201002a00000000cc250030a9",
+          "{\"el3dec_version\":1,\"packet_type\":15,\"engine_type\":1,\"uav_type\":1,\"uav_id\":1337,\"flight_time\":969,\"remaining_min\":90,\"careen\":82.25,\"pitch\":-114.5999984741211,\"timestamp\":{\"hours\":16,\"minutes\":48,\"seconds\":57},\"gps\":{\"latitude\":47.663658142089844,\"longitude\":36.50265121459961,\"altitude\":781,\"speed\":55.5},\"video\":{\"tx_freq\":1214,\"tx_chan\":3},\"camera\":{\"angle\":3.1500000953674316,\"azimuth\":-89.0,\"pos\":-13.300000190734863}}" },
+        { "aa612105390f10303b03cbb4601e314e301edd014962abd287b00302580257030d0c21010700370204301f81101400cd38525a009706b54b30260000006701e76f000200030000000000000000008bcf770101086310032201002a00000000cc2300355a",
+          "{\"el3dec_version\":1,\"packet_type\":15,\"engine_type\":1,\"uav_type\":1,\"uav_id\":1337,\"flight_time\":971,\"remaining_min\":90,\"careen\":82.25,\"pitch\":-114.5,\"timestamp\":{\"hours\":16,\"minutes\":48,\"seconds\":59},\"gps\":{\"latitude\":47.66383743286133,\"longitude\":36.502235412597656,\"altitude\":781,\"speed\":55.25},\"video\":{\"tx_freq\":1214,\"tx_chan\":3},\"camera\":{\"angle\":5.150000095367432,\"azimuth\":-88.5,\"pos\":-13.699999809265137}}" },
+        { "aa612105390f10310503d1b46110314e2df4db014762abda86b00002580257030d0c21010500360204301f81101400cc38525a009606d74b30260000006701e66f0001000300000000000000000076cf720101086310032201002a00000000cc2500406d",
+          "{\"el3dec_version\":1,\"packet_type\":15,\"engine_type\":1,\"uav_type\":1,\"uav_id\":1337,\"flight_time\":977,\"remaining_min\":90,\"careen\":81.75,\"pitch\":-114.5999984741211,\"timestamp\":{\"hours\":16,\"minutes\":49,\"seconds\":5},\"gps\":{\"latitude\":47.664241790771484,\"longitude\":36.501312255859375,\"altitude\":781,\"speed\":54.75},\"video\":{\"tx_freq\":1214,\"tx_chan\":3},\"camera\":{\"angle\":5.150000095367432,\"azimuth\":-90.5999984741211,\"pos\":-14.199999809265137}}" },
+    };
+
+    rapidjson::StringBuffer strbuf;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(strbuf);
+
+    for (auto &e: expected)
+    {
+        auto bindata = str2bin(e.frame);
+        El3Telemetry telemetry(bindata.data(), bindata.size(), FAULT_TOLERANT);
+
+        strbuf.Clear();
+        writer.Reset(strbuf);
+        el3WriteJson(telemetry.Record(), writer);
+
+        REQUIRE(std::string(strbuf.GetString()) == e.json);
+        REQUIRE(telemetry.toJson(false) == e.json);
+    }
+}
+
+TEST_CASE("el3dec Multi-sensor fusion")
+{
+    El3FusionConfig config;
+    config.windowMs = 100;
+
+    SECTION("Majority vote across sensors")
+    {
+        El3Fusion fusion(config);
+        std::vector<El3FusedRecord> out;
+        static unsigned char payload_flipped[sizeof(payload_ok)];
+
+        memcpy(payload_flipped, payload_ok, sizeof(payload_ok));
+        payload_flipped[0xc] ^= 0x10;
+
+        El3Telemetry good(payload_ok, sizeof(payload_ok), FAULT_INTOLERANT);
+        El3Telemetry flipped(payload_flipped, sizeof(payload_flipped), FAULT_INTOLERANT);
+        REQUIRE(flipped.Latitude() != good.Latitude());
+
+        fusion.ingest(3, flipped, 0);
+        fusion.ingest(1, good, 10);
+        fusion.ingest(2, good, 20);
+        fusion.ingest(2, good, 30);
+
+        REQUIRE(fusion.poll(50, out) == 0);
+        REQUIRE(fusion.poll(100, out) == 1);
+        REQUIRE(fusion.pending() == 0);
+
+        REQUIRE(out[0].record.uavNo == 1337);
+        REQUIRE(out[0].record.gpsData.latitude == good.Latitude());
+        REQUIRE(out[0].record.gpsData.longitude == good.Longitude());
+        REQUIRE(out[0].reports == 3);
+        REQUIRE(out[0].agreeing == 2);
+        REQUIRE(out[0].firstSensor == 3);
+
+        /* the packet was already emitted */
+        fusion.ingest(4, good, 150);
+        REQUIRE(fusion.pending() == 0);
+
+        auto &stats = fusion.sensorStats();
+        REQUIRE(stats.at(3).outvoted == 1);
+        REQUIRE(stats.at(3).first == 1);
+        REQUIRE(stats.at(1).agreed == 1);
+        REQUIRE(stats.at(2).duplicates == 1);
+        REQUIRE(stats.at(4).late == 1);
+    }
+
+    SECTION("Reports past the limit are counted, not merged")
+    {
+        El3Fusion fusion(config);
+        std::vector<El3FusedRecord> out;
+        El3Telemetry good(payload_ok, sizeof(payload_ok), FAULT_INTOLERANT);
+
+        for (uint32_t sensor = 0; sensor < EL3_FUSION_MAX_REPORTS + 2; sensor++)
+            fusion.ingest(sensor, good, 0);
+
+        REQUIRE(fusion.flush(out) == 1);
+        REQUIRE(out[0].reports == EL3_FUSION_MAX_REPORTS);
+
+        auto &stats = fusion.sensorStats();
+        REQUIRE(stats.at(EL3_FUSION_MAX_REPORTS - 1).overflow == 0);
+        REQUIRE(stats.at(EL3_FUSION_MAX_REPORTS).overflow == 1);
+        REQUIRE(stats.at(EL3_FUSION_MAX_REPORTS + 1).overflow == 1);
+    }
+
+    SECTION("Track plausibility breaks ties")
+    {
+        El3Fusion fusion(config);
+        std::vector<El3FusedRecord> out;
+        std::vector<std::string> vecHexLines;
+
+        readSamples(EL3DEC_TEST_FIXTURES "/telemetry-samples.txt", vecHexLines, 8);
+        REQUIRE(vecHexLines.size() > 5);
+
+        /* samples 4 and 5 are the same packet, sample 4 carries a ~700m position jump */
+        El3TelemetryRecord anchor = decodeSampleRecord(vecHexLines[3]);
+        El3TelemetryRecord glitch = decodeSampleRecord(vecHexLines[4]);
+        El3TelemetryRecord sane = decodeSampleRecord(vecHexLines[5]);
+
+        REQUIRE(glitch.flightTime == sane.flightTime);
+        REQUIRE(glitch.gpsData.latitude != sane.gpsData.latitude);
+
+        fusion.ingest(1, anchor, 0);
+        REQUIRE(fusion.poll(100, out) == 1);
+
+        fusion.ingest(1, glitch, 1000);
+        fusion.ingest(2, sane, 1001);
+        REQUIRE(fusion.poll(1100, out) == 1);
+
+        REQUIRE(out[1].reports == 2);
+        REQUIRE(out[1].implausible == 1);
+        REQUIRE(out[1].record.gpsData.latitude == sane.gpsData.latitude);
+        REQUIRE(fusion.sensorStats().at(1).implausible == 1);
+    }
+
+    SECTION("One record per packet, from samples")
+    {
+        El3Fusion fusion(config);
+        std::vector<El3FusedRecord> out;
+        std::vector<std::string> vecHexLines;
+        uint64_t now = 0;
+
+        readSamples(EL3DEC_TEST_FIXTURES "/telemetry-samples.txt", vecHexLines, 0);
+
+        for (auto &s: vecHexLines)
+        {
+            El3TelemetryRecord rec = decodeSampleRecord(s);
+
+            for (uint32_t sensor = 1; sensor <= 4; sensor++)
+                fusion.ingest(sensor, rec, now + sensor);
+
+            now += 1000;
+            fusion.poll(now, out);
+        }
+
+        fusion.flush(out);
+
+        REQUIRE(out.size() > 0);
+        REQUIRE(out.size() <= vecHexLines.size());
+        REQUIRE(fusion.tracks() == 1);
+    }
+}
+
+static El3TelemetryRecord stampedRecord(uint16_t uav, int h, int m, int s, uint16_t flightTime)
+{
+    El3TelemetryRecord rec;
+
+    memset(&rec, 0, sizeof(rec));
+    rec.uavNo = uav;
+    rec.stampHours = h;
+    rec.stampMinutes = m;
+    rec.stampSeconds = s;
+    rec.flightTime = flightTime;
+
+    return rec;
+}
+
+TEST_CASE("el3dec Reorder buffer")
+{
+    /* 2022-09-12 23:59:58 UTC */
+    const uint64_t base = 1663027198000ULL;
+
+    El3ReorderConfig config;
+    config.maxLatencyMs = 300;
+    config.slots = 4;
+    config.maxTracks = 2;
+
+    SECTION("Dating across midnight")
+    {
+        REQUIRE(El3ReorderBuffer::dateStamp(23, 59, 58, base) == (int64_t) base);
+        REQUIRE(El3ReorderBuffer::dateStamp(0, 0, 1, base) == (int64_t) base + 3000);
+        REQUIRE(El3ReorderBuffer::dateStamp(23, 59, 57, base + 5000) == (int64_t) base - 1000);
+    }
+
+    SECTION("Released in timestamp order within the latency bound")
+    {
+        El3ReorderBuffer reorder(config);
+        std::vector<El3TimedRecord> out;
+
+        reorder.ingest(stampedRecord(1, 23, 59, 59, 101), base + 1000, 1, out);
+        reorder.ingest(stampedRecord(1, 0, 0, 0, 102), base + 1050, 1, out);
+        reorder.ingest(stampedRecord(1, 23, 59, 58, 100), base + 1100, 2, out);
+
+        REQUIRE(out.empty());
+        REQUIRE(reorder.poll(base + 1299, out) == 0);
+        REQUIRE(reorder.poll(base + 1300, out) == 2);
+        REQUIRE(out[0].utcMs == (int64_t) base);
+        REQUIRE(out[0].sensorId == 2);
+        REQUIRE(out[1].utcMs == (int64_t) base + 1000);
+        REQUIRE(reorder.buffered() == 1);
+
+        REQUIRE(reorder.poll(base + 1350, out) == 1);
+        REQUIRE(out[2].utcMs == (int64_t) base + 2000);
+        REQUIRE(out[2].flags == EL3_TS_STAMP);
+
+        /* older than what was released already */
+        reorder.ingest(stampedRecord(1, 23, 59, 59, 101), base + 1400, 3, out);
+        REQUIRE(out.size() == 4);
+        REQUIRE(out[3].flags & EL3_TS_LATE);
+    }
+
+    SECTION("Glitched stamps are rebuilt from the flight time")
+    {
+        El3ReorderBuffer reorder(config);
+        std::vector<El3TimedRecord> out;
+
+        reorder.ingest(stampedRecord(7, 23, 59, 58, 500), base, 1, out);
+        reorder.ingest(stampedRecord(7, 31, 59, 59, 501), base + 1000, 1, out);
+        reorder.ingest(stampedRecord(7, 7, 59, 59, 502), base + 2000, 1, out);
+        reorder.flush(out);
+
+        REQUIRE(out.size() == 3);
+        REQUIRE(out[1].utcMs == (int64_t) base + 1000);
+        REQUIRE(out[1].flags == EL3_TS_FLIGHTTIME);
+        REQUIRE(out[2].utcMs == (int64_t) base + 2000);
+        REQUIRE(out[2].flags == EL3_TS_FLIGHTTIME);
+    }
+
+    SECTION("Full rings and tracks")
+    {
+        El3ReorderBuffer reorder(config);
+        std::vector<El3TimedRecord> out;
+
+        for (int i = 0; i < 5; i++)
+            reorder.ingest(stampedRecord(1, 12, 0, i, i), base, 1, out);
+
+        REQUIRE(out.size() == 1);
+        REQUIRE(out[0].record.stampSeconds == 0);
+
+        reorder.ingest(stampedRecord(2, 12, 0, 0, 0), base, 1, out);
+        reorder.ingest(stampedRecord(3, 12, 0, 0, 0), base, 1, out);
+        REQUIRE(out.size() == 2);
+        REQUIRE(out[1].flags & EL3_TS_UNTRACKED);
+        REQUIRE(reorder.buffered() == 5);
+    }
+}
+
+TEST_CASE("el3dec Track consistency filter")
+{
+    std::vector<std::string> vecHexLines;
+    readSamples(EL3DEC_TEST_FIXTURES "/telemetry-samples.txt", vecHexLines, 0);
+
+    SECTION("Position jumps in the samples are glitches")
+    {
+        El3TrackFilter filter;
+        size_t glitches = 0, flagged = 0;
+
+        for (auto &s: vecHexLines)
+        {
+            auto bindata = str2bin(s);
+            El3Telemetry telemetry(bindata.data(), bindata.size(), FAULT_TOLERANT);
+
+            El3TrackVerdict verdict = filter.check(telemetry);
+            REQUIRE(telemetry.TrackVerdict() == verdict);
+            REQUIRE(verdict != TRACK_UNCHECKED);
+
+            /* every corrupted fix in the samples comes with bit 6 of the minutes byte set */
+            if (bindata[7] & 0x40)
+                flagged++;
+
+            if (verdict == TRACK_GLITCH)
+            {
+                REQUIRE(telemetry.TrackConfidence() < 0.5);
+                REQUIRE(telemetry.toJson(false).find("\"verdict\":\"glitch\"") != std::string::npos);
+                glitches++;
+            }
+        }
+
+        REQUIRE(filter.tracks() == 1);
+        REQUIRE(glitches == flagged);
+        REQUIRE(glitches > 0);
+    }
+
+    SECTION("Suppression policy and re-anchoring")
+    {
+        El3TrackFilterConfig config;
+        config.suppress = true;
+
+        El3TrackFilter filter(config);
+        El3TelemetryRecord rec = decodeSampleRecord(vecHexLines[3]);
+
+        REQUIRE(filter.check(rec) == TRACK_NEW);
+        REQUIRE(!filter.suppressed(TRACK_NEW));
+
+        /* ~700m away within the same second */
+        rec.gpsData.latitude += 0.006;
+        REQUIRE(filter.check(rec) == TRACK_GLITCH);
+        REQUIRE(filter.suppressed(TRACK_GLITCH));
+        REQUIRE(rec.trackVerdict == TRACK_GLITCH);
+
+        /* the far position persists for longer than reanchorSeconds: that is where the UAV is */
+        rec.gpsData.latitude += 1.0;
+        for (int i = 1; i <= 3; i++)
+        {
+            rec.flightTime += 2;
+            El3TrackVerdict verdict = filter.check(rec);
+            REQUIRE(verdict == (i < 3 ? TRACK_GLITCH : TRACK_NEW));
+        }
+
+        rec.flightTime += 1;
+        REQUIRE(filter.check(rec) == TRACK_CONSISTENT);
+    }
+
+    SECTION("Unfiltered telemetry carries no verdict")
+    {
+        El3Telemetry telemetry(payload_ok, sizeof(payload_ok), FAULT_INTOLERANT);
+
+        REQUIRE(telemetry.TrackVerdict() == TRACK_UNCHECKED);
+        REQUIRE(telemetry.toJson(false).find("\"track\"") == std::string::npos);
+    }
+}
+
+TEST_CASE("el3dec Capture archive")
+{
+    std::vector<std::string> vecHexLines;
+    readSamples(EL3DEC_TEST_FIXTURES "/telemetry-samples.txt", vecHexLines, 0);
+
+    char path[] = "/tmp/el3dec_capture_XXXXXX";
+    int fd = mkstemp(path);
+    REQUIRE(fd >= 0);
+    close(fd);
+    unlink(path);
+
+    const int64_t start = 1663030425LL * 1000000000LL;
+    const int64_t step = 500000000LL;
+    std::vector<std::vector<unsigned char>> frames;
+
+    for (auto &s: vecHexLines)
+    {
+        /* the fixture has CRLF line endings */
+        size_t hexlen = s.find_last_of("0123456789abcdefABCDEF") + 1;
+        std::vector<unsigned char> frame(hexlen / 2);
+        REQUIRE(hex_to_bytes(s.data(), hexlen, frame.data(), frame.size()) == frame.size());
+        frames.push_back(frame);
+    }
+
+    {
+        /* small blocks, so there are plenty of them to index */
+        El3CaptureWriter writer(path, 4096);
+
+        for (size_t i = 0; i < frames.size(); i++)
+            writer.append(start + i * step, i % 3, frames[i].data(), frames[i].size());
+
+        /* a foreign frame, with no Eleron header */
+        const unsigned char junk[] = { 0x01, 0x02, 0x03 };
+        writer.append(start + frames.size() * step, 7, junk, sizeof(junk));
+
+        writer.close();
+        REQUIRE(writer.records() == frames.size() + 1);
+        REQUIRE(writer.blocks() > 10);
+    }
+
+    SECTION("Records read back as written")
+    {
+        El3CaptureReader reader(path);
+        size_t n = 0;
+
+        REQUIRE(!reader.recovered());
+        REQUIRE(reader.records() == frames.size() + 1);
+
+        for (uint32_t b = 0; b < reader.blocks(); b++)
+        {
+            El3CaptureCursor cursor;
+            El3CaptureRecord rec;
+
+            reader.begin(b, cursor);
+            while (reader.next(cursor, rec))
+            {
+                if (n < frames.size())
+                {
+                    REQUIRE(rec.length == frames[n].size());
+                    REQUIRE(memcmp(rec.data, frames[n].data(), rec.length) == 0);
+                    REQUIRE(rec.recvNs == start + (int64_t) n * step);
+                    REQUIRE(rec.sensorId == n % 3);
+                }
+                else
+                {
+                    REQUIRE(rec.length == 3);
+                    REQUIRE(rec.sensorId == 7);
+                }
+                n++;
+            }
+        }
+
+        REQUIRE(n == frames.size() + 1);
+    }
+
+    SECTION("Time range and UAV lookups")
+    {
+        El3CaptureReader reader(path);
+        std::vector<uint32_t> blocks;
+
+        /* records 100 to 110 */
+        reader.blocksInRange(start + 100 * step, start + 110 * step, blocks);
+        REQUIRE(!blocks.empty());
+        REQUIRE(blocks.size() <= 2);
+        REQUIRE(reader.block(blocks.front()).minNs <= start + 100 * step);
+        REQUIRE(reader.block(blocks.back()).maxNs >= start + 110 * step);
+
+        blocks.clear();
+        reader.blocksInRange(start - 10 * step, start - step, blocks);
+        REQUIRE(blocks.empty());
+
+        blocks.clear();
+        reader.blocksForUav(1337, blocks);
+        REQUIRE(blocks.size() == reader.blocks());
+
+        blocks.clear();
+        reader.blocksForUav(1338, blocks);
+        REQUIRE(blocks.empty());
+    }
+
+    SECTION("Appending to an existing archive")
+    {
+        size_t blocks;
+        {
+            El3CaptureReader reader(path);
+            blocks = reader.blocks();
+        }
+        {
+            El3CaptureWriter writer(path, 4096);
+            writer.append(start + 5000 * step, 1, frames[0].data(), frames[0].size());
+        }
+
+        El3CaptureReader reader(path);
+        std::vector<uint32_t> found;
+
+        REQUIRE(!reader.recovered());
+        REQUIRE(reader.blocks() == blocks + 1);
+        REQUIRE(reader.records() == frames.size() + 2);
+
+        reader.blocksInRange(start + 5000 * step, start + 5000 * step, found);
+        REQUIRE(found.size() == 1);
+        REQUIRE(found[0] == blocks);
+    }
+
+    SECTION("Archives without an index are recovered")
+    {
+        size_t blocks, records;
+        {
+            El3CaptureReader reader(path);
+            blocks = reader.blocks();
+            records = reader.records();
+        }
+
+        /* lose the index and trailer, and tear the last block */
+        {
+            El3CaptureReader reader(path);
+            REQUIRE(truncate(path, reader.block(blocks - 1).offset + 40) == 0);
+        }
+
+        El3CaptureReader reader(path);
+        std::vector<uint32_t> found;
+
+        REQUIRE(reader.recovered());
+        REQUIRE(reader.blocks() == blocks - 1);
+        REQUIRE(reader.records() < records);
+
+        reader.blocksForUav(1337, found);
+        REQUIRE(found.size() == blocks - 1);
+    }
+
+    SECTION("Damaged indexes are rebuilt, not trusted")
+    {
+        El3CaptureTrailer trailer;
+        El3CaptureIndexHeader ih;
+        uint64_t size;
+        {
+            El3CaptureReader reader(path);
+            size = reader.dataEnd();
+        }
+
+        int fd = open(path, O_RDWR);
+        REQUIRE(fd >= 0);
+        off_t end = lseek(fd, 0, SEEK_END);
+        REQUIRE(pread(fd, &trailer, sizeof(trailer), end - sizeof(trailer)) == sizeof(trailer));
+        REQUIRE(trailer.indexOffset == size);
+        REQUIRE(pread(fd, &ih, sizeof(ih), trailer.indexOffset) == sizeof(ih));
+
+        uint64_t entries = trailer.indexOffset + sizeof(ih);
+        uint64_t postings = entries + (uint64_t) ih.blocks * sizeof(El3CaptureBlockEntry);
+        El3CaptureBlockEntry entry;
+        El3CaptureUavEntry posting;
+
+        REQUIRE(pread(fd, &entry, sizeof(entry), entries) == sizeof(entry));
+        REQUIRE(pread(fd, &posting, sizeof(posting), postings) == sizeof(posting));
+
+        SECTION("A block running past the data")
+        {
+            El3CaptureBlockEntry bad = entry;
+            bad.bytes = 0xffffffff;
+            REQUIRE(pwrite(fd, &bad, sizeof(bad), entries) == sizeof(bad));
+        }
+
+        SECTION("A block before the file header")
+        {
+            El3CaptureBlockEntry bad = entry;
+            bad.offset = 0;
+            REQUIRE(pwrite(fd, &bad, sizeof(bad), entries) == sizeof(bad));
+        }
+
+        SECTION("A posting to a block that is not there")
+        {
+            El3CaptureUavEntry bad = posting;
+            bad.block = ih.blocks;
+            REQUIRE(pwrite(fd, &bad, sizeof(bad), postings) == sizeof(bad));
+        }
+
+        SECTION("An index offset that wraps around")
+        {
+            El3CaptureTrailer bad = trailer;
+            bad.indexOffset = UINT64_MAX - sizeof(ih);
+            REQUIRE(pwrite(fd, &bad, sizeof(bad), end - sizeof(bad)) == sizeof(bad));
+        }
+
+        close(fd);
+
+        El3CaptureReader reader(path);
+        std::vector<uint32_t> found;
+
+        REQUIRE(reader.recovered());
+        REQUIRE(reader.records() == frames.size() + 1);
+
+        reader.blocksForUav(1337, found);
+        REQUIRE(found.size() == reader.blocks());
+    }
+
+    unlink(path);
+}
+
+/* an archive past its file header, which holds the creation time */
+static std::string readArchiveData(const std::string &path)
+{
+    std::ifstream in(path, std::ios::binary);
+    std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    return data.substr(std::min(data.size(), sizeof(El3CaptureFileHeader)));
+}
+
+TEST_CASE("el3dec Capture I/O backends")
+{
+    std::vector<std::string> vecHexLines;
+    readSamples(EL3DEC_TEST_FIXTURES "/telemetry-samples.txt", vecHexLines, 0);
+
+    std::vector<std::vector<unsigned char>> frames;
+
+    for (auto &s: vecHexLines)
+    {
+        size_t hexlen = s.find_last_of("0123456789abcdefABCDEF") + 1;
+        std::vector<unsigned char> frame(hexlen / 2);
+        REQUIRE(hex_to_bytes(s.data(), hexlen, frame.data(), frame.size()) == frame.size());
+        frames.push_back(frame);
+    }
+
+    char base[] = "/tmp/el3dec_capio_XXXXXX";
+    int fd = mkstemp(base);
+    REQUIRE(fd >= 0);
+    close(fd);
+
+    const int64_t start = 1663030425LL * 1000000000LL;
+    std::string buffered = std::string(base) + ".buffered";
+    std::string uring = std::string(base) + ".uring";
+    std::string direct = std::string(base) + ".direct";
+
+    El3CaptureIoConfig io;
+    REQUIRE(!el3ParseCaptureIo("mmap", io));
+    REQUIRE(el3ParseCaptureIo("direct", io));
+    REQUIRE(io.mode == CAPTURE_IO_URING);
+    REQUIRE(io.direct);
+    REQUIRE(el3ParseCaptureIo("buffered", io));
+    REQUIRE(io.mode == CAPTURE_IO_BUFFERED);
+    REQUIRE(!io.direct);
+
+    /* small segments, so submissions wrap around the ring several times */
+    El3CaptureIoConfig ioBuffered, ioUring, ioDirect;
+    ioBuffered.mode = CAPTURE_IO_BUFFERED;
+    ioUring.mode = ioDirect.mode = CAPTURE_IO_URING;
+    ioUring.depth = ioDirect.depth = 2;
+    ioUring.bufferSize = ioDirect.bufferSize = 8192;
+    ioDirect.direct = true;
+
+    auto write = [&](const std::string &path, const El3CaptureIoConfig &cfg, size_t from, size_t to) {
+        El3CaptureWriter writer(path, 4096, cfg);
+
+        for (size_t i = from; i < to; i++)
+        {
+            writer.append(start + i, i % 3, frames[i].data(), frames[i].size());
+
+            /* a partial block, and with O_DIRECT a partial unit held back */
+            if (i == from + 17)
+                writer.flush();
+        }
+
+        bool used = writer.uring();
+        writer.close();
+        return used;
+    };
+
+    REQUIRE(!write(buffered, ioBuffered, 0, frames.size()));
+
+    if (!El3Uring::available())
+    {
+        WARN("io_uring not available, only the buffered backend was tested");
+        unlink(buffered.c_str());
+        unlink(base);
+        return;
+    }
+
+    REQUIRE(write(uring, ioUring, 0, frames.size()));
+    REQUIRE(write(direct, ioDirect, 0, frames.size()));
+
+    SECTION("Every backend writes the same archive")
+    {
+        std::string expected = readArchiveData(buffered);
+
+        REQUIRE(expected.size() > 4 * 8192);
+        REQUIRE(readArchiveData(uring) == expected);
+        REQUIRE(readArchiveData(direct) == expected);
+    }
+
+    SECTION("Appending resumes where the archive ends")
+    {
+        size_t half = frames.size() / 2;
+
+        unlink(uring.c_str());
+        unlink(direct.c_str());
+
+        write(uring, ioUring, 0, half);
+        write(uring, ioUring, half, frames.size());
+        write(direct, ioDirect, 0, half);
+        write(direct, ioDirect, half, frames.size());
+
+        std::string expected = readArchiveData(uring);
+        El3CaptureReader reader(direct);
+
+        REQUIRE(!reader.recovered());
+        REQUIRE(reader.records() == frames.size());
+        REQUIRE(readArchiveData(direct) == expected);
+    }
+
+    SECTION("What is not written yet is copied, not flushed")
+    {
+        std::string live = std::string(base) + ".live";
+
+        for (auto *cfg : { &ioBuffered, &ioUring, &ioDirect })
+        {
+            El3CaptureWriter writer(live, 4096, *cfg);
+
+            for (size_t i = 0; i < frames.size(); i++)
+            {
+                writer.append(start + i, i % 3, frames[i].data(), frames[i].size());
+
+                if (i % 37)
+                    continue;
+
+                std::vector<unsigned char> tail, pending;
+                std::vector<El3CaptureRecord> records;
+                size_t blocks = writer.blocks();
+                uint64_t written = writer.unwritten(tail);
+                uint64_t archived = 0;
+
+                REQUIRE(writer.blocks() == blocks);
+
+                if (written < sizeof(El3CaptureFileHeader))
+                    pending.assign(tail.begin() + sizeof(El3CaptureFileHeader) - written, tail.end());
+                else
+                {
+                    El3CaptureReader reader(live, written);
+
+                    archived = reader.records();
+                    reader.partial(pending);
+                    pending.insert(pending.end(), tail.begin(), tail.end());
+                }
+
+                el3CaptureRecords(pending.data(), pending.size(), records);
+
+                REQUIRE(archived + records.size() == i + 1);
+                REQUIRE(records.back().recvNs == start + (int64_t) i);
+                REQUIRE(records.back().length == frames[i].size());
+            }
+
+            writer.close();
+            REQUIRE(El3CaptureReader(live).records() == frames.size());
+            unlink(live.c_str());
+        }
+    }
+
+    SECTION("Block streams read what the reader does")
+    {
+        El3CaptureReader reader(buffered);
+        std::vector<uint32_t> all, some;
+
+        for (uint32_t b = 0; b < reader.blocks(); b++)
+        {
+            all.push_back(b);
+            if (b % 3 != 1)
+                some.push_back(b);
+        }
+
+        auto expect = [&](const std::vector<uint32_t> &blocks) {
+            std::vector<std::pair<int64_t, std::string>> out;
+            El3CaptureCursor cursor;
+            El3CaptureRecord rec;
+
+            for (auto b : blocks)
+            {
+                reader.begin(b, cursor);
+                while (reader.next(cursor, rec))
+                    out.emplace_back(rec.recvNs, std::string((const char *) rec.data, rec.length));
+            }
+            return out;
+        };
+
+        for (auto *cfg : { &ioBuffered, &ioUring, &ioDirect })
+        {
+            for (auto *blocks : { &all, &some })
+            {
+                El3CaptureBlockStream stream(reader, buffered, *blocks, *cfg);
+                std::vector<std::pair<int64_t, std::string>> out;
+                El3CaptureRecord rec;
+
+                REQUIRE(stream.uring() == (cfg != &ioBuffered));
+                REQUIRE(stream.direct() <= cfg->direct);
+
+                while (stream.next(rec))
+                    out.emplace_back(rec.recvNs, std::string((const char *) rec.data, rec.length));
+
+                REQUIRE(out == expect(*blocks));
+            }
+        }
+
+        /* leaving early, with reads still in flight */
+        {
+            El3CaptureBlockStream stream(reader, buffered, all, ioDirect);
+            El3CaptureRecord rec;
+            REQUIRE(stream.next(rec));
+        }
+
+        /* a truncated archive is an error, not a short read */
+        REQUIRE(truncate(buffered.c_str(), reader.block(all.back()).offset + 40) == 0);
+        El3CaptureBlockStream stream(reader, buffered, std::vector<uint32_t>(1, all.back()), ioUring);
+        El3CaptureRecord rec;
+        REQUIRE_THROWS_AS(stream.next(rec), std::runtime_error);
+    }
+
+    unlink(buffered.c_str());
+    unlink(uring.c_str());
+    unlink(direct.c_str());
+    unlink(base);
+}
+
+TEST_CASE("el3dec Telemetry encoding")
+{
+    std::vector<std::string> vecHexLines;
+    readSamples(EL3DEC_TEST_FIXTURES "/telemetry-samples.txt", vecHexLines, 0);
+
+    REQUIRE(vecHexLines.size() == 2037);
+
+    unsigned char frame[EL3_TELEMETRY_FRAME_LEN], again[EL3_TELEMETRY_FRAME_LEN];
+
+    REQUIRE(el3EncodeTelemetry(decodeSampleRecord(vecHexLines[0]), frame, sizeof(frame) - 1) == 0);
+
+    for (auto &s: vecHexLines)
+    {
+        El3TelemetryRecord rec = decodeSampleRecord(s);
+
+        REQUIRE(el3EncodeTelemetry(rec, frame, sizeof(frame)) == EL3_TELEMETRY_FRAME_LEN);
+
+        El3Telemetry telemetry(frame, sizeof(frame), FAULT_INTOLERANT);
+        El3TelemetryRecord dec = telemetry.Record();
+
+        REQUIRE(dec.packetType == ENICS_ELERON_PACKET_TELEMETRY);
+        REQUIRE(dec.engineType == rec.engineType);
+        REQUIRE(dec.uavType == rec.uavType);
+        REQUIRE(dec.uavNo == rec.uavNo);
+        REQUIRE(dec.flightTime == rec.flightTime);
+        REQUIRE(dec.stampHours == rec.stampHours);
+        REQUIRE(dec.stampMinutes == rec.stampMinutes);
+        REQUIRE(dec.stampSeconds == rec.stampSeconds);
+        REQUIRE(dec.gpsData.latitude == Approx(rec.gpsData.latitude).margin(1e-5));
+        REQUIRE(dec.gpsData.longitude == Approx(rec.gpsData.longitude).margin(1e-5));
+        REQUIRE(dec.gpsData.altitude == rec.gpsData.altitude);
+        REQUIRE(dec.groundSpeed == rec.groundSpeed);
+        REQUIRE(dec.careen == rec.careen);
+        REQUIRE(dec.pitch == Approx(rec.pitch).margin(1e-4));
+        REQUIRE(dec.remainingMinutes == rec.remainingMinutes);
+        REQUIRE(dec.videoTxChannel == rec.videoTxChannel);
+        REQUIRE(dec.videoTxFreq == rec.videoTxFreq);
+        REQUIRE(dec.camera.angle == Approx(rec.camera.angle).margin(1e-4));
+        REQUIRE(dec.camera.azimuth == Approx(rec.camera.azimuth).margin(1e-4));
+        REQUIRE(dec.camera.position == Approx(rec.camera.position).margin(1e-4));
+
+        /*
+         * Quantization is stable: a decoded frame encodes back to the same bytes. Coordinates are
+         * the exception, the decoder converts them through a float before scaling.
+         */
+        REQUIRE(el3EncodeTelemetry(dec, again, sizeof(again)) == EL3_TELEMETRY_FRAME_LEN);
+        REQUIRE(memcmp(frame, again, 0xb) == 0);
+        REQUIRE(memcmp(frame + 0x12, again + 0x12, sizeof(frame) - 0x12) == 0);
+    }
+
+    SECTION("Out of range values are clamped to their fields")
+    {
+        El3TelemetryRecord rec = decodeSampleRecord(vecHexLines[0]);
+
+        rec.groundSpeed = 5000;
+        rec.pitch = -400;
+        rec.camera.azimuth = 300;
+
+        el3EncodeTelemetry(rec, frame, sizeof(frame));
+        El3Telemetry telemetry(frame, sizeof(frame), FAULT_INTOLERANT);
+
+        REQUIRE(telemetry.Record().groundSpeed == Approx(0xfff * 0.25));
+        REQUIRE(telemetry.Record().pitch == Approx(-204.8));
+        REQUIRE(telemetry.Record().camera.azimuth == Approx(204.7));
+    }
+}
+
+TEST_CASE("el3dec Shared memory ring")
+{
+    std::vector<std::string> vecHexLines;
+    readSamples(EL3DEC_TEST_FIXTURES "/telemetry-samples.txt", vecHexLines, 0);
+
+    std::vector<std::vector<unsigned char>> frames;
+    for (auto &s: vecHexLines)
+    {
+        size_t hexlen = s.find_last_of("0123456789abcdefABCDEF") + 1;
+        std::vector<unsigned char> frame(hexlen / 2);
+        REQUIRE(hex_to_bytes(s.data(), hexlen, frame.data(), frame.size()) == frame.size());
+        frames.push_back(frame);
+    }
+
+    std::string name = "/el3dec-test-" + std::to_string(getpid());
+
+    el3_shm_ring_unlink(name.c_str());
+
+    /* a small ring, so the 2037 frames wrap it many times */
+    el3_shm_producer *producer = el3_shm_producer_open(name.c_str(), 4096);
+    REQUIRE(producer);
+
+    El3ShmRingReader reader(name);
+    El3CaptureRecord rec;
+
+    REQUIRE(reader.capacity() == 4096);
+    REQUIRE_FALSE(reader.next(rec));
+
+    SECTION("Frames come out in order, decodable in place")
+    {
+        size_t in = 0, out = 0;
+
+        while (out < frames.size())
+        {
+            while (in < frames.size() && el3_shm_producer_write(producer, 1000 + in, 7,
+                frames[in].data(), frames[in].size()) == 0)
+                in++;
+
+            REQUIRE(reader.next(rec));
+            REQUIRE(rec.recvNs == (int64_t) (1000 + out));
+            REQUIRE(rec.sensorId == 7);
+            REQUIRE(rec.length == frames[out].size());
+            REQUIRE(memcmp(rec.data, frames[out].data(), rec.length) == 0);
+
+            El3Telemetry telemetry(rec.data, rec.length, FAULT_TOLERANT);
+            REQUIRE(telemetry.ID() == 1337);
+
+            out++;
+        }
+
+        REQUIRE_FALSE(reader.next(rec));
+    }
+
+    SECTION("A full ring drops frames instead of overwriting them")
+    {
+        size_t written = 0;
+
+        while (el3_shm_producer_write(producer, 0, 0, frames[0].data(), frames[0].size()) == 0)
+            written++;
+
+        /* 100 byte frames take 128 bytes with their record header and padding */
+        REQUIRE(written == 4096 / 128);
+        REQUIRE(el3_shm_producer_dropped(producer) == 1);
+        REQUIRE(reader.dropped() == 1);
+
+        /* the space only comes back once the consumer moved past the frame */
+        REQUIRE(reader.next(rec));
+        REQUIRE(el3_shm_producer_write(producer, 0, 0, frames[0].data(), frames[0].size()) == -1);
+        REQUIRE(reader.next(rec));
+        REQUIRE(el3_shm_producer_write(producer, 0, 0, frames[0].data(), frames[0].size()) == 0);
+    }
+
+    SECTION("Reserve and commit")
+    {
+        unsigned char *buf = el3_shm_producer_reserve(producer, 200);
+
+        REQUIRE(buf);
+        memcpy(buf, frames[1].data(), frames[1].size());
+        REQUIRE_FALSE(reader.next(rec));
+
+        el3_shm_producer_commit(producer, 42, 3, frames[1].size());
+        REQUIRE(reader.next(rec));
+        REQUIRE(rec.length == frames[1].size());
+        REQUIRE(memcmp(rec.data, frames[1].data(), rec.length) == 0);
+
+        REQUIRE_FALSE(el3_shm_producer_reserve(producer, 5000));
+
+        /* committing more than was reserved would overrun the record */
+        REQUIRE(el3_shm_producer_reserve(producer, 10));
+        el3_shm_producer_commit(producer, 42, 3, frames[1].size());
+        REQUIRE_FALSE(reader.next(rec));
+        REQUIRE(el3_shm_producer_dropped(producer) == 1);
+    }
+
+    SECTION("Corrupt records are skipped, not read past")
+    {
+        size_t size;
+        el3_shm_ring_header *ring = el3_shm_ring_map(name.c_str(), 0, &size);
+
+        REQUIRE(ring);
+
+        for (uint16_t length : { (uint16_t) 4000, (uint16_t) EL3_SHM_RING_MAX_FRAME })
+        {
+            uint64_t corrupt = reader.corrupt();
+
+            /* far from the end of the ring, the first frame goes at head */
+            el3_shm_ring_record *first = (el3_shm_ring_record *) ((unsigned char *) (ring + 1) +
+                (ring->head & (ring->capacity - 1)));
+
+            REQUIRE(el3_shm_producer_write(producer, 0, 0, frames[0].data(), frames[0].size()) == 0);
+            REQUIRE(el3_shm_producer_write(producer, 0, 0, frames[1].data(), frames[1].size()) == 0);
+            first->length = length;
+
+            REQUIRE_FALSE(reader.next(rec));
+            REQUIRE(reader.corrupt() == corrupt + 1);
+
+            REQUIRE(el3_shm_producer_write(producer, 5, 0, frames[2].data(), frames[2].size()) == 0);
+            REQUIRE(reader.next(rec));
+            REQUIRE(rec.recvNs == 5);
+            REQUIRE(rec.length == frames[2].size());
+        }
+
+        el3_shm_ring_unmap(ring, size);
+    }
+
+    SECTION("Waiting for the producer")
+    {
+        REQUIRE_FALSE(reader.wait(20));
+
+        std::thread feeder([&] {
+            usleep(20000);
+            el3_shm_producer_write(producer, 1, 1, frames[0].data(), frames[0].size());
+        });
+
+        bool woken = false;
+        for (int i = 0; i < 50 && !woken; i++)
+            woken = reader.wait(100);
+
+        feeder.join();
+
+        REQUIRE(woken);
+        REQUIRE(reader.next(rec));
+    }
+
+    SECTION("Both ends attach to the same ring")
+    {
+        El3ShmRingReader second(name, 1 << 20);
+
+        REQUIRE(second.capacity() == 4096);
+    }
+
+    el3_shm_producer_close(producer);
+    el3_shm_ring_unlink(name.c_str());
+}
+
+TEST_CASE("el3dec C ABI")
+{
+    std::vector<std::string> vecHexLines;
+    readSamples(EL3DEC_TEST_FIXTURES "/telemetry-samples.txt", vecHexLines, 0);
+
+    REQUIRE(el3dec_abi_version() == EL3DEC_ABI_VERSION);
+    REQUIRE(el3dec_record_size() == 64);
+
+    /* one frame per row, and the same frames back to back with junk in between */
+    std::vector<uint8_t> rows(vecHexLines.size() * MAX_PAYLOAD_BYTES);
+    std::vector<uint16_t> lengths(vecHexLines.size());
+    std::vector<uint64_t> offsets(vecHexLines.size());
+    std::vector<uint8_t> stream;
+
+    for (size_t i = 0; i < vecHexLines.size(); i++)
+    {
+        const std::string &s = vecHexLines[i];
+        size_t hexlen = s.find_last_of("0123456789abcdefABCDEF") + 1;
+
+        lengths[i] = hex_to_bytes(s.data(), hexlen, &rows[i * MAX_PAYLOAD_BYTES], MAX_PAYLOAD_BYTES);
+        REQUIRE(lengths[i]);
+
+        if (i % 100 == 0)
+            stream.insert(stream.end(), { 0x00, 0xAA, 0x01, 0x13 });
+
+        offsets[i] = stream.size();
+        const uint8_t *frame = &rows[i * MAX_PAYLOAD_BYTES];
+        stream.insert(stream.end(), frame, frame + lengths[i]);
+    }
+
+    std::vector<el3dec_record> batch(vecHexLines.size());
+    std::vector<el3dec_record> indexed(vecHexLines.size());
+    std::vector<el3dec_record> streamed(vecHexLines.size());
+
+    REQUIRE(el3dec_decode_batch(rows.data(), MAX_PAYLOAD_BYTES, lengths.data(), lengths.size(),
+        EL3DEC_FAULT_TOLERANT, batch.data()) == vecHexLines.size());
+    REQUIRE(el3dec_decode_indexed(stream.data(), offsets.data(), lengths.data(), offsets.size(),
+        EL3DEC_FAULT_TOLERANT, indexed.data()) == vecHexLines.size());
+
+    size_t consumed = 0;
+    REQUIRE(el3dec_decode_stream(stream.data(), stream.size(), EL3DEC_FAULT_TOLERANT, streamed.data(),
+        streamed.size(), &consumed) == vecHexLines.size());
+    REQUIRE(consumed == stream.size());
+
+    for (size_t i = 0; i < vecHexLines.size(); i++)
+    {
+        El3TelemetryRecord rec = decodeSampleRecord(vecHexLines[i]);
+
+        REQUIRE(batch[i].status == EL3DEC_OK);
+        REQUIRE(batch[i].uav_no == rec.uavNo);
+        REQUIRE(batch[i].flight_time == rec.flightTime);
+        REQUIRE(batch[i].stamp_seconds == rec.stampSeconds);
+        REQUIRE(batch[i].latitude == rec.gpsData.latitude);
+        REQUIRE(batch[i].longitude == rec.gpsData.longitude);
+        REQUIRE(batch[i].altitude == rec.gpsData.altitude);
+        REQUIRE(batch[i].ground_speed == rec.groundSpeed);
+        REQUIRE(batch[i].camera_azimuth == rec.camera.azimuth);
+        REQUIRE(batch[i].video_freq == rec.videoTxFreq);
+
+        REQUIRE(memcmp(&batch[i], &indexed[i], sizeof(el3dec_record)) == 0);
+        REQUIRE(memcmp(&batch[i], &streamed[i], sizeof(el3dec_record)) == 0);
+    }
+
+    SECTION("Errors are statuses")
+    {
+        el3dec_record rec;
+
+        REQUIRE(el3dec_decode(payload_ok, 2, EL3DEC_FAULT_TOLERANT, &rec) == EL3DEC_INVALID);
+        REQUIRE(rec.status == EL3DEC_INVALID);
+        REQUIRE(rec.uav_no == 0);
+    }
+
+    SECTION("Lengths past the row are errors, not reads past it")
+    {
+        std::vector<uint16_t> longer(lengths);
+
+        longer[0] = MAX_PAYLOAD_BYTES + 1;
+        longer.back() = 60000;
+
+        REQUIRE(el3dec_decode_batch(rows.data(), MAX_PAYLOAD_BYTES, longer.data(), longer.size(),
+            EL3DEC_FAULT_TOLERANT, batch.data()) == vecHexLines.size() - 2);
+        REQUIRE(batch[0].status == EL3DEC_INVALID);
+        REQUIRE(batch.back().status == EL3DEC_INVALID);
+        REQUIRE(batch[1].status == EL3DEC_OK);
+    }
+
+    SECTION("A frame cut short is left for the next call")
+    {
+        REQUIRE(el3dec_decode_stream(stream.data(), offsets[1] + 10, EL3DEC_FAULT_TOLERANT,
+            streamed.data(), streamed.size(), &consumed) == 1);
+        REQUIRE(consumed == offsets[1]);
+    }
+}
+
+TEST_CASE("el3dec Packet layouts")
+{
+    REQUIRE(el3LayoutVersion(ENICS_ELERON_PACKET_TELEMETRY) == El3EleronTelemetryV1::version);
+    REQUIRE(el3LayoutVersion(0x01) == 0);
+    REQUIRE_FALSE(el3SelectLayout(ENICS_ELERON_PACKET_TELEMETRY, 99));
+    REQUIRE_FALSE(el3SelectLayout(0x01, 1));
+    REQUIRE(el3SelectLayout(ENICS_ELERON_PACKET_TELEMETRY, El3EleronTelemetryV1::version));
+
+    SECTION("Packet types without a layout decode the header only")
+    {
+        unsigned char frame[sizeof(payload_ok)];
+
+        memcpy(frame, payload_ok, sizeof(frame));
+        frame[EL3_HEADER_PACKET_TYPE] = 0x01;
+
+        El3Telemetry telemetry(frame, sizeof(frame), FAULT_INTOLERANT);
+
+        REQUIRE(telemetry.PacketType() == 0x01);
+        REQUIRE(telemetry.ID() == 1337);
+        REQUIRE(telemetry.Latitude() == 0);
+        REQUIRE(telemetry.VideoFreq() == 0);
+    }
+
+    SECTION("Full length and length checked decoding agree")
+    {
+        std::vector<std::string> vecHexLines;
+        readSamples(EL3DEC_TEST_FIXTURES "/telemetry-samples.txt", vecHexLines, 64);
+
+        for (auto &s: vecHexLines)
+        {
+            auto bindata = str2bin(s);
+
+            /* just short of the camera fields, so every check runs (the length byte must agree) */
+            bindata[EL3_HEADER_LENGTH] = El3EleronTelemetryV1::fullLength - 1;
+
+            El3Telemetry full(bindata.data(), El3EleronTelemetryV1::fullLength, FAULT_TOLERANT);
+            El3Telemetry checked(bindata.data(), El3EleronTelemetryV1::fullLength - 1, FAULT_TOLERANT);
+
+            El3TelemetryRecord a = full.Record(), b = checked.Record();
+
+            REQUIRE(a.camera.azimuth != 0);
+            REQUIRE(b.camera.azimuth == 0);
+
+            b.camera = a.camera;
+            REQUIRE(memcmp(&a, &b, sizeof(a)) == 0);
+        }
+    }
+}
+
+TEST_CASE("el3dec Frame pre-filter")
+{
+    El3Screen screen;
+    unsigned char frame[sizeof(payload_ok)];
+
+    memcpy(frame, payload_ok, sizeof(frame));
+
+    auto verdict = [&](const El3Screen &s, size_t len) { return EL3_SCREEN_VERDICT(s.screen(frame, len)); };
+    auto reason = [&](const El3Screen &s, size_t len) { return EL3_SCREEN_REASON(s.screen(frame, len)); };
+
+    SECTION("Verdicts and reasons")
+    {
+        REQUIRE(verdict(screen, sizeof(frame)) == SCREEN_ACCEPT);
+        REQUIRE(reason(screen, sizeof(frame)) == SCREEN_OK);
+        REQUIRE(reason(screen, 5) == SCREEN_SHORT);
+        REQUIRE(verdict(screen, 5) == SCREEN_REJECT);
+
+        /* sound header, but the frame ends before the camera fields */
+        frame[EL3_HEADER_LENGTH] = 40;
+        REQUIRE(verdict(screen, 50) == SCREEN_DECODE);
+        REQUIRE(reason(screen, 50) == SCREEN_OK);
+        REQUIRE(reason(screen, 39) == SCREEN_LENGTH);
+        frame[EL3_HEADER_LENGTH] = 0;
+        REQUIRE(reason(screen, sizeof(frame)) == SCREEN_LENGTH);
+        frame[EL3_HEADER_LENGTH] = payload_ok[EL3_HEADER_LENGTH];
+
+        frame[EL3_HEADER_PACKET_TYPE] = 0x01;
+        REQUIRE(reason(screen, sizeof(frame)) == SCREEN_PACKET_TYPE);
+        REQUIRE(verdict(el3DecodableScreen(), sizeof(frame)) == SCREEN_ACCEPT);
+        frame[EL3_HEADER_PACKET_TYPE] = ENICS_ELERON_PACKET_TELEMETRY;
+
+        El3ScreenConfig config;
+        config.engineTypes = (uint8_t) ~(1 << 1);
+        REQUIRE(reason(El3Screen(config), sizeof(frame)) == SCREEN_ENGINE_TYPE);
+        config.engineTypes = 0xff;
+        config.uavTypes = ~(1u << 1);
+        REQUIRE(reason(El3Screen(config), sizeof(frame)) == SCREEN_UAV_TYPE);
+
+        /* the first failing check is the one reported */
+        frame[EL3_HEADER_MAGIC] = 0x55;
+        REQUIRE(reason(El3Screen(config), sizeof(frame)) == SCREEN_MAGIC);
+    }
+
+    std::mt19937 rng(1337);
+    std::vector<std::vector<unsigned char>> corpus;
+
+    /* noise, frames with a damaged header byte, frames cut short */
+    for (int i = 0; i < 3000; i++)
+    {
+        std::vector<unsigned char> f(payload_ok, payload_ok + sizeof(payload_ok));
+
+        switch (i % 3)
+        {
+            case 0:
+                f.resize(rng() % 300);
+                for (auto &b : f)
+                    b = rng();
+                if (!f.empty() && rng() % 2)
+                    f[0] = ENICS_ELERON_PACKET_MAGICBYTE;
+                break;
+            case 1:
+                f[rng() % (EL3_HEADER_PACKET_TYPE + 1)] = rng();
+                break;
+            default:
+                f.resize(rng() % sizeof(payload_ok));
+                /* half of them with a length byte that agrees */
+                if (f.size() > EL3_HEADER_LENGTH + 3 && rng() % 2)
+                    f[EL3_HEADER_LENGTH] = f.size() - 3;
+                break;
+        }
+
+        corpus.push_back(f);
+    }
+
+    SECTION("Batch screening matches one frame at a time")
+    {
+        El3ScreenConfig config;
+        config.engineTypes = 0x0f;
+        config.uavTypes = 0x0000ffff;
+        El3Screen picky(config);
+
+        std::vector<const unsigned char *> ptrs;
+        std::vector<size_t> lens;
+        std::vector<unsigned char> rows(corpus.size() * 300, 0);
+        std::vector<uint16_t> rowLens;
+
+        for (size_t i = 0; i < corpus.size(); i++)
+        {
+            ptrs.push_back(corpus[i].data());
+            lens.push_back(corpus[i].size());
+            rowLens.push_back(corpus[i].size());
+            std::copy(corpus[i].begin(), corpus[i].end(), rows.begin() + i * 300);
+        }
+
+        std::vector<uint8_t> batch(corpus.size()), strided(corpus.size());
+        El3ScreenCounters counters = {}, expected = {};
+
+        picky.screen(ptrs.data(), lens.data(), corpus.size(), batch.data(), &counters);
+        picky.screen(rows.data(), 300, rowLens.data(), corpus.size(), strided.data());
+
+        for (size_t i = 0; i < corpus.size(); i++)
+        {
+            uint8_t single = picky.screen(corpus[i].data(), corpus[i].size());
+
+            REQUIRE(batch[i] == single);
+            REQUIRE(strided[i] == single);
+            El3Screen::count(&single, 1, expected);
+        }
+
+        REQUIRE(counters.screened() == corpus.size());
+        REQUIRE(memcmp(&counters, &expected, sizeof(counters)) == 0);
+        REQUIRE(counters.accepted > 0);
+        REQUIRE(counters.decode > 0);
+
+        for (int r = SCREEN_SHORT; r < SCREEN_REASONS; r++)
+            REQUIRE(counters.rejected[r] > 0);
+    }
+
+    SECTION("Accepted frames decode, rejected ones do not")
+    {
+        for (auto &f : corpus)
+        {
+            El3ScreenVerdict v = EL3_SCREEN_VERDICT(el3DecodableScreen().screen(f.data(), f.size()));
+
+            if (v == SCREEN_ACCEPT)
+                REQUIRE_NOTHROW(El3Telemetry(f.data(), f.size(), FAULT_TOLERANT));
+            else if (v == SCREEN_REJECT)
+                REQUIRE_THROWS(El3Telemetry(f.data(), f.size(), FAULT_TOLERANT));
+        }
+    }
+}
+
+TEST_CASE("el3dec Sampled tracing")
+{
+    rapidjson::Document doc;
+
+    auto tracedPackets = [](int count) {
+        for (int i = 0; i < count; i++)
+        {
+            el3TraceBegin();
+
+            El3Telemetry telemetry(payload_ok, sizeof(payload_ok), FAULT_TOLERANT);
+            telemetry.toJson(false);
+
+            el3TraceFinish(el3TraceDetach(), TRACE_WRITE);
+        }
+    };
+
+    el3TraceSampling(0);
+    el3TraceClear();
+    tracedPackets(10);
+
+    doc.Parse(el3TraceJson().c_str());
+    REQUIRE(doc["traceEvents"].Size() == 0);
+
+    SECTION("One packet in N is traced, stage by stage")
+    {
+        el3TraceSampling(2);
+        tracedPackets(10);
+        el3TraceSampling(0);
+
+        doc.Parse(el3TraceJson().c_str());
+
+        const rapidjson::Value &events = doc["traceEvents"];
+        const char *stages[] = { "decode", "json", "write" };
+
+        REQUIRE(events.Size() == 5 * 3);
+
+        for (rapidjson::SizeType i = 0; i < events.Size(); i++)
+        {
+            const rapidjson::Value &ev = events[i];
+
+            REQUIRE(std::string(ev["ph"].GetString()) == "X");
+            REQUIRE(std::string(ev["name"].GetString()) == stages[i % 3]);
+            REQUIRE(ev["dur"].GetDouble() >= 0);
+
+            /* a packet's stages follow each other */
+            if (i % 3)
+            {
+                const rapidjson::Value &prev = events[i - 1];
+
+                REQUIRE(ev["args"]["packet"].GetUint() == prev["args"]["packet"].GetUint());
+                REQUIRE(ev["ts"].GetDouble() >= prev["ts"].GetDouble());
+            }
+            else if (i)
+            {
+                REQUIRE(ev["args"]["packet"].GetUint() != events[i - 1]["args"]["packet"].GetUint());
+            }
+        }
+    }
+
+    SECTION("Every thread has its own buffer")
+    {
+        el3TraceSampling(1);
+        tracedPackets(1);
+        std::thread other([&] { tracedPackets(1); });
+        other.join();
+        el3TraceSampling(0);
+
+        doc.Parse(el3TraceJson().c_str());
+
+        const rapidjson::Value &events = doc["traceEvents"];
+
+        REQUIRE(events.Size() == 2 * 3);
+        REQUIRE(events[0]["tid"].GetUint() != events[3]["tid"].GetUint());
+
+        el3TraceClear();
+        doc.Parse(el3TraceJson().c_str());
+        REQUIRE(doc["traceEvents"].Size() == 0);
+    }
+}
+
+TEST_CASE("el3dec Track store and snapshots")
+{
+    std::vector<std::string> vecHexLines;
+    readSamples(EL3DEC_TEST_FIXTURES "/telemetry-samples.txt", vecHexLines, 200);
+
+    El3TrackStore store;
+    El3TrackFilter filter;
+    const int64_t start = 1663030425LL * 1000000000LL;
+
+    for (size_t i = 0; i < vecHexLines.size(); i++)
+    {
+        auto bindata = str2bin(vecHexLines[i]);
+        El3TelemetryRecord rec = El3Telemetry(bindata.data(), bindata.size(), FAULT_TOLERANT).Record();
+
+        /* three UAVs sharing the recording */
+        rec.uavNo = 1000 + i % 3;
+        filter.check(rec);
+        store.update(rec, start + i);
+        store.counters().frames++;
+        store.counters().decoded++;
+    }
+
+    REQUIRE(store.size() == 3);
+    REQUIRE(filter.tracks() == 3);
+
+    const El3TrackEntry *entry = store.find(1001);
+    REQUIRE(entry != NULL);
+    REQUIRE(entry->count == EL3_TRACK_HISTORY);
+    REQUIRE(entry->fixes == 67);     /* frames 1, 4, ... 199 */
+    REQUIRE(entry->firstNs == start + 1);
+    REQUIRE(entry->lastNs == start + 199);
+    REQUIRE(store.find(1337) == NULL);
+
+    std::vector<El3TelemetryRecord> history;
+    store.history(1001, history);
+    REQUIRE(history.size() == EL3_TRACK_HISTORY);
+    REQUIRE(memcmp(&history.back(), &entry->latest(), sizeof(El3TelemetryRecord)) == 0);
+
+    char path[] = "/tmp/el3dec_snapshot_XXXXXX";
+    int fd = mkstemp(path);
+    REQUIRE(fd >= 0);
+    close(fd);
+
+    SECTION("A snapshot restores the store and the filter")
+    {
+        REQUIRE(el3WriteSnapshot(path, store, &filter));
+
+        El3SnapshotReader snapshot(path);
+        El3TrackStore restored;
+        El3TrackFilter restoredFilter;
+
+        REQUIRE(snapshot.header().tracks == 3);
+        REQUIRE(snapshot.header().filterTracks == 3);
+        snapshot.restore(restored, &restoredFilter);
+
+        REQUIRE(restored.size() == store.size());
+        REQUIRE(memcmp(restored.entries(), store.entries(), store.size() * sizeof(El3TrackEntry)) == 0);
+        REQUIRE(memcmp(&restored.counters(), &store.counters(), sizeof(El3TrackStoreCounters)) == 0);
+        REQUIRE(restoredFilter.tracks() == 3);
+
+        /* both carry on alike */
+        restored.update(entry->latest(), start + 1000);
+        REQUIRE(restored.find(1001)->fixes == entry->fixes + 1);
+
+        for (auto &s : vecHexLines)
+        {
+            auto bindata = str2bin(s);
+            El3TelemetryRecord a = El3Telemetry(bindata.data(), bindata.size(), FAULT_TOLERANT).Record();
+            El3TelemetryRecord b = a;
+
+            a.uavNo = b.uavNo = 1002;
+            REQUIRE(filter.check(a) == restoredFilter.check(b));
+            REQUIRE(a.trackConfidence == b.trackConfidence);
+        }
+    }
+
+    SECTION("A forked child writes the snapshot")
+    {
+        pid_t child = el3ForkSnapshot(path, store, &filter);
+        int status;
+
+        REQUIRE(child > 0);
+        REQUIRE(waitpid(child, &status, 0) == child);
+        REQUIRE(WIFEXITED(status));
+        REQUIRE(WEXITSTATUS(status) == 0);
+
+        El3SnapshotReader snapshot(path);
+        REQUIRE(snapshot.header().tracks == 3);
+    }
+
+    SECTION("Damaged snapshots are refused")
+    {
+        REQUIRE(el3WriteSnapshot(path, store, &filter));
+
+        std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(sizeof(El3SnapshotHeader) + 100);
+        file.put(0x5a);
+        file.close();
+
+        REQUIRE_THROWS_WITH(El3SnapshotReader(path), Catch::Contains("corrupted"));
+
+        REQUIRE(truncate(path, sizeof(El3SnapshotHeader) + 10) == 0);
+        REQUIRE_THROWS_WITH(El3SnapshotReader(path), Catch::Contains("truncated"));
+
+        REQUIRE(truncate(path, 16) == 0);
+        REQUIRE_THROWS_WITH(El3SnapshotReader(path), Catch::Contains("not a snapshot"));
+    }
+
+    unlink(path);
+}
+
+TEST_CASE("el3dec Relay protocol")
+{
+    El3TelemetryRecord rec = El3Telemetry(payload_ok, sizeof(payload_ok), FAULT_TOLERANT).Record();
+
+    SECTION("Records survive the trip")
+    {
+        El3RelayRecord wire;
+        El3TelemetryRecord back;
+
+        rec.trackConfidence = 1.0f;
+        el3RelayPack(rec, 42, wire);
+        el3RelayUnpack(wire, back);
+
+        REQUIRE(wire.recvNs == 42);
+        REQUIRE(back.uavNo == rec.uavNo);
+        REQUIRE(back.uavType == rec.uavType);
+        REQUIRE(back.engineType == rec.engineType);
+        REQUIRE(back.stampSeconds == rec.stampSeconds);
+        REQUIRE(back.gpsData.latitude == rec.gpsData.latitude);
+        REQUIRE(back.gpsData.longitude == rec.gpsData.longitude);
+        REQUIRE(back.gpsData.altitude == rec.gpsData.altitude);
+        REQUIRE(back.camera.azimuth == rec.camera.azimuth);
+        REQUIRE(back.trackConfidence == 1.0f);
+    }
+
+    SECTION("Batches are resent until acknowledged")
+    {
+        El3RelayOutbox outbox(7, 100);
+        El3RelayReader reader;
+        El3RelayMessageView msg;
+        El3RelayBatchHeader hdr;
+        std::string wire;
+
+        outbox.hello(wire);
+        for (int i = 0; i < 30; i++)
+        {
+            rec.uavNo = 1000 + i;
+            outbox.push(rec, i);
+        }
+
+        REQUIRE(outbox.unsent() == 30);
+        REQUIRE(outbox.batch(wire, 20));
+        REQUIRE(outbox.batch(wire, 20));
+        REQUIRE_FALSE(outbox.batch(wire, 20));
+        REQUIRE(outbox.unsent() == 0);
+        REQUIRE(outbox.pending() == 30);
+
+        /* a byte at a time, the reader waits for whole messages */
+        for (size_t i = 0; i < wire.size(); i++)
+        {
+            reader.feed(&wire[i], 1);
+            if (i < sizeof(uint32_t) + 1 + sizeof(El3RelayHello) - 1)
+                REQUIRE_FALSE(reader.next(msg));
+        }
+
+        REQUIRE(reader.next(msg));
+        REQUIRE(msg.type == RELAY_HELLO);
+
+        El3RelayHello hello;
+        memcpy(&hello, msg.body, sizeof(hello));
+        REQUIRE(memcmp(hello.magic, EL3_RELAY_MAGIC, 4) == 0);
+        REQUIRE(hello.sensorId == 7);
+        REQUIRE(hello.session == outbox.session());
+
+        REQUIRE(reader.next(msg));
+        REQUIRE(msg.type == RELAY_BATCH);
+        memcpy(&hdr, msg.body, sizeof(hdr));
+        REQUIRE(hdr.firstSeq == 1);
+        REQUIRE(hdr.count == 20);
+
+        El3RelayRecord last;
+        memcpy(&last, msg.body + sizeof(hdr) + 19 * sizeof(El3RelayRecord), sizeof(last));
+        REQUIRE(last.uavNo == 1019);
+
+        REQUIRE(reader.next(msg));
+        memcpy(&hdr, msg.body, sizeof(hdr));
+        REQUIRE(hdr.firstSeq == 21);
+        REQUIRE(hdr.count == 10);
+        REQUIRE_FALSE(reader.next(msg));
+
+        /* the link drops with 20 acknowledged; what follows is resent */
+        outbox.ack(20);
+        REQUIRE(outbox.pending() == 10);
+        outbox.resume(15);
+        REQUIRE(outbox.pending() == 10);
+        REQUIRE(outbox.unsent() == 10);
+
+        wire.clear();
+        REQUIRE(outbox.batch(wire));
+        reader.feed(wire.data(), wire.size());
+        REQUIRE(reader.next(msg));
+        memcpy(&hdr, msg.body, sizeof(hdr));
+        REQUIRE(hdr.firstSeq == 21);
+        REQUIRE(hdr.count == 10);
+
+        outbox.ack(30);
+        REQUIRE(outbox.pending() == 0);
+        REQUIRE(outbox.dropped() == 0);
+    }
+
+    SECTION("A full outbox drops its oldest records")
+    {
+        El3RelayOutbox outbox(1, 10);
+        El3RelayBatchHeader hdr;
+        std::string wire;
+
+        for (int i = 0; i < 25; i++)
+            outbox.push(rec, i);
+
+        REQUIRE(outbox.pending() == 10);
+        REQUIRE(outbox.dropped() == 15);
+        REQUIRE(outbox.batch(wire));
+
+        memcpy(&hdr, wire.data() + sizeof(uint32_t) + 1, sizeof(hdr));
+        REQUIRE(hdr.firstSeq == 16);
+        REQUIRE(hdr.count == 10);
+    }
+
+    SECTION("The aggregator drops what it already has")
+    {
+        El3RelayPeers peers;
+        El3RelayHello hello = {};
+
+        hello.sensorId = 3;
+        hello.session = 1;
+
+        uint64_t lastSeq;
+
+        REQUIRE(peers.hello(hello, lastSeq));
+        REQUIRE(lastSeq == 0);
+        REQUIRE(peers.receive(3, 1, 20) == 20);
+        REQUIRE(peers.receive(3, 11, 20) == 10);    /* resent in part */
+        REQUIRE(peers.receive(3, 1, 30) == 0);
+        REQUIRE(peers.receive(3, 41, 5) == 5);      /* records lost by the edge */
+        REQUIRE(peers.receive(3, 46, 0) == 0);
+        REQUIRE(peers.lastSeq(3) == 45);
+
+        /* the same edge reconnecting resumes, even before its old link is found closed */
+        REQUIRE(peers.hello(hello, lastSeq));
+        REQUIRE(lastSeq == 45);
+
+        /* another edge with the same ID is refused while the first one is up */
+        hello.session = 2;
+        REQUIRE_FALSE(peers.hello(hello, lastSeq));
+        peers.closed(3, 1);
+        REQUIRE_FALSE(peers.hello(hello, lastSeq));
+        peers.closed(3, 2);                         /* not its session, ignored */
+        peers.closed(3, 1);
+
+        /* a restarted edge starts over once the old one is gone */
+        REQUIRE(peers.hello(hello, lastSeq));
+        REQUIRE(lastSeq == 0);
+        REQUIRE(peers.receive(3, 1, 5) == 5);
+        REQUIRE(peers.size() == 1);
+    }
+
+    SECTION("Malformed streams are refused")
+    {
+        El3RelayReader reader;
+        El3RelayMessageView msg;
+        std::string wire;
+        El3RelayAck ack = { 1 };
+
+        el3RelayMessage(wire, RELAY_ACK, &ack, sizeof(ack) - 1);
+        reader.feed(wire.data(), wire.size());
+        REQUIRE_THROWS_WITH(reader.next(msg), Catch::Contains("invalid length"));
+
+        El3RelayReader unknown;
+        wire.clear();
+        el3RelayMessage(wire, (El3RelayType) 9, &ack, sizeof(ack));
+        unknown.feed(wire.data(), wire.size());
+        REQUIRE_THROWS_WITH(unknown.next(msg), Catch::Contains("unknown"));
+
+        El3RelayReader oversized;
+        uint32_t length = EL3_RELAY_MAX_MESSAGE + 1;
+        oversized.feed(&length, sizeof(length));
+        oversized.feed("\x03", 1);
+        REQUIRE_THROWS(oversized.next(msg));
+
+        /* a batch whose count disagrees with its size */
+        El3RelayReader batch;
+        El3RelayBatchHeader hdr = { 1, 2 };
+        El3RelayRecord records[1] = {};
+        std::string body((const char *) &hdr, sizeof(hdr));
+
+        body.append((const char *) records, sizeof(records));
+        wire.clear();
+        el3RelayMessage(wire, RELAY_BATCH, body.data(), body.size());
+        batch.feed(wire.data(), wire.size());
+        REQUIRE_THROWS(batch.next(msg));
+    }
+}
+
+/* an output writing nowhere, failing or stalling on demand */
+struct TestOutput : public El3OutputSink {
+  std::atomic<int> failures;
+  std::atomic<bool> stalled;
+  std::atomic<size_t> records;
+  std::atomic<int> lastUav;
+
+  TestOutput(const El3OutputConfig &config):
+    El3OutputSink("test", config), failures(0), stalled(false), records(0), lastUav(0) {}
+  ~TestOutput() override { stop(); }
+
+  void write(const std::vector<El3OutputItem> &batch) override {
+    while (stalled)
+      usleep(1000);
+    if (failures > 0)
+    {
+      failures--;
+      throw std::runtime_error("refused");
+    }
+    records += batch.size();
+    lastUav = batch.back().record.uavNo;
+  }
+};
+
+static bool readExactly(int fd, std::string &out, size_t len)
+{
+    char buf[4096];
+
+    while (len)
+    {
+        ssize_t n = read(fd, buf, std::min(len, sizeof(buf)));
+        if (n <= 0)
+            return false;
+        out.append(buf, n);
+        len -= n;
+    }
+    return true;
+}
+
+static int listenLocal(int &port)
+{
+    struct sockaddr_in addr = {};
+    socklen_t len = sizeof(addr);
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bind(fd, (struct sockaddr *) &addr, sizeof(addr));
+    listen(fd, 4);
+    getsockname(fd, (struct sockaddr *) &addr, &len);
+    port = ntohs(addr.sin_port);
+    return fd;
+}
+
+/*
+ * Just enough of an AMQP 0-9-1 broker to take confirmed publishes: the publish numbered nack on
+ * the first connection is refused, the client has to publish its batch again on a second one.
+ */
+struct TestBroker {
+  int fd;
+  int port;
+  uint64_t nack;
+  std::string user;
+  std::vector<std::string> bodies;
+  std::thread thread;
+
+  TestBroker(uint64_t n): nack(n) {
+    fd = listenLocal(port);
+    thread = std::thread([this] { for (int i = 0; i < 2; i++) serve(i == 0); });
+  }
+
+  ~TestBroker() {
+    thread.join();
+    close(fd);
+  }
+
+  static void send(int conn, uint8_t type, const std::string &payload) {
+    std::string frame;
+    uint32_t len = htonl(payload.size());
+
+    frame.push_back(type);
+    frame.append("\0\1", 2);
+    frame.append((const char *) &len, 4);
+    frame.append(payload);
+    frame.push_back((char) 0xce);
+    REQUIRE(write(conn, frame.data(), frame.size()) == (ssize_t) frame.size());
+  }
+
+  static std::string method(uint16_t classId, uint16_t methodId, const std::string &args) {
+    std::string m;
+
+    m.push_back(classId >> 8);  m.push_back(classId);
+    m.push_back(methodId >> 8); m.push_back(methodId);
+    return m + args;
+  }
+
+  /* class * 1000 + method for method frames, payload in body */
+  static int read(int conn, std::string &body) {
+    std::string hdr;
+
+    body.clear();
+    if (!readExactly(conn, hdr, 7))
+      return -1;
+
+    uint32_t len = (uint8_t) hdr[3] << 24 | (uint8_t) hdr[4] << 16 | (uint8_t) hdr[5] << 8 | (uint8_t) hdr[6];
+    if (!readExactly(conn, body, len + 1) || (uint8_t) body.back() != 0xce)
+      return -1;
+    body.pop_back();
+
+    if (hdr[0] != 1)
+      return 0;
+
+    int id = ((uint8_t) body[0] << 8 | (uint8_t) body[1]) * 1000 + ((uint8_t) body[2] << 8 | (uint8_t) body[3]);
+    body.erase(0, 4);
+    return id;
+  }
+
+  void serve(bool first) {
+    int conn = accept(fd, NULL, NULL);
+    std::string in;
+    uint64_t tag = 0;
+
+    bodies.clear();
+    REQUIRE(readExactly(conn, in, 8));
+    REQUIRE(in == std::string("AMQP\0\0\x09\x01", 8));
+
+    send(conn, 1, method(10, 10, std::string("\0\x09\0\0\0\0\0\0\0\x05PLAIN\0\0\0\x05" "en_US", 24)));
+    REQUIRE(read(conn, in) == 10011);
+    user = in.substr(4 + 1 + 5 + 4 + 1, in.find('\0', 15) - 15);
+    send(conn, 1, method(10, 30, std::string("\0\0\0\0\x10\0\0\x3c", 8)));
+    REQUIRE(read(conn, in) == 10031);
+    REQUIRE(read(conn, in) == 10040);
+    send(conn, 1, method(10, 41, std::string("\0", 1)));
+    REQUIRE(read(conn, in) == 20010);
+    send(conn, 1, method(20, 11, std::string("\0\0\0\0", 4)));
+    REQUIRE(read(conn, in) == 85010);
+    send(conn, 1, method(85, 11, ""));
+
+    for (;;)
+    {
+      int id = read(conn, in);
+
+      if (id < 0)
+        break;
+
+      if (id == 10050)
+      {
+        send(conn, 1, method(10, 51, ""));
+        break;
+      }
+
+      if (id != 60040)
+        continue;
+
+      /* content header, then the body in as many frames as it takes */
+      REQUIRE(read(conn, in) == 0);
+      uint64_t size = 0;
+      for (int i = 4; i < 12; i++)
+        size = size << 8 | (uint8_t) in[i];
+
+      std::string body, part;
+      while (body.size() < size)
+      {
+        REQUIRE(read(conn, part) == 0);
+        body += part;
+      }
+
+      std::string confirm(8, '\0');
+      tag++;
+      for (int i = 0; i < 8; i++)
+        confirm[i] = tag >> (56 - 8 * i);
+      confirm.push_back(1);
+
+      if (first && tag == nack)
+        send(conn, 1, method(60, 120, confirm));
+      else
+      {
+        bodies.push_back(body);
+        send(conn, 1, method(60, 80, confirm));
+      }
+    }
+
+    close(conn);
+  }
+};
+
+TEST_CASE("el3dec Output sinks")
+{
+    El3TelemetryRecord rec = El3Telemetry(payload_ok, sizeof(payload_ok), FAULT_TOLERANT).Record();
+    El3OutputConfig config;
+    rapidjson::Document doc;
+
+    config.batch = 50;
+    config.flushMs = 10;
+
+    SECTION("Files, rotated")
+    {
+        char dir[] = "/tmp/el3dec_output_XXXXXX";
+        REQUIRE(mkdtemp(dir) != NULL);
+
+        {
+            El3FileOutput output(std::string(dir) + "/out-%N.ndjson", config, 8192);
+
+            output.start();
+            for (int i = 0; i < 300; i++)
+            {
+                rec.uavNo = i;
+                REQUIRE(output.push(rec, 1000 + i));
+            }
+            output.stop();
+
+            REQUIRE(output.counters().written == 300);
+            REQUIRE(output.counters().dropped == 0);
+        }
+
+        int files = 0, lines = 0;
+
+        for (;; files++)
+        {
+            std::ifstream file(std::string(dir) + "/out-" + std::to_string(files) + ".ndjson");
+            std::string line;
+
+            if (!file)
+                break;
+
+            while (std::getline(file, line))
+            {
+                doc.Parse(line.c_str());
+                REQUIRE_FALSE(doc.HasParseError());
+                REQUIRE(doc["recv_ns"].GetInt64() == 1000 + lines);
+                REQUIRE(doc["telemetry"]["uav_id"].GetInt() == lines);
+                lines++;
+            }
+        }
+
+        REQUIRE(files > 1);
+        REQUIRE(lines == 300);
+
+        {
+            config.format = OUTPUT_RELAY;
+            El3FileOutput output(std::string(dir) + "/out.bin", config, 100 * sizeof(El3RelayRecord));
+
+            output.start();
+            for (int i = 0; i < 300; i++)
+            {
+                rec.uavNo = i;
+                output.push(rec, i);
+            }
+        }
+
+        /* out.bin holds the newest, rotated files the rest */
+        std::ifstream newest(std::string(dir) + "/out.bin", std::ios::binary);
+        std::ifstream oldest(std::string(dir) + "/out.bin.0", std::ios::binary);
+        El3RelayRecord packed;
+        El3TelemetryRecord unpacked;
+
+        REQUIRE(oldest.read((char *) &packed, sizeof(packed)));
+        el3RelayUnpack(packed, unpacked);
+        REQUIRE(unpacked.uavNo == 0);
+        REQUIRE(unpacked.gpsData.latitude == rec.gpsData.latitude);
+
+        newest.seekg(-(std::streamoff) sizeof(packed), std::ios::end);
+        REQUIRE(newest.read((char *) &packed, sizeof(packed)));
+        REQUIRE(packed.uavNo == 299);
+
+        REQUIRE(system((std::string("rm -r ") + dir).c_str()) == 0);
+    }
+
+    SECTION("Full queues drop or block as configured")
+    {
+        config.queue = 10;
+        config.batch = 5;
+
+        config.policy = OUTPUT_DROP_NEWEST;
+        {
+            TestOutput output(config);
+
+            output.stalled = true;
+            output.start();
+            for (int i = 0; i < 100; i++)
+            {
+                rec.uavNo = i;
+                output.push(rec, i);
+            }
+
+            El3OutputCounters counters = output.counters();
+            REQUIRE(counters.queued + counters.dropped == 100);
+            REQUIRE(counters.queued <= 15);
+
+            output.stalled = false;
+            output.stop();
+            REQUIRE(output.records == counters.queued);
+            REQUIRE(output.lastUav < 15);
+        }
+
+        config.policy = OUTPUT_DROP_OLDEST;
+        {
+            TestOutput output(config);
+
+            output.stalled = true;
+            output.start();
+            for (int i = 0; i < 100; i++)
+            {
+                rec.uavNo = i;
+                REQUIRE(output.push(rec, i));
+            }
+
+            output.stalled = false;
+            output.stop();
+            REQUIRE(output.counters().dropped >= 85);
+            REQUIRE(output.records + output.counters().dropped == 100);
+            REQUIRE(output.lastUav == 99);
+        }
+
+        config.policy = OUTPUT_BLOCK;
+        {
+            TestOutput output(config);
+            std::atomic<int> pushed(0);
+
+            output.stalled = true;
+            output.start();
+
+            std::thread producer([&] {
+                for (int i = 0; i < 100; i++, pushed++)
+                    output.push(rec, i);
+            });
+
+            usleep(50000);
+            REQUIRE(pushed <= 15);
+
+            output.stalled = false;
+            producer.join();
+            output.stop();
+            REQUIRE(output.records == 100);
+            REQUIRE(output.counters().dropped == 0);
+        }
+    }
+
+    SECTION("Failed batches are retried")
+    {
+        TestOutput output(config);
+
+        output.failures = 3;
+        output.start();
+        for (int i = 0; i < 20; i++)
+            output.push(rec, i);
+        output.stop();
+
+        REQUIRE(output.records == 20);
+        REQUIRE(output.counters().failures == 3);
+        REQUIRE(output.lastError().empty());
+    }
+
+    SECTION("TCP push")
+    {
+        int port;
+        int fd = listenLocal(port);
+        std::string received;
+
+        std::thread peer([&] {
+            int conn = accept(fd, NULL, NULL);
+            readExactly(conn, received, SIZE_MAX);
+            close(conn);
+        });
+
+        {
+            El3TcpOutput output("127.0.0.1", std::to_string(port), config);
+
+            output.start();
+            for (int i = 0; i < 100; i++)
+                output.push(rec, i);
+        }
+
+        peer.join();
+        close(fd);
+
+        REQUIRE(std::count(received.begin(), received.end(), '\n') == 100);
+    }
+
+    SECTION("AMQP publish with confirms")
+    {
+        TestBroker broker(5);
+        El3AmqpConfig amqp;
+
+        amqp.port = std::to_string(broker.port);
+        config.batch = 20;
+        config.flushMs = 1000;
+
+        {
+            El3AmqpOutput output(amqp, config);
+
+            output.start();
+            for (int i = 0; i < 20; i++)
+            {
+                rec.uavNo = i;
+                output.push(rec, i);
+            }
+            output.stop();
+
+            /* refused once, published again whole */
+            REQUIRE(output.counters().failures == 1);
+            REQUIRE(output.counters().written == 20);
+        }
+
+        REQUIRE(broker.user == "guest");
+        REQUIRE(broker.bodies.size() == 20);
+
+        for (int i = 0; i < 20; i++)
+        {
+            doc.Parse(broker.bodies[i].c_str());
+            REQUIRE_FALSE(doc.HasParseError());
+            REQUIRE(doc["telemetry"]["uav_id"].GetInt() == i);
+        }
+    }
+
+    SECTION("Command line specs")
+    {
+        auto output = el3OutputSink("file:/tmp/el3dec.bin,format=binary,policy=block,rotate-mb=1");
+        REQUIRE(output->name() == "file:/tmp/el3dec.bin");
+        REQUIRE(output->config().format == OUTPUT_BINARY);
+        REQUIRE(output->config().policy == OUTPUT_BLOCK);
+
+        output = el3OutputSink("file:/tmp/el3dec.relay,format=relay");
+        REQUIRE(output->config().format == OUTPUT_RELAY);
+
+        output = el3OutputSink("amqp:localhost,exchange=,routing-key=el3,batch=64");
+        REQUIRE(output->name() == "amqp:localhost:5672/");
+        REQUIRE(output->config().batch == 64);
+
+        REQUIRE(el3OutputSink("tcp:127.0.0.1:9000")->name() == "tcp:127.0.0.1:9000");
+
+        REQUIRE_THROWS_AS(el3OutputSink("kafka:localhost:9092"), std::invalid_argument);
+        REQUIRE_THROWS_AS(el3OutputSink("tcp:localhost"), std::invalid_argument);
+        REQUIRE_THROWS_AS(el3OutputSink("file:"), std::invalid_argument);
+        REQUIRE_THROWS_AS(el3OutputSink("file:x,queue=many"), std::invalid_argument);
+        REQUIRE_THROWS_AS(el3OutputSink("file:x,exchange=y"), std::invalid_argument);
+        REQUIRE_THROWS_AS(el3OutputSink("tcp:h:1,format=xml"), std::invalid_argument);
+
+        /* Arrow batches are record batches, larger by default; AMQP publishes single records */
+        REQUIRE(el3OutputSink("tcp:h:1,format=arrow")->config().batch == EL3_ARROW_BATCH_ROWS);
+        REQUIRE(el3OutputSink("file:x,format=arrow,batch=64")->config().batch == 64);
+        REQUIRE_THROWS_AS(el3OutputSink("amqp:localhost,format=arrow"), std::invalid_argument);
+    }
+}
+
+/* reads back what El3ArrowWriter wrote, tables by field ID as Arrow's .fbs files number them */
+struct FlatTable {
+    const unsigned char *buf;
+    uint32_t pos;
+
+    const unsigned char *field(unsigned id) const
+    {
+        int32_t soffset;
+        uint16_t vtableSize, offset = 0;
+
+        memcpy(&soffset, buf + pos, sizeof(soffset));
+        memcpy(&vtableSize, buf + pos - soffset, sizeof(vtableSize));
+        if (4 + 2 * id < vtableSize)
+            memcpy(&offset, buf + pos - soffset + 4 + 2 * id, sizeof(offset));
+        return offset ? buf + pos + offset : NULL;
+    }
+
+    template <typename T>
+    T scalar(unsigned id) const
+    {
+        T value = 0;
+        if (field(id))
+            memcpy(&value, field(id), sizeof(value));
+        return value;
+    }
+
+    /* a table, or the start of a vector or string, with its element count */
+    const unsigned char *ref(unsigned id, uint32_t *count = NULL) const
+    {
+        const unsigned char *p = field(id);
+        uint32_t rel;
+
+        REQUIRE(p != NULL);
+        memcpy(&rel, p, sizeof(rel));
+        p += rel;
+        if (count)
+        {
+            memcpy(count, p, sizeof(*count));
+            p += sizeof(*count);
+        }
+        return p;
+    }
+
+    FlatTable table(unsigned id) const { return FlatTable{ buf, (uint32_t) (ref(id) - buf) }; }
+
+    FlatTable element(unsigned id, uint32_t n) const
+    {
+        const unsigned char *p = ref(id, NULL) + sizeof(uint32_t) + n * sizeof(uint32_t);
+        uint32_t rel;
+
+        memcpy(&rel, p, sizeof(rel));
+        return FlatTable{ buf, (uint32_t) (p + rel - buf) };
+    }
+
+    std::string string(unsigned id) const
+    {
+        uint32_t len;
+        const char *p = (const char *) ref(id, &len);
+        return std::string(p, len);
+    }
+};
+
+static FlatTable flatRoot(const unsigned char *buf)
+{
+    uint32_t root;
+    memcpy(&root, buf, sizeof(root));
+    return FlatTable{ buf, root };
+}
+
+/* the encapsulated message at offset: its Message table, and where its body starts */
+static FlatTable arrowMessage(const std::string &data, size_t offset, size_t &body)
+{
+    uint32_t prefix[2];
+
+    REQUIRE(offset + sizeof(prefix) <= data.size());
+    memcpy(prefix, data.data() + offset, sizeof(prefix));
+    REQUIRE(prefix[0] == 0xffffffffu);
+    REQUIRE(prefix[1] % 8 == 0);
+
+    body = offset + sizeof(prefix) + prefix[1];
+    return flatRoot((const unsigned char *) data.data() + offset + sizeof(prefix));
+}
+
+/* el3dec_app with args, its exit status */
+static int runApp(const std::vector<std::string> &args)
+{
+    pid_t pid = fork();
+
+    if (pid == 0)
+    {
+        std::vector<char *> argv;
+        int null = open("/dev/null", O_WRONLY);
+
+        dup2(null, STDERR_FILENO);
+        argv.push_back((char *) EL3DEC_APP);
+        for (auto &arg : args)
+            argv.push_back((char *) arg.c_str());
+        argv.push_back(NULL);
+
+        execv(EL3DEC_APP, argv.data());
+        _exit(127);
+    }
+
+    int status = -1;
+
+    if (pid < 0 || waitpid(pid, &status, 0) != pid || !WIFEXITED(status))
+        return -1;
+    return WEXITSTATUS(status);
+}
+
+static std::string readFile(const std::string &path)
+{
+    std::ifstream in(path, std::ios::binary);
+    return std::string((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+}
+
+TEST_CASE("el3dec Arrow IPC export")
+{
+    El3TelemetryRecord rec = El3Telemetry(payload_ok, sizeof(payload_ok), FAULT_TOLERANT).Record();
+    const size_t rows = EL3_ARROW_BATCH_ROWS + 100;
+    const int64_t start = 1663030425LL * 1000000000LL;
+
+    SECTION("Files: schema, batches and footer")
+    {
+        El3ArrowWriter arrow(ARROW_FILE);
+        std::string out;
+
+        arrow.begin(out);
+        for (size_t i = 0; i < rows; i++)
+        {
+            rec.uavNo = i;
+            arrow.add(rec, start + i);
+            if (arrow.pending() == EL3_ARROW_BATCH_ROWS)
+                arrow.batch(out);
+        }
+        arrow.end(out);
+
+        REQUIRE(arrow.rows() == rows);
+        REQUIRE(arrow.batches() == 2);
+        REQUIRE(out.compare(0, 8, std::string("ARROW1\0\0", 8)) == 0);
+        REQUIRE(out.compare(out.size() - 6, 6, "ARROW1") == 0);
+
+        /* the schema comes first */
+        size_t body;
+        FlatTable msg = arrowMessage(out, 8, body);
+        REQUIRE(msg.scalar<int16_t>(0) == 4);
+        REQUIRE(msg.scalar<uint8_t>(1) == 1);
+
+        FlatTable schema = msg.table(2);
+        uint32_t fields;
+        schema.ref(1, &fields);
+        REQUIRE(fields == 23);
+        REQUIRE(schema.element(1, 0).string(0) == "recv_ns");
+        REQUIRE(schema.element(1, 0).scalar<uint8_t>(2) == 10);
+        REQUIRE(schema.element(1, 4).string(0) == "uav_id");
+        REQUIRE(schema.element(1, 4).table(3).scalar<int32_t>(0) == 16);
+        REQUIRE(schema.element(1, 12).string(0) == "gps_latitude");
+        REQUIRE(schema.element(1, 12).scalar<uint8_t>(2) == 3);
+
+        /* the footer indexes the batches */
+        int32_t footerLength;
+        memcpy(&footerLength, out.data() + out.size() - 10, sizeof(footerLength));
+
+        FlatTable footer = flatRoot((const unsigned char *) out.data() + out.size() - 10 - footerLength);
+        uint32_t blocks;
+        const unsigned char *block = footer.ref(3, &blocks);
+        REQUIRE(blocks == 2);
+        REQUIRE(footer.table(1).element(1, 22).string(0) == "track_confidence");
+
+        size_t seen = 0;
+
+        for (uint32_t b = 0; b < blocks; b++, block += 24)
+        {
+            int64_t offset, bodyLength;
+            int32_t metaLength;
+
+            memcpy(&offset, block, 8);
+            memcpy(&metaLength, block + 8, 4);
+            memcpy(&bodyLength, block + 16, 8);
+
+            msg = arrowMessage(out, offset, body);
+            REQUIRE(body == (size_t) (offset + metaLength));
+            REQUIRE(msg.scalar<uint8_t>(1) == 3);
+            REQUIRE(msg.scalar<int64_t>(3) == bodyLength);
+
+            FlatTable batch = msg.table(2);
+            int64_t length = batch.scalar<int64_t>(0);
+            uint32_t buffers;
+            const unsigned char *buffer = batch.ref(2, &buffers);
+
+            REQUIRE(length == (b ? 100 : EL3_ARROW_BATCH_ROWS));
+            REQUIRE(buffers == 2 * 23);
+
+            /* recv_ns, then uav_id, the second buffer (after validity) of columns 0 and 4 */
+            int64_t recvOffset, uavOffset, uavLength, recvNs;
+            uint16_t uav;
+
+            memcpy(&recvOffset, buffer + 16, 8);
+            memcpy(&uavOffset, buffer + 4 * 32 + 16, 8);
+            memcpy(&uavLength, buffer + 4 * 32 + 24, 8);
+            REQUIRE(uavOffset % 64 == 0);
+            REQUIRE(uavLength == length * 2);
+
+            for (int64_t i = 0; i < length; i++, seen++)
+            {
+                memcpy(&recvNs, out.data() + body + recvOffset + i * 8, 8);
+                memcpy(&uav, out.data() + body + uavOffset + i * 2, 2);
+                REQUIRE(recvNs == start + (int64_t) seen);
+                REQUIRE(uav == (uint16_t) seen);
+            }
+        }
+
+        REQUIRE(seen == rows);
+    }
+
+    SECTION("Streams, without receive times")
+    {
+        El3ArrowWriter arrow(ARROW_STREAM, false);
+        std::string out;
+        size_t body;
+
+        arrow.begin(out);
+        arrow.batch(out);
+        REQUIRE(arrow.batches() == 0);
+
+        size_t schemaEnd = out.size();
+        arrow.add(rec);
+        arrow.end(out);
+
+        FlatTable schema = arrowMessage(out, 0, body).table(2);
+        uint32_t fields;
+        schema.ref(1, &fields);
+        REQUIRE(fields == 22);
+        REQUIRE(schema.element(1, 0).string(0) == "packet_type");
+
+        FlatTable msg = arrowMessage(out, schemaEnd, body);
+        REQUIRE(msg.table(2).scalar<int64_t>(0) == 1);
+        REQUIRE(body + msg.scalar<int64_t>(3) + 8 == out.size());
+        REQUIRE(out.compare(out.size() - 8, 8, std::string("\xff\xff\xff\xff\0\0\0\0", 8)) == 0);
+    }
+
+    SECTION("Batch decoding of empty inputs writes complete files")
+    {
+        char dir[] = "/tmp/el3dec_arrow_XXXXXX";
+        REQUIRE(mkdtemp(dir) != NULL);
+
+        std::string text = std::string(dir) + "/empty.txt", archive = std::string(dir) + "/empty.el3cap";
+        std::string out = std::string(dir) + "/out.arrow";
+
+        std::ofstream(text).close();
+        El3CaptureWriter(archive).close();
+
+        for (auto &input : { text, archive })
+        {
+            REQUIRE(runApp({ "--batch", "--format", "arrow", "--output", out, input }) == 0);
+
+            std::string data = readFile(out);
+            size_t body;
+
+            REQUIRE(data.size() > 16);
+            REQUIRE(data.compare(0, 8, std::string("ARROW1\0\0", 8)) == 0);
+            REQUIRE(data.compare(data.size() - 6, 6, "ARROW1") == 0);
+
+            /* receive times are there for archives only */
+            FlatTable schema = arrowMessage(data, 8, body).table(2);
+            uint32_t fields;
+            schema.ref(1, &fields);
+            REQUIRE(fields == (input == archive ? 23 : 22));
+
+            int32_t footerLength;
+            memcpy(&footerLength, data.data() + data.size() - 10, sizeof(footerLength));
+
+            FlatTable footer = flatRoot((const unsigned char *) data.data() + data.size() - 10 - footerLength);
+            uint32_t blocks;
+            footer.ref(3, &blocks);
+            REQUIRE(blocks == 0);
+        }
+
+        std::filesystem::remove_all(dir);
+    }
+
+    SECTION("File sinks write whole files")
+    {
+        char dir[] = "/tmp/el3dec_arrow_XXXXXX";
+        REQUIRE(mkdtemp(dir) != NULL);
+
+        std::string path = std::string(dir) + "/out.arrow";
+        std::ofstream(path) << "not arrow";
+
+        {
+            auto output = el3OutputSink("file:" + path + ",format=arrow,batch=100,flush-ms=10");
+
+            output->start();
+            for (int i = 0; i < 1000; i++)
+            {
+                rec.uavNo = i;
+                REQUIRE(output->push(rec, start + i));
+            }
+            output->stop();
+            REQUIRE(output->counters().written == 1000);
+        }
+
+        std::ifstream file(path, std::ios::binary);
+        std::string out((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        int32_t footerLength;
+
+        /* what was there is kept aside, never appended to */
+        std::ifstream aside(path + ".0");
+        std::string old;
+        REQUIRE(std::getline(aside, old));
+        REQUIRE(old == "not arrow");
+
+        REQUIRE(out.compare(0, 6, "ARROW1") == 0);
+        REQUIRE(out.compare(out.size() - 6, 6, "ARROW1") == 0);
+        memcpy(&footerLength, out.data() + out.size() - 10, sizeof(footerLength));
+
+        FlatTable footer = flatRoot((const unsigned char *) out.data() + out.size() - 10 - footerLength);
+        uint32_t blocks;
+        const unsigned char *block = footer.ref(3, &blocks);
+        int64_t total = 0;
+
+        for (uint32_t b = 0; b < blocks; b++, block += 24)
+        {
+            int64_t offset;
+            size_t body;
+
+            memcpy(&offset, block, 8);
+            total += arrowMessage(out, offset, body).table(2).scalar<int64_t>(0);
+        }
+
+        REQUIRE(blocks >= 10);
+        REQUIRE(total == 1000);
+        REQUIRE(system((std::string("rm -r ") + dir).c_str()) == 0);
+    }
+}
+
+TEST_CASE("el3dec Windowed aggregation")
+{
+    El3TelemetryRecord rec = El3Telemetry(payload_ok, sizeof(payload_ok), FAULT_TOLERANT).Record();
+    const int64_t start = 1663030440LL * 1000000000LL;     /* on a minute */
+    const int64_t sec = 1000000000LL;
+    std::vector<El3WindowSummary> windows;
+
+    SECTION("Tumbling windows")
+    {
+        El3Aggregator agg;
+        const float speeds[] = { 10, 20, 30 };
+        const uint16_t altitudes[] = { 100, 300, 200 };
+
+        for (int i = 0; i < 3; i++)
+        {
+            rec.uavNo = 1;
+            rec.groundSpeed = speeds[i];
+            rec.gpsData.altitude = altitudes[i];
+            rec.videoTxChannel = i ? 5 : 2;
+            agg.add(rec, start + i * sec);
+            agg.receive(7, start + i * sec);
+        }
+
+        rec.uavNo = 2;
+        agg.add(rec, start + 40 * sec);
+        agg.receive(9, start + 40 * sec);
+
+        agg.advance(start + 59 * sec, windows);
+        REQUIRE(windows.empty());
+
+        /* the minute so far */
+        El3WindowSummary now;
+        agg.query(start + 30 * sec, now);
+        REQUIRE(now.startNs == start);
+        REQUIRE(now.endNs == start + 60 * sec);
+        REQUIRE(now.packets == 4);
+        REQUIRE(now.uavs.size() == 2);
+        REQUIRE(now.uavs[0].uavNo == 1);
+        REQUIRE(now.uavs[0].packets == 3);
+        REQUIRE(now.uavs[0].speedMean() == Approx(20));
+        REQUIRE(now.uavs[0].speedMax == 30);
+        REQUIRE(now.uavs[0].altitudeMin == 100);
+        REQUIRE(now.uavs[0].altitudeMax == 300);
+        REQUIRE(now.uavs[0].channels == ((1 << 2) | (1 << 5)));
+        REQUIRE(now.sensors.size() == 2);
+        REQUIRE(now.sensors[0].sensorId == 7);
+        REQUIRE(now.sensors[0].packets == 3);
+        REQUIRE(now.sensors[1].packets == 1);
+
+        /* the next minute closes the first, and forgets the UAV and sensors gone quiet */
+        rec.uavNo = 1;
+        agg.add(rec, start + 61 * sec);
+        agg.advance(start + 61 * sec, windows);
+        REQUIRE(windows.size() == 1);
+        REQUIRE(windows[0].startNs == start);
+        REQUIRE(windows[0].packets == 4);
+        REQUIRE(windows[0].uavs.size() == 2);
+        REQUIRE(agg.uavs() == 1);
+        REQUIRE(agg.sensors() == 0);
+
+        /* too late for any window still open */
+        agg.add(rec, start + 10 * sec);
+        REQUIRE(agg.late() == 1);
+
+        /* a quiet clock still closes the window */
+        windows.clear();
+        agg.advance(start + 125 * sec, windows);
+        REQUIRE(windows.size() == 1);
+        REQUIRE(windows[0].startNs == start + 60 * sec);
+        REQUIRE(windows[0].packets == 1);
+        REQUIRE(agg.uavs() == 0);
+
+        agg.advance(start + 3600 * sec, windows);
+        REQUIRE(windows.size() == 1);
+    }
+
+    SECTION("Sliding windows")
+    {
+        El3AggregateConfig config;
+        config.windowMs = 60000;
+        config.slideMs = 20000;
+        El3Aggregator agg(config);
+
+        for (int i = 0; i < 4; i++)
+        {
+            rec.uavNo = 100 + i;
+            agg.add(rec, start + (5 + 20 * i) * sec);
+        }
+
+        agg.advance(start + 125 * sec, windows);
+
+        /* every window that held a packet, each one slide after the last */
+        const uint64_t packets[] = { 1, 2, 3, 3, 2, 1 };
+        REQUIRE(windows.size() == 6);
+        for (size_t i = 0; i < windows.size(); i++)
+        {
+            REQUIRE(windows[i].endNs == start + 20 * sec * (int64_t) (i + 1));
+            REQUIRE(windows[i].endNs - windows[i].startNs == 60 * sec);
+            REQUIRE(windows[i].packets == packets[i]);
+            REQUIRE(windows[i].uavs.size() == packets[i]);
+        }
+        REQUIRE(agg.uavs() == 0);
+    }
+
+    SECTION("Bounded by the UAVs of a window")
+    {
+        El3Aggregator agg;
+
+        for (int i = 0; i < 1000; i++)
+        {
+            rec.uavNo = i;
+            agg.add(rec, start + i * 1000000LL);
+        }
+        REQUIRE(agg.uavs() == 1000);
+
+        agg.add(rec, start + 120 * sec);
+        REQUIRE(agg.uavs() == 1);
+
+        agg.advance(start + 120 * sec, windows);
+        REQUIRE(windows.size() == 1);
+        REQUIRE(windows[0].uavs.size() == 1000);
+    }
+
+    SECTION("Heatmap and JSON")
+    {
+        El3Aggregator agg;
+
+        rec.gpsData.latitude = 50.4551f;
+        rec.gpsData.longitude = 30.5234f;
+        agg.add(rec, start);
+        agg.add(rec, start + sec);
+        rec.gpsData.latitude = 50.4651f;
+        agg.add(rec, start + 2 * sec);
+
+        /* without a fix */
+        rec.gpsData.latitude = rec.gpsData.longitude = 0;
+        agg.add(rec, start + 3 * sec);
+
+        El3WindowSummary now;
+        agg.query(start, now);
+        REQUIRE(now.packets == 4);
+        REQUIRE(now.cells.size() == 2);
+        REQUIRE(now.cells[0].packets == 2);
+        REQUIRE(now.cells[0].latitude == Approx(50.45f));
+        REQUIRE(now.cells[0].longitude == Approx(30.52f));
+        REQUIRE(now.cells[1].latitude == Approx(50.46f));
+        REQUIRE(now.cellsDropped == 0);
+
+        rapidjson::StringBuffer strbuf;
+        rapidjson::Writer<rapidjson::StringBuffer> writer(strbuf);
+        el3WriteJson(now, writer);
+
+        rapidjson::Document doc;
+        doc.Parse(strbuf.GetString());
+        REQUIRE(!doc.HasParseError());
+        REQUIRE(doc["start_ns"].GetInt64() == start);
+        REQUIRE(doc["packets"].GetUint() == 4);
+        REQUIRE(doc["uavs"][0]["uav_id"].GetUint() == rec.uavNo);
+        REQUIRE(doc["uavs"][0]["video_channels"].Size() == 1);
+        REQUIRE(doc["cells"].Size() == 2);
+        REQUIRE(doc["cells"][0]["packets"].GetUint() == 2);
+    }
+
+    SECTION("Configurations")
+    {
+        El3AggregateConfig config;
+
+        config.slideMs = config.windowMs * 2;
+        REQUIRE_THROWS_AS(El3Aggregator(config), std::invalid_argument);
+
+        config.windowMs = 3600000;
+        config.slideMs = 1000;
+        REQUIRE_THROWS_AS(El3Aggregator(config), std::invalid_argument);
+
+        config.slideMs = 60000;
+        REQUIRE_NOTHROW(El3Aggregator(config));
+    }
+}
+
+TEST_CASE("el3dec Track queries")
+{
+    std::vector<std::string> vecHexLines;
+    readSamples(EL3DEC_TEST_FIXTURES "/telemetry-samples.txt", vecHexLines, 0);
+
+    char early[] = "/tmp/el3dec_query_XXXXXX";
+    char late[] = "/tmp/el3dec_query_XXXXXX";
+    for (char *path : { early, late })
+    {
+        int fd = mkstemp(path);
+        REQUIRE(fd >= 0);
+        close(fd);
+        unlink(path);
+    }
+
+    const int64_t start = 1663030425LL * 1000000000LL;
+    const int64_t step = 500000000LL;
+    El3TrackStore store;
+
+    /* two UAVs taking turns, a third alone for a while; half in each archive */
+    auto uavAt = [](size_t i) { return i >= 1200 && i < 1300 ? 1002 : 1000 + i % 2; };
+
+    /* the late archive is still being written: no index yet */
+    El3CaptureWriter second(late, 4096);
+
+    {
+        El3CaptureWriter first(early, 4096);
+        unsigned char frame[EL3_TELEMETRY_FRAME_LEN];
+
+        for (size_t i = 0; i < 2000; i++)
+        {
+            El3TelemetryRecord rec = decodeSampleRecord(vecHexLines[i % vecHexLines.size()]);
+
+            rec.uavNo = uavAt(i);
+            REQUIRE(el3EncodeTelemetry(rec, frame, sizeof(frame)) == sizeof(frame));
+            (i < 1000 ? first : second).append(start + i * step, 5, frame, sizeof(frame));
+
+            /* the live store saw the same fixes */
+            store.update(El3Telemetry(frame, sizeof(frame), FAULT_TOLERANT).Record(), start + i * step);
+        }
+
+        first.close();
+        second.flush(true);
+    }
+
+    REQUIRE(El3CaptureReader(late).recovered());
+
+    /* and a few more since, not archived */
+    for (size_t i = 2001; i < 2010; i += 2)
+    {
+        El3TelemetryRecord rec = decodeSampleRecord(vecHexLines[i % vecHexLines.size()]);
+
+        rec.uavNo = 1001;
+        store.update(rec, start + i * step);
+    }
+
+    SECTION("Only blocks in range holding the UAV are read")
+    {
+        El3TrackQueryCursor cursor({ 1002, start, start + 3000 * step });
+        std::vector<El3QueryFix> fixes;
+        size_t n = 0;
+
+        cursor.addArchive(early);
+        cursor.addArchive(late);
+
+        while (cursor.next(fixes, 1000))
+        {
+            for (auto &fix : fixes)
+            {
+                REQUIRE(fix.record.uavNo == 1002);
+                REQUIRE(fix.recvNs == start + (int64_t) (1200 + n) * step);
+                REQUIRE(fix.sensorId == 5);
+                n++;
+            }
+        }
+
+        const El3QueryStats &stats = cursor.stats();
+
+        REQUIRE(n == 100);
+        REQUIRE(stats.archives == 1);
+        REQUIRE(stats.blocksInRange == stats.blocks);
+        REQUIRE(stats.blocksRead < stats.blocks / 8);
+        REQUIRE(stats.framesDecoded == 100);
+        REQUIRE(stats.framesScanned < 200);
+        REQUIRE(stats.fixes == 100);
+    }
+
+    SECTION("Archives and live fixes, in chunks")
+    {
+        El3TrackQueryCursor cursor({ 1001, start + 500 * step, start + 2010 * step });
+        std::vector<El3QueryFix> fixes;
+        std::vector<int64_t> times;
+
+        /* planned in time order, whatever order they come in */
+        cursor.addArchive(late);
+        cursor.addArchive(early);
+        cursor.addLive(store, 5);
+
+        while (cursor.next(fixes, 64))
+        {
+            REQUIRE(fixes.size() <= 64);
+            for (auto &fix : fixes)
+            {
+                REQUIRE(fix.record.uavNo == 1001);
+                times.push_back(fix.recvNs);
+            }
+        }
+
+        /* archived ones within [500, 2000) bar the 1002 stretch, then the 5 live only */
+        REQUIRE(times.size() == 750 - 50 + 5);
+        REQUIRE(std::is_sorted(times.begin(), times.end()));
+        REQUIRE(std::adjacent_find(times.begin(), times.end()) == times.end());
+        REQUIRE(times.front() == start + 501 * step);
+        REQUIRE(times.back() == start + 2009 * step);
+        REQUIRE(cursor.stats().fixes == times.size());
+        REQUIRE(cursor.stats().blocksInRange < cursor.stats().blocks);
+        REQUIRE(!cursor.next(fixes, 64));
+        REQUIRE_THROWS(cursor.addArchive(early));
+    }
+
+    SECTION("The archive being written, not flushed for the query")
+    {
+        unsigned char frame[EL3_TELEMETRY_FRAME_LEN];
+        std::vector<unsigned char> tail;
+        std::vector<El3QueryFix> fixes;
+        std::vector<int64_t> times;
+
+        /* the 1001 ones also live */
+        for (size_t i = 2000; i < 2100; i++)
+        {
+            El3TelemetryRecord rec = decodeSampleRecord(vecHexLines[i % vecHexLines.size()]);
+
+            rec.uavNo = uavAt(i);
+            REQUIRE(el3EncodeTelemetry(rec, frame, sizeof(frame)) == sizeof(frame));
+            second.append(start + i * step, 5, frame, sizeof(frame));
+        }
+
+        size_t blocks = second.blocks();
+        uint64_t written = second.unwritten(tail);
+        El3TrackQueryCursor cursor({ 1001, start + 1900 * step, start + 2200 * step });
+
+        REQUIRE(second.blocks() == blocks);
+        REQUIRE(!tail.empty());
+
+        cursor.addCapture(late, written, tail);
+        cursor.addLive(store, 5);
+
+        while (cursor.next(fixes, 16))
+        {
+            for (auto &fix : fixes)
+                times.push_back(fix.recvNs);
+        }
+
+        REQUIRE(times.size() == 100);
+        REQUIRE(std::is_sorted(times.begin(), times.end()));
+        REQUIRE(std::adjacent_find(times.begin(), times.end()) == times.end());
+        REQUIRE(times.front() == start + 1901 * step);
+        REQUIRE(times.back() == start + 2099 * step);
+    }
+
+    SECTION("Nothing in range")
+    {
+        El3TrackQueryCursor cursor({ 1000, start - 10 * step, start - step });
+        std::vector<El3QueryFix> fixes;
+
+        cursor.addArchive(early);
+        cursor.addArchive(late);
+        cursor.addLive(store, 5);
+
+        REQUIRE(!cursor.next(fixes, 64));
+        REQUIRE(cursor.stats().archives == 0);
+        REQUIRE(cursor.stats().blocksRead == 0);
+        REQUIRE_THROWS(El3TrackQueryCursor({ 1000, 0, 1 }).addArchive("/nonexistent.el3cap"));
+    }
+
+    SECTION("Query times")
+    {
+        int64_t ns;
+
+        REQUIRE(el3ParseTime("2022-09-13T14:00:00Z", ns));
+        REQUIRE(ns == 1663077600LL * 1000000000LL);
+        REQUIRE(el3ParseTime("2022-09-13 14:00:00.25", ns));
+        REQUIRE(ns == 1663077600LL * 1000000000LL + 250000000);
+        REQUIRE(el3ParseTime("1663077600", ns));
+        REQUIRE(ns == 1663077600LL * 1000000000LL);
+        REQUIRE(el3ParseTime("1663077600.000000001", ns));
+        REQUIRE(ns == 1663077600LL * 1000000000LL + 1);
+        REQUIRE(el3ParseTime("-0.5", ns));
+        REQUIRE(ns == -500000000);
+
+        REQUIRE(!el3ParseTime("", ns));
+        REQUIRE(!el3ParseTime("14:00", ns));
+        REQUIRE(!el3ParseTime("2022-13-01T00:00:00Z", ns));
+        REQUIRE(!el3ParseTime("2022-09-13T14:00:00+02:00", ns));
+        REQUIRE(!el3ParseTime("1663077600Z", ns));
+        REQUIRE(!el3ParseTime("1663077600.", ns));
+    }
+
+    unlink(early);
+    unlink(late);
+}
+
+static void countingSink(const El3Telemetry &telemetry, void *ctx)
+{
+    std::vector<int> *seen = (std::vector<int> *) ctx;
+
+    seen->push_back(telemetry.ID());
+}
+
+struct CountingSink {
+    int *calls;
+
+    void operator()(const El3Telemetry &telemetry) { (*calls)++; REQUIRE(telemetry.ID() == 1337); }
+};
+
+TEST_CASE("el3dec Decoding sinks")
+{
+    std::vector<std::string> vecHexLines;
+    readSamples(EL3DEC_TEST_FIXTURES "/telemetry-samples.txt", vecHexLines, 32);
+
+    SECTION("Runtime sinks are called per packet type")
+    {
+        std::vector<int> seen, other;
+
+        el3SetSink(ENICS_ELERON_PACKET_TELEMETRY, countingSink, &seen);
+        el3SetSink(0x01, countingSink, &other);
+
+        for (auto &s: vecHexLines)
+            delete el3Decode(str2bin(s).data(), MAX_PAYLOAD_BYTES, FAULT_TOLERANT);
+
+        /* frames that do not decode never reach a sink */
+        REQUIRE_THROWS(el3Decode(payload_ok, 2, FAULT_TOLERANT));
+
+        el3ClearSinks();
+        delete el3Decode(payload_ok, sizeof(payload_ok), FAULT_TOLERANT);
+
+        REQUIRE(seen.size() == vecHexLines.size());
+        REQUIRE(seen[0] == 1337);
+        REQUIRE(other.empty());
+    }
+
+    SECTION("Compile-time sinks")
+    {
+        int calls = 0, skipped = 0;
+        CountingSink sink = { &calls };
+
+        for (auto &s: vecHexLines)
+        {
+            auto bindata = str2bin(s);
+
+            El3Telemetry plain(bindata.data(), bindata.size(), FAULT_TOLERANT, El3NoSink());
+            El3Telemetry one(bindata.data(), bindata.size(), FAULT_TOLERANT, sink);
+            El3Telemetry routed(bindata.data(), bindata.size(), FAULT_TOLERANT,
+                el3SinkChain(el3PacketSink<ENICS_ELERON_PACKET_TELEMETRY>(sink),
+                    el3PacketSink<0x01>(CountingSink { &skipped })));
+
+            REQUIRE(plain.ID() == one.ID());
+        }
+
+        REQUIRE(calls == 2 * (int) vecHexLines.size());
+        REQUIRE(skipped == 0);
+    }
+}
+
+// Allocations made by the second call of fn, the first one warms up caches and scratch buffers
+template <typename F>
+static uint64_t steadyAllocations(F fn)
+{
+    fn();
+
+    El3AllocScope scope;
+    fn();
+
+    return scope.allocations();
+}
+
+TEST_CASE("el3dec Allocation budgets")
+{
+    std::vector<std::string> vecHexLines;
+    std::vector<std::vector<unsigned char>> frames;
+    readSamples(EL3DEC_TEST_FIXTURES "/telemetry-samples.txt", vecHexLines, 64);
+
+    for (auto &s: vecHexLines)
+    {
+        size_t hexlen = s.find_last_of("0123456789abcdefABCDEF") + 1;
+        std::vector<unsigned char> frame(hexlen / 2);
+        REQUIRE(hex_to_bytes(s.data(), hexlen, frame.data(), frame.size()) == frame.size());
+        frames.push_back(frame);
+    }
+
+    SECTION("Decoding into a caller owned object allocates nothing")
+    {
+        REQUIRE(steadyAllocations([&] {
+            for (auto &f: frames)
+            {
+                El3Telemetry telemetry(f.data(), f.size(), FAULT_TOLERANT);
+                El3TelemetryRecord rec = telemetry.Record();
+                (void) rec;
+            }
+        }) == 0);
+    }
+
+    SECTION("el3Decode allocates the telemetry object only")
+    {
+        REQUIRE(steadyAllocations([&] {
+            for (auto &f: frames)
+                delete el3Decode(f.data(), f.size(), FAULT_TOLERANT);
+        }) == frames.size());
+    }
+
+    SECTION("Serialization")
+    {
+        El3Telemetry telemetry(frames[0].data(), frames[0].size(), FAULT_TOLERANT);
+        rapidjson::StringBuffer strbuf;
+        rapidjson::Writer<rapidjson::StringBuffer> writer(strbuf);
+
+        /* a reused writer and buffer, as the batch and streaming modes do */
+        REQUIRE(steadyAllocations([&] {
+            for (auto &f: frames)
+            {
+                El3Telemetry t(f.data(), f.size(), FAULT_TOLERANT);
+
+                strbuf.Clear();
+                writer.Reset(strbuf);
+                el3WriteJson(t.Record(), writer);
+            }
+        }) == 0);
+
+        /* toJson keeps its scratch buffers, only the returned string is allocated */
+        REQUIRE(steadyAllocations([&] { telemetry.toJson(false); }) <= 1);
+        REQUIRE(steadyAllocations([&] { telemetry.toJson(true); }) <= 1);
+
+        REQUIRE(steadyAllocations([&] { telemetry.Timestamp(); }) == 0);
+    }
+
+    SECTION("Track filter on a known track")
+    {
+        El3TrackFilter filter;
+
+        REQUIRE(steadyAllocations([&] {
+            for (auto &f: frames)
+            {
+                El3Telemetry telemetry(f.data(), f.size(), FAULT_TOLERANT);
+                filter.check(telemetry);
+            }
+        }) == 0);
+    }
+
+    SECTION("Reorder buffer in steady state")
+    {
+        El3ReorderBuffer reorder;
+        std::vector<El3TimedRecord> out;
+        uint64_t now = 1663027198000ULL;
+
+        out.reserve(1024);
+
+        REQUIRE(steadyAllocations([&] {
+            out.clear();
+
+            for (auto &f: frames)
+            {
+                El3Telemetry telemetry(f.data(), f.size(), FAULT_TOLERANT);
+
+                reorder.ingest(telemetry.Record(), now, 1, out);
+                now += 100;
+                reorder.poll(now, out);
+            }
+        }) == 0);
+    }
+}
+
+static long residentKb(pid_t pid)
+{
+    std::ifstream status("/proc/" + std::to_string(pid) + "/status");
+    std::string line;
+
+    while (std::getline(status, line))
+        if (line.compare(0, 6, "VmRSS:") == 0)
+            return atol(line.c_str() + 6);
+    return -1;
+}
+
+// A websocket client connection from source address 127.0.0.<host>, -1 unless the upgrade went through
+static int websocketConnect(int port, int host)
+{
+    struct sockaddr_in addr = {};
+    int fd = socket(AF_INET, SOCK_STREAM, 0), one = 1;
+
+    /* each source address has its own ephemeral ports, one address has too few */
+    setsockopt(fd, IPPROTO_IP, IP_BIND_ADDRESS_NO_PORT, &one, sizeof(one));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK + host - 1);
+    bind(fd, (struct sockaddr *) &addr, sizeof(addr));
+
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+
+    const std::string upgrade = "GET / HTTP/1.1\r\nHost: localhost\r\nUpgrade: websocket\r\n"
+        "Connection: Upgrade\r\nSec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+        "Sec-WebSocket-Version: 13\r\n\r\n";
+    std::string response;
+
+    if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 ||
+        write(fd, upgrade.data(), upgrade.size()) != (ssize_t) upgrade.size())
+    {
+        close(fd);
+        return -1;
+    }
+
+    while (response.find("\r\n\r\n") == std::string::npos)
+        if (!readExactly(fd, response, 1))
+        {
+            close(fd);
+            return -1;
+        }
+
+    if (response.compare(0, 12, "HTTP/1.1 101") != 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+struct DaemonGuard {
+  pid_t pid;
+  std::string dir;
+
+  ~DaemonGuard()
+  {
+      if (pid > 0)
+      {
+          kill(pid, SIGKILL);
+          waitpid(pid, NULL, 0);
+      }
+      if (!dir.empty())
+      {
+          std::error_code ec;
+          std::filesystem::remove_all(dir, ec);
+      }
+  }
+};
+
+TEST_CASE("el3dec Idle websocket sessions")
+{
+    struct rlimit nofile;
+
+    /* both ends of every connection need a descriptor, in this process and the daemon's */
+    REQUIRE(getrlimit(RLIMIT_NOFILE, &nofile) == 0);
+    nofile.rlim_cur = nofile.rlim_max;
+    REQUIRE(setrlimit(RLIMIT_NOFILE, &nofile) == 0);
+
+    /* a few hundred descriptors are kept for everything else */
+    if (nofile.rlim_cur < 256 + 1000)
+    {
+        WARN("RLIMIT_NOFILE of " << nofile.rlim_cur << " is too low for a meaningful run");
+        return;
+    }
+
+    const size_t connections = std::min<size_t>(50000, nofile.rlim_cur - 256);
+    char dir[] = "/tmp/el3dec-sessions-XXXXXX";
+    int port;
+
+    REQUIRE(mkdtemp(dir) != NULL);
+    close(listenLocal(port));
+
+    DaemonGuard daemon = { fork(), dir };
+    REQUIRE(daemon.pid >= 0);
+
+    if (daemon.pid == 0)
+    {
+        /* the daemon logs to its working directory */
+        std::string portArg = std::to_string(port);
+        int null = open("/dev/null", O_WRONLY);
+
+        dup2(null, STDOUT_FILENO);
+        dup2(null, STDERR_FILENO);
+        if (chdir(dir) == 0)
+            execl(EL3DEC_NETDAEMON, EL3DEC_NETDAEMON, "--address", "127.0.0.1", "--port",
+                portArg.c_str(), "--num-threads", "1", (char *) NULL);
+        _exit(127);
+    }
+
+    int first = -1;
+    for (int tries = 0; first < 0 && tries < 100; tries++)
+        if ((first = websocketConnect(port, 1)) < 0)
+            usleep(50000);
+    REQUIRE(first >= 0);
+
+    long before = residentKb(daemon.pid);
+    std::vector<int> fds;
+
+    fds.reserve(connections);
+    for (size_t i = 0; i < connections; i++)
+    {
+        int fd = websocketConnect(port, 1 + i / 20000);
+
+        REQUIRE(fd >= 0);
+        fds.push_back(fd);
+    }
+
+    long after = residentKb(daemon.pid);
+    double perConnection = (after - before) * 1024.0 / connections;
+
+    WARN(connections << " idle connections, " << perConnection << " bytes each");
+    REQUIRE(perConnection < 6 * 1024);
+
+    /* every one of them still served */
+    fds.push_back(first);
+    for (int fd : fds)
+    {
+        const unsigned char query[] = { 0x81, 0x86, 0, 0, 0, 0, 't', 'r', 'a', 'c', 'k', 's' };
+        std::string header, reply;
+
+        REQUIRE(write(fd, query, sizeof(query)) == sizeof(query));
+        REQUIRE(readExactly(fd, header, 2));
+        REQUIRE((unsigned char) header[0] == 0x81);
+        REQUIRE((unsigned char) header[1] < 126);
+        REQUIRE(readExactly(fd, reply, (unsigned char) header[1]));
+        REQUIRE(reply.compare(0, 10, "{\"tracks\":") == 0);
+    }
+
+    for (int fd : fds)
+        close(fd);
+}